@@ -0,0 +1,228 @@
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cmath>
+
+#include <CorsikaSynthetic.h>
+
+CorsikaSynthetic::CorsikaSynthetic(bool thin, bool markers, int nshow, int nbunch, int run)
+: rng(run)
+, iSub(0)
+, nSubWords(thin ? 312 : 273)
+, nWordsPerParticle(thin ? 8 : 7)
+, kThin(thin)
+, kMarkers(markers)
+, nShowers(nshow)
+, nBunches(nbunch)
+, nSteps(100)
+, runNumber(run)
+, nBytes(0.)
+{
+}
+
+
+
+std::vector<float> CorsikaSynthetic::NewSubBlock(std::string s)
+{
+  std::vector<float> v(this->nSubWords, 0.);
+  std::memcpy(v.data(), s.data(), 4);
+  return v;
+}
+
+
+
+void CorsikaSynthetic::PutSubBlock(const std::vector<float> & v)
+{
+  this->vBlock.insert(this->vBlock.end(), v.begin(), v.end());
+  if (++this->iSub == 21) this->FlushBlock();
+}
+
+
+
+void CorsikaSynthetic::FlushBlock()
+{
+  if (this->iSub == 0) return;
+
+  // Pad the last block with empty sub-blocks
+  this->vBlock.resize(21*this->nSubWords, 0.);
+
+  int nBlockBytes = this->vBlock.size()*4;
+
+  if (this->kMarkers) this->stream.write((char*)&nBlockBytes, 4);
+  this->stream.write((char*)this->vBlock.data(), nBlockBytes);
+  if (this->kMarkers) this->stream.write((char*)&nBlockBytes, 4);
+
+  this->nBytes += nBlockBytes + 8*int(this->kMarkers);
+
+  this->vBlock.clear();
+  this->iSub = 0;
+}
+
+
+
+bool CorsikaSynthetic::Write(std::string sDir)
+{
+  if (!sDir.empty() && sDir[sDir.size()-1] != '/') sDir += "/";
+
+  std::string sRunNumber = std::to_string(this->runNumber);
+  while (sRunNumber.size() < 6) sRunNumber = "0" + sRunNumber;
+
+  this->stream.open(sDir + "CER" + sRunNumber, std::ios::out | std::ios::binary);
+  if (!this->stream.is_open())
+  {
+    std::cerr << "CorsikaSynthetic::Write(): could not open " << sDir << "CER" << sRunNumber << "." << std::endl;
+    return false;
+  }
+
+  this->nBytes = 0.;
+
+  std::uniform_real_distribution<float> uniform(0.,1.);
+  std::exponential_distribution<float> radial(1./8000.);
+
+  //
+  // Run header, with the US standard atmosphere (Linsley)
+  //
+  auto vRunh = this->NewSubBlock("RUNH");
+  const float h[5] = {0., 4.e5, 1.e6, 4.e6, 1.e7};
+  const float a[5] = {-186.555305, -94.919, 0.61289, 0., 0.01128292};
+  const float b[5] = {1222.6562, 1144.9069, 1305.5948, 540.1778, 1.};
+  const float c[5] = {994186.38, 878153.55, 636143.04, 772170.16, 1.e9};
+  vRunh[1] = this->runNumber;
+  vRunh[2] = 210101;
+  vRunh[3] = 7.63;
+  vRunh[92] = this->nShowers;
+  for (int i = 0; i < 5; i++)
+  {
+    vRunh[249+i] = h[i];
+    vRunh[254+i] = a[i];
+    vRunh[259+i] = b[i];
+    vRunh[264+i] = c[i];
+  }
+  this->PutSubBlock(vRunh);
+
+  //
+  // Showers
+  //
+  std::vector<float> vPart(this->nSubWords, 0.);
+
+  for (int ishow = 1; ishow <= this->nShowers; ishow++)
+  {
+    auto vEvth = this->NewSubBlock("EVTH");
+    vEvth[1] = ishow;
+    vEvth[2] = 14;
+    vEvth[3] = 1.e5;
+    vEvth[6] = 2.5e6;
+    vEvth[10] = 0.7*uniform(this->rng);
+    vEvth[11] = 2.*std::acos(-1.)*(uniform(this->rng) - 0.5);
+    vEvth[47] = 1.4e5;
+    vEvth[74] = 2;
+    vEvth[75] = 3;
+    this->PutSubBlock(vEvth);
+
+    int iPart = 0;
+    for (int ibunch = 0; ibunch < this->nBunches; ibunch++)
+    {
+      float r = radial(this->rng);
+      float az = 2.*std::acos(-1.)*uniform(this->rng);
+      float * p = vPart.data() + iPart*this->nWordsPerParticle;
+
+      p[0] = 1. + 4.*uniform(this->rng);
+      p[1] = r*std::cos(az);
+      p[2] = r*std::sin(az);
+      p[3] = 0.4*(uniform(this->rng) - 0.5);
+      p[4] = 0.4*(uniform(this->rng) - 0.5);
+      p[5] = 50.*uniform(this->rng);
+      p[6] = 2.e5 + 1.8e6*uniform(this->rng);
+      if (this->kThin) p[7] = 1.;
+
+      if (++iPart == 39)
+      {
+        this->PutSubBlock(vPart);
+        std::fill(vPart.begin(), vPart.end(), 0.);
+        iPart = 0;
+      }
+    }
+    if (iPart > 0)
+    {
+      this->PutSubBlock(vPart);
+      std::fill(vPart.begin(), vPart.end(), 0.);
+    }
+
+    auto vEvte = this->NewSubBlock("EVTE");
+    vEvte[1] = ishow;
+    this->PutSubBlock(vEvte);
+  }
+
+  //
+  // Run end
+  //
+  auto vRune = this->NewSubBlock("RUNE");
+  vRune[1] = this->runNumber;
+  vRune[2] = this->nShowers;
+  this->PutSubBlock(vRune);
+  this->FlushBlock();
+
+  this->stream.close();
+
+  return this->WriteLong(sDir + "DAT" + sRunNumber + ".long");
+}
+
+
+
+//
+// The longitudinal file, in the text format parsed by CorsikaLong
+//
+bool CorsikaSynthetic::WriteLong(std::string s)
+{
+  std::ofstream out(s);
+  if (!out.is_open())
+  {
+    std::cerr << "CorsikaSynthetic::WriteLong(): could not open " << s << "." << std::endl;
+    return false;
+  }
+
+  const double fPart[9] = {5., 1., 1.2, 0.01, 0.01, 0.001, 2.2, 0., 3.e3};
+  const double fDep[9] = {1., 2., 3., 0.1, 0.1, 0.1, 0.1, 0.01, 6.4};
+
+  out << std::scientific << std::setprecision(5);
+
+  for (int ishow = 1; ishow <= this->nShowers; ishow++)
+  {
+    double nmax = 2.e5;
+    double xmax = 650. + 20.*(ishow%10);
+    double lambda = 70.;
+
+    auto gh = [&](double x){return x <= 0. ? 0. : nmax*std::pow(x/xmax,xmax/lambda)*std::exp((xmax-x)/lambda);};
+
+    for (int itype = 0; itype < 2; itype++)
+    {
+      if (itype == 0)
+      {
+        out << " LONGITUDINAL DISTRIBUTION IN " << std::setw(5) << this->nSteps << " SLANT  STEPS OF   10. G/CM**2 FOR SHOWER " << std::setw(6) << ishow << std::endl;
+        out << " DEPTH     GAMMAS   POSITRONS   ELECTRONS         MU+         MU-     HADRONS     CHARGED      NUCLEI   CHERENKOV" << std::endl;
+      }
+      else
+      {
+        out << " LONGITUDINAL ENERGY DEPOSIT IN " << std::setw(5) << this->nSteps << " SLANT  STEPS OF   10. G/CM**2 FOR SHOWER " << std::setw(6) << ishow << std::endl;
+        out << " DEPTH       GAMMA    EM IONIZ     EM CUT    MU IONIZ      MU CUT  HADR IONIZ    HADR CUT   NEUTRINO    SUM" << std::endl;
+      }
+
+      for (int istep = 0; istep < this->nSteps; istep++)
+      {
+        double x = 5. + 10.*istep;
+        out << std::fixed << std::setprecision(1) << std::setw(7) << x << std::scientific << std::setprecision(5);
+        for (int ipart = 0; ipart < 9; ipart++) out << std::setw(12) << gh(x)*(itype == 0 ? fPart[ipart] : fDep[ipart]);
+        out << std::endl;
+      }
+    }
+
+    out << " FIT OF THE HILLAS CURVE   N(T) = P1*((T-P2)/(P3-P2))**((P3-P2)/(P4+P5*T+P6*T**2)) * EXP((P3-T)/(P4+P5*T+P6*T**2))" << std::endl;
+    out << " TO LONGITUDINAL DISTRIBUTION OF ALL CHARGED PARTICLES" << std::endl;
+    out << " PARAMETERS         = " << std::setw(12) << nmax*2.2 << std::setw(12) << 0. << std::setw(12) << xmax << std::setw(12) << lambda << std::setw(12) << 0. << std::setw(12) << 0. << std::endl;
+    out << " CHI**2/DOF         = " << std::setw(12) << 1. << std::endl;
+    out << " AV. DEVIATION IN % = " << std::setw(12) << 1. << std::endl;
+    out << std::endl;
+  }
+
+  return out.good();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#ifndef __CLASS__CorsikaSynthetic__
+#define __CLASS__CorsikaSynthetic__ 1
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+
+//
+// Writer of synthetic CORSIKA outputs: a CER file with the requested block
+// layout and the matching DATnnnnnn.long file
+//
+class CorsikaSynthetic
+{
+private:
+
+  std::ofstream stream;
+  std::mt19937 rng;
+
+  std::vector<float> vBlock;
+
+  int iSub;
+  int nSubWords;
+  int nWordsPerParticle;
+
+  bool kThin;
+  bool kMarkers;
+
+  int nShowers;
+  int nBunches;
+  int nSteps;
+  int runNumber;
+
+  double nBytes;
+
+  void PutSubBlock(const std::vector<float> &);
+  void FlushBlock();
+
+  std::vector<float> NewSubBlock(std::string);
+
+  bool WriteLong(std::string);
+
+public:
+
+  CorsikaSynthetic(bool thin, bool markers, int nShowers, int nBunches, int runNumber = 1);
+
+  void SetSteps(int n){this->nSteps = n;}
+
+  // Write CERnnnnnn and DATnnnnnn.long into the given directory
+  bool Write(std::string);
+
+  double NBytes(){return this->nBytes;}
+  double NBunches(){return double(this->nShowers)*this->nBunches;}
+
+};
+
+#endif
@@ -0,0 +1,207 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <sys/stat.h>
+
+#include <CorsikaFile.h>
+#include <CorsikaShower.h>
+#include <CorsikaLong.h>
+#include <CorsikaAtmosphere.h>
+#include <CorsikaBunches.h>
+#include <CorsikaOptions.h>
+#include <CorsikaSynthetic.h>
+
+//
+// Benchmarks of the readers. Each result is printed as one JSON object per
+// line, with the best time over the repetitions and the rate of its items
+// (bunches, showers or evaluations, as given by the unit). A benchmark with
+// a failed repetition is reported with "ok": false and no time.
+//
+class CorsikaBench
+{
+private:
+
+  std::string sDir;
+  int nRepeat;
+
+  static double Now(){return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();}
+
+public:
+
+  CorsikaBench(std::string s, int n) : sDir(s), nRepeat(n) {}
+
+  std::string File(std::string sType, int run)
+  {
+    std::string sRun = std::to_string(run);
+    while (sRun.size() < 6) sRun = "0" + sRun;
+    return this->sDir + sType + sRun + (sType == "DAT" ? ".long" : "");
+  }
+
+  static void Report(std::string sName, std::string sLayout, std::string sUnit, double nItems, double nBytes, double t)
+  {
+    const bool ok = t >= 0.;
+    std::cout << "{\"benchmark\": \"" << sName << "\"";
+    std::cout << ", \"layout\": \"" << sLayout << "\"";
+    std::cout << ", \"unit\": \"" << sUnit << "\"";
+    std::cout << std::setprecision(10);
+    std::cout << ", \"items\": " << nItems;
+    std::cout << ", \"bytes\": " << nBytes;
+    std::cout << ", \"ok\": " << (ok ? "true" : "false");
+    if (ok)
+    {
+      std::cout << ", \"seconds\": " << t;
+      std::cout << ", \"items_per_s\": " << (t > 0. ? nItems/t : 0.);
+      std::cout << ", \"bytes_per_s\": " << (t > 0. ? nBytes/t : 0.);
+    }
+    else std::cout << ", \"seconds\": null, \"items_per_s\": null, \"bytes_per_s\": null";
+    std::cout << "}" << std::endl;
+  }
+
+  // Read every sub-block of the file
+  double SubBlocks(std::string s)
+  {
+    CorsikaFile cfile(s);
+    double t0 = Now();
+    while (!cfile.NextSubBlock().empty());
+    return Now() - t0;
+  }
+
+  // Loop over every particle of every shower, one particle at a time
+  double Particles(std::string s, double & sum)
+  {
+    CorsikaFile cfile(s);
+    double t0 = Now();
+    while (!cfile.Done())
+    {
+      auto shower = cfile.NextShower();
+      if (!shower.Good()) continue;
+      while (!shower.Done()) sum += shower.NextParticle()[0];
+    }
+    return Now() - t0;
+  }
+
+  // Loop over every particle of every shower, one sub-block at a time
+  double Batches(std::string s, double & sum)
+  {
+    CorsikaFile cfile(s);
+    CorsikaBunches b(39);
+    double t0 = Now();
+    while (!cfile.Done())
+    {
+      auto shower = cfile.NextShower();
+      if (!shower.Good()) continue;
+      while (!shower.Done())
+      {
+        int n = shower.NextBunches(b);
+        for (int i = 0; i < n; i++) sum += b.bunch[i];
+      }
+    }
+    return Now() - t0;
+  }
+
+  // Best time of the repetitions, or -1 if any of them failed (negative time)
+  double Best(std::function<double()> f)
+  {
+    double best = -1.;
+    for (int i = 0; i < this->nRepeat; i++)
+    {
+      double t = f();
+      if (t < 0.) return -1.;
+      if (best < 0. || t < best) best = t;
+    }
+    return best;
+  }
+
+  void Run(int nShowers, int nBunches, std::string sReadCorsika)
+  {
+    const std::string sLayout[4] = {"nothin","nothin-markers","thin","thin-markers"};
+    double sum = 0.;
+
+    for (int ilayout = 0; ilayout < 4; ilayout++)
+    {
+      int run = ilayout + 1;
+      CorsikaSynthetic synth(ilayout >= 2, ilayout%2 == 1, nShowers, nBunches, run);
+      if (!synth.Write(this->sDir)) return;
+
+      std::string sCer = this->File("CER", run);
+
+      Report("NextSubBlock", sLayout[ilayout], "bunches", synth.NBunches(), synth.NBytes(), this->Best([&](){return this->SubBlocks(sCer);}));
+      Report("NextParticle", sLayout[ilayout], "bunches", synth.NBunches(), synth.NBytes(), this->Best([&](){return this->Particles(sCer,sum);}));
+      Report("NextBunches", sLayout[ilayout], "bunches", synth.NBunches(), synth.NBytes(), this->Best([&](){return this->Batches(sCer,sum);}));
+
+      if (ilayout != 0) continue;
+
+      // Longitudinal file parse
+      struct stat st;
+      double nLongBytes = stat(this->File("DAT",run).c_str(), &st) == 0 ? st.st_size : 0.;
+      Report("CorsikaLong", "text", "showers", nShowers, nLongBytes, this->Best([&](){
+        double t0 = Now();
+        CorsikaLong clong(this->File("DAT",run));
+        return Now() - t0;
+      }));
+
+      // Atmosphere
+      CorsikaFile cfile(sCer);
+      CorsikaAtmosphere catm(cfile);
+      const int nEval = 10000000;
+      Report("AtmosphereDepth", "", "evaluations", nEval, 0., this->Best([&](){
+        double t0 = Now();
+        for (int i = 0; i < nEval; i++) sum += catm.Depth(1.e2*(i%1000000));
+        return Now() - t0;
+      }));
+      Report("AtmosphereHeight", "", "evaluations", nEval, 0., this->Best([&](){
+        double t0 = Now();
+        for (int i = 0; i < nEval; i++) sum += catm.Height(1.e-4*(i%10000000) + 1.);
+        return Now() - t0;
+      }));
+
+      // The full shower loop of readCorsika
+      if (!sReadCorsika.empty())
+      {
+        std::string sCmd = sReadCorsika + " " + this->sDir + " " + this->sDir + " " + std::to_string(run) + " > /dev/null";
+        Report("readCorsika", sLayout[ilayout], "bunches", synth.NBunches(), synth.NBytes(), this->Best([&](){
+          double t0 = Now();
+          if (std::system(sCmd.c_str()) != 0) return -1.;
+          return Now() - t0;
+        }));
+      }
+    }
+
+    // Keep the loops from being optimized away
+    if (sum == 0.123456789) std::cerr << sum << std::endl;
+  }
+
+};
+
+
+
+int main(int argc, char ** argv)
+{
+  CorsikaOptions opts(argc, argv, {
+    {"showers",1},
+    {"bunches",1},
+    {"repeat",1},
+    {"readCorsika",1}
+  });
+
+  for (auto s : {"showers","bunches","repeat"}) opts.CheckNumbers(s, true);
+
+  if (!opts.Good() || opts.NArgs() > 1)
+  {
+    std::cerr << "Syntax error! Usage: ./benchCorsika [workDir/] [--showers n] [--bunches n] [--repeat n] [--readCorsika path]" << std::endl;
+    return 1;
+  }
+
+  std::string sDir = opts.NArgs() == 1 ? opts.GetArg(0) : "bench_data";
+  if (sDir[sDir.size()-1] != '/') sDir += "/";
+  mkdir(sDir.c_str(), 0755);
+
+  CorsikaBench bench(sDir, opts.GetInt("repeat",3));
+  bench.Run(opts.GetInt("showers",10), opts.GetInt("bunches",100000), opts.GetString("readCorsika","./readCorsika"));
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <string>
+
+#include <CorsikaOptions.h>
+#include <CorsikaSynthetic.h>
+
+int main(int argc, char ** argv)
+{
+  CorsikaOptions opts(argc, argv, {
+    {"thin",0},
+    {"markers",0},
+    {"steps",1}
+  });
+
+  opts.CheckNumbers("steps", true);
+  for (int i = 1; i < 4 && opts.NArgs() == 4; i++) opts.GetArgInt(i);
+
+  if (!opts.Good() || opts.NArgs() != 4)
+  {
+    std::cerr << "Syntax error! Usage: ./makeSynthetic outputDir/ runNumber nShowers nBunchesPerShower [--thin] [--markers] [--steps n]" << std::endl;
+    return 1;
+  }
+
+  CorsikaSynthetic synth(opts.Has("thin"), opts.Has("markers"), opts.GetArgInt(2), opts.GetArgInt(3), opts.GetArgInt(1));
+  synth.SetSteps(opts.GetInt("steps",100));
+
+  if (!synth.Write(opts.GetArg(0))) return 1;
+
+  std::cout << "Wrote " << synth.NBunches() << " bunches in " << synth.NBytes() << " bytes." << std::endl;
+
+  return 0;
+}
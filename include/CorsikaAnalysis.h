@@ -0,0 +1,312 @@
+#pragma once
+#ifndef __CLASS__CorsikaAnalysis__
+#define __CLASS__CorsikaAnalysis__ 1
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstdint>
+
+#include <TH1.h>
+#include <TH2.h>
+#include <TGraph.h>
+
+#include <CorsikaClasses.h>
+#include <CorsikaBunches.h>
+#include <CorsikaParticles.h>
+#include <CorsikaFilter.h>
+#include <CorsikaFootprint.h>
+#include <CorsikaGHFit.h>
+#include <CorsikaProfileGrid.h>
+#include <CorsikaResultIndex.h>
+#include <CorsikaResultArena.h>
+#include <CorsikaRows.h>
+#include <CorsikaTileMap.h>
+#include <CorsikaTimeFront.h>
+#include <CorsikaVoxelGrid.h>
+
+class TDirectory;
+class CorsikaCache;
+class CorsikaCheckpoint;
+
+//
+// The cherenkov analysis of readCorsika: per-shower histograms written to
+// the Event_ID directories and the sums over all showers, normalized and
+// written to the Average directory by Write()
+//
+class CorsikaAnalysis
+{
+public:
+
+  // The parts of the analysis filled from the bunches or the particles of a
+  // shower, whose results are kept in the cache
+  enum Part
+  {
+    kPartCherenkov,
+    kPartGroundMap,
+    kPartVoxels,
+    kPartTimeFront,
+    kPartParticles,
+    kPartTelescopes,
+    kNParts
+  };
+
+private:
+
+  double maxRadius;
+
+  CorsikaFilter filter;
+  int iAgeCut;
+
+  // Derived quantities of the selected bunches of a batch
+  std::vector<int> vSel;
+  std::vector<float> vAge, vTheta, vDist, vPosr;
+  std::vector<float> vSlant, vAzim;
+
+  // Sums over showers
+  std::vector<TH1D> hThetaAverage;
+  std::vector<TH1D> hDistAverage;
+  TH2D hGroundAverage;
+  TH1D hDensityAverage;
+  TH1D hDensitySigma;
+
+  // Average profiles on the grid set, or without one, on the depths of the
+  // first shower of each run, by run; Write() merges them in the order of
+  // the runs, so that the grid does not depend on the reader threads
+  bool kGridSet;
+  CorsikaProfileGrid gridPart;
+  CorsikaProfileGrid gridDep;
+  std::map<int,CorsikaProfileGrid> mGridPart;
+  std::map<int,CorsikaProfileGrid> mGridDep;
+
+  // Rows of the Header tuple, and the one of the current shower
+  CorsikaRows headerRows;
+  std::vector<double> vHeader;
+
+  std::unique_ptr<CorsikaTileMapSum> pGroundMapAverage;
+  std::unique_ptr<CorsikaVoxelGrid> pVoxelsAverage;
+  std::unique_ptr<CorsikaTimeFront> pTimeFrontAverage;
+
+  // Profiles to refit, fit by batches of the same depths as they fill, with
+  // the run, ID, type and column of each, and the rows of the GHFit tuple of
+  // those moved out by FitProfiles(); with a memory bound, the profiles are
+  // fit once they hold more than nMaxRefitBytes
+  int nRefitPar;
+  int nRefitThreads;
+  std::unique_ptr<CorsikaGHFit> pRefit;
+  std::vector<double> vRefitLabels;
+  long nMaxRefitBytes;
+  CorsikaRows refitRows;
+
+  // Sub-block sampling: probability, weight of the kept sub-blocks and rows
+  // ID, probability, sub-blocks, kept sub-blocks, photons and their sigma
+  double sampleProb;
+  double sampleWeight;
+  CorsikaRows sampleRows;
+
+  // Ground particles of the DAT files: density per group, and rows ID,
+  // weighted number of particles per group
+  bool kParticles;
+  std::vector<TH1D> hParticleDensityAverage;
+  CorsikaRows particleRows;
+
+  // Photons on the mirrors of the telescopes of a layout: the photons per
+  // telescope summed over showers, and rows ID, telescope, photons, bunches,
+  // mean, standard deviation, first and last arrival time
+  std::unique_ptr<CorsikaFootprint> pFootprint;
+  TH1D hTelescopeAverage;
+  CorsikaRows telescopeRows;
+
+  int nShowers;
+
+  // Output queue: objects of the showers held in memory by the output file,
+  // unless their directories are dropped once written
+  bool kRelease;
+  long nHeldObjects;
+
+  // Bound of the stores that grow with the showers, 0 if none
+  long nMaxBytes;
+
+  // The current shower: the histograms are in the arena, by handle (the
+  // first of 20 for the age bins, of 4 for the particle groups), and the
+  // graph that writes the profiles is reused
+  CorsikaResultArena arena;
+  int hThetaShower;
+  int hDistShower;
+  int hPhotonsAtGround;
+  int hPhotonDensity;
+  int hParticleDensityShower;
+  TGraph gProfile;
+  std::unique_ptr<CorsikaTileMap> pGroundMap;
+  std::unique_ptr<CorsikaVoxelGrid> pVoxels;
+  std::unique_ptr<CorsikaTimeFront> pTimeFront;
+  std::vector<double> vParticleCount;
+
+  // Cache of the results of each shower: definition of each enabled part,
+  // options of the reader the bunches depend on, and for the current shower
+  // the key of each part and whether it is filled or was found in the
+  // cache. With a cache, the averages of the emission angle and of the
+  // photons at ground are summed per shower at their binning, in an arena
+  // reset only for the showers filled.
+  CorsikaCache * pCache;
+  std::string sCacheContext;
+  std::vector<std::string> vPartDefinition;
+  std::vector<uint64_t> vPartKey;
+  std::vector<bool> vCompute;
+  std::vector<double> vCountersBegin;
+  std::vector<double> vCountersCached;
+  CorsikaResultArena arenaFine;
+  int hThetaFine;
+  int hGroundFine;
+
+  // With a cache, the run, header row and keys of the parts of each shower,
+  // and the run of the file being read
+  CorsikaResultIndex results;
+  int iRun;
+
+  void SavePart(int, std::vector<char> &);
+  bool LoadPart(int, const std::vector<char> &);
+
+  void Normalize(int);
+  void FitProfiles();
+  void Bound();
+  void WriteGraph(const std::vector<double> &, const std::vector<double> &, const char *);
+
+  std::vector<std::vector<double>> vProfPart;
+  std::vector<std::vector<double>> vProfDep;
+
+  long nSubKept, nSubSkipped;
+  double samplePhotons, sampleVar;
+
+  int iID;
+  float xmax;
+  double sinTheta, cosTheta, tanTheta, sinPhi, cosPhi;
+  double tCore;
+
+public:
+
+  // Maximum radius at ground, in m
+  CorsikaAnalysis(double);
+
+  CorsikaFilter & Filter(){return this->filter;}
+
+  // Also fill a high resolution map of the photons at ground, with the given
+  // bin size and half size in m. Only the weight and time cuts apply to it.
+  void EnableGroundMap(double, double);
+
+  // Also fill the 3D density of emission points around the shower axis
+  void EnableVoxels();
+
+  // Also fill the arrival time of the photons relative to the plane front
+  // through the core, vs. distance to the axis and emission age
+  void EnableTimeFront();
+
+  // Average the profiles on a grid of n nodes from min to max, in slant depth
+  // or age (CorsikaProfileGrid::kDepth or kAge), instead of on the depths of
+  // the first shower
+  void SetProfileGrid(int, int, double, double);
+
+  // Also refit all the particle and deposit profiles with Gaisser-Hillas
+  // functions of 4 or 6 parameters, written by Write() to the GHFit tuple
+  void EnableRefit(int, int nThreads = 1);
+
+  // Also fill the density at ground of the particles of the DAT files, per
+  // group (gammas, e+-, mu+-, hadrons), and the GroundParticles tuple
+  void EnableParticles();
+
+  // Also count the photons on the mirrors of the telescopes of a layout, with
+  // their arrival times relative to the core time, written per shower to
+  // the Telescopes tuple. Only the weight and time cuts apply to them.
+  void EnableTelescopes(const CorsikaFootprint &);
+
+  // Only a fraction p of the sub-blocks is filled, with weights scaled by 1/p
+  void SetSampling(double);
+
+  // Keep the results of each shower in a cache, together with a text of the
+  // options of the reader that change the bunches (e.g. the sampling)
+  void SetCache(CorsikaCache *, std::string);
+
+  // Run of the file of the showers that follow, and the showers read with a
+  // cache and the keys of their results, to save as the result index
+  void SetRun(int r){this->iRun = r;}
+  CorsikaResultIndex & Results(){return this->results;}
+
+  // Save the directory of each shower to the file and drop it from memory
+  // once written, so that the output file holds no shower in memory
+  void SetReleaseShowers(bool k){this->kRelease = k;}
+
+  // Bound the stores that grow with the number of showers to about the given
+  // bytes: beyond it the rows of the tuples and of the result index are
+  // spilled to temporary files, and the weight that would need new tiles
+  // of the ground maps or new outer voxels is dropped; the maps of the
+  // current shower get as much again
+  void SetMaxBytes(long);
+
+  // Bytes of the accumulators (sums over showers and the current shower) and
+  // estimated bytes of the output queue. With kFilled, the histograms are
+  // counted with the sums of squared weights they get at the first shower.
+  long Bytes(bool kFilled = false);
+  long OutputBytes();
+
+  // Reduce the accumulators that grow with the number of showers: fit the
+  // profiles waiting for the refit now, keep only the results, and spill
+  // the rows to their temporary files
+  void Compact();
+
+  // Start a shower given its event header and the Gaisser-Hillas fit of the .long file
+  void BeginShower(const std::vector<float> &, const std::vector<double> &);
+
+  // Time at which the plane front crosses the core, in ns. BeginShower()
+  // sets it from the height of the first interaction, the origin of the
+  // times of CER files.
+  void SetCoreTime(double t){this->tCore = t;}
+
+  // Add the longitudinal profiles of the current shower
+  void AddProfiles(CorsikaLong &);
+
+  // Take the parts of the current shower found in the cache, keyed by its
+  // header, Xmax, core time and atmosphere and by the definition of each
+  // part, instead of filling them. Call it after AddProfiles(). Returns
+  // whether some part still needs the bunches.
+  bool UseCache(const std::vector<float> &, CorsikaAtmosphere &);
+  bool NeedsParticles(){return this->vCompute[kPartParticles];}
+
+  // Add a batch of bunches of the current shower, with the slant depth
+  // table of the atmosphere set for it
+  void Fill(CorsikaBunches &, CorsikaAtmosphere &);
+
+  // Add a batch of particles of the current shower, read from its DAT file.
+  // Only the particles of the first observation level are used.
+  void FillParticles(CorsikaParticles &);
+
+  // Count a particle sub-block left out by the sampling
+  void Skip(){if (this->vCompute[kPartCherenkov]) this->nSubSkipped++;}
+
+  // Particle sub-blocks of the current shower, read or found in the cache
+  long NSubBlocks(){return this->nSubKept + this->nSubSkipped;}
+
+  // Write the current shower to its Event_ID directory and add it to the averages
+  void EndShower(TDirectory &);
+
+  // Normalize the averages and write them, together with the Header tuple
+  void Write(TDirectory &);
+
+  // Add the sums of another analysis, e.g. the one of another reader thread
+  void Merge(CorsikaAnalysis &);
+
+  // Export the normalized and smoothed emission angle and distance
+  // distributions per age bin as CorsikaEmissionModel tables
+  bool WriteTables(std::string, int angleRebin = 10, int nSmooth = 2);
+
+  // Save and restore the state accumulated so far
+  void Save(CorsikaCheckpoint &);
+  bool Load(CorsikaCheckpoint &);
+
+  int NShowers(){return this->nShowers;}
+  int ID(){return this->iID;}
+  std::vector<int> ShowerIDs();
+
+};
+
+#endif
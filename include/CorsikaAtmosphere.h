@@ -4,20 +4,40 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 #include <CorsikaClasses.h>
 
+//
+// The atmosphere of a CORSIKA file (5 layers) and, per shower, a table of
+// the slant depth along the shower axis vs. height, built by SetShower() in
+// a flat or curved geometry. Lookups in the table are a linear interpolation
+// between nodes 10 m apart, with no exp per call, and the table is not
+// changed by them, so that it can be read concurrently.
+//
 class CorsikaAtmosphere
 {
+public:
+
+  static constexpr double kEarthRadius = 6371.315e5; // cm, as CORSIKA
+  static constexpr double kTableStep = 1.e3;         // cm
+
 private:
 
   std::vector<double> a, b, c, h, d;
 
-  void Initialize(CorsikaFile &);
+  // Slant depth table of the current shower
+  std::vector<double> vSlant;
+  double slantHmin;
+  double slantInvStep;
+  double cosZenith;
+
+  void Initialize(const std::vector<float> &);
 
 public:
 
   CorsikaAtmosphere(CorsikaFile &);
+  CorsikaAtmosphere(const std::vector<float> &); // the RUNH words, e.g. of an IACT file
   CorsikaAtmosphere(std::string);
 
   void Print();
@@ -27,6 +47,25 @@ public:
   double Density_vs_height(double);
   double Density_vs_depth(double);
 
+  // Build the slant depth table of a shower given its zenith angle, the
+  // height of its core and whether the Earth is curved
+  void SetShower(double, double, bool curved = false);
+
+  // Hash of the layers and of the slant depth table of the current shower,
+  // which identifies the depths given by SlantDepth()
+  uint64_t Hash();
+
+  // Slant depth (g/cm2) along the axis at the given height (cm). Outside
+  // the table, the flat approximation Depth(h)/cos(theta).
+  double SlantDepth(double height)
+  {
+    const double u = (height - this->slantHmin)*this->slantInvStep;
+    const long i = long(u);
+    if (!(u >= 0.) || i+1 >= long(this->vSlant.size())) return this->Depth(height)/this->cosZenith;
+
+    const double f = u - i;
+    return (1. - f)*this->vSlant[i] + f*this->vSlant[i+1];
+  }
 
 };
 
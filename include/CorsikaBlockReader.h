@@ -0,0 +1,207 @@
+#pragma once
+#ifndef __CLASS__CorsikaBlockReader__
+#define __CLASS__CorsikaBlockReader__ 1
+
+#include <fstream>
+#include <vector>
+
+#include <CorsikaBunches.h>
+#include <CorsikaParticles.h>
+#include <CorsikaProfiler.h>
+
+//
+// Access to the sub-blocks of a CORSIKA file by global sub-block index. The
+// concrete readers are specialized at compile time for the block layout
+// (thinning or not, Fortran record markers or not), so that the strides are
+// constants. Use Create() to get the reader of a given layout.
+//
+class CorsikaBlockReader
+{
+public:
+
+  virtual ~CorsikaBlockReader(){}
+
+  // Pointer to the next sub-block, valid until the next call, or 0 on failure
+  virtual const float * Next() = 0;
+
+  // Position at the given sub-block and return the index of the next one
+  virtual void Seek(long) = 0;
+  virtual long Tell() = 0;
+
+  // Number of complete sub-blocks in the file
+  virtual long NSubBlocks() = 0;
+
+  // Byte offset of the given sub-block within the file
+  virtual long Offset(long) = 0;
+
+  // Decode the particles of a sub-block, from the given one on, into a batch
+  virtual int Decode(const float *, int, CorsikaBunches &) = 0;
+
+  // Same for the particles of a DAT file, read in place from the block. The
+  // empty records that fill the last sub-block of a shower are left out.
+  virtual int Decode(const float *, int, CorsikaParticles &) = 0;
+
+  virtual int SubWords() = 0;
+  virtual int WordsPerParticle() = 0;
+  virtual int BlockBytes() = 0;
+
+  static CorsikaBlockReader * Create(std::ifstream &, bool thin, bool markers);
+
+};
+
+
+
+template<bool Thin, bool Markers>
+class CorsikaBlockReaderT : public CorsikaBlockReader
+{
+public:
+
+  static const int kSubBlocks = 21;
+  static const int kParticles = 39;
+  static const int kWordsPerParticle = Thin ? 8 : 7;
+  static const int kSubWords = kParticles*kWordsPerParticle;
+  static const int kMarkerWords = Markers ? 1 : 0;
+  static const int kBlockWords = kSubBlocks*kSubWords + 2*kMarkerWords;
+  static const int kBlockBytes = 4*kBlockWords;
+
+private:
+
+  std::ifstream & stream;
+
+  std::vector<float> vBlock;
+
+  long iSub;
+  long iLoaded;
+  long nSize;
+  int nValid;
+
+  // Read the whole block containing the given sub-block
+  bool Load(long iBlock)
+  {
+    CorsikaTimer timer(CorsikaProfiler::kSubBlockIO);
+
+    this->stream.clear();
+    this->stream.seekg(iBlock*kBlockBytes);
+    this->stream.read((char*)this->vBlock.data(), kBlockBytes);
+
+    long nBytes = this->stream.gcount();
+    this->nValid = nBytes > 4*kMarkerWords ? (nBytes - 4*kMarkerWords)/(4*kSubWords) : 0;
+    if (this->nValid > kSubBlocks) this->nValid = kSubBlocks;
+    this->iLoaded = iBlock;
+
+    CorsikaProfiler::Count(CorsikaProfiler::kBytesRead, nBytes);
+
+    return this->nValid > 0;
+  }
+
+public:
+
+  CorsikaBlockReaderT(std::ifstream & s)
+  : stream(s)
+  , vBlock(kBlockWords)
+  , iSub(0)
+  , iLoaded(-1)
+  , nSize(0)
+  , nValid(0)
+  {
+    this->stream.clear();
+    this->stream.seekg(0, std::ios::end);
+    this->nSize = long(this->stream.tellg());
+    this->stream.seekg(0);
+  }
+
+  const float * Next()
+  {
+    long iBlock = this->iSub/kSubBlocks;
+    int iPos = this->iSub%kSubBlocks;
+
+    if (iBlock != this->iLoaded && !this->Load(iBlock)) return 0;
+    if (iPos >= this->nValid) return 0;
+
+    this->iSub++;
+    CorsikaProfiler::Count(CorsikaProfiler::kSubBlocks);
+
+    return this->vBlock.data() + kMarkerWords + iPos*kSubWords;
+  }
+
+  void Seek(long i){this->iSub = i < 0 ? 0 : i;}
+  long Tell(){return this->iSub;}
+
+  long NSubBlocks()
+  {
+    long nFull = this->nSize/kBlockBytes;
+    long nRest = this->nSize%kBlockBytes - 4*kMarkerWords;
+    return nFull*kSubBlocks + (nRest > 0 ? nRest/(4*kSubWords) : 0);
+  }
+
+  long Offset(long i){return (i/kSubBlocks)*kBlockBytes + 4*(kMarkerWords + (i%kSubBlocks)*kSubWords);}
+
+  int Decode(const float * sub, int first, CorsikaBunches & b)
+  {
+    const int n = kParticles - first;
+    const float * p = sub + first*kWordsPerParticle;
+
+    b.Resize(n);
+
+    float * bunch  = b.bunch.data();
+    float * posx   = b.posx.data();
+    float * posy   = b.posy.data();
+    float * cosu   = b.cosu.data();
+    float * cosv   = b.cosv.data();
+    float * nsec   = b.nsec.data();
+    float * height = b.height.data();
+    float * weight = b.weight.data();
+
+    for (int i = 0; i < n; i++)
+    {
+      const float * q = p + i*kWordsPerParticle;
+      bunch[i]  = q[0];
+      posx[i]   = q[1];
+      posy[i]   = q[2];
+      cosu[i]   = q[3];
+      cosv[i]   = q[4];
+      nsec[i]   = q[5];
+      height[i] = q[6];
+      weight[i] = Thin ? q[kWordsPerParticle-1] : 1.f;
+    }
+
+    return n;
+  }
+
+  int Decode(const float * sub, int first, CorsikaParticles & b)
+  {
+    const float * p = sub + first*kWordsPerParticle;
+
+    b.Resize(kParticles - first);
+
+    int n = 0;
+    for (int i = 0; i < kParticles - first; i++)
+    {
+      const float * q = p + i*kWordsPerParticle;
+      const int desc = int(q[0]);
+      if (desc == 0) continue;
+
+      b.id[n]         = desc/1000;
+      b.generation[n] = desc%1000/10;
+      b.level[n]      = desc%10;
+      b.px[n]         = q[1];
+      b.py[n]         = q[2];
+      b.pz[n]         = q[3];
+      b.x[n]          = q[4];
+      b.y[n]          = q[5];
+      b.t[n]          = q[6];
+      b.weight[n]     = Thin ? q[kWordsPerParticle-1] : 1.f;
+      n++;
+    }
+
+    b.n = n;
+    return n;
+  }
+
+  int SubWords(){return kSubWords;}
+  int WordsPerParticle(){return kWordsPerParticle;}
+  int BlockBytes(){return kBlockBytes;}
+
+};
+
+#endif
@@ -0,0 +1,88 @@
+#pragma once
+#ifndef __CLASS__CorsikaBunchIndex__
+#define __CLASS__CorsikaBunchIndex__ 1
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <CorsikaBunches.h>
+
+//
+// Per-shower uniform grid over the ground positions (posx, posy) of the
+// bunches. Each cell lists the sub-blocks holding at least one bunch in it,
+// so that region queries only read those sub-blocks, with
+// CorsikaFile::ReadBunches(). Bunches outside the grid go to one overflow
+// cell, which is part of any query reaching beyond the grid. The index is
+// built during a pass over the file and saved next to it, as CERnnnnnn.idx.
+// All lengths are in cm.
+//
+class CorsikaBunchIndex
+{
+private:
+
+  struct Shower
+  {
+    int id;
+    long first;
+    long nsub;
+    std::vector<unsigned int> vCellStart;
+    std::vector<unsigned int> vSubs;
+  };
+
+  double cellSize;
+  int nCells;
+  double halfSize;
+
+  long nFileSubBlocks;
+
+  std::vector<Shower> vShowers;
+  std::map<int,int> mShowers;
+
+  // The shower being built: sub-blocks per cell, relative to the first one
+  std::vector<std::vector<unsigned int>> vBuild;
+  int iBuildID;
+  long iBuildFirst;
+
+  int Cell(float, float);
+  std::vector<long> Collect(int, const std::vector<int> &);
+
+public:
+
+  // Cell size and number of cells per side; the grid is centered at the core
+  CorsikaBunchIndex(double cell = 1.e4, int n = 40);
+
+  // Number of sub-blocks of the indexed file, to detect a stale index
+  void SetFileSubBlocks(long n){this->nFileSubBlocks = n;}
+  long NFileSubBlocks(){return this->nFileSubBlocks;}
+
+  // Building: the first particle sub-block of the shower, then the decoded
+  // batch of each sub-block and the index of the sub-block after the shower
+  void BeginShower(int, long);
+  void Add(long, const CorsikaBunches &);
+  void EndShower(long);
+
+  bool Write(std::string);
+  bool Read(std::string);
+
+  int NShowers(){return this->vShowers.size();}
+  bool Has(int id){return this->mShowers.count(id) > 0;}
+
+  // Sub-block of the header of each shower by ID, the one before its first
+  std::map<int,long> Headers();
+
+  // Sub-block after the particle data of a shower, where its LONG sub-blocks
+  // are if CORSIKA wrote them to the file, or -1 if it is not indexed
+  long End(int);
+
+  // Sorted sub-blocks of a shower with bunches possibly inside a rectangle
+  // [x0,x1]x[y0,y1], or inside an annulus rMin <= r < rMax around (x,y)
+  std::vector<long> Box(int, double, double, double, double);
+  std::vector<long> Annulus(int, double, double, double, double);
+  std::vector<long> Circle(int id, double x, double y, double r){return this->Annulus(id,x,y,0.,r);}
+
+  static std::string FileName(std::string sCerFile){return sCerFile + ".idx";}
+
+};
+
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+#ifndef __CLASS__CorsikaBunches__
+#define __CLASS__CorsikaBunches__ 1
+
+#include <vector>
+
+//
+// A batch of cherenkov bunches stored as structure of arrays, plus the
+// selection mask set by CorsikaFilter
+//
+class CorsikaBunches
+{
+public:
+
+  int n;
+
+  std::vector<float> bunch;
+  std::vector<float> posx;
+  std::vector<float> posy;
+  std::vector<float> cosu;
+  std::vector<float> cosv;
+  std::vector<float> nsec;
+  std::vector<float> height;
+  std::vector<float> weight;
+
+  std::vector<unsigned char> mask;
+
+  CorsikaBunches(int capacity = 0) : n(0) {this->Resize(capacity);}
+
+  void Resize(int m)
+  {
+    if (m > int(this->bunch.size()))
+    {
+      this->bunch.resize(m);
+      this->posx.resize(m);
+      this->posy.resize(m);
+      this->cosu.resize(m);
+      this->cosv.resize(m);
+      this->nsec.resize(m);
+      this->height.resize(m);
+      this->weight.resize(m);
+      this->mask.resize(m);
+    }
+    this->n = m;
+  }
+
+  int Size(){return this->n;}
+  long Bytes(){return this->bunch.capacity()*(8*sizeof(float) + sizeof(unsigned char));}
+
+};
+
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef __CLASS__CorsikaCache__
+#define __CLASS__CorsikaCache__ 1
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+//
+// Content-addressed store of the results of a shower, one file per key in a
+// directory. The key is a hash of everything the result depends on (the
+// shower, the atmosphere and the definition of the analysis), so a changed
+// input or analysis gives a new key and old entries are simply not found.
+// Entries are written to a temporary file and renamed, so that readers never
+// see a partial one, and several threads or jobs can share the directory.
+//
+class CorsikaCache
+{
+private:
+
+  std::string sDir;
+  bool kGood;
+
+  std::atomic<long> nHits;
+  std::atomic<long> nMisses;
+  std::atomic<long> nStored;
+
+  std::string FileName(uint64_t);
+
+public:
+
+  CorsikaCache(std::string);
+
+  bool Good(){return this->kGood;}
+  std::string Dir(){return this->sDir;}
+
+  // Bytes stored under a key, false if there are none
+  bool Get(uint64_t, std::vector<char> &);
+  bool Put(uint64_t, const std::vector<char> &);
+
+  // Map the bytes stored under a key in memory, read only, without copying
+  // them: n bytes from p, until Unmap(p, n). False if there are none.
+  bool Map(uint64_t, const char * &, long &);
+  static void Unmap(const char *, long);
+
+  long NHits(){return this->nHits;}
+  long NMisses(){return this->nMisses;}
+
+  void Print();
+
+};
+
+#endif
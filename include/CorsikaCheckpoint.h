@@ -0,0 +1,46 @@
+#pragma once
+#ifndef __CLASS__CorsikaCheckpoint__
+#define __CLASS__CorsikaCheckpoint__ 1
+
+#include <string>
+#include <vector>
+#include <map>
+
+class TH1;
+
+//
+// A set of named arrays of numbers saved to and restored from a binary file.
+// Write() replaces the file atomically, so that a job killed while writing
+// leaves the previous checkpoint intact.
+//
+class CorsikaCheckpoint
+{
+private:
+
+  std::map<std::string,std::vector<double>> mData;
+
+public:
+
+  CorsikaCheckpoint(){}
+
+  void Clear(){this->mData.clear();}
+
+  bool Has(std::string s){return this->mData.count(s) > 0;}
+
+  void Set(std::string s, const std::vector<double> & v){this->mData[s] = v;}
+  std::vector<double> Get(std::string);
+
+  // Histogram contents, errors, statistics and number of entries
+  void SetHist(std::string, const TH1 &);
+  bool GetHist(std::string, TH1 &);
+
+  // Raw bytes, packed into the numbers of an entry
+  void SetBytes(std::string, const std::vector<char> &);
+  bool GetBytes(std::string, std::vector<char> &);
+
+  bool Write(std::string);
+  bool Read(std::string);
+
+};
+
+#endif
@@ -0,0 +1,260 @@
+#pragma once
+#ifndef __CLASS__CorsikaEmissionModel__
+#define __CLASS__CorsikaEmissionModel__ 1
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+//
+// Tables of the cherenkov emission model (e.g. the normalized distribution
+// of emission angles per shower age) and their evaluation. Each table holds
+// values at the nodes of a regular grid of up to kMaxDims axes, the last one
+// being the variable of the distribution and the others the parameters
+// (age, and possibly energy or height). Evaluation is multilinear
+// interpolation between the 2^d surrounding nodes, in constant time and
+// without allocation, and values outside the grid are clamped to its edges.
+//
+// This header has no dependency besides the standard library, so that it
+// can be copied into reconstruction code.
+//
+class CorsikaEmissionModel
+{
+public:
+
+  static const int kMaxDims = 4;
+
+  struct Axis
+  {
+    char name[16];
+    int n;
+    double min;
+    double max;
+  };
+
+  static Axis MakeAxis(std::string s, int n, double min, double max)
+  {
+    Axis a;
+    std::memset(a.name, 0, sizeof(a.name));
+    std::strncpy(a.name, s.c_str(), sizeof(a.name)-1);
+    a.n = n;
+    a.min = min;
+    a.max = max;
+    return a;
+  }
+
+  class Table
+  {
+    friend class CorsikaEmissionModel;
+
+  private:
+
+    char name[16];
+    int nDims;
+    Axis axes[kMaxDims];
+    long stride[kMaxDims];
+    double scale[kMaxDims];
+    std::vector<float> vData;
+
+  public:
+
+    Table() : nDims(0) {std::memset(this->name, 0, sizeof(this->name));}
+
+    // Table with the given axes, whose nodes go from min to max included
+    Table(std::string s, const std::vector<Axis> & vAxes) : nDims(vAxes.size() < kMaxDims ? vAxes.size() : kMaxDims)
+    {
+      std::memset(this->name, 0, sizeof(this->name));
+      std::strncpy(this->name, s.c_str(), sizeof(this->name)-1);
+      for (int i = 0; i < this->nDims; i++) this->axes[i] = vAxes[i];
+      this->Init();
+    }
+
+    void Init()
+    {
+      long n = 1;
+      for (int i = this->nDims-1; i >= 0; i--)
+      {
+        this->stride[i] = n;
+        n *= this->axes[i].n;
+        this->scale[i] = this->axes[i].n > 1 ? (this->axes[i].n - 1)/(this->axes[i].max - this->axes[i].min) : 0.;
+      }
+      this->vData.assign(n, 0.f);
+    }
+
+    std::string Name() const {return this->name;}
+    int NDims() const {return this->nDims;}
+    const Axis & GetAxis(int i) const {return this->axes[i];}
+    long Size() const {return this->vData.size();}
+
+    // Node values, with the last axis running fastest
+    float * Data(){return this->vData.data();}
+    const float * Data() const {return this->vData.data();}
+
+    double Node(int i, int k) const {return this->axes[i].n > 1 ? this->axes[i].min + k/this->scale[i] : this->axes[i].min;}
+
+    double Eval(const double * x) const
+    {
+      long i0 = 0;
+      long di[kMaxDims];
+      double f[kMaxDims];
+
+      for (int i = 0; i < this->nDims; i++)
+      {
+        double u = (x[i] - this->axes[i].min)*this->scale[i];
+        const int nMax = this->axes[i].n - 1;
+
+        // Clamp, also sending NaN to the first node
+        if (!(u > 0.)) u = 0.;
+        if (u > nMax) u = nMax;
+
+        int k = int(u);
+        if (k >= nMax) k = nMax > 0 ? nMax - 1 : 0;
+
+        f[i] = nMax > 0 ? u - k : 0.;
+        di[i] = nMax > 0 ? this->stride[i] : 0;
+        i0 += k*this->stride[i];
+      }
+
+      // Sum over the corners of the cell
+      const float * p = this->vData.data() + i0;
+      double sum = 0.;
+      for (int c = 0; c < (1 << this->nDims); c++)
+      {
+        double w = 1.;
+        long off = 0;
+        for (int i = 0; i < this->nDims; i++)
+        {
+          if (c & (1 << i))
+          {
+            w *= f[i];
+            off += di[i];
+          }
+          else w *= 1. - f[i];
+        }
+        if (w != 0.) sum += w*p[off];
+      }
+
+      return sum;
+    }
+
+    // Two dimensional tables, e.g. (age, angle)
+    double Eval(double a, double b) const
+    {
+      const double x[2] = {a, b};
+      return this->Eval(x);
+    }
+
+    // Evaluate n points given as n consecutive coordinate sets
+    void Eval(long n, const double * x, double * out) const
+    {
+      for (long k = 0; k < n; k++) out[k] = this->Eval(x + k*this->nDims);
+    }
+
+    // Evaluate n points of a two dimensional table given as separate arrays
+    void Eval(long n, const double * a, const double * b, double * out) const
+    {
+      for (long k = 0; k < n; k++) out[k] = this->Eval(a[k], b[k]);
+    }
+
+  };
+
+private:
+
+  std::vector<Table> vTables;
+
+public:
+
+  CorsikaEmissionModel(){}
+  CorsikaEmissionModel(std::string s){this->Read(s);}
+
+  void Add(const Table & t){this->vTables.push_back(t);}
+
+  int NTables() const {return this->vTables.size();}
+  const Table & GetTable(int i) const {return this->vTables[i];}
+
+  // Table by name, 0 if there is none
+  const Table * Find(std::string s) const
+  {
+    for (auto & t : this->vTables) if (s == t.name) return &t;
+    return 0;
+  }
+
+  //
+  // Binary format: "CEMT", version, number of tables, then for each table its
+  // name, number of axes, the axes and the node values as floats
+  //
+  bool Write(std::string s) const
+  {
+    FILE * f = std::fopen(s.c_str(), "wb");
+    if (!f) return false;
+
+    const int version = 1;
+    const int n = this->vTables.size();
+    bool ok = std::fwrite("CEMT", 1, 4, f) == 4;
+    ok = ok && std::fwrite(&version, sizeof(int), 1, f) == 1;
+    ok = ok && std::fwrite(&n, sizeof(int), 1, f) == 1;
+
+    for (auto & t : this->vTables)
+    {
+      ok = ok && std::fwrite(t.name, 1, sizeof(t.name), f) == sizeof(t.name);
+      ok = ok && std::fwrite(&t.nDims, sizeof(int), 1, f) == 1;
+      for (int i = 0; ok && i < t.nDims; i++)
+      {
+        ok = ok && std::fwrite(t.axes[i].name, 1, sizeof(t.axes[i].name), f) == sizeof(t.axes[i].name);
+        ok = ok && std::fwrite(&t.axes[i].n, sizeof(int), 1, f) == 1;
+        ok = ok && std::fwrite(&t.axes[i].min, sizeof(double), 1, f) == 1;
+        ok = ok && std::fwrite(&t.axes[i].max, sizeof(double), 1, f) == 1;
+      }
+      ok = ok && std::fwrite(t.vData.data(), sizeof(float), t.vData.size(), f) == t.vData.size();
+    }
+
+    return std::fclose(f) == 0 && ok;
+  }
+
+  bool Read(std::string s)
+  {
+    this->vTables.clear();
+
+    FILE * f = std::fopen(s.c_str(), "rb");
+    if (!f) return false;
+
+    char magic[4];
+    int version = 0;
+    int n = 0;
+    bool ok = std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, "CEMT", 4) == 0;
+    ok = ok && std::fread(&version, sizeof(int), 1, f) == 1 && version == 1;
+    ok = ok && std::fread(&n, sizeof(int), 1, f) == 1 && n >= 0;
+
+    for (int k = 0; ok && k < n; k++)
+    {
+      Table t;
+      ok = std::fread(t.name, 1, sizeof(t.name), f) == sizeof(t.name);
+      ok = ok && std::fread(&t.nDims, sizeof(int), 1, f) == 1 && t.nDims > 0 && t.nDims <= kMaxDims;
+      for (int i = 0; ok && i < t.nDims; i++)
+      {
+        ok = ok && std::fread(t.axes[i].name, 1, sizeof(t.axes[i].name), f) == sizeof(t.axes[i].name);
+        ok = ok && std::fread(&t.axes[i].n, sizeof(int), 1, f) == 1 && t.axes[i].n > 0;
+        ok = ok && std::fread(&t.axes[i].min, sizeof(double), 1, f) == 1;
+        ok = ok && std::fread(&t.axes[i].max, sizeof(double), 1, f) == 1;
+      }
+      if (!ok) break;
+
+      t.name[sizeof(t.name)-1] = 0;
+      for (int i = 0; i < t.nDims; i++) t.axes[i].name[sizeof(t.axes[i].name)-1] = 0;
+
+      t.Init();
+      ok = std::fread(t.vData.data(), sizeof(float), t.vData.size(), f) == t.vData.size();
+      if (ok) this->vTables.push_back(t);
+    }
+
+    std::fclose(f);
+
+    if (!ok) this->vTables.clear();
+    return ok;
+  }
+
+};
+
+#endif
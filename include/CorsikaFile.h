@@ -6,12 +6,16 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <map>
+#include <memory>
 
 #include <CorsikaClasses.h>
+#include <CorsikaBlockReader.h>
 
 class CorsikaFile
 {
   friend class CorsikaShower;
+  friend class CorsikaBench;
 
 private:
   std::ifstream stream;
@@ -23,24 +27,33 @@ private:
   int nWordsPerParticle;
   int nParticlesPerBlock;
 
-  int iCurSub;
+  std::unique_ptr<CorsikaBlockReader> reader;
 
   bool kThin;
   bool kSkip;
   bool kGood;
   bool kDone;
+  bool kSalvage;
+  bool kTruncated;
+
+  long iLastEnd;
+  int iSkipped;
 
   std::vector<float> vHeader;
   std::vector<float> vEnd;
 
   std::string sFileName;
 
+  std::map<int,long> mHeaders;
+
   std::vector<float> NextSubBlock();
+  const float * ReadSubBlock(){return this->reader->Next();}
   void RewindSubBlock();
   void Reset();
+  int NextHeader(long &, long iEnd = -1);
 
 public:
-  CorsikaFile(std::string);
+  CorsikaFile(std::string, bool salvage = false);
   ~CorsikaFile();
 
   CorsikaShower NextShower();
@@ -50,8 +63,33 @@ public:
   int Version(){return this->vHeader[3];}
 
   bool Good(){return this->kGood;}
+
+  // Position in the file, as the index of the next sub-block to be read
+  long Tell(){return this->reader->Tell();}
+  void Seek(long i){this->reader->Seek(i); this->kDone = false;}
+  long NSubBlocksTotal(){return this->reader->NSubBlocks();}
+
+  // Bytes of the block buffer and of the run header and end
+  long Bytes(){return this->reader->BlockBytes() + 2*this->nSubWords*sizeof(float);}
+
+  // Move to the header of the shower with the given ID, found by bisection
+  // on the sub-blocks since CORSIKA writes the showers by increasing ID, or
+  // directly at its header set from an index, if it is there. The position
+  // is left unchanged if there is no such shower.
+  bool SeekShower(int);
+
+  // Sub-blocks of the shower headers by ID, e.g. from a CorsikaBunchIndex
+  void SetHeaders(const std::map<int,long> & m){this->mHeaders = m;}
+
+  // Decode the bunches of the given particle sub-block, e.g. one found with a
+  // CorsikaBunchIndex. Moves the position in the file.
+  int ReadBunches(long, CorsikaBunches &);
   bool Done(){return this->kDone;}
 
+  // Salvage mode: the run end is missing and only complete showers are read
+  bool Truncated(){return this->kTruncated;}
+  int SkippedShower(){return this->iSkipped;}
+
   void DumpRUNE(){for (int i=0; i<this->vEnd.size(); i++) std::cout << this->vEnd[i] << std::endl;};
   void DumpRUNH(){for (int i=0; i<this->vHeader.size(); i++) std::cout << this->vHeader[i] << std::endl;};
 
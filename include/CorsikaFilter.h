@@ -0,0 +1,70 @@
+#pragma once
+#ifndef __CLASS__CorsikaFilter__
+#define __CLASS__CorsikaFilter__ 1
+
+#include <string>
+#include <vector>
+
+#include <CorsikaBunches.h>
+
+//
+// Ordered selection of cherenkov bunches. The cheap cuts (bunch weight,
+// ground radius and time window) are evaluated over a whole batch before any
+// derived quantity is computed. Cuts that depend on derived quantities (like
+// the emission age) are registered with AddCut() and counted with Reject().
+//
+class CorsikaFilter
+{
+private:
+
+  double maxRadius2;
+  double minBunch;
+  double tMin;
+  double tMax;
+
+  bool kTime;
+
+  std::vector<std::string> vName;
+  std::vector<double> vRejected;
+
+  double nInput;
+  double nAccepted;
+
+public:
+
+  enum {kWeightCut, kRadiusCut, kTimeCut};
+
+  // Maximum radius at ground, in cm
+  CorsikaFilter(double);
+
+  void SetMinBunch(double w){this->minBunch = w;}
+  void SetTimeWindow(double, double);
+
+  double MinBunch(){return this->minBunch;}
+  bool InTime(float t){return !this->kTime || (this->tMin <= t && t < this->tMax);}
+
+  int AddCut(std::string);
+
+  int Apply(CorsikaBunches &);
+  void Reject(int icut, double n = 1.){this->vRejected[icut] += n; this->nAccepted -= n;}
+
+  double NInput(){return this->nInput;}
+  double NAccepted(){return this->nAccepted;}
+  double NRejected(int icut){return this->vRejected[icut];}
+
+  // All counters, to save and restore the state of a run
+  std::vector<double> GetCounters();
+  void SetCounters(const std::vector<double> &);
+
+  // The cuts and their values, as text, e.g. to tell whether two filters
+  // select the same bunches
+  std::string Definition();
+
+  // Add the counters of a filter with the same cuts
+  void Merge(const CorsikaFilter &);
+
+  void Print();
+
+};
+
+#endif
@@ -0,0 +1,113 @@
+#pragma once
+#ifndef __CLASS__CorsikaFootprint__
+#define __CLASS__CorsikaFootprint__ 1
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+//
+// Photons of a shower on the mirrors of an array of telescopes. The layout
+// is a text file with a telescope per line: position at ground x y and
+// mirror radius r in m, and optionally the zenith and azimuth angles of its
+// pointing and the half-angle of its field of view in deg, in the convention
+// of the shower direction (a telescope pointing at the source of the shower
+// has its theta and phi). Lines starting with # are comments.
+//
+// Telescopes are bucketed on a grid of cells at least a mirror diameter
+// wide, each with the list of the mirrors it overlaps, so that a bunch is
+// only tested against the mirrors of its cell. Per telescope, it keeps the
+// photons, the bunches and the arrival times: streaming weighted mean and
+// sum of squared deviations, first and last.
+//
+class CorsikaFootprint
+{
+private:
+
+  struct Telescope
+  {
+    double x, y, r2;
+    bool kPointing;
+    double u, v, w, cosFov;
+  };
+
+  std::string sDefinition;
+  bool kGood;
+
+  std::vector<Telescope> vTel;
+
+  // The grid, in cm, and the telescopes of each cell, those of cell i from
+  // vCellStart[i] to vCellStart[i+1] in vCellTel
+  double xMin, yMin, fCell;
+  int nx, ny;
+  std::vector<int> vCellStart;
+  std::vector<int> vCellTel;
+
+  std::vector<double> vPhotons;
+  std::vector<double> vBunches;
+  std::vector<double> vMean;
+  std::vector<double> vM2;
+  std::vector<double> vFirst;
+  std::vector<double> vLast;
+
+  void Bucket();
+
+public:
+
+  CorsikaFootprint(std::string);
+
+  bool Good(){return this->kGood;}
+
+  // Position at ground (cm), direction cosines, arrival time (ns) and photons of a bunch
+  void Fill(double x, double y, double u, double v, double t, double w)
+  {
+    const double fx = (x - this->xMin)*this->fCell;
+    const double fy = (y - this->yMin)*this->fCell;
+    if (!(fx >= 0. && fx < this->nx && fy >= 0. && fy < this->ny)) return;
+
+    const int c = int(fy)*this->nx + int(fx);
+    for (int k = this->vCellStart[c]; k < this->vCellStart[c+1]; k++)
+    {
+      const int i = this->vCellTel[k];
+      const Telescope & tel = this->vTel[i];
+
+      const double dx = x - tel.x;
+      const double dy = y - tel.y;
+      if (dx*dx + dy*dy >= tel.r2) continue;
+      if (tel.kPointing && u*tel.u + v*tel.v + std::sqrt(std::max(0., 1. - u*u - v*v))*tel.w < tel.cosFov) continue;
+
+      this->vPhotons[i] += w;
+      this->vBunches[i] += 1.;
+      const double d = t - this->vMean[i];
+      this->vMean[i] += d*w/this->vPhotons[i];
+      this->vM2[i] += w*d*(t - this->vMean[i]);
+      if (t < this->vFirst[i]) this->vFirst[i] = t;
+      if (t > this->vLast[i]) this->vLast[i] = t;
+    }
+  }
+
+  void Reset();
+
+  int NTelescopes() const {return this->vTel.size();}
+  long Bytes(){return (this->vCellStart.capacity() + this->vCellTel.capacity())*sizeof(int) + this->vTel.capacity()*sizeof(Telescope) + 6*this->vPhotons.capacity()*sizeof(double);}
+
+  // The telescopes and their cuts, as text
+  std::string Definition(){return this->sDefinition;}
+
+  // Photons, bunches, and mean, standard deviation, first and last arrival
+  // time of the photons on a telescope
+  double Photons(int i){return this->vPhotons[i];}
+  double Bunches(int i){return this->vBunches[i];}
+  double Mean(int i){return this->vMean[i];}
+  double Sigma(int i){return this->vPhotons[i] > 0. ? std::sqrt(std::max(0., this->vM2[i])/this->vPhotons[i]) : 0.;}
+  double First(int i){return this->vPhotons[i] > 0. ? this->vFirst[i] : 0.;}
+  double Last(int i){return this->vPhotons[i] > 0. ? this->vLast[i] : 0.;}
+
+  // The sums of the current shower
+  void Serialize(std::vector<char> &);
+  bool Deserialize(const std::vector<char> &);
+
+};
+
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+#ifndef __CLASS__CorsikaGHFit__
+#define __CLASS__CorsikaGHFit__ 1
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+//
+// Gaisser-Hillas fits of many longitudinal profiles at once:
+//
+//   N(X) = Nmax ((X-X0)/(Xmax-X0))^((Xmax-X0)/L) exp((Xmax-X)/L)
+//   L = P4 + P5 X + P6 X^2
+//
+// with 6 parameters, as CORSIKA, or 4 (P5 = P6 = 0). The fits run
+// Levenberg-Marquardt with the analytic Jacobian in lockstep: profiles on
+// the same depth grid form a batch whose data are stored point by point,
+// with the fits contiguous, so that the loops over fits vectorize. Batches
+// are split among threads. Weights are Poisson-like, sigma^2 = max(N, 1e-4 Nmax).
+// A batch is fit as soon as it holds a chunk of profiles, whose data are then
+// released, so that only the results and the depths of each grid are kept.
+// A fit whose steps are all rejected until the damping exceeds 1e10 stops
+// as kStalled: its parameters are the best found, not a converged minimum.
+//
+class CorsikaGHFit
+{
+public:
+
+  enum {kNmax, kX0, kXmax, kP4, kP5, kP6, kNPar};
+  enum {kNotFit = -1, kConverged = 0, kMaxIter = 1, kFailed = 2, kStalled = 3};
+
+private:
+
+  int nPar;
+  int maxIter;
+
+  // Profiles grouped by depth grid, found by the hash of the grid
+  struct Batch
+  {
+    std::vector<double> vDepth;
+    std::vector<int> vFit;
+  };
+  std::vector<Batch> vBatches;
+  std::unordered_map<uint64_t,std::vector<int>> mBatches;
+
+  // Data and results per fit
+  std::vector<std::vector<double>> vData;
+  std::vector<std::vector<double>> vPar;
+  std::vector<double> vChi2;
+  std::vector<int> vNdof;
+  std::vector<int> vStatus;
+
+  void FitBatch(const Batch &, int, int);
+  void Release(Batch &);
+
+public:
+
+  CorsikaGHFit(int npar = 6, int maxiter = 200);
+
+  int NPar(){return this->nPar;}
+
+  // Add a profile, returns the index of its fit
+  int Add(const std::vector<double> &, const std::vector<double> &);
+
+  // Fit the profiles not fit yet
+  void Fit(int nThreads = 1);
+
+  int NFits(){return this->vData.size();}
+  std::vector<double> GetParameters(int i){return this->vPar[i];}
+  double GetChi2(int i){return this->vChi2[i];}
+  int GetNdof(int i){return this->vNdof[i];}
+  int GetStatus(int i){return this->vStatus[i];}
+
+  long Bytes();
+
+  // The function, with parameters as in the enum above
+  static double Eval(const double *, double);
+
+};
+
+#endif
@@ -0,0 +1,135 @@
+#pragma once
+#ifndef __CLASS__CorsikaIACTFile__
+#define __CLASS__CorsikaIACTFile__ 1
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+
+#include <CorsikaBunches.h>
+
+//
+// Streaming reader of the eventio files written by the CORSIKA IACT option.
+// The file is a sequence of objects, each with a type, an id and a length,
+// read one at a time: the objects that are not needed, and the photon
+// objects of telescopes that are not requested, are skipped by their length
+// without being read. The bunches of the requested telescopes come in
+// batches of at most 39, like the sub-blocks of a CER file, with positions
+// relative to the shower core (bunch + telescope + array offset), so that
+// the analysis runs on them as on a CER file. When a shower is used several
+// times (CSCAT), the bunches of each use are weighted by the weight of the
+// use over the total, so that the shower is the average of its uses.
+// Only uncompressed, little-endian files are read.
+//
+class CorsikaIACTFile
+{
+public:
+
+  enum
+  {
+    kRunHeader   = 1200,
+    kTelescopes  = 1201,
+    kEventHeader = 1202,
+    kOffsets     = 1203,
+    kArray       = 1204,
+    kPhotons     = 1205,
+    kEventEnd    = 1209,
+    kRunEnd      = 1210
+  };
+
+  static const unsigned int kSync = 0xD41F8A37;
+  static const int kBatch = 39;
+
+private:
+
+  struct Object
+  {
+    int type;
+    int version;
+    long id;
+    long length;
+  };
+
+  std::ifstream stream;
+  std::string sFileName;
+
+  bool kGood;
+  bool kDone;
+  bool kShowerDone;
+
+  std::vector<float> vHeader;
+  std::vector<float> vEnd;
+  std::vector<float> vEventHeader;
+  std::vector<float> vEventEnd;
+
+  // Telescopes of the layout, in cm, and the ones requested (numbers from 1)
+  std::vector<float> vTelX, vTelY, vTelZ, vTelR;
+  std::set<int> sTelescopes;
+
+  // Arrays (uses) of the current shower
+  std::vector<float> vOffX, vOffY, vOffW;
+
+  // Current telescope array object, and photon object in it
+  long iArrayEnd;
+  long iPhotonsEnd;
+  int iArray;
+  int iTelescope;
+  long nLeft;
+  bool kCompact;
+  float fWeight;
+
+  std::vector<char> vBuffer;
+
+  bool ReadObject(Object &, bool top = true);
+  bool ReadFloats(std::vector<float> &, long);
+  void SkipObject(const Object &);
+  bool Wanted(int tel){return this->sTelescopes.empty() || this->sTelescopes.count(tel+1) > 0;}
+
+public:
+
+  // File name, and the telescopes to read (numbers from 1), all if empty
+  CorsikaIACTFile(std::string, const std::set<int> & telescopes = std::set<int>());
+
+  // Does the file start with the eventio sync marker
+  static bool IsIACT(std::string);
+
+  bool Good(){return this->kGood;}
+  bool Done(){return this->kDone;}
+
+  // Move to the next shower, false at the end of the run
+  bool NextShower();
+
+  // Next batch of bunches of the current shower, 0 at its end
+  int NextBunches(CorsikaBunches &);
+
+  // Telescope (number from 1) and array of the last batch
+  int Telescope(){return this->iTelescope+1;}
+  int Array(){return this->iArray;}
+
+  int NTelescopes(){return this->vTelX.size();}
+  float TelescopeX(int i){return this->vTelX[i];}
+  float TelescopeY(int i){return this->vTelY[i];}
+  float TelescopeZ(int i){return this->vTelZ[i];}
+  float TelescopeR(int i){return this->vTelR[i];}
+  int NArrays(){return this->vOffX.size();}
+
+  // Bytes of the object buffer, of the headers and of the layout
+  long Bytes(){return this->vBuffer.capacity() + (this->vHeader.capacity() + this->vEnd.capacity() + this->vEventHeader.capacity() + this->vEventEnd.capacity() + 4*this->vTelX.capacity())*sizeof(float);}
+
+  int NShow(){return this->vHeader[92];}
+  int StartDate(){return this->vHeader[2];}
+  int Version(){return this->vHeader[3];}
+
+  std::vector<float> GetHeader(){return this->vHeader;}
+  std::vector<float> GetEnd(){return this->vEnd;}
+  std::vector<float> GetEventHeader(){return this->vEventHeader;}
+  std::vector<float> GetEventEnd(){return this->vEventEnd;}
+
+  int ID(){return int(this->vEventHeader[1]);}
+  float Theta(){return this->vEventHeader[10];}
+  float ObsLvl(int i = 0){return this->vEventHeader[47+i];}
+
+};
+
+#endif
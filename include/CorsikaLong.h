@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
 
 class CorsikaLong
 {
@@ -18,16 +19,44 @@ private:
   std::map<int,std::map<int,std::map<int,std::vector<double>>>> mProf;
   std::map<int,std::vector<double>> mGH;
 
-  std::vector<std::string> vColPart;
-  std::vector<std::string> vColDep;
-
   int nShow;
 
   bool kGood;
   bool kSlant;
 
+  // Number of steps of the showers being read from LONG sub-blocks
+  std::map<int,int> mSteps;
+
+  // Bounded store: the position of each shower in the file, to read it
+  // again once dropped, and the showers in memory, oldest first
+  std::map<int,std::streampos> mOffset;
+  std::deque<int> qKept;
+  long nMaxBytes;
+  long nBytes;
+
+  void Discard(int);
+  int ReadShower(bool);
+  void Keep(int);
+  bool Fetch(int);
+
 public:
-  CorsikaLong(std::string);
+
+  // Profiles of at most about maxBytes are kept in memory (0: all of them).
+  // The oldest are dropped first, and read again from the file if needed.
+  CorsikaLong(std::string, long maxBytes = 0);
+
+  // Empty, to be filled with the LONG sub-blocks of a CER file. Their depths
+  // are vertical, or slant if CORSIKA ran with the SLANT option.
+  CorsikaLong();
+  void SetSlant(bool b){this->kSlant = b;}
+  void SetMaxBytes(long b){this->nMaxBytes = b;}
+
+  // Decode a LONG sub-block: 13 header words (LONG, event number, primary,
+  // energy, 100*steps + sub-blocks, index of the sub-block, ...) and then 26
+  // steps of depth and the 9 particle columns. There is no energy deposit
+  // table: its profiles are empty. Once all steps of a shower are in, its
+  // charged particle profile is fit with a 6 parameter Gaisser-Hillas.
+  void AddSubBlock(const float *);
 
   int GetID(int);
 
@@ -36,11 +65,18 @@ public:
   bool Slant(){return this->kSlant;}
   bool Good(){return this->kGood;}
 
+  // Bytes of the profiles and fits in memory, estimated
+  long Bytes(){return this->nBytes;}
+
   double GetXmax(int);
   double GetXmaxByNumber(int n){return this->GetXmax(this->GetID(n));}
 
-  std::vector<double> GetFit(int n);
-  std::vector<double> GetFitByNumber(int n){return this->GetFit(this->GetID(n));}
+  const std::vector<double> & GetFit(int n);
+  const std::vector<double> & GetFitByNumber(int n){return this->GetFit(this->GetID(n));}
+
+  // Profile ipart of table itype (0 particles, 1 energy deposit) of a shower
+  // into a buffer, reusing its capacity: empty if there is none
+  bool FillProfile(int, int, int, std::vector<double> &);
 
   std::vector<double> GetProfile(int,int);
   std::vector<double> GetProfileByNumber(int n, int ipart){return this->GetProfile(this->GetID(n),ipart);}
@@ -48,7 +84,8 @@ public:
   std::vector<double> GetDepositProfile(int,int);
   std::vector<double> GetDepositProfileByNumber(int n, int ipart){return this->GetDepositProfile(this->GetID(n),ipart);}
 
-  std::string GetColumnName(int i, int j);
+  std::string GetColumnName(int i, int j){return ColumnName(i,j);}
+  static std::string ColumnName(int, int);
 
   void Print(int);
   void PrintByNumber(int n){this->Print(this->GetID(n));}
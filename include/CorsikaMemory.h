@@ -0,0 +1,63 @@
+#pragma once
+#ifndef __CLASS__CorsikaMemory__
+#define __CLASS__CorsikaMemory__ 1
+
+#include <string>
+#include <vector>
+
+//
+// Memory held per subsystem: input buffers, long-profile store, accumulators
+// and output queue (the objects of the showers kept in memory by the output
+// file). Each thread sets the bytes of its own objects, e.g. once per shower;
+// the totals and their peaks are over all threads. A budget, if set, is what
+// the callers bound their buffers, stores and caches to; this class only
+// measures against it.
+//
+class CorsikaMemory
+{
+public:
+
+  enum Subsystem
+  {
+    kInput,
+    kLong,
+    kAccumulators,
+    kOutput,
+    kNSubsystems
+  };
+
+private:
+
+  static long nBudget;
+
+  long vBytes[kNSubsystems];
+
+  CorsikaMemory();
+
+  static CorsikaMemory & Local();
+  static std::vector<CorsikaMemory*> & Instances();
+
+public:
+
+  // Bytes held by the calling thread in a subsystem
+  static void Set(int, long);
+
+  // Current total and peak total over all threads, of a subsystem or of all
+  // of them (s < 0)
+  static long Current(int s = -1);
+  static long Peak(int s = -1);
+
+  // Peak resident size of the process, in bytes
+  static long Resident();
+
+  static void SetBudget(long b){nBudget = b;}
+  static long Budget(){return nBudget;}
+  static bool OverBudget(){return nBudget > 0 && Current() > nBudget;}
+
+  static std::string SubsystemName(int);
+
+  static void Print();
+
+};
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+#ifndef __CLASS__CorsikaOptions__
+#define __CLASS__CorsikaOptions__ 1
+
+#include <string>
+#include <vector>
+#include <map>
+
+class CorsikaOptions
+{
+private:
+
+  std::vector<std::string> vArgs;
+
+  std::map<std::string,std::vector<std::string>> mOpt;
+
+  bool kGood;
+
+  bool Parse(std::string, std::string, bool, double &);
+
+public:
+
+  // The map gives the known options (without the leading "--") and the number
+  // of values each one takes
+  CorsikaOptions(int, char **, std::map<std::string,int>);
+
+  bool Good(){return this->kGood;}
+
+  int NArgs(){return this->vArgs.size();}
+  std::string GetArg(int n){return this->vArgs[n];}
+  int GetArgInt(int, int def = 0);
+
+  bool Has(std::string s){return this->mOpt.count(s) > 0;}
+
+  // The numbers return the default for a value that is not one, and make Good() fail
+  std::string GetString(std::string, std::string def = "", int i = 0);
+  double GetDouble(std::string, double def = 0., int i = 0);
+  int GetInt(std::string, int def = 0, int i = 0);
+
+  // Check n values of an option (all if n < 0) from the first on, before
+  // Good() is checked: numbers, or integers if kInt
+  void CheckNumbers(std::string, bool kInt = false, int first = 0, int n = -1);
+
+};
+
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef __CLASS__CorsikaParticles__
+#define __CLASS__CorsikaParticles__ 1
+
+#include <vector>
+#include <cmath>
+
+//
+// A batch of particles of a DAT particle file stored as structure of arrays.
+// The description word of CORSIKA, id*1000 + hadronic generation*10 +
+// observation level, is split into its fields. Momenta in GeV/c, positions
+// at the observation level in cm from the core, time in ns, and the
+// thinning weight (1 for unthinned files).
+//
+class CorsikaParticles
+{
+public:
+
+  enum Group {kGammas, kElectrons, kMuons, kHadrons, kNGroups, kOther = -1};
+
+  int n;
+
+  std::vector<int> id;
+  std::vector<int> generation;
+  std::vector<int> level;
+  std::vector<float> px;
+  std::vector<float> py;
+  std::vector<float> pz;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> t;
+  std::vector<float> weight;
+
+  CorsikaParticles(int capacity = 0) : n(0) {this->Resize(capacity);}
+
+  void Resize(int m)
+  {
+    if (m > int(this->id.size()))
+    {
+      this->id.resize(m);
+      this->generation.resize(m);
+      this->level.resize(m);
+      this->px.resize(m);
+      this->py.resize(m);
+      this->pz.resize(m);
+      this->x.resize(m);
+      this->y.resize(m);
+      this->t.resize(m);
+      this->weight.resize(m);
+    }
+    this->n = m;
+  }
+
+  int Size(){return this->n;}
+  long Bytes(){return this->id.capacity()*(3*sizeof(int) + 7*sizeof(float));}
+
+  float Momentum(int i){return std::sqrt(this->px[i]*this->px[i] + this->py[i]*this->py[i] + this->pz[i]*this->pz[i]);}
+
+  // Group of a CORSIKA particle id: gammas, e+-, mu+-, hadrons and nuclei.
+  // Neutrinos, the additional muon information and the like are other.
+  static int GroupOf(int pid)
+  {
+    if (pid == 1) return kGammas;
+    if (pid == 2 || pid == 3) return kElectrons;
+    if (pid == 5 || pid == 6) return kMuons;
+    if ((pid >= 7 && pid <= 65) || (pid >= 100 && pid < 6000)) return kHadrons;
+    return kOther;
+  }
+
+  static const char * GroupName(int g)
+  {
+    static const char * names[kNGroups] = {"gammas","electrons","muons","hadrons"};
+    return g >= 0 && g < kNGroups ? names[g] : "other";
+  }
+
+};
+
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef __CLASS__CorsikaProfileGrid__
+#define __CLASS__CorsikaProfileGrid__ 1
+
+#include <string>
+#include <vector>
+
+//
+// Sums of longitudinal profiles over showers on a common grid. The profiles
+// of a shower (e.g. the 9 particle profiles of a .long file, which share
+// their depths) are interpolated linearly onto the grid nodes: the position
+// of each node among the shower depths is computed once, then each profile
+// is added in one pass over the nodes. The grid is in slant depth (g/cm2),
+// or in shower age s = 3X/(X + 2Xmax). Nodes outside the depths of a shower
+// are not covered by it, and the average at a node is over the showers that
+// cover it, counted per profile so that a profile missing from a shower does
+// not pull the average down. Without a grid set, the depths of the first
+// shower are the grid.
+//
+class CorsikaProfileGrid
+{
+public:
+
+  enum {kDepth, kAge};
+
+private:
+
+  int iType;
+  int nProfiles;
+
+  std::vector<double> vNodes;
+  std::vector<double> vSum;
+  std::vector<double> vCount;
+
+  // Interpolation of the current shower: index, fraction and coverage per node
+  std::vector<int> vIndex;
+  std::vector<double> vFrac;
+  std::vector<double> vIn;
+
+  void Allocate();
+
+public:
+
+  CorsikaProfileGrid(int nprof = 9);
+
+  // Grid of n nodes from min to max included, in depth or age
+  void SetGrid(int, int, double, double);
+
+  // Add the profiles of a shower: v[0] are the slant depths, v[1..] the
+  // profiles. Xmax (slant) is needed for the age grid only.
+  void Add(const std::vector<std::vector<double>> &, double xmax = -1.);
+
+  // Add the sums of another grid, interpolated if the nodes differ
+  void Merge(const CorsikaProfileGrid &);
+
+  int Type(){return this->iType;}
+  bool Empty(){return this->vNodes.empty();}
+  bool Filled();
+  const std::vector<double> & Nodes(){return this->vNodes;}
+  long Bytes(){return (this->vNodes.capacity() + this->vSum.capacity() + this->vCount.capacity() + this->vFrac.capacity() + this->vIn.capacity())*sizeof(double) + this->vIndex.capacity()*sizeof(int);}
+
+  // Average of profile i (from 0) over the showers covering each node
+  std::vector<double> Average(int);
+
+  void Serialize(std::vector<char> &);
+  bool Deserialize(const std::vector<char> &);
+
+};
+
+#endif
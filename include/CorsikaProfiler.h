@@ -0,0 +1,114 @@
+#pragma once
+#ifndef __CLASS__CorsikaProfiler__
+#define __CLASS__CorsikaProfiler__ 1
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+//
+// Per-stage timers and counters. Each thread accumulates into its own
+// instance; Print() and WriteJSON() sum over all of them, and give the time
+// of each stage as a share of the wall time of all the threads. When
+// profiling is disabled every call reduces to a single test of a global flag.
+//
+class CorsikaProfiler
+{
+public:
+
+  enum Stage
+  {
+    kSubBlockIO,
+    kDecode,
+    kFilter,
+    kGeometry,
+    kFill,
+    kRootIO,
+    kLongParse,
+    kNStages
+  };
+
+  enum Counter
+  {
+    kBytesRead,
+    kSubBlocks,
+    kBunches,
+    kAccepted,
+    kShowers,
+    kParticles,
+    kNCounters
+  };
+
+private:
+
+  static bool kEnabled;
+  static int nThreads;
+
+  double vTime[kNStages];
+  double vCalls[kNStages];
+  double vCount[kNCounters];
+
+  CorsikaProfiler();
+
+  static CorsikaProfiler & Local();
+  static std::vector<CorsikaProfiler*> & Instances();
+
+  static double Total(int, bool);
+
+public:
+
+  static void Enable(bool k = true);
+  static bool Enabled(){return kEnabled;}
+
+  // Number of threads working at once, e.g. the readers
+  static void SetThreads(int n){nThreads = n > 1 ? n : 1;}
+
+  static void Count(int c, double n = 1.){if (kEnabled) Local().vCount[c] += n;}
+  static void Time(int s, double t){if (kEnabled) {Local().vTime[s] += t; Local().vCalls[s]++;}}
+
+  static double GetTime(int s){return Total(s,true);}
+  static double GetCount(int c){return Total(c,false);}
+  static double WallTime();
+
+  static std::string StageName(int);
+  static std::string CounterName(int);
+
+  static void Print();
+  static bool WriteJSON(std::string);
+
+};
+
+
+
+//
+// Scoped timer: adds the time elapsed between construction and destruction
+// to the given stage
+//
+class CorsikaTimer
+{
+private:
+
+  int iStage;
+  bool kActive;
+  std::chrono::steady_clock::time_point tStart;
+
+public:
+
+  CorsikaTimer(int s)
+  : iStage(s)
+  , kActive(CorsikaProfiler::Enabled())
+  {
+    if (this->kActive) this->tStart = std::chrono::steady_clock::now();
+  }
+
+  ~CorsikaTimer(){this->Stop();}
+
+  void Stop()
+  {
+    if (this->kActive) CorsikaProfiler::Time(this->iStage, std::chrono::duration<double>(std::chrono::steady_clock::now() - this->tStart).count());
+    this->kActive = false;
+  }
+
+};
+
+#endif
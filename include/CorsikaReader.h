@@ -0,0 +1,156 @@
+#pragma once
+#ifndef __CLASS__CorsikaReader__
+#define __CLASS__CorsikaReader__ 1
+
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+
+#include <CorsikaSampler.h>
+
+class TFile;
+class TDirectory;
+class CorsikaRun;
+class CorsikaFile;
+class CorsikaLong;
+class CorsikaAtmosphere;
+class CorsikaBunches;
+class CorsikaParticles;
+class CorsikaAnalysis;
+class CorsikaCheckpoint;
+
+//
+// The readers of readCorsika: each reader (thread) claims whole files of the
+// run, one at a time, and reads their showers into its own analysis, until
+// none is left. The output file, the number of showers started and the
+// checkpoint are shared by the readers, under the output lock.
+//
+class CorsikaReader
+{
+private:
+
+  // The showers of an input file, for the loop over them that the readers
+  // share. Next() moves to the next shower and gives its header, false at
+  // the end; Begin() follows the start of the shower in the analysis;
+  // Fill(kBunches) reads its bunches, filled unless the shower was found
+  // whole in the cache; Save() sets the position of the next shower in the
+  // checkpoint, if the source is Resumable(); Bytes() is the memory of the
+  // input buffers.
+  class Source
+  {
+  public:
+    virtual ~Source(){}
+    virtual bool Next(std::vector<float> &) = 0;
+    virtual void Begin(){}
+    virtual void Fill(bool) = 0;
+    virtual bool Resumable(){return false;}
+    virtual void Save(CorsikaCheckpoint &){}
+    virtual long Bytes() = 0;
+  };
+
+  class SourceCER;
+  class SourceIACT;
+
+  CorsikaRun & run;
+  TFile & froot;
+  std::vector<std::unique_ptr<CorsikaAnalysis>> & vAnalysis;
+
+  int maxShowers;
+  long nLongBytes;
+  bool kSalvage;
+  bool kCurved;
+  bool kParticles;
+  bool kEmbedded;
+  bool kSlant;
+  bool kIndex;
+  bool kKeepIndex;
+  CorsikaSampler sampler;
+  std::set<int> sTelescopes;
+
+  // Checkpoints, every n showers
+  CorsikaCheckpoint * pCkpt;
+  std::string sCkpFil;
+  int nCheckpoint;
+  bool kResume;
+
+  // The shard of the run, by the sizes of its files
+  int iShard;
+  int nShards;
+  std::vector<long> vFileBytes;
+  long nRunBytes;
+
+  // Shared by the readers, under the output lock
+  std::mutex mtxOut;
+  int nStarted;
+  long nShardRead;
+  long nShardRange;
+  bool kFailed;
+  bool kOverBudget;
+
+  bool Multi();
+
+  // Sub-blocks [first, last) of a file in the range of the shard
+  void ShardBounds(int, long, long &, long &);
+
+  // Memory held by a reader after a shower
+  void Account(CorsikaAnalysis &, long, CorsikaLong &);
+
+  // The ground particles of a shower, from the next shower of the DAT file
+  void FillParticles(CorsikaFile *, int, CorsikaAnalysis &, CorsikaParticles &);
+
+  // Under the output lock: the checks of the input files of a reader, and
+  // the directory of the showers of a file, after its banner
+  bool CheckInputs(int, bool, std::string, CorsikaLong &, CorsikaFile *);
+  TDirectory * BeginFile(int, std::string, int, int, int, CorsikaFile *);
+
+  void ReadShowers(int, int, TDirectory *, Source &, CorsikaAnalysis &, CorsikaLong &, CorsikaAtmosphere &, CorsikaFile *, CorsikaBunches &, CorsikaParticles &);
+
+  // A CER file, or an IACT eventio file, into the analysis of a reader
+  void ReadCER(int, CorsikaAnalysis &, CorsikaBunches &, CorsikaParticles &);
+  void ReadIACT(int, CorsikaAnalysis &, CorsikaBunches &, CorsikaParticles &);
+
+  // The reader of a thread, with the analysis of the same index
+  void Read(int);
+
+public:
+
+  // The run, the output file and the analyses of the readers
+  CorsikaReader(CorsikaRun &, TFile &, std::vector<std::unique_ptr<CorsikaAnalysis>> &);
+
+  void SetMaxShowers(int n){this->maxShowers = n;}
+  void SetLongBytes(long n){this->nLongBytes = n;}
+  void SetSalvage(bool k){this->kSalvage = k;}
+  void SetCurved(bool k){this->kCurved = k;}
+  void SetParticles(bool k){this->kParticles = k;}
+  void SetSampler(const CorsikaSampler & s){this->sampler = s;}
+  void SetTelescopes(const std::set<int> & s){this->sTelescopes = s;}
+
+  // Profiles from the LONG sub-blocks of the CER files, in slant depths or not
+  void SetEmbeddedLong(bool);
+
+  // Save a spatial index of the bunches next to each input, or with the
+  // cache, keep the index saved by an earlier pass (kKeep)
+  void SetIndex(bool);
+
+  // Save the state to the file every n showers, and resume from the state
+  // already loaded, if any
+  void SetCheckpoint(CorsikaCheckpoint &, std::string, int, bool);
+
+  // Read the i-th of N parts of the run, of equal size in bytes
+  void SetShard(int, int);
+  long RunBytes(){return this->nRunBytes;}
+
+  // Read the whole run with n threads
+  void Run(int);
+
+  bool Failed(){return this->kFailed;}
+
+  // Sub-blocks read by the shard, and in its range
+  long NShardRead(){return this->nShardRead;}
+  long NShardRange(){return this->nShardRange;}
+
+};
+
+#endif
@@ -0,0 +1,125 @@
+#pragma once
+#ifndef __CLASS__CorsikaResultArena__
+#define __CLASS__CorsikaResultArena__ 1
+
+#include <vector>
+#include <memory>
+
+#include <TH1.h>
+
+//
+// The per-shower histograms of a reader, booked once in a single buffer.
+// Each histogram takes its bin contents, its sums of squared weights (both
+// with under- and overflow, in the cell order of ROOT) and its statistics,
+// so that Reset() between showers is one memset and filling is an index
+// computation. Write() copies the buffers into a ROOT histogram allocated at
+// booking, so that writing a shower allocates nothing either. Bins and
+// statistics are those ROOT would give with Fill().
+//
+class CorsikaResultArena
+{
+private:
+
+  enum {kSumw, kSumw2, kSumwx, kSumwx2, kSumwy, kSumwy2, kSumwxy, kEntries, kNStats};
+
+  struct Hist
+  {
+    int nx, ny;
+    double xmin, xmax, ymin, ymax;
+    long offset;
+    long nCells;
+    std::unique_ptr<TH1> carrier;
+  };
+
+  std::vector<Hist> vHist;
+  std::vector<double> vBuffer;
+
+  long Book(int, double, double, int, double, double);
+
+  // Bin of ROOT for fixed bins, NaN in the overflow
+  static int FindBin(double x, int n, double min, double max)
+  {
+    if (x < min) return 0;
+    if (!(x < max)) return n+1;
+    return 1 + int(n*(x - min)/(max - min));
+  }
+
+public:
+
+  // Book a histogram of n bins from min to max (and in y), and return its handle
+  int Book1D(int, double, double);
+  int Book2D(int, double, double, int, double, double);
+
+  void Fill(int h, double x, double w)
+  {
+    const Hist & hist = this->vHist[h];
+    const int b = FindBin(x, hist.nx, hist.xmin, hist.xmax);
+
+    double * c = this->vBuffer.data() + hist.offset;
+    double * s = c + 2*hist.nCells;
+    c[b] += w;
+    c[hist.nCells + b] += w*w;
+    s[kEntries] += 1.;
+
+    if (b == 0 || b > hist.nx) return;
+    s[kSumw] += w;
+    s[kSumw2] += w*w;
+    s[kSumwx] += w*x;
+    s[kSumwx2] += w*x*x;
+  }
+
+  void Fill(int h, double x, double y, double w)
+  {
+    const Hist & hist = this->vHist[h];
+    const int bx = FindBin(x, hist.nx, hist.xmin, hist.xmax);
+    const int by = FindBin(y, hist.ny, hist.ymin, hist.ymax);
+    const long b = bx + long(hist.nx + 2)*by;
+
+    double * c = this->vBuffer.data() + hist.offset;
+    double * s = c + 2*hist.nCells;
+    c[b] += w;
+    c[hist.nCells + b] += w*w;
+    s[kEntries] += 1.;
+
+    if (bx == 0 || bx > hist.nx || by == 0 || by > hist.ny) return;
+    s[kSumw] += w;
+    s[kSumw2] += w*w;
+    s[kSumwx] += w*x;
+    s[kSumwx2] += w*x*x;
+    s[kSumwy] += w*y;
+    s[kSumwy2] += w*y*y;
+    s[kSumwxy] += w*x*y;
+  }
+
+  // Zero all histograms
+  void Reset();
+
+  // Bin contents and sums of squared weights of a histogram, by ROOT cell
+  double * Contents(int h){return this->vBuffer.data() + this->vHist[h].offset;}
+  double * Sumw2(int h){return this->Contents(h) + this->vHist[h].nCells;}
+  int NBinsX(int h){return this->vHist[h].nx;}
+  double BinLowEdge(int h, int i){const Hist & hist = this->vHist[h]; return hist.xmin + (i-1)*(hist.xmax - hist.xmin)/hist.nx;}
+
+  // Add a histogram to a ROOT histogram of the same bins, as TH1::Add would,
+  // or its squared contents
+  void AddTo(int, TH1 &, bool squared = false);
+
+  // Write a histogram to the current directory
+  void Write(int, const char *);
+
+  // Append the non-empty cells and the statistics of a histogram to a byte
+  // buffer, and read them back into a histogram of the same bins
+  void Append(int, std::vector<char> &);
+  bool Extract(int, const std::vector<char> &, size_t &);
+
+  // Add a histogram appended to a buffer to a ROOT histogram of the same
+  // bins, as AddTo(), touching only its non-empty cells. Without a target,
+  // only check that it can be read.
+  static bool ExtractTo(const std::vector<char> &, size_t &, TH1 *);
+
+  // Size of the buffer in bytes
+  long Bytes(){return this->vBuffer.size()*sizeof(double);}
+
+};
+
+#endif
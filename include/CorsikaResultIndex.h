@@ -0,0 +1,115 @@
+#pragma once
+#ifndef __CLASS__CorsikaResultIndex__
+#define __CLASS__CorsikaResultIndex__ 1
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdio>
+#include <cstdint>
+
+//
+// The showers of a processed run and where their results are in the cache:
+// per shower, the run of its file, its row of the Header tuple and the cache
+// key of each part of the analysis (0 for the parts not enabled). It is
+// saved next to the output file, as cherenkov_RUN.results, by readCorsika
+// with --cache, so that the results of the showers can be found and merged
+// without the output file, e.g. by queryCorsika. With a memory bound, the
+// showers beyond it are spilled to a temporary file, in the order of the
+// index.
+//
+class CorsikaResultIndex
+{
+public:
+
+  // Columns of the Header tuple, and the part of the emission histograms,
+  // as in CorsikaAnalysis
+  enum {kNColumns = 16};
+  enum {kPartCherenkov = 0};
+
+  // The sparse histograms of a cherenkov part: the emission angle per age bin
+  // at the binning of the averages, the emission distance per age bin and
+  // the photon density at ground, before its normalization to the area
+  enum Hist
+  {
+    kEmissionAngle = 0,
+    kEmissionDist = 20,
+    kPhotonDensity = 40,
+    kNHists = 41
+  };
+
+private:
+
+  std::string sRun;
+  std::string sCacheDir;
+  int nParts;
+
+  std::vector<int> vRuns;
+  std::vector<std::vector<double>> vHeaderRows;
+  std::vector<std::vector<uint64_t>> vKeys;
+
+  // Spilled showers, as in the serialized index
+  long nMaxBytes;
+  std::unique_ptr<FILE, int(*)(FILE*)> pSpill;
+  long nSpilled;
+
+  long RecordBytes(){return sizeof(int) + kNColumns*sizeof(double) + this->nParts*sizeof(uint64_t);}
+
+  // The serialized index up to its showers, and the showers in memory
+  void AppendHead(std::vector<char> &);
+  void AppendRows(std::vector<char> &);
+
+  // The spilled showers, by blocks of whole records given to f(bytes, n)
+  bool ReadSpilled(std::function<void(const char *, long)>);
+
+public:
+
+  CorsikaResultIndex();
+
+  // Name of the run (e.g. 000001-000008) and directory of the cache
+  void SetRun(std::string s){this->sRun = s;}
+  void SetCacheDir(std::string s){this->sCacheDir = s;}
+  std::string Run(){return this->sRun;}
+  std::string CacheDir(){return this->sCacheDir;}
+
+  // A shower: the run of its file, its header row and the key of each part
+  void Add(int, const std::vector<double> &, const std::vector<uint64_t> &);
+
+  // Add the showers of another index, e.g. the one of another reader thread
+  void Merge(CorsikaResultIndex &);
+
+  // Bytes of the showers kept in memory, the others are spilled (0: no bound)
+  void SetMaxBytes(long n){this->nMaxBytes = n;}
+  void Spill();
+
+  // The showers, and those in memory: all of them for an index that was read
+  int NShowers(){return this->nSpilled + this->vRuns.size();}
+  int RunOf(int i){return this->vRuns[i];}
+  const std::vector<double> & HeaderRow(int i){return this->vHeaderRows[i];}
+  uint64_t Key(int i, int p){return p < this->nParts ? this->vKeys[i][p] : 0;}
+
+  void Serialize(std::vector<char> &);
+  bool Deserialize(const std::vector<char> &);
+
+  bool Write(std::string);
+  bool Read(std::string);
+
+  long Bytes(){return this->vRuns.capacity()*(sizeof(int) + sizeof(std::vector<double>) + sizeof(std::vector<uint64_t>)) + this->vRuns.size()*(kNColumns*sizeof(double) + this->nParts*sizeof(uint64_t));}
+
+  // A cherenkov part starts with its layout: the version kPartLayout and the
+  // offset of each of the kNHists histograms. CorsikaAnalysis::SavePart()
+  // begins the part with BeginLayout() and marks each histogram with
+  // SetOffset(h) before appending it; Locate() reads the offsets back, false
+  // if the layout is another one or the histograms do not fit in the bytes.
+  enum {kPartLayout = 1};
+  static long LayoutBytes(){return sizeof(int) + kNHists*sizeof(long);}
+  static void BeginLayout(std::vector<char> &);
+  static void SetOffset(std::vector<char> &, int);
+  static bool Locate(const char *, long, std::vector<long> &);
+
+  static std::string FileName(std::string sOutDir, std::string sRun){return sOutDir + "cherenkov_" + sRun + ".results";}
+
+};
+
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+#ifndef __CLASS__CorsikaResultStore__
+#define __CLASS__CorsikaResultStore__ 1
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include <CorsikaCache.h>
+#include <CorsikaResultIndex.h>
+
+//
+// The processed runs of a set of output directories, found by their result
+// indexes (cherenkov_RUN.results), with the cherenkov part of each shower
+// mapped from the cache. The header rows are kept in memory and the
+// histograms of each mapped part are located once, so that a query only
+// selects showers by their header and adds the non-empty cells of one
+// histogram of each, in any number of runs. Queries are text lines:
+//
+//   runs
+//   showers [cuts]
+//   average EmissionAngle|EmissionDist age=a [cuts]
+//   average PhotonDensity [cuts]
+//
+// A cut is a column of the Header tuple or run, an operator among < <= > >=
+// = != and a value, or a range a..b (e.g. run=1..20 theta<30). Column names
+// are not case sensitive, and theta and phi are in deg.
+//
+class CorsikaResultStore
+{
+private:
+
+  struct Shower
+  {
+    int run;
+    int index;
+    const char * p;
+    long n;
+    bool kMapped;
+    long vOffsets[CorsikaResultIndex::kNHists];
+  };
+
+  struct Run
+  {
+    std::string sFile;
+    std::string sName;
+    int nShowers;
+    int nFound;
+  };
+
+  std::vector<std::string> vDirs;
+  std::string sCacheDir;
+
+  std::map<std::string,std::unique_ptr<CorsikaCache>> mCaches;
+  std::vector<Run> vRuns;
+  std::vector<Shower> vShowers;
+
+  // Header rows of the showers, kNColumns each, with theta and phi in deg,
+  // and the parts read into memory once the mappings are used up
+  std::vector<double> vHeader;
+  std::vector<std::unique_ptr<std::vector<char>>> vCopies;
+  long nMappedBytes;
+
+  // Sums of a query, reused
+  std::vector<double> vSum, vSum2;
+
+  void Clear();
+  bool Select(const std::vector<std::string> &, std::vector<int> &, std::string &);
+
+  std::string Runs();
+  std::string Showers(const std::vector<std::string> &);
+  std::string Average(const std::vector<std::string> &);
+
+public:
+
+  // Output directories, and the cache to use instead of the one of each index
+  CorsikaResultStore(std::vector<std::string>, std::string sCache = "");
+  ~CorsikaResultStore();
+
+  // Read the result indexes of the directories again, and map their showers
+  void Load();
+
+  // The answer to a query, as text lines
+  std::string Query(std::string);
+
+  int NRuns(){return this->vRuns.size();}
+  int NShowers(){return this->vShowers.size();}
+  long MappedBytes(){return this->nMappedBytes;}
+
+  // Mappings at most, within the limit of the kernel on the mappings of a
+  // process; the parts of the other showers are read into memory
+  static const int kMaxMaps = 32768;
+
+  // Columns of the cuts, those of the Header tuple and the run
+  static int Column(std::string);
+
+};
+
+#endif
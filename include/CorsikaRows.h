@@ -0,0 +1,75 @@
+#pragma once
+#ifndef __CLASS__CorsikaRows__
+#define __CLASS__CorsikaRows__ 1
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdio>
+
+class TNtupleD;
+class CorsikaCheckpoint;
+
+//
+// Rows of a tuple of the analysis, one or more per shower, with the run of
+// the file of each. The first column is the ID of the shower. The tuple is
+// filled in the order of the runs and IDs, whatever the order in which the
+// reader threads added the rows, and the rows of a shower keep their order.
+// With a memory bound, the rows beyond it are sorted and spilled to a
+// temporary file as a chunk, and the chunks are merged when read back.
+//
+class CorsikaRows
+{
+private:
+
+  int nColumns;
+  long nMaxRows;
+  std::vector<double> vData;
+  std::vector<int> vRuns;
+
+  // Spilled chunks: a row in the file is its run, as a double, and its
+  // columns; the number of rows of each chunk, in the order of the file
+  std::unique_ptr<FILE, int(*)(FILE*)> pSpill;
+  std::vector<long> vChunks;
+  long nSpilled;
+
+  // Indexes of the rows in memory, sorted by run and ID
+  std::vector<long> Order();
+
+public:
+
+  CorsikaRows(int n = 1);
+
+  int NColumns(){return this->nColumns;}
+  long NRows(){return this->nSpilled + long(this->vRuns.size());}
+
+  // A row of the given run, cut or padded with zeros to the columns
+  void Add(int, const std::vector<double> &);
+
+  // Bytes of the rows kept in memory, the others are spilled (0: no bound)
+  void SetMaxBytes(long);
+
+  // Move the rows in memory to the temporary file
+  void Spill();
+
+  // Add the rows of another set, e.g. the one of another reader thread
+  void Merge(CorsikaRows &);
+  void Clear();
+
+  long Bytes(){return this->vData.capacity()*sizeof(double) + this->vRuns.capacity()*sizeof(int) + this->vChunks.capacity()*sizeof(long);}
+
+  // All rows, sorted by run and ID, given to f(run, columns)
+  void ForEach(std::function<void(int, const double *)>);
+
+  // Fill the tuple, sorted by run and ID
+  void Fill(TNtupleD &);
+
+  // The rows and their runs as the entries s and s + "Runs"; rows saved
+  // without their runs are taken as those of the given run
+  void Save(CorsikaCheckpoint &, std::string);
+  bool Load(CorsikaCheckpoint &, std::string, int);
+
+};
+
+#endif
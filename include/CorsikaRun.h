@@ -0,0 +1,56 @@
+#pragma once
+#ifndef __CLASS__CorsikaRun__
+#define __CLASS__CorsikaRun__ 1
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+//
+// A logical run split over several CER/DAT.long file pairs (and DAT particle files), as written by
+// parallel CORSIKA productions. The files are handed out one at a time with
+// Claim(), so that each reader (thread) processes whole files and the set is
+// read as a single stream of showers.
+//
+class CorsikaRun
+{
+private:
+
+  std::vector<int> vRunNumbers;
+  std::vector<std::string> vCerFiles;
+  std::vector<std::string> vLongFiles;
+  std::vector<std::string> vDatFiles;
+
+  std::mutex mtx;
+  int iNext;
+
+  bool kGood;
+
+public:
+
+  // Input directory and list of run numbers, like "1", "1,4,7" or "1-8,12"
+  CorsikaRun(std::string, std::string);
+
+  bool Good(){return this->kGood;}
+
+  int NFiles(){return this->vRunNumbers.size();}
+  int RunNumber(int i){return this->vRunNumbers[i];}
+  std::string CerName(int i){return this->vCerFiles[i];}
+  std::string LongName(int i){return this->vLongFiles[i];}
+  std::string DatName(int i){return this->vDatFiles[i];}
+
+  // Name of the run for output files: "000001" or "000001-000008"
+  std::string Name();
+
+  // Index of the next file not yet taken by a reader, -1 if none is left
+  int Claim();
+
+  static std::string RunString(int);
+
+  // Parse a comma separated list of numbers and ranges, like "1-8,12", into
+  // increasing numbers. False if an item is invalid.
+  static bool ParseList(std::string, std::vector<int> &);
+
+};
+
+#endif
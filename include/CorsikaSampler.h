@@ -0,0 +1,52 @@
+#pragma once
+#ifndef __CLASS__CorsikaSampler__
+#define __CLASS__CorsikaSampler__ 1
+
+#include <cstdint>
+
+//
+// Random selection of particle sub-blocks with probability p, for quick
+// looks at a run. The draw of a sub-block is a counter-based random number:
+// a hash of the seed, run, shower and index of the sub-block within the
+// shower, so it does not depend on the order in which sub-blocks are read,
+// nor on the number of threads. Kept sub-blocks weigh 1/p.
+//
+class CorsikaSampler
+{
+private:
+
+  double prob;
+  uint64_t seed;
+
+  // The finalizer of SplitMix64
+  static uint64_t Mix(uint64_t x)
+  {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27))*0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+public:
+
+  CorsikaSampler(double p = 1., uint64_t s = 0) : prob(p), seed(s) {}
+
+  bool Active() const {return this->prob < 1.;}
+  double Probability() const {return this->prob;}
+  double Weight() const {return 1./this->prob;}
+
+  // Uniform number in [0,1) of the given counters
+  double Uniform(uint64_t run, uint64_t shower, uint64_t sub) const
+  {
+    const uint64_t x = Mix(Mix(Mix(Mix(this->seed) ^ run) ^ shower) ^ sub);
+    return (x >> 11)*(1./9007199254740992.);
+  }
+
+  bool Keep(uint64_t run, uint64_t shower, uint64_t sub) const
+  {
+    return !this->Active() || this->Uniform(run, shower, sub) < this->prob;
+  }
+
+};
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef __CLASS__CorsikaSerialize__
+#define __CLASS__CorsikaSerialize__ 1
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//
+// Helpers to write and read plain values to and from byte buffers, used by
+// the accumulators that are stored in ROOT files as byte vectors
+//
+template<class T> inline void CorsikaAppend(std::vector<char> & v, const T * p, size_t n = 1)
+{
+  const char * c = (const char *) p;
+  v.insert(v.end(), c, c + n*sizeof(T));
+}
+
+template<class T> inline bool CorsikaExtract(const std::vector<char> & v, size_t & pos, T * p, size_t n = 1)
+{
+  if (pos + n*sizeof(T) > v.size()) return false;
+  if (n > 0) std::memcpy(p, v.data() + pos, n*sizeof(T));
+  pos += n*sizeof(T);
+  return true;
+}
+
+// FNV-1a hash of plain values, chained through its last argument
+template<class T> inline uint64_t CorsikaHash(const T * p, size_t n = 1, uint64_t h = 14695981039346656037ULL)
+{
+  const unsigned char * c = (const unsigned char *) p;
+  for (size_t i = 0; i < n*sizeof(T); i++) h = (h ^ c[i])*1099511628211ULL;
+  return h;
+}
+
+#endif
@@ -6,6 +6,8 @@
 #include <cmath>
 
 #include <CorsikaClasses.h>
+#include <CorsikaBunches.h>
+#include <CorsikaParticles.h>
 
 class CorsikaShower
 {
@@ -16,19 +18,44 @@ private:
   CorsikaFile * filePtr;
 
   int iSubParticle;
+  long iCurSub;
 
   bool kGood;
   bool kDone;
 
   std::vector<float> vHeader;
   std::vector<float> vEnd;
-  std::vector<float> vCurSub;
+  const float * pCurSub;
 
   CorsikaShower(CorsikaFile&, bool good = true);
 
+  void NextParticleBlock();
+
 public:
 
   std::vector<float> NextParticle();
+  int NextBunches(CorsikaBunches &);
+
+  // Same as NextBunches(), for the shower of a DAT particle file
+  int NextParticles(CorsikaParticles &);
+
+  // Move to the next sub-block without decoding the current one
+  void SkipBunches();
+
+  // Move straight to the given sub-block, e.g. the end of the particle data
+  // known from an earlier pass, if the particle data ends there; the shower
+  // stays at its position otherwise
+  bool SkipTo(long);
+
+  // Decode the LONG sub-blocks that CORSIKA writes after the particle data
+  // of the shower into the given object. They are read from the given
+  // sub-block if they start there, e.g. the end of the particle data from a
+  // CorsikaBunchIndex; otherwise the sub-blocks up to them are read ahead,
+  // only checked for their tag. The shower stays at its position.
+  bool ReadLong(CorsikaLong &, long iLong = -1);
+
+  // Index in the file of the sub-block decoded by the next NextBunches()
+  long SubBlock(){return this->iCurSub;}
 
   bool Done(){return this->kDone;}
   bool Good(){return this->kGood;}
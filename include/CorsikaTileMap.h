@@ -0,0 +1,142 @@
+#pragma once
+#ifndef __CLASS__CorsikaTileMap__
+#define __CLASS__CorsikaTileMap__ 1
+
+#include <string>
+#include <vector>
+
+#include <TH2.h>
+
+class TDirectory;
+
+//
+// High resolution map of the photons at ground, split in square tiles that
+// are only allocated where photons land. A tile starts as a list of
+// (bin, weight) pairs and becomes a dense array once a third of its bins are
+// used, so that the sparse outskirts cost memory per bunch, not per bin.
+// With a memory bound, the weight that would need a new tile beyond it is
+// counted as dropped.
+// Positions in m, weights in photons. The contents are of type T: float for
+// the map of a shower (CorsikaTileMap), double for the sums of many showers
+// (CorsikaTileMapSum).
+//
+template<class T> class CorsikaTileMapT
+{
+private:
+
+  template<class U> friend class CorsikaTileMapT;
+
+  struct Tile
+  {
+    bool kDense;
+    unsigned int nCompact;
+    std::vector<unsigned short> vBin;
+    std::vector<T> vValue;
+  };
+
+  double binSize;
+  double halfSize;
+  int nBins;
+  int nTileBins;
+  int nTiles;
+
+  // Slot of each tile in the pool, -1 if not allocated, and the slots in use
+  std::vector<int> vSlot;
+  std::vector<int> vUsed;
+  std::vector<Tile> vPool;
+
+  double overflow;
+
+  int nMaxTiles;
+  double dropped;
+
+  bool Full(int slot){return this->vSlot[slot] < 0 && this->nMaxTiles >= 0 && int(this->vUsed.size()) >= this->nMaxTiles;}
+
+  Tile & GetTile(int);
+  void Compact(Tile &);
+  template<class S> void AddTile(int, const S &, double);
+
+public:
+
+  // Bin size, half size of the map and number of bins per side of a tile
+  CorsikaTileMapT(double bin = 0.1, double half = 1000., int tile = 64);
+
+  void Fill(double x, double y, double w)
+  {
+    const double fx = (x + this->halfSize)/this->binSize;
+    const double fy = (y + this->halfSize)/this->binSize;
+
+    // Written to also send NaN to the overflow
+    if (!(fx >= 0. && fx < this->nBins && fy >= 0. && fy < this->nBins))
+    {
+      this->overflow += w;
+      return;
+    }
+
+    const int ix = int(fx);
+    const int iy = int(fy);
+    const int slot = (iy/this->nTileBins)*this->nTiles + ix/this->nTileBins;
+
+    if (this->Full(slot))
+    {
+      this->dropped += w;
+      return;
+    }
+
+    Tile & t = this->GetTile(slot);
+    const int ib = (iy%this->nTileBins)*this->nTileBins + ix%this->nTileBins;
+
+    if (t.kDense)
+    {
+      t.vValue[ib] += w;
+      return;
+    }
+
+    t.vBin.push_back(ib);
+    t.vValue.push_back(w);
+    if (t.vBin.size() >= t.nCompact) this->Compact(t);
+  }
+
+  // Clear the contents, keeping the allocated tiles for reuse
+  void Reset();
+
+  // Add another map with the same binning, e.g. a shower to the average
+  template<class U> void Merge(CorsikaTileMapT<U> &, double scale = 1.);
+  void Scale(double);
+
+  int NTiles(){return this->vUsed.size();}
+
+  // Bytes of the tiles, each counted as a dense one, beyond which new tiles
+  // are not allocated (negative: no bound)
+  void SetMaxBytes(long);
+  double Dropped(){return this->dropped;}
+
+  // Bytes of the allocated tiles and of the tile table
+  long Bytes()
+  {
+    long n = (this->vSlot.capacity() + this->vUsed.capacity())*sizeof(int) + this->vPool.capacity()*sizeof(Tile);
+    for (auto & t : this->vPool) n += t.vBin.capacity()*sizeof(unsigned short) + t.vValue.capacity()*sizeof(T);
+    return n;
+  }
+  double Overflow(){return this->overflow;}
+  double Integral();
+
+  // Coarse histogram of the map, with the given bin size and half size in m
+  TH2D Coarse(double, double, std::string name = "");
+
+  // Compact binary form: for each tile, the sparse or dense contents,
+  // whichever is smaller, as values of type T. Written to ROOT files as a
+  // compressed byte array.
+  void Serialize(std::vector<char> &);
+  bool Deserialize(const std::vector<char> &);
+
+  // Number of objects written
+  int Write(TDirectory &, std::string);
+  bool Read(TDirectory &, std::string);
+
+};
+
+typedef CorsikaTileMapT<float> CorsikaTileMap;
+typedef CorsikaTileMapT<double> CorsikaTileMapSum;
+
+#endif
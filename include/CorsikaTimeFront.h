@@ -0,0 +1,104 @@
+#pragma once
+#ifndef __CLASS__CorsikaTimeFront__
+#define __CLASS__CorsikaTimeFront__ 1
+
+#include <string>
+#include <vector>
+
+class TDirectory;
+
+//
+// Shape of the cherenkov light front: arrival time of the photons relative
+// to the plane front through the core (ns), vs. distance to the shower axis
+// in the shower plane (m). It keeps a time histogram per radius bin, and
+// streaming moments of the time (weight, mean and sum of squared deviations,
+// updated as in West 1979) per emission age bin and radius bin, that merge
+// exactly between showers or threads (Chan et al.).
+//
+class CorsikaTimeFront
+{
+public:
+
+  static constexpr double kSpeedOfLight = 29.9792458; // cm/ns
+
+private:
+
+  int nRadius;
+  double radiusMax;
+  int nTime;
+  double timeMin;
+  double timeMax;
+  int nAge;
+
+  double fRadius;
+  double fTime;
+
+  std::vector<double> vHist;
+  std::vector<double> vWeight;
+  std::vector<double> vMean;
+  std::vector<double> vM2;
+
+  double overflow;
+
+public:
+
+  // Radius bins and maximum radius, time bins and range, age bins (0.1 wide)
+  CorsikaTimeFront(int nr = 40, double rmax = 200., int nt = 200, double t0 = -5., double t1 = 45., int na = 20);
+
+  void Fill(double radius, double age, double dt, double w)
+  {
+    const double fr = radius*this->fRadius;
+    const int ia = int(age*10.);
+
+    // Written to also send NaN to the overflow
+    if (!(fr >= 0. && fr < this->nRadius && ia >= 0 && ia < this->nAge && dt == dt))
+    {
+      this->overflow += w;
+      return;
+    }
+
+    const int ir = int(fr);
+    const double ft = (dt - this->timeMin)*this->fTime;
+    if (ft >= 0. && ft < this->nTime) this->vHist[ir*this->nTime + int(ft)] += w;
+
+    const int i = ia*this->nRadius + ir;
+    this->vWeight[i] += w;
+    const double d = dt - this->vMean[i];
+    this->vMean[i] += d*w/this->vWeight[i];
+    this->vM2[i] += w*d*(dt - this->vMean[i]);
+  }
+
+  void Reset();
+
+  // Add another front of the same binning
+  void Merge(const CorsikaTimeFront &);
+
+  // Scale the weights, e.g. by 1/number of showers; means and widths are unchanged
+  void Scale(double);
+
+  int NRadius(){return this->nRadius;}
+  int NTime(){return this->nTime;}
+  int NAge(){return this->nAge;}
+  double Overflow(){return this->overflow;}
+  long Bytes(){return (this->vHist.capacity() + this->vWeight.capacity() + this->vMean.capacity() + this->vM2.capacity())*sizeof(double);}
+
+  // Time histogram of a radius bin
+  double Hist(int ir, int it){return this->vHist[ir*this->nTime + it];}
+
+  // Weight, mean time and its standard deviation of a radius bin, for an age
+  // bin or all ages (ia < 0)
+  double Weight(int ir, int ia = -1);
+  double Mean(int ir, int ia = -1);
+  double Sigma(int ir, int ia = -1);
+
+  // Serialized for the cache and the checkpoints
+  void Serialize(std::vector<char> &);
+  bool Deserialize(const std::vector<char> &);
+
+  // As the histogram of the delays vs. radius (name) and the profile of their
+  // mean and RMS (name + "Profile"); number of objects written
+  int Write(TDirectory &, std::string);
+
+};
+
+#endif
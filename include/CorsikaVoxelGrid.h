@@ -0,0 +1,111 @@
+#pragma once
+#ifndef __CLASS__CorsikaVoxelGrid__
+#define __CLASS__CorsikaVoxelGrid__ 1
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <algorithm>
+
+#include <TH3.h>
+
+class TDirectory;
+
+//
+// Density of emission points around the shower axis: depth along the axis
+// (g/cm2) x distance to the axis (m) x azimuth around the axis (rad). The
+// voxels close to the axis, where most of the light is emitted, are a dense
+// array. The outer voxels are kept in a hash map of bounded size; weight
+// that would need a new outer voxel beyond the bound is counted as dropped.
+//
+class CorsikaVoxelGrid
+{
+private:
+
+  int nDepth;
+  double depthMin;
+  double depthMax;
+  int nDist;
+  double distMax;
+  int nAzim;
+  int nDense;
+  size_t nMaxSparse;
+
+  double fDepth;
+  double fDist;
+  double fAzim;
+
+  std::vector<double> vDense;
+  std::unordered_map<unsigned int,double> mSparse;
+
+  double overflow;
+  double dropped;
+
+  void AddSparse(unsigned int i, double w)
+  {
+    auto it = this->mSparse.find(i);
+    if (it != this->mSparse.end()) it->second += w;
+    else if (this->mSparse.size() < this->nMaxSparse) this->mSparse[i] = w;
+    else this->dropped += w;
+  }
+
+public:
+
+  // Depth bins and range, distance bins and maximum distance, azimuth bins,
+  // distance up to which voxels are dense and maximum number of outer voxels
+  CorsikaVoxelGrid(int nd = 120, double d0 = 0., double d1 = 1200., int nr = 500, double rmax = 500., int na = 36, double rdense = 50., size_t nsparse = 1<<20);
+
+  void Fill(double depth, double dist, double azim, double w)
+  {
+    const double fd = (depth - this->depthMin)*this->fDepth;
+    const double fr = dist*this->fDist;
+    const double fa = (azim + M_PI)*this->fAzim;
+
+    // Written to also send NaN to the overflow
+    if (!(fd >= 0. && fd < this->nDepth && fr >= 0. && fr < this->nDist))
+    {
+      this->overflow += w;
+      return;
+    }
+
+    const int id = int(fd);
+    const int ir = int(fr);
+    const int ia = fa >= 0. && fa < this->nAzim ? int(fa) : 0;
+
+    if (ir < this->nDense) this->vDense[(id*this->nDense + ir)*this->nAzim + ia] += w;
+    else this->AddSparse((id*this->nDist + ir)*this->nAzim + ia, w);
+  }
+
+  void Reset();
+
+  // Add another grid with the same binning, e.g. a shower to the average
+  void Merge(const CorsikaVoxelGrid &, double scale = 1.);
+  void Scale(double);
+
+  double Integral();
+  double Overflow(){return this->overflow;}
+  double Dropped(){return this->dropped;}
+  size_t NSparse(){return this->mSparse.size();}
+
+  // Bound the outer voxels to about the given bytes, with their hash nodes
+  // and up to two buckets each, if fewer than the bound they have
+  void SetMaxBytes(long n){this->nMaxSparse = std::min(this->nMaxSparse, size_t(std::max(0L, n))/(32 + 2*sizeof(void*)));}
+
+  // Bytes of the dense voxels and of the outer ones, with their hash nodes
+  long Bytes(){return this->vDense.capacity()*sizeof(double) + this->mSparse.size()*32 + this->mSparse.bucket_count()*sizeof(void*);}
+
+  // Dense histogram of the whole grid: x = depth, y = distance, z = azimuth
+  TH3D Histogram(std::string name = "");
+
+  // Nonzero voxels as (index, content) pairs, with the binning
+  void Serialize(std::vector<char> &);
+  bool Deserialize(const std::vector<char> &);
+
+  // Number of objects written
+  int Write(TDirectory &, std::string);
+  bool Read(TDirectory &, std::string);
+
+};
+
+#endif
@@ -0,0 +1,1369 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+#include <TDirectory.h>
+#include <TNtupleD.h>
+
+#include <CorsikaAnalysis.h>
+#include <CorsikaAtmosphere.h>
+#include <CorsikaCache.h>
+#include <CorsikaCheckpoint.h>
+#include <CorsikaEmissionModel.h>
+#include <CorsikaGHFit.h>
+#include <CorsikaLong.h>
+#include <CorsikaProfiler.h>
+#include <CorsikaSerialize.h>
+
+CorsikaAnalysis::CorsikaAnalysis(double r)
+: maxRadius(r)
+, filter(r*1.e2)
+, iAgeCut(0)
+, vSel(39)
+, vAge(39)
+, vTheta(39)
+, vDist(39)
+, vPosr(39)
+, vSlant(39)
+, vAzim(39)
+, hThetaAverage(20,TH1D("","",1000*18,0.,10.*18.))
+, hDistAverage(20,TH1D("","",1000,0.,1000.))
+, hGroundAverage("","",2*r,-r,r,2*r,-r,r)
+, hDensityAverage("","",r,0,r)
+, hDensitySigma("","",r,0,r)
+, kGridSet(false)
+, headerRows(CorsikaResultIndex::kNColumns)
+, nRefitPar(0)
+, nRefitThreads(1)
+, nMaxRefitBytes(0)
+, refitRows(13)
+, sampleProb(1.)
+, sampleWeight(1.)
+, sampleRows(6)
+, kParticles(false)
+, particleRows(1 + CorsikaParticles::kNGroups)
+, telescopeRows(8)
+, nShowers(0)
+, kRelease(false)
+, nHeldObjects(0)
+, nMaxBytes(0)
+, hParticleDensityShower(-1)
+, pCache(0)
+, vPartDefinition(kNParts)
+, vPartKey(kNParts, 0)
+, vCompute(kNParts, true)
+, hThetaFine(-1)
+, hGroundFine(-1)
+, iRun(0)
+, nSubKept(0), nSubSkipped(0)
+, samplePhotons(0.), sampleVar(0.)
+, iID(-1)
+, xmax(0.)
+, sinTheta(0.), cosTheta(1.), tanTheta(0.), sinPhi(0.), cosPhi(1.)
+, tCore(0.)
+{
+  // The emission age is the last cut, applied after the emission point is computed
+  this->iAgeCut = this->filter.AddCut("age");
+
+  // Histograms of the current shower, in consecutive handles
+  this->hThetaShower = this->arena.Book1D(1000,0.,10.);
+  for (int i=1; i<20; i++) this->arena.Book1D(1000,0.,10.);
+  this->hDistShower = this->arena.Book1D(1000,0.,1000.);
+  for (int i=1; i<20; i++) this->arena.Book1D(1000,0.,1000.);
+  this->hPhotonsAtGround = this->arena.Book2D(2*r/2,-r,r,2*r/2,-r,r);
+  this->hPhotonDensity = this->arena.Book1D(r,0.,r);
+
+  std::ostringstream sDef;
+  sDef << std::setprecision(17) << "cherenkov 2 r=" << r;
+  this->vPartDefinition[kPartCherenkov] = sDef.str();
+}
+
+
+
+void CorsikaAnalysis::BeginShower(const std::vector<float> & evth, const std::vector<double> & fit)
+{
+  // Same fields as the accessors of CorsikaShower
+  this->iID = int(evth[1]);
+  this->xmax = fit.size() > 2 ? fit[2] : -1.;
+
+  const float theta = evth[10];
+  const float phi = evth[11];
+
+  // Shower geometry, constant for all bunches
+  this->sinTheta = std::sin(theta);
+  this->cosTheta = std::cos(theta);
+  this->tanTheta = std::tan(theta);
+  this->sinPhi = std::sin(phi);
+  this->cosPhi = std::cos(phi);
+
+  // Times are counted from the first interaction, at height evth[6]
+  this->tCore = evth[6] > evth[47] ? (evth[6] - evth[47])/(CorsikaTimeFront::kSpeedOfLight*this->cosTheta) : 0.;
+
+  // Build the vector that will go to the header tree, in the one of the
+  // previous shower
+  this->vHeader.assign({double(this->iID), evth[3], evth[2], theta, phi, evth[47], evth[74], evth[75]});
+  this->vHeader.insert(this->vHeader.end(),fit.begin(),fit.end());
+  this->vHeader.resize(CorsikaResultIndex::kNColumns,0.);
+
+  this->headerRows.Add(this->iRun, this->vHeader);
+
+  this->nSubKept = 0;
+  this->nSubSkipped = 0;
+  this->samplePhotons = 0.;
+  this->sampleVar = 0.;
+
+  // Reset the histograms of the current shower
+  this->arena.Reset();
+  if (this->pGroundMap) this->pGroundMap->Reset();
+  if (this->pVoxels) this->pVoxels->Reset();
+  if (this->pTimeFront) this->pTimeFront->Reset();
+  if (this->pFootprint) this->pFootprint->Reset();
+  std::fill(this->vParticleCount.begin(), this->vParticleCount.end(), 0.);
+  for (auto & v : this->vProfPart) v.clear();
+  for (auto & v : this->vProfDep) v.clear();
+
+  // All parts are filled unless found in the cache
+  this->vCompute.assign(kNParts, true);
+}
+
+
+
+void CorsikaAnalysis::AddProfiles(CorsikaLong & clong)
+{
+  // Emission depths are slant, so is the Xmax used for the age
+  if (!clong.Slant()) this->xmax /= this->cosTheta;
+
+  // The rows of the profiles are those of the previous shower, refilled
+  for (int itype = 0; itype < 2; itype++)
+  {
+    auto & vProf = itype == 0 ? this->vProfPart : this->vProfDep;
+    vProf.resize(10);
+
+    // depths of the profiles
+    auto & vDepth = vProf[0];
+    if (!clong.FillProfile(this->iID,itype,0,vDepth) || vDepth.empty()) continue;
+    if (!clong.Slant())
+      for (auto & x : vDepth)
+        x = x/this->cosTheta;
+
+    for (int i=1; i<10; i++)
+    {
+      clong.FillProfile(this->iID,itype,i,vProf[i]);
+
+      // add the profile to the refit
+      if (this->pRefit)
+      {
+        this->pRefit->Add(vDepth, vProf[i]);
+        this->vRefitLabels.insert(this->vRefitLabels.end(), {double(this->iRun), double(this->iID), double(itype), double(i)});
+      }
+    }
+
+    // fit the profiles beyond the bound
+    if (this->pRefit && this->nMaxRefitBytes > 0 && this->pRefit->Bytes() + long(this->vRefitLabels.capacity()*sizeof(double)) > this->nMaxRefitBytes)
+      this->FitProfiles();
+
+    // add the profiles to the averages
+    auto & grid = this->kGridSet ? (itype == 0 ? this->gridPart : this->gridDep) : (itype == 0 ? this->mGridPart : this->mGridDep)[this->iRun];
+    grid.Add(vProf, this->xmax);
+  }
+}
+
+
+
+void CorsikaAnalysis::Fill(CorsikaBunches & bunches, CorsikaAtmosphere & catm)
+{
+  // Convention:
+  // cosu = sin(theta)*cos(phi)
+  // cosv = sin(theta)*sin(phi)
+  // distance in cm
+  // time in nsec
+
+  const int n = bunches.n;
+
+  // Weight of the bunches: 1/p of the sampling, cuts apply to the bunch sizes
+  const float wSample = this->sampleWeight;
+
+  // Parts of the shower still to fill, the others were found in the cache
+  const bool kCherenkov = this->vCompute[kPartCherenkov];
+  const bool kVoxels = this->pVoxels && this->vCompute[kPartVoxels];
+  const bool kTimeFront = this->pTimeFront && this->vCompute[kPartTimeFront];
+  if (kCherenkov) this->nSubKept++;
+
+  // The high resolution ground map and the telescopes reach beyond the
+  // radius cut, and are filled in one pass
+  const bool kGroundMap = this->pGroundMap && this->vCompute[kPartGroundMap];
+  const bool kTelescopes = this->pFootprint && this->vCompute[kPartTelescopes];
+  if (kGroundMap || kTelescopes)
+  {
+    CorsikaTimer timer(CorsikaProfiler::kFill);
+    const float w0 = this->filter.MinBunch();
+    for (int i = 0; i < n; i++)
+    {
+      if (!(bunches.bunch[i] > w0 && this->filter.InTime(bunches.nsec[i]))) continue;
+      if (kGroundMap) this->pGroundMap->Fill(bunches.posx[i]*1.e-2, bunches.posy[i]*1.e-2, bunches.bunch[i]*wSample);
+      if (kTelescopes) this->pFootprint->Fill(bunches.posx[i], bunches.posy[i], bunches.cosu[i], bunches.cosv[i], bunches.nsec[i] - this->tCore, bunches.bunch[i]*wSample);
+    }
+  }
+
+  if (!kCherenkov && !kVoxels && !kTimeFront) return;
+
+  // Apply the cheap cuts (weight, radius at ground, time)
+  int nSel = 0;
+  {
+    CorsikaTimer timer(CorsikaProfiler::kFilter);
+    if (this->filter.Apply(bunches) == 0) return;
+
+    for (int i = 0; i < n; i++)
+      if (bunches.mask[i]) this->vSel[nSel++] = i;
+  }
+
+  // Compute the emission point of the selected bunches and apply the age cut
+  int nAcc = 0;
+  {
+    CorsikaTimer timer(CorsikaProfiler::kGeometry);
+
+    for (int j = 0; j < nSel; j++)
+    {
+      const int i = this->vSel[j];
+
+      // Give friendly names to particle fields
+      const float & posx   = bunches.posx[i];
+      const float & posy   = bunches.posy[i];
+      const float & cosu   = bunches.cosu[i];
+      const float & cosv   = bunches.cosv[i];
+      const float & height = bunches.height[i];
+
+      // Project the emission height into the shower axis
+      float cosThetaEm = std::sqrt(1. - cosu*cosu - cosv*cosv);
+      float xem = posx - height*cosu/cosThetaEm;
+      float yem = posy - height*cosv/cosThetaEm;
+      float heightProj = this->cosTheta*this->cosTheta*(height - this->tanTheta*(xem*this->cosPhi + yem*this->sinPhi));
+
+      // Compute emission slant depth and emission age, the last cut
+      float depth = catm.SlantDepth(heightProj);
+      float age = 3./(1.+2.*this->xmax/depth);
+
+      if (age >= 2.)
+      {
+        this->filter.Reject(this->iAgeCut);
+        continue;
+      }
+
+      // Compute distance of emission point to shower, on the shower plane
+      float delta = this->sinTheta*(this->cosPhi*xem + this->sinPhi*yem) - this->cosTheta*height;
+
+      this->vSel[nAcc] = i;
+      this->vAge[nAcc] = age;
+      this->vPosr[nAcc] = std::sqrt(posx*posx + posy*posy);
+      this->vTheta[nAcc] = std::acos(cosThetaEm)*180./std::acos(-1.);
+      this->vDist[nAcc] = std::sqrt(xem*xem + yem*yem + height*height - delta*delta);
+
+      // Slant depth and azimuth of the emission point around the axis, in the
+      // shower plane, from the direction of the shower azimuth
+      if (this->pVoxels)
+      {
+        this->vSlant[nAcc] = depth;
+        this->vAzim[nAcc] = std::atan2(this->cosPhi*yem - this->sinPhi*xem, this->cosTheta*(this->cosPhi*xem + this->sinPhi*yem) + this->sinTheta*height);
+      }
+      nAcc++;
+    }
+  }
+
+  CorsikaProfiler::Count(CorsikaProfiler::kAccepted, nAcc);
+
+  // Fill histograms
+  CorsikaTimer timer(CorsikaProfiler::kFill);
+
+  // With a cache, the averages are summed per shower and added by EndShower()
+  const bool kFine = this->hThetaFine >= 0;
+
+  double total = 0.;
+  for (int j = 0; kCherenkov && j < nAcc; j++)
+  {
+    const int i = this->vSel[j];
+    const int iAge = (int)std::floor(this->vAge[j]*10.);
+
+    const float bunch = bunches.bunch[i]*wSample;
+    const float & posx  = bunches.posx[i];
+    const float & posy  = bunches.posy[i];
+
+    // Histograms with number of cherenkov photons vs. emission angle
+    if (kFine) this->arenaFine.Fill(this->hThetaFine + iAge,this->vTheta[j],bunch);
+    else this->hThetaAverage[iAge].Fill(this->vTheta[j],bunch);
+    this->arena.Fill(this->hThetaShower + iAge,this->vTheta[j],bunch);
+
+    // Histograms with number of cherenkov photons vs. perpendicular distance to axis
+    if (!kFine) this->hDistAverage[iAge].Fill(this->vDist[j]*1.e-2,bunch);
+    this->arena.Fill(this->hDistShower + iAge,this->vDist[j]*1.e-2,bunch);
+
+    // 2D histogram with photons at ground
+    this->arena.Fill(this->hPhotonsAtGround,posx*1.e-2,posy*1.e-2,bunch);
+    if (kFine) this->arenaFine.Fill(this->hGroundFine,posx*1.e-2,posy*1.e-2,bunch);
+    else this->hGroundAverage.Fill(posx*1.e-2,posy*1.e-2,bunch);
+
+    // Histogram of photon density vs. r
+    this->arena.Fill(this->hPhotonDensity,this->vPosr[j]*1.e-2,bunch);
+
+    total += bunches.bunch[i];
+  }
+
+  if (kVoxels)
+    for (int j = 0; j < nAcc; j++)
+      this->pVoxels->Fill(this->vSlant[j], this->vDist[j]*1.e-2, this->vAzim[j], bunches.bunch[this->vSel[j]]*wSample);
+
+  // Delay to the plane front, which reaches the ground point at the core
+  // time plus its projection on the axis over c, vs. distance to the axis
+  if (kTimeFront)
+  {
+    const double u = this->sinTheta*this->cosPhi;
+    const double v = this->sinTheta*this->sinPhi;
+    for (int j = 0; j < nAcc; j++)
+    {
+      const int i = this->vSel[j];
+      const double s = bunches.posx[i]*u + bunches.posy[i]*v;
+      const double r = std::sqrt(std::max(0., double(this->vPosr[j])*this->vPosr[j] - s*s));
+      const double dt = bunches.nsec[i] - this->tCore - s/CorsikaTimeFront::kSpeedOfLight;
+      this->pTimeFront->Fill(r*1.e-2, this->vAge[j], dt, bunches.bunch[i]*wSample);
+    }
+  }
+
+  // Horvitz-Thompson estimate of the accepted photons and of its variance,
+  // with the sub-blocks as sampling units
+  if (!kCherenkov) return;
+  this->samplePhotons += this->sampleWeight*total;
+  this->sampleVar += (1. - this->sampleProb)*this->sampleWeight*this->sampleWeight*total*total;
+}
+
+
+
+void CorsikaAnalysis::FillParticles(CorsikaParticles & particles)
+{
+  if (!this->vCompute[kPartParticles]) return;
+
+  CorsikaTimer timer(CorsikaProfiler::kFill);
+
+  for (int i = 0; i < particles.n; i++)
+  {
+    const int g = CorsikaParticles::GroupOf(particles.id[i]);
+    if (g < 0 || particles.level[i] != 1) continue;
+
+    const float r = std::sqrt(particles.x[i]*particles.x[i] + particles.y[i]*particles.y[i]);
+    this->arena.Fill(this->hParticleDensityShower + g, r*1.e-2, particles.weight[i]);
+    this->vParticleCount[g] += particles.weight[i];
+  }
+}
+
+
+
+void CorsikaAnalysis::EndShower(TDirectory & froot)
+{
+  CorsikaTimer timer(CorsikaProfiler::kRootIO);
+
+  std::string sEvent = "Event_" + std::to_string(this->iID);
+
+  // Parts filled for this shower go to the cache; the filter counts of a
+  // shower found in it are those it had when filled
+  if (this->pCache)
+  {
+    std::vector<char> v;
+    for (int p = 0; p < kNParts; p++)
+    {
+      if (!this->vCompute[p] || this->vPartDefinition[p].empty()) continue;
+      this->SavePart(p, v);
+      this->pCache->Put(this->vPartKey[p], v);
+    }
+    this->results.Add(this->iRun, this->vHeader, this->vPartKey);
+
+    if (!this->vCompute[kPartCherenkov])
+    {
+      auto vCounters = this->vCountersBegin;
+      for (size_t i = 0; i < vCounters.size() && i < this->vCountersCached.size(); i++) vCounters[i] += this->vCountersCached[i];
+      this->filter.SetCounters(vCounters);
+    }
+  }
+
+  if (this->sampleProb < 1.)
+    this->sampleRows.Add(this->iRun, {double(this->iID), this->sampleProb, double(this->nSubKept + this->nSubSkipped), double(this->nSubKept), this->samplePhotons, std::sqrt(this->sampleVar)});
+
+  // Objects and directories written for this shower, with its directory
+  long nObjects = 1;
+
+  // Profiles
+  const std::string sProfDir[2] = {"/ParticleProfiles","/DepositProfiles"};
+  for (int itype = 0; itype < 2; itype++)
+  {
+    auto & vProf = itype == 0 ? this->vProfPart : this->vProfDep;
+    if (vProf.empty() || vProf[0].empty()) continue;
+
+    froot.mkdir((sEvent + sProfDir[itype]).c_str());
+    froot.cd((sEvent + sProfDir[itype]).c_str());
+    nObjects++;
+
+    for (int i=1; i<10; i++, nObjects++) this->WriteGraph(vProf[0], vProf[i], CorsikaLong::ColumnName(itype,i).c_str());
+  }
+
+  // Write histograms of this shower to output file
+  froot.mkdir((sEvent + "/EmissionAngle").c_str());
+  froot.cd((sEvent + "/EmissionAngle").c_str());
+  nObjects++;
+  for (int i=0; i<20; i++, nObjects++) this->arena.Write(this->hThetaShower + i, std::to_string(i).c_str());
+
+  froot.mkdir((sEvent + "/EmissionDist").c_str());
+  froot.cd((sEvent + "/EmissionDist").c_str());
+  nObjects++;
+  for (int i=0; i<20; i++, nObjects++) this->arena.Write(this->hDistShower + i, std::to_string(i).c_str());
+
+  froot.cd(sEvent.c_str());
+  this->arena.Write(this->hPhotonsAtGround, "PhotonsAtGround");
+  nObjects++;
+
+  this->Normalize(this->hPhotonDensity);
+
+  froot.cd(sEvent.c_str());
+  this->arena.Write(this->hPhotonDensity, "PhotonDensity");
+  nObjects++;
+
+  if (this->pGroundMap)
+  {
+    TDirectory * pEvent = froot.GetDirectory(sEvent.c_str());
+    if (pEvent) nObjects += this->pGroundMap->Write(*pEvent, "GroundMap");
+    this->pGroundMapAverage->Merge(*this->pGroundMap);
+  }
+
+  if (this->pVoxels)
+  {
+    TDirectory * pEvent = froot.GetDirectory(sEvent.c_str());
+    if (pEvent) nObjects += this->pVoxels->Write(*pEvent, "EmissionVoxels");
+    this->pVoxelsAverage->Merge(*this->pVoxels);
+  }
+
+  if (this->pTimeFront)
+  {
+    TDirectory * pEvent = froot.GetDirectory(sEvent.c_str());
+    if (pEvent) nObjects += this->pTimeFront->Write(*pEvent, "TimeFront");
+    this->pTimeFrontAverage->Merge(*this->pTimeFront);
+  }
+
+  // Ground particles, as densities per m2 like the photons
+  if (this->kParticles)
+  {
+    froot.mkdir((sEvent + "/ParticleDensity").c_str());
+    froot.cd((sEvent + "/ParticleDensity").c_str());
+    nObjects++;
+    for (int g = 0; g < CorsikaParticles::kNGroups; g++, nObjects++)
+    {
+      const int h = this->hParticleDensityShower + g;
+      this->Normalize(h);
+      this->arena.Write(h, CorsikaParticles::GroupName(g));
+      this->arena.AddTo(h, this->hParticleDensityAverage[g]);
+    }
+
+    std::vector<double> vRow = {double(this->iID)};
+    vRow.insert(vRow.end(), this->vParticleCount.begin(), this->vParticleCount.end());
+    this->particleRows.Add(this->iRun, vRow);
+  }
+
+  // Telescopes, all of them also without photons
+  if (this->pFootprint)
+  {
+    CorsikaFootprint & fp = *this->pFootprint;
+    for (int i = 0; i < fp.NTelescopes(); i++)
+    {
+      this->telescopeRows.Add(this->iRun, {double(this->iID), double(i+1), fp.Photons(i), fp.Bunches(i), fp.Mean(i), fp.Sigma(i), fp.First(i), fp.Last(i)});
+      this->hTelescopeAverage.Fill(i+1, fp.Photons(i));
+    }
+  }
+
+  this->arena.AddTo(this->hPhotonDensity, this->hDensityAverage);
+  this->arena.AddTo(this->hPhotonDensity, this->hDensitySigma, true);
+
+  // With a cache, the averages of a shower found in it are added by UseCache()
+  if (this->hThetaFine >= 0)
+  {
+    for (int i=0; i<20; i++) this->arena.AddTo(this->hDistShower + i, this->hDistAverage[i]);
+    if (this->vCompute[kPartCherenkov])
+    {
+      for (int i=0; i<20; i++) this->arenaFine.AddTo(this->hThetaFine + i, this->hThetaAverage[i]);
+      this->arenaFine.AddTo(this->hGroundFine, this->hGroundAverage);
+    }
+  }
+
+  froot.cd();
+
+  // Objects and directories of the shower, in memory until the file is closed
+  // unless the directory is closed now, which writes and deletes them
+  TDirectory * pEvent = froot.GetDirectory(sEvent.c_str());
+  if (this->kRelease && pEvent) pEvent->Close();
+  else this->nHeldObjects += nObjects;
+
+  this->nShowers++;
+}
+
+
+
+//
+// Fit the profiles of the refit not fit yet, all at once, and move the
+// results to the rows of the GHFit tuple, with the run of each
+//
+void CorsikaAnalysis::FitProfiles()
+{
+  if (!this->pRefit || this->pRefit->NFits() == 0) return;
+
+  CorsikaGHFit & ghfit = *this->pRefit;
+  ghfit.Fit(this->nRefitThreads);
+
+  for (int i = 0; i < ghfit.NFits(); i++)
+  {
+    std::vector<double> vRow(this->vRefitLabels.begin() + 4*i + 1, this->vRefitLabels.begin() + 4*i + 4);
+    vRow.push_back(ghfit.NPar());
+    auto vPar = ghfit.GetParameters(i);
+    vRow.insert(vRow.end(), vPar.begin(), vPar.end());
+    vRow.push_back(ghfit.GetChi2(i));
+    vRow.push_back(ghfit.GetNdof(i));
+    vRow.push_back(ghfit.GetStatus(i));
+    this->refitRows.Add(int(this->vRefitLabels[4*i]), vRow);
+  }
+
+  this->pRefit.reset(new CorsikaGHFit(this->nRefitPar));
+  this->vRefitLabels.clear();
+  this->vRefitLabels.shrink_to_fit();
+}
+
+
+
+void CorsikaAnalysis::Compact()
+{
+  this->FitProfiles();
+
+  for (auto p : {&this->headerRows, &this->refitRows, &this->sampleRows, &this->particleRows, &this->telescopeRows}) p->Spill();
+  this->results.Spill();
+}
+
+
+
+void CorsikaAnalysis::SetMaxBytes(long n)
+{
+  this->nMaxBytes = n;
+  this->Bound();
+}
+
+
+
+//
+// The rows of the tuples in use, the profiles waiting for the refit and the
+// result index share a quarter of the bound, or all of it without maps; the
+// sums of the ground map and of the voxels share the rest. The maps of the
+// current shower are bounded apart, their dropped weight goes to the sums.
+//
+void CorsikaAnalysis::Bound()
+{
+  if (this->nMaxBytes <= 0) return;
+
+  std::vector<CorsikaRows*> vRows = {&this->headerRows};
+  if (this->nRefitPar > 0) vRows.push_back(&this->refitRows);
+  if (this->sampleProb < 1.) vRows.push_back(&this->sampleRows);
+  if (this->kParticles) vRows.push_back(&this->particleRows);
+  if (this->pFootprint) vRows.push_back(&this->telescopeRows);
+
+  const int nMaps = (this->pGroundMapAverage ? 1 : 0) + (this->pVoxelsAverage ? 1 : 0);
+  const long nRowBytes = nMaps > 0 ? this->nMaxBytes/4 : this->nMaxBytes;
+  const long nShare = nRowBytes/(vRows.size() + (this->pRefit ? 1 : 0) + (this->pCache ? 1 : 0));
+  for (auto p : vRows) p->SetMaxBytes(nShare);
+  if (this->pRefit) this->nMaxRefitBytes = nShare;
+  if (this->pCache) this->results.SetMaxBytes(nShare);
+
+  if (this->pGroundMapAverage) this->pGroundMapAverage->SetMaxBytes((this->nMaxBytes - nRowBytes)/nMaps);
+  if (this->pVoxelsAverage) this->pVoxelsAverage->SetMaxBytes((this->nMaxBytes - nRowBytes)/nMaps);
+
+  // The maps of the current shower share three quarters of as much again
+  if (this->pGroundMap) this->pGroundMap->SetMaxBytes(3*this->nMaxBytes/(4*std::max(nMaps, 1)));
+  if (this->pVoxels) this->pVoxels->SetMaxBytes(3*this->nMaxBytes/(4*std::max(nMaps, 1)));
+}
+
+
+
+long CorsikaAnalysis::Bytes(bool kFilled)
+{
+  auto hist = [kFilled](TH1 & h){return long(h.GetNcells())*sizeof(double)*(kFilled || h.GetSumw2N() > 0 ? 2 : 1);};
+  auto rows = [](std::vector<std::vector<double>> & v)
+  {
+    long n = v.capacity()*sizeof(std::vector<double>);
+    for (auto & row : v) n += row.capacity()*sizeof(double);
+    return n;
+  };
+
+  long n = this->arena.Bytes() + this->arenaFine.Bytes();
+  for (auto & h : this->hThetaAverage) n += hist(h);
+  for (auto & h : this->hDistAverage) n += hist(h);
+  for (auto & h : this->hParticleDensityAverage) n += hist(h);
+  n += hist(this->hGroundAverage) + hist(this->hDensityAverage) + hist(this->hDensitySigma);
+  n += this->gridPart.Bytes() + this->gridDep.Bytes();
+  for (auto & p : this->mGridPart) n += p.second.Bytes();
+  for (auto & p : this->mGridDep) n += p.second.Bytes();
+
+  if (this->pGroundMap) n += this->pGroundMap->Bytes() + this->pGroundMapAverage->Bytes();
+  if (this->pVoxels) n += this->pVoxels->Bytes() + this->pVoxelsAverage->Bytes();
+  if (this->pTimeFront) n += this->pTimeFront->Bytes() + this->pTimeFrontAverage->Bytes();
+
+  if (this->pFootprint) n += this->pFootprint->Bytes() + hist(this->hTelescopeAverage);
+
+  if (this->pRefit) n += this->pRefit->Bytes() + this->vRefitLabels.capacity()*sizeof(double);
+  n += this->headerRows.Bytes() + this->vHeader.capacity()*sizeof(double) + this->refitRows.Bytes() + this->sampleRows.Bytes() + this->particleRows.Bytes() + this->telescopeRows.Bytes();
+  n += rows(this->vProfPart) + rows(this->vProfDep);
+  n += this->results.Bytes();
+
+  return n;
+}
+
+
+
+long CorsikaAnalysis::OutputBytes()
+{
+  // A key with its names, or a directory, as kept in memory by ROOT
+  static const long nObjectBytes = 512;
+  return this->nHeldObjects*nObjectBytes;
+}
+
+
+
+//
+// Density per m2 of a radial histogram of the arena, without errors
+//
+void CorsikaAnalysis::Normalize(int h)
+{
+  double * c = this->arena.Contents(h);
+  double * e = this->arena.Sumw2(h);
+  for (int i=1; i<=this->arena.NBinsX(h); i++)
+  {
+    double xleft = this->arena.BinLowEdge(h,i);
+    double xright = this->arena.BinLowEdge(h,i+1);
+    c[i] = c[i]/(std::acos(-1.)*(xright*xright-xleft*xleft));
+    e[i] = 0.;
+  }
+}
+
+
+
+//
+// Write a profile with the reused graph, which only reallocates when the
+// number of points changes
+//
+void CorsikaAnalysis::WriteGraph(const std::vector<double> & x, const std::vector<double> & y, const char * name)
+{
+  const int n = std::min(x.size(), y.size());
+  this->gProfile.Set(n);
+  std::copy(x.begin(), x.begin() + n, this->gProfile.GetX());
+  std::copy(y.begin(), y.begin() + n, this->gProfile.GetY());
+  this->gProfile.Write(name);
+}
+
+
+
+//
+// A grid with the grids of the runs added in the order of the runs: without
+// a grid set, the first run gives the nodes
+//
+static CorsikaProfileGrid MergeRuns(const CorsikaProfileGrid & grid, const std::map<int,CorsikaProfileGrid> & mRuns)
+{
+  CorsikaProfileGrid g = grid;
+  for (auto & p : mRuns) g.Merge(p.second);
+  return g;
+}
+
+
+
+void CorsikaAnalysis::Write(TDirectory & froot)
+{
+  CorsikaTimer timer(CorsikaProfiler::kRootIO);
+
+  //
+  // Finish computation of average particle profiles and write them to the output file
+  //
+  const std::string sProfDir[2] = {"Average/ParticleProfiles","Average/DepositProfiles"};
+  this->gridPart = MergeRuns(this->gridPart, this->mGridPart);
+  this->gridDep = MergeRuns(this->gridDep, this->mGridDep);
+  this->mGridPart.clear();
+  this->mGridDep.clear();
+  for (int itype = 0; itype < 2; itype++)
+  {
+    // The LONG sub-blocks of CER files have no energy deposit table
+    auto & grid = itype == 0 ? this->gridPart : this->gridDep;
+    if (!grid.Filled()) continue;
+
+    froot.mkdir(sProfDir[itype].c_str());
+    froot.cd(sProfDir[itype].c_str());
+    for (int i=0; i<9; i++)
+    {
+      this->WriteGraph(grid.Nodes(), grid.Average(i), CorsikaLong::ColumnName(itype,i+1).c_str());
+    }
+  }
+
+  //
+  // Finish computations of histograms with averages and write to output file
+  //
+  for(int i=0; i<20; i++)
+  {
+    this->hThetaAverage[i].Scale(1./double(this->nShowers));
+    this->hDistAverage[i].Scale(1./double(this->nShowers));
+  }
+  froot.mkdir("Average/EmissionAngle");
+  froot.cd("Average/EmissionAngle");
+  for(int i=0; i<20; i++) this->hThetaAverage[i].Write(std::to_string(i).c_str());
+  froot.mkdir("Average/EmissionDist");
+  froot.cd("Average/EmissionDist");
+  for(int i=0; i<20; i++) this->hDistAverage[i].Write(std::to_string(i).c_str());
+
+  froot.cd("Average");
+
+  this->hGroundAverage.Scale(1./double(this->nShowers));
+  this->hGroundAverage.Write("PhotonsAtGround");
+
+  this->hDensityAverage.Scale(1./double(this->nShowers));
+  this->hDensityAverage.Write("PhotonDensity");
+
+  this->hDensitySigma.Scale(1./double(this->nShowers));
+  auto hDensityAverageSquared = this->hDensityAverage;
+  hDensityAverageSquared.Multiply(&hDensityAverageSquared);
+  this->hDensitySigma.Add(&hDensityAverageSquared,-1.);
+  for (int i=1; i<=this->hDensitySigma.GetNbinsX(); i++) this->hDensitySigma.SetBinContent(i,std::sqrt(this->hDensitySigma.GetBinContent(i)));
+  this->hDensitySigma.Write("PhotonDensitySigma");
+
+  if (this->pGroundMapAverage)
+  {
+    this->pGroundMapAverage->Scale(1./double(this->nShowers));
+    TDirectory * pAverage = froot.GetDirectory("Average");
+    if (pAverage) this->pGroundMapAverage->Write(*pAverage, "GroundMap");
+    if (this->pGroundMapAverage->Dropped() > 0.)
+      std::cerr << "CorsikaAnalysis::Write(): the ground maps lack " << this->pGroundMapAverage->Dropped() << " photons per shower, in tiles beyond their memory bound." << std::endl;
+  }
+
+  if (this->pVoxelsAverage)
+  {
+    this->pVoxelsAverage->Scale(1./double(this->nShowers));
+    TDirectory * pAverage = froot.GetDirectory("Average");
+    if (pAverage) this->pVoxelsAverage->Write(*pAverage, "EmissionVoxels");
+    if (this->pVoxelsAverage->Dropped() > 0.)
+      std::cerr << "CorsikaAnalysis::Write(): the emission voxels lack " << this->pVoxelsAverage->Dropped() << " photons per shower, in outer voxels beyond their bound." << std::endl;
+  }
+
+  if (this->pTimeFrontAverage)
+  {
+    this->pTimeFrontAverage->Scale(1./double(this->nShowers));
+    TDirectory * pAverage = froot.GetDirectory("Average");
+    if (pAverage) this->pTimeFrontAverage->Write(*pAverage, "TimeFront");
+  }
+
+  if (this->kParticles)
+  {
+    froot.mkdir("Average/ParticleDensity");
+    froot.cd("Average/ParticleDensity");
+    for (int g = 0; g < CorsikaParticles::kNGroups; g++)
+    {
+      this->hParticleDensityAverage[g].Scale(1./double(this->nShowers));
+      this->hParticleDensityAverage[g].Write(CorsikaParticles::GroupName(g));
+    }
+  }
+
+  if (this->pFootprint)
+  {
+    froot.cd("Average");
+    this->hTelescopeAverage.Scale(1./double(this->nShowers));
+    this->hTelescopeAverage.Write("TelescopePhotons");
+  }
+
+  // Header tree (tuple), in the order of the runs and IDs whatever the
+  // order in which the reader threads took the files, as the other tuples
+  froot.cd();
+  TNtupleD theader("Header","Header","ID:Energy:Primary:Theta:Phi:ObsLvl:LEmod:HEmod:Fit0:Fit1:Fit2:Fit3:Fit4:Fit5:FitChi2ndof:FitDev");
+  this->headerRows.Fill(theader);
+  theader.Write();
+
+  // Gaisser-Hillas refit of all profiles; Status is that of CorsikaGHFit:
+  // -1 not fit, 0 converged, 1 too many iterations, 2 failed, 3 stalled
+  if (this->nRefitPar > 0)
+  {
+    this->FitProfiles();
+
+    TNtupleD tfit("GHFit","GHFit","ID:Type:Column:NPar:Nmax:X0:Xmax:P4:P5:P6:Chi2:Ndof:Status");
+    this->refitRows.Fill(tfit);
+    tfit.Write();
+  }
+
+  // Ground particles per shower
+  if (this->kParticles)
+  {
+    TNtupleD tpart("GroundParticles","GroundParticles","ID:Gammas:Electrons:Muons:Hadrons");
+    this->particleRows.Fill(tpart);
+    tpart.Write();
+  }
+
+  // Photons and arrival times per shower and telescope
+  if (this->pFootprint)
+  {
+    TNtupleD ttel("Telescopes","Telescopes","ID:Telescope:Photons:Bunches:TimeMean:TimeSigma:TimeFirst:TimeLast");
+    this->telescopeRows.Fill(ttel);
+    ttel.Write();
+  }
+
+  // Sampled totals per shower
+  if (this->sampleProb < 1.)
+  {
+    TNtupleD tsample("Sampling","Sampling","ID:Prob:NSubBlocks:NKept:Photons:PhotonsSigma");
+    this->sampleRows.Fill(tsample);
+    tsample.Write();
+  }
+}
+
+
+
+void CorsikaAnalysis::Merge(CorsikaAnalysis & other)
+{
+  if (other.nShowers == 0) return;
+
+  for (int i=0; i<20; i++)
+  {
+    this->hThetaAverage[i].Add(&other.hThetaAverage[i]);
+    this->hDistAverage[i].Add(&other.hDistAverage[i]);
+  }
+  this->hGroundAverage.Add(&other.hGroundAverage);
+  this->hDensityAverage.Add(&other.hDensityAverage);
+  this->hDensitySigma.Add(&other.hDensitySigma);
+  if (this->pGroundMapAverage && other.pGroundMapAverage) this->pGroundMapAverage->Merge(*other.pGroundMapAverage);
+  if (this->pVoxelsAverage && other.pVoxelsAverage) this->pVoxelsAverage->Merge(*other.pVoxelsAverage);
+  if (this->pTimeFrontAverage && other.pTimeFrontAverage) this->pTimeFrontAverage->Merge(*other.pTimeFrontAverage);
+  if (this->kParticles && other.kParticles)
+    for (int g = 0; g < CorsikaParticles::kNGroups; g++) this->hParticleDensityAverage[g].Add(&other.hParticleDensityAverage[g]);
+  if (this->pFootprint && other.pFootprint) this->hTelescopeAverage.Add(&other.hTelescopeAverage);
+
+  this->gridPart.Merge(other.gridPart);
+  this->gridDep.Merge(other.gridDep);
+  for (auto & p : other.mGridPart) this->mGridPart[p.first].Merge(p.second);
+  for (auto & p : other.mGridDep) this->mGridDep[p.first].Merge(p.second);
+
+  this->headerRows.Merge(other.headerRows);
+  this->FitProfiles();
+  other.FitProfiles();
+  this->refitRows.Merge(other.refitRows);
+  this->sampleRows.Merge(other.sampleRows);
+  this->particleRows.Merge(other.particleRows);
+  this->telescopeRows.Merge(other.telescopeRows);
+  this->results.Merge(other.results);
+
+  this->filter.Merge(other.filter);
+
+  this->nShowers += other.nShowers;
+  this->nHeldObjects += other.nHeldObjects;
+}
+
+
+
+void CorsikaAnalysis::EnableGroundMap(double bin, double half)
+{
+  this->pGroundMap.reset(new CorsikaTileMap(bin, half));
+  this->pGroundMapAverage.reset(new CorsikaTileMapSum(bin, half));
+
+  std::ostringstream sDef;
+  sDef << std::setprecision(17) << "ground_map 2 bin=" << bin << " half=" << half;
+  this->vPartDefinition[kPartGroundMap] = sDef.str();
+}
+
+
+
+void CorsikaAnalysis::EnableVoxels()
+{
+  this->pVoxels.reset(new CorsikaVoxelGrid());
+  this->pVoxelsAverage.reset(new CorsikaVoxelGrid());
+
+  this->vPartDefinition[kPartVoxels] = "voxels 1";
+}
+
+
+
+void CorsikaAnalysis::EnableTimeFront()
+{
+  const int nr = std::max(1, int(this->maxRadius/5.));
+  this->pTimeFront.reset(new CorsikaTimeFront(nr, 5.*nr));
+  this->pTimeFrontAverage.reset(new CorsikaTimeFront(nr, 5.*nr));
+
+  this->vPartDefinition[kPartTimeFront] = "time_front 1 nr=" + std::to_string(nr);
+}
+
+
+
+void CorsikaAnalysis::EnableParticles()
+{
+  const double r = this->maxRadius;
+  this->kParticles = true;
+  this->hParticleDensityAverage.assign(CorsikaParticles::kNGroups, TH1D("","",r,0.,r));
+  this->hParticleDensityShower = this->arena.Book1D(r,0.,r);
+  for (int g = 1; g < CorsikaParticles::kNGroups; g++) this->arena.Book1D(r,0.,r);
+  this->vParticleCount.assign(CorsikaParticles::kNGroups, 0.);
+
+  std::ostringstream sDef;
+  sDef << std::setprecision(17) << "particles 1 r=" << r;
+  this->vPartDefinition[kPartParticles] = sDef.str();
+}
+
+
+
+void CorsikaAnalysis::EnableTelescopes(const CorsikaFootprint & footprint)
+{
+  const int n = footprint.NTelescopes();
+  this->pFootprint.reset(new CorsikaFootprint(footprint));
+  this->hTelescopeAverage = TH1D("","",n,0.5,n+0.5);
+
+  this->vPartDefinition[kPartTelescopes] = "telescopes 1 " + this->pFootprint->Definition();
+}
+
+
+
+void CorsikaAnalysis::SetProfileGrid(int type, int n, double min, double max)
+{
+  this->kGridSet = true;
+  this->gridPart.SetGrid(type, n, min, max);
+  this->gridDep.SetGrid(type, n, min, max);
+}
+
+
+
+void CorsikaAnalysis::SetSampling(double p)
+{
+  this->sampleProb = p;
+  this->sampleWeight = 1./p;
+}
+
+
+
+void CorsikaAnalysis::SetCache(CorsikaCache * p, std::string context)
+{
+  this->pCache = p;
+  this->sCacheContext = context;
+  this->results.SetCacheDir(p->Dir());
+
+  // Per-shower sums of the averages, at their binning
+  if (this->hThetaFine < 0)
+  {
+    const double r = this->maxRadius;
+    this->hThetaFine = this->arenaFine.Book1D(1000*18,0.,10.*18.);
+    for (int i=1; i<20; i++) this->arenaFine.Book1D(1000*18,0.,10.*18.);
+    this->hGroundFine = this->arenaFine.Book2D(2*r,-r,r,2*r,-r,r);
+  }
+}
+
+
+
+//
+// The shower is identified by everything its bunches are filled with: its
+// header (which holds the run, the event number and the random seeds), the
+// Xmax of the emission ages, the core time and the slant depths. Particles
+// only depend on the header.
+//
+bool CorsikaAnalysis::UseCache(const std::vector<float> & evth, CorsikaAtmosphere & catm)
+{
+  if (!this->pCache) return true;
+
+  const uint64_t hHeader = CorsikaHash(evth.data(), evth.size());
+  const uint64_t hAtmosphere = catm.Hash();
+  uint64_t hShower = CorsikaHash(&this->xmax, 1, hHeader);
+  hShower = CorsikaHash(&this->tCore, 1, hShower);
+  hShower = CorsikaHash(&hAtmosphere, 1, hShower);
+
+  const std::string sBunches = " " + this->filter.Definition() + " " + this->sCacheContext;
+
+  this->vCountersBegin = this->filter.GetCounters();
+
+  bool kBunches = false;
+  std::vector<char> v;
+  for (int p = 0; p < kNParts; p++)
+  {
+    this->vCompute[p] = !this->vPartDefinition[p].empty();
+    if (!this->vCompute[p]) continue;
+
+    const std::string sDef = this->vPartDefinition[p] + (p == kPartParticles ? "" : sBunches);
+    this->vPartKey[p] = CorsikaHash(sDef.data(), sDef.size(), p == kPartParticles ? hHeader : hShower);
+
+    if (this->pCache->Get(this->vPartKey[p], v) && this->LoadPart(p, v)) this->vCompute[p] = false;
+    else if (p != kPartParticles) kBunches = true;
+  }
+
+  if (this->vCompute[kPartCherenkov]) this->arenaFine.Reset();
+
+  return kBunches;
+}
+
+
+
+//
+// The results of a part for the current shower, before EndShower()
+// normalizes them. The cherenkov part starts with the offsets of the
+// histograms that queryCorsika reads (see CorsikaResultIndex::Locate()).
+//
+void CorsikaAnalysis::SavePart(int p, std::vector<char> & v)
+{
+  static_assert(int(kPartCherenkov) == int(CorsikaResultIndex::kPartCherenkov), "part of the result index");
+
+  v.clear();
+
+  if (p == kPartCherenkov)
+  {
+    CorsikaResultIndex::BeginLayout(v);
+    for (int i=0; i<20; i++) this->arena.Append(this->hThetaShower + i, v);
+    for (int i=0; i<20; i++)
+    {
+      CorsikaResultIndex::SetOffset(v, CorsikaResultIndex::kEmissionDist + i);
+      this->arena.Append(this->hDistShower + i, v);
+    }
+    this->arena.Append(this->hPhotonsAtGround, v);
+    CorsikaResultIndex::SetOffset(v, CorsikaResultIndex::kPhotonDensity);
+    this->arena.Append(this->hPhotonDensity, v);
+    auto vCounters = this->filter.GetCounters();
+    for (size_t i = 0; i < vCounters.size() && i < this->vCountersBegin.size(); i++) vCounters[i] -= this->vCountersBegin[i];
+    const unsigned long n = vCounters.size();
+    CorsikaAppend(v, &n);
+    CorsikaAppend(v, vCounters.data(), n);
+
+    CorsikaAppend(v, &this->nSubKept);
+    CorsikaAppend(v, &this->nSubSkipped);
+    CorsikaAppend(v, &this->samplePhotons);
+    CorsikaAppend(v, &this->sampleVar);
+
+    for (int i=0; i<20; i++)
+    {
+      CorsikaResultIndex::SetOffset(v, CorsikaResultIndex::kEmissionAngle + i);
+      this->arenaFine.Append(this->hThetaFine + i, v);
+    }
+    this->arenaFine.Append(this->hGroundFine, v);
+  }
+  else if (p == kPartGroundMap) this->pGroundMap->Serialize(v);
+  else if (p == kPartVoxels) this->pVoxels->Serialize(v);
+  else if (p == kPartTimeFront) this->pTimeFront->Serialize(v);
+  else if (p == kPartTelescopes) this->pFootprint->Serialize(v);
+  else if (p == kPartParticles)
+  {
+    for (int g = 0; g < CorsikaParticles::kNGroups; g++) this->arena.Append(this->hParticleDensityShower + g, v);
+    const unsigned long n = this->vParticleCount.size();
+    CorsikaAppend(v, &n);
+    CorsikaAppend(v, this->vParticleCount.data(), n);
+  }
+}
+
+
+
+//
+// A part that can not be read back is left empty, to be filled again
+//
+bool CorsikaAnalysis::LoadPart(int p, const std::vector<char> & v)
+{
+  size_t pos = 0;
+  bool ok = true;
+
+  if (p == kPartCherenkov)
+  {
+    std::vector<long> vOffsets;
+    ok = CorsikaResultIndex::Locate(v.data(), v.size(), vOffsets);
+    pos = CorsikaResultIndex::LayoutBytes();
+
+    for (int i=0; i<20; i++) ok = ok && this->arena.Extract(this->hThetaShower + i, v, pos);
+    for (int i=0; i<20; i++) ok = ok && this->arena.Extract(this->hDistShower + i, v, pos);
+    ok = ok && this->arena.Extract(this->hPhotonsAtGround, v, pos);
+    ok = ok && this->arena.Extract(this->hPhotonDensity, v, pos);
+
+    unsigned long n = 0;
+    ok = ok && CorsikaExtract(v, pos, &n) && n == this->vCountersBegin.size();
+    this->vCountersCached.assign(ok ? n : 0, 0.);
+    ok = ok && CorsikaExtract(v, pos, this->vCountersCached.data(), n);
+
+    ok = ok && CorsikaExtract(v, pos, &this->nSubKept) && CorsikaExtract(v, pos, &this->nSubSkipped);
+    ok = ok && CorsikaExtract(v, pos, &this->samplePhotons) && CorsikaExtract(v, pos, &this->sampleVar);
+
+    // The averages, added at once if they all can be read
+    size_t end = pos;
+    for (int i=0; i<21; i++) ok = ok && CorsikaResultArena::ExtractTo(v, end, 0);
+    for (int i=0; ok && i<20; i++) CorsikaResultArena::ExtractTo(v, pos, &this->hThetaAverage[i]);
+    if (ok) CorsikaResultArena::ExtractTo(v, pos, &this->hGroundAverage);
+
+    if (!ok)
+    {
+      this->arena.Reset();
+      this->nSubKept = this->nSubSkipped = 0;
+      this->samplePhotons = this->sampleVar = 0.;
+    }
+  }
+  else if (p == kPartGroundMap) ok = this->pGroundMap->Deserialize(v);
+  else if (p == kPartVoxels) ok = this->pVoxels->Deserialize(v);
+  else if (p == kPartTimeFront) ok = this->pTimeFront->Deserialize(v);
+  else if (p == kPartTelescopes) ok = this->pFootprint->Deserialize(v);
+  else if (p == kPartParticles)
+  {
+    for (int g = 0; g < CorsikaParticles::kNGroups; g++) ok = ok && this->arena.Extract(this->hParticleDensityShower + g, v, pos);
+
+    unsigned long n = 0;
+    ok = ok && CorsikaExtract(v, pos, &n) && n == this->vParticleCount.size();
+    ok = ok && CorsikaExtract(v, pos, this->vParticleCount.data(), n);
+
+    if (!ok) std::fill(this->vParticleCount.begin(), this->vParticleCount.end(), 0.);
+  }
+
+  return ok;
+}
+
+
+
+void CorsikaAnalysis::EnableRefit(int npar, int nThreads)
+{
+  this->nRefitPar = npar;
+  this->nRefitThreads = nThreads;
+  this->pRefit.reset(new CorsikaGHFit(npar));
+}
+
+
+
+//
+// Rows of the tables: histograms rebinned, smoothed with a binomial kernel
+// and normalized to unit integral, as probability densities per unit of x
+//
+static CorsikaEmissionModel::Table EmissionTable(std::string name, std::string xname, std::vector<TH1D> & vHist, int rebin, int nSmooth)
+{
+  const int nAge = vHist.size();
+  const int nIn = vHist[0].GetNbinsX();
+  const int nOut = nIn/rebin;
+  const double xmin = vHist[0].GetBinLowEdge(1);
+  const double width = rebin*(vHist[0].GetBinLowEdge(nIn+1) - xmin)/nIn;
+
+  CorsikaEmissionModel::Table t(name, {
+    CorsikaEmissionModel::MakeAxis("age", nAge, 0.05, 0.05 + 0.1*(nAge-1)),
+    CorsikaEmissionModel::MakeAxis(xname, nOut, xmin + 0.5*width, xmin + (nOut-0.5)*width)
+  });
+
+  std::vector<double> v(nOut), w(nOut);
+  for (int ia = 0; ia < nAge; ia++)
+  {
+    std::fill(v.begin(), v.end(), 0.);
+    for (int i = 0; i < nOut*rebin; i++) v[i/rebin] += vHist[ia].GetBinContent(i+1);
+
+    for (int k = 0; k < nSmooth; k++)
+    {
+      for (int i = 0; i < nOut; i++)
+      {
+        const double l = v[i > 0 ? i-1 : i];
+        const double r = v[i < nOut-1 ? i+1 : i];
+        w[i] = 0.25*l + 0.5*v[i] + 0.25*r;
+      }
+      v.swap(w);
+    }
+
+    double sum = 0.;
+    for (auto x : v) sum += x;
+
+    float * row = t.Data() + long(ia)*nOut;
+    for (int i = 0; i < nOut; i++) row[i] = sum > 0. ? v[i]/(sum*width) : 0.;
+  }
+
+  return t;
+}
+
+
+
+bool CorsikaAnalysis::WriteTables(std::string s, int angleRebin, int nSmooth)
+{
+  CorsikaEmissionModel model;
+  model.Add(EmissionTable("EmissionAngle", "theta", this->hThetaAverage, angleRebin, nSmooth));
+  model.Add(EmissionTable("EmissionDist", "dist", this->hDistAverage, 1, nSmooth));
+
+  if (!model.Write(s))
+  {
+    std::cerr << "CorsikaAnalysis::WriteTables(): could not write " << s << "." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+
+std::vector<int> CorsikaAnalysis::ShowerIDs()
+{
+  std::vector<int> v;
+  this->headerRows.ForEach([&v](int, const double * p){v.push_back(int(p[0]));});
+  return v;
+}
+
+
+
+//
+// The state is stored as sums over the showers written so far
+//
+void CorsikaAnalysis::Save(CorsikaCheckpoint & ckpt)
+{
+  ckpt.Set("nShowers", {double(this->nShowers)});
+
+  for (int i=0; i<20; i++)
+  {
+    ckpt.SetHist("EmissionAngle/" + std::to_string(i), this->hThetaAverage[i]);
+    ckpt.SetHist("EmissionDist/" + std::to_string(i), this->hDistAverage[i]);
+  }
+  ckpt.SetHist("PhotonsAtGround", this->hGroundAverage);
+  ckpt.SetHist("PhotonDensity", this->hDensityAverage);
+  ckpt.SetHist("PhotonDensitySigma", this->hDensitySigma);
+
+  if (this->pGroundMapAverage)
+  {
+    std::vector<char> v;
+    this->pGroundMapAverage->Serialize(v);
+    ckpt.SetBytes("GroundMap", v);
+  }
+
+  if (this->pVoxelsAverage)
+  {
+    std::vector<char> v;
+    this->pVoxelsAverage->Serialize(v);
+    ckpt.SetBytes("EmissionVoxels", v);
+  }
+
+  if (this->pTimeFrontAverage)
+  {
+    std::vector<char> v;
+    this->pTimeFrontAverage->Serialize(v);
+    ckpt.SetBytes("TimeFront", v);
+  }
+
+  {
+    // The runs of the checkpoint, or of the shard, as one grid
+    std::vector<char> v;
+    MergeRuns(this->gridPart, this->mGridPart).Serialize(v);
+    ckpt.SetBytes("ParticleProfiles", v);
+    MergeRuns(this->gridDep, this->mGridDep).Serialize(v);
+    ckpt.SetBytes("DepositProfiles", v);
+  }
+
+  // Header rows and their runs, flattened
+  this->headerRows.Save(ckpt, "Header");
+
+  // Refit: the profiles not fit yet are fit now, and only the rows saved
+  if (this->nRefitPar > 0)
+  {
+    this->FitProfiles();
+    this->refitRows.Save(ckpt, "RefitRows");
+  }
+
+  if (this->sampleProb < 1.) this->sampleRows.Save(ckpt, "Sampling");
+
+  if (this->kParticles)
+  {
+    this->particleRows.Save(ckpt, "GroundParticles");
+    for (int g = 0; g < CorsikaParticles::kNGroups; g++)
+      ckpt.SetHist(std::string("ParticleDensity/") + CorsikaParticles::GroupName(g), this->hParticleDensityAverage[g]);
+  }
+
+  if (this->pFootprint)
+  {
+    this->telescopeRows.Save(ckpt, "Telescopes");
+    ckpt.SetHist("TelescopePhotons", this->hTelescopeAverage);
+  }
+
+  if (this->results.NShowers() > 0)
+  {
+    std::vector<char> v;
+    this->results.Serialize(v);
+    ckpt.SetBytes("Results", v);
+  }
+
+  ckpt.Set("Filter", this->filter.GetCounters());
+}
+
+
+
+bool CorsikaAnalysis::Load(CorsikaCheckpoint & ckpt)
+{
+  if (!ckpt.Has("nShowers") || !ckpt.Has("Header"))
+  {
+    std::cerr << "CorsikaAnalysis::Load(): the checkpoint has no analysis state." << std::endl;
+    return false;
+  }
+
+  bool ok = true;
+
+  for (int i=0; i<20; i++)
+  {
+    ok &= ckpt.GetHist("EmissionAngle/" + std::to_string(i), this->hThetaAverage[i]);
+    ok &= ckpt.GetHist("EmissionDist/" + std::to_string(i), this->hDistAverage[i]);
+  }
+  ok &= ckpt.GetHist("PhotonsAtGround", this->hGroundAverage);
+  ok &= ckpt.GetHist("PhotonDensity", this->hDensityAverage);
+  ok &= ckpt.GetHist("PhotonDensitySigma", this->hDensitySigma);
+
+  if (this->pGroundMapAverage)
+  {
+    std::vector<char> v;
+    ok &= ckpt.GetBytes("GroundMap", v) && this->pGroundMapAverage->Deserialize(v);
+  }
+
+  if (this->pVoxelsAverage)
+  {
+    std::vector<char> v;
+    ok &= ckpt.GetBytes("EmissionVoxels", v) && this->pVoxelsAverage->Deserialize(v);
+  }
+
+  if (this->pTimeFrontAverage)
+  {
+    std::vector<char> v;
+    ok &= ckpt.GetBytes("TimeFront", v) && this->pTimeFrontAverage->Deserialize(v);
+  }
+
+  if (!ok) return false;
+
+  // Without a grid set, the profiles are those of the current run (a
+  // resumed file) or of the first run of the shard
+  std::vector<char> vPart, vDep;
+  this->mGridPart.clear();
+  this->mGridDep.clear();
+  auto & gPart = this->kGridSet ? this->gridPart : this->mGridPart[this->iRun];
+  auto & gDep = this->kGridSet ? this->gridDep : this->mGridDep[this->iRun];
+  if (!ckpt.GetBytes("ParticleProfiles", vPart) || !gPart.Deserialize(vPart)) return false;
+  if (!ckpt.GetBytes("DepositProfiles", vDep) || !gDep.Deserialize(vDep)) return false;
+
+  if (!this->headerRows.Load(ckpt, "Header", this->iRun)) return false;
+
+  this->refitRows.Clear();
+  if (this->nRefitPar > 0 && ckpt.Has("RefitRows") && !this->refitRows.Load(ckpt, "RefitRows", this->iRun)) return false;
+
+  // The profiles not fit yet were fit by Save()
+  if (this->nRefitPar > 0)
+  {
+    this->pRefit.reset(new CorsikaGHFit(this->nRefitPar));
+    this->vRefitLabels.clear();
+  }
+
+  this->sampleRows.Clear();
+  if (this->sampleProb < 1. && !this->sampleRows.Load(ckpt, "Sampling", this->iRun)) return false;
+
+  this->particleRows.Clear();
+  if (this->kParticles)
+  {
+    if (!this->particleRows.Load(ckpt, "GroundParticles", this->iRun)) return false;
+    for (int g = 0; g < CorsikaParticles::kNGroups; g++)
+      if (!ckpt.GetHist(std::string("ParticleDensity/") + CorsikaParticles::GroupName(g), this->hParticleDensityAverage[g])) return false;
+  }
+
+  this->telescopeRows.Clear();
+  if (this->pFootprint)
+  {
+    if (!this->telescopeRows.Load(ckpt, "Telescopes", this->iRun)) return false;
+    if (!ckpt.GetHist("TelescopePhotons", this->hTelescopeAverage)) return false;
+  }
+
+  // The showers read with a cache, also when the run goes on without it
+  std::vector<char> vResults;
+  if (ckpt.Has("Results") && (!ckpt.GetBytes("Results", vResults) || !this->results.Deserialize(vResults))) return false;
+
+  this->filter.SetCounters(ckpt.Get("Filter"));
+
+  this->nShowers = int(ckpt.Get("nShowers")[0]);
+
+  // The voxels are restored with the bound they were saved with
+  this->Bound();
+
+  return true;
+}
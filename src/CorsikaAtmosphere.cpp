@@ -1,14 +1,31 @@
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <algorithm>
 
 #include <CorsikaAtmosphere.h>
 #include <CorsikaFile.h>
+#include <CorsikaSerialize.h>
 
 CorsikaAtmosphere::CorsikaAtmosphere(CorsikaFile & cfile)
 : a(0), b(0), c(0), h(0), d(0)
+, slantHmin(0.)
+, slantInvStep(1./kTableStep)
+, cosZenith(1.)
 {
-  if (cfile.Good()) this->Initialize(cfile);
+  if (cfile.Good()) this->Initialize(cfile.GetHeader());
+  return;
+}
+
+
+
+CorsikaAtmosphere::CorsikaAtmosphere(const std::vector<float> & vRunHeader)
+: a(0), b(0), c(0), h(0), d(0)
+, slantHmin(0.)
+, slantInvStep(1./kTableStep)
+, cosZenith(1.)
+{
+  if (vRunHeader.size() > 268) this->Initialize(vRunHeader);
   return;
 }
 
@@ -16,22 +33,25 @@ CorsikaAtmosphere::CorsikaAtmosphere(CorsikaFile & cfile)
 
 CorsikaAtmosphere::CorsikaAtmosphere(std::string s)
 : a(0), b(0), c(0), h(0), d(0)
+, slantHmin(0.)
+, slantInvStep(1./kTableStep)
+, cosZenith(1.)
 {
   CorsikaFile cfile(s);
-  if (cfile.Good()) this->Initialize(cfile);
+  if (cfile.Good()) this->Initialize(cfile.GetHeader());
   return;
 }
 
 
 
-void CorsikaAtmosphere::Initialize(CorsikaFile &cfile)
+void CorsikaAtmosphere::Initialize(const std::vector<float> & vRunHeader)
 {
   for (int i=0; i<5; i++)
   {
-    this->h.push_back(cfile.GetHeader(249+i));
-    this->a.push_back(cfile.GetHeader(254+i));
-    this->b.push_back(cfile.GetHeader(259+i));
-    this->c.push_back(cfile.GetHeader(264+i));
+    this->h.push_back(vRunHeader[249+i]);
+    this->a.push_back(vRunHeader[254+i]);
+    this->b.push_back(vRunHeader[259+i]);
+    this->c.push_back(vRunHeader[264+i]);
   }
 
   for (int i=0; i<5; i++) this->d.push_back(this->Depth(this->h[i]));
@@ -96,3 +116,66 @@ double CorsikaAtmosphere::Density_vs_depth(double depth)
 {
   return this->Density_vs_height(this->Height(depth));
 }
+
+
+
+//
+// Flat: X(h) = Depth(h)/cos(theta) at the nodes. Curved: a point of the axis
+// at distance s from the core is at height h with (R+h)^2 = (R+hc)^2 + s^2 +
+// 2s(R+hc)cos(theta), so X(h) is the integral from h to the top of
+//
+//   rho(h') ds/dh' = rho(h') (R+h')/sqrt((R+hc)^2 cos^2(theta) + (h'-hc)(2R+h'+hc))
+//
+// done by Simpson's rule per cell, downwards from the top of the atmosphere.
+//
+void CorsikaAtmosphere::SetShower(double theta, double hcore, bool curved)
+{
+  this->cosZenith = std::cos(theta);
+  this->vSlant.clear();
+  if (this->h.size() < 5 || !(this->cosZenith > 0.)) return;
+
+  // The top of the atmosphere, where the depth of the last layer vanishes
+  const double hTop = this->a[4]*this->c[4]/this->b[4];
+  this->slantHmin = std::max(this->h[0], hcore);
+  if (!(hTop > this->slantHmin)) return;
+
+  const long n = long(std::ceil((hTop - this->slantHmin)/kTableStep)) + 1;
+  this->vSlant.resize(n);
+
+  if (!curved)
+  {
+    for (long i = 0; i < n; i++) this->vSlant[i] = std::max(0., this->Depth(this->slantHmin + i*kTableStep))/this->cosZenith;
+    return;
+  }
+
+  const double R = kEarthRadius;
+  const double rc2 = (R + hcore)*(R + hcore)*this->cosZenith*this->cosZenith;
+  auto f = [&](double x)
+  {
+    const double q = rc2 + (x - hcore)*(2.*R + x + hcore);
+    return q > 0. ? this->Density_vs_height(x)*(R + x)/std::sqrt(q) : 0.;
+  };
+
+  this->vSlant[n-1] = std::max(0., this->Depth(this->slantHmin + (n-1)*kTableStep))/this->cosZenith;
+  for (long i = n-2; i >= 0; i--)
+  {
+    const double x0 = this->slantHmin + i*kTableStep;
+    const double x1 = x0 + kTableStep;
+    this->vSlant[i] = this->vSlant[i+1] + kTableStep/6.*(f(x0) + 4.*f(0.5*(x0 + x1)) + f(x1));
+  }
+}
+
+
+
+uint64_t CorsikaAtmosphere::Hash()
+{
+  uint64_t h = CorsikaHash(this->a.data(), this->a.size());
+  h = CorsikaHash(this->b.data(), this->b.size(), h);
+  h = CorsikaHash(this->c.data(), this->c.size(), h);
+  h = CorsikaHash(this->h.data(), this->h.size(), h);
+  h = CorsikaHash(this->d.data(), this->d.size(), h);
+  h = CorsikaHash(this->vSlant.data(), this->vSlant.size(), h);
+  h = CorsikaHash(&this->slantHmin, 1, h);
+  h = CorsikaHash(&this->slantInvStep, 1, h);
+  return CorsikaHash(&this->cosZenith, 1, h);
+}
@@ -0,0 +1,18 @@
+#include <CorsikaBlockReader.h>
+
+//
+// Runtime dispatch to the reader specialized for the block layout
+//
+CorsikaBlockReader * CorsikaBlockReader::Create(std::ifstream & s, bool thin, bool markers)
+{
+  if (thin)
+  {
+    if (markers) return new CorsikaBlockReaderT<true,true>(s);
+    else         return new CorsikaBlockReaderT<true,false>(s);
+  }
+  else
+  {
+    if (markers) return new CorsikaBlockReaderT<false,true>(s);
+    else         return new CorsikaBlockReaderT<false,false>(s);
+  }
+}
@@ -0,0 +1,291 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include <CorsikaBunchIndex.h>
+
+static const char sIndexMagic[4] = {'C','I','D','X'};
+static const int iIndexVersion = 1;
+
+CorsikaBunchIndex::CorsikaBunchIndex(double cell, int n)
+: cellSize(cell)
+, nCells(n)
+, halfSize(0.5*cell*n)
+, nFileSubBlocks(0)
+, vBuild(n*n+1)
+, iBuildID(-1)
+, iBuildFirst(0)
+{
+}
+
+
+
+//
+// Index of the cell of a position, the last one being the overflow cell
+//
+int CorsikaBunchIndex::Cell(float x, float y)
+{
+  const double fx = (x + this->halfSize)/this->cellSize;
+  const double fy = (y + this->halfSize)/this->cellSize;
+
+  // Written to also send NaN to the overflow cell
+  if (!(fx >= 0. && fx < this->nCells && fy >= 0. && fy < this->nCells)) return this->nCells*this->nCells;
+
+  return int(fy)*this->nCells + int(fx);
+}
+
+
+
+void CorsikaBunchIndex::BeginShower(int id, long first)
+{
+  for (auto & v : this->vBuild) v.clear();
+  this->iBuildID = id;
+  this->iBuildFirst = first;
+}
+
+
+
+void CorsikaBunchIndex::Add(long iSub, const CorsikaBunches & b)
+{
+  const unsigned int rel = iSub - this->iBuildFirst;
+
+  for (int i = 0; i < b.n; i++)
+  {
+    // Empty slots at the end of a sub-block have zero weight
+    if (!(b.bunch[i] > 0.f)) continue;
+
+    // Sub-blocks come in order, so a repeated entry is always the last one
+    auto & v = this->vBuild[this->Cell(b.posx[i], b.posy[i])];
+    if (v.empty() || v.back() != rel) v.push_back(rel);
+  }
+}
+
+
+
+void CorsikaBunchIndex::EndShower(long end)
+{
+  if (this->iBuildID < 0) return;
+
+  // Compressed rows: the sub-blocks of cell i are vSubs[vCellStart[i]..vCellStart[i+1])
+  Shower s;
+  s.id = this->iBuildID;
+  s.first = this->iBuildFirst;
+  s.nsub = end - this->iBuildFirst;
+  s.vCellStart.push_back(0);
+  for (auto & v : this->vBuild)
+  {
+    s.vSubs.insert(s.vSubs.end(), v.begin(), v.end());
+    s.vCellStart.push_back(s.vSubs.size());
+  }
+
+  if (this->mShowers.count(s.id)) this->vShowers[this->mShowers[s.id]] = s;
+  else
+  {
+    this->mShowers[s.id] = this->vShowers.size();
+    this->vShowers.push_back(s);
+  }
+
+  this->iBuildID = -1;
+}
+
+
+
+std::map<int,long> CorsikaBunchIndex::Headers()
+{
+  std::map<int,long> m;
+  for (auto & s : this->vShowers) m[s.id] = s.first - 1;
+  return m;
+}
+
+
+
+long CorsikaBunchIndex::End(int id)
+{
+  if (!this->Has(id)) return -1;
+
+  const Shower & s = this->vShowers[this->mShowers[id]];
+  return s.first + s.nsub;
+}
+
+
+
+std::vector<long> CorsikaBunchIndex::Collect(int id, const std::vector<int> & vCells)
+{
+  std::vector<long> vOut;
+  if (!this->Has(id)) return vOut;
+
+  const Shower & s = this->vShowers[this->mShowers[id]];
+  for (auto c : vCells)
+    for (unsigned int k = s.vCellStart[c]; k < s.vCellStart[c+1]; k++)
+      vOut.push_back(s.first + s.vSubs[k]);
+
+  std::sort(vOut.begin(), vOut.end());
+  vOut.erase(std::unique(vOut.begin(), vOut.end()), vOut.end());
+
+  return vOut;
+}
+
+
+
+std::vector<long> CorsikaBunchIndex::Box(int id, double x0, double x1, double y0, double y1)
+{
+  std::vector<int> vCells;
+
+  const int n = this->nCells;
+  int ix0 = std::max(0, int(std::floor((x0 + this->halfSize)/this->cellSize)));
+  int ix1 = std::min(n-1, int(std::floor((x1 + this->halfSize)/this->cellSize)));
+  int iy0 = std::max(0, int(std::floor((y0 + this->halfSize)/this->cellSize)));
+  int iy1 = std::min(n-1, int(std::floor((y1 + this->halfSize)/this->cellSize)));
+
+  for (int iy = iy0; iy <= iy1; iy++)
+    for (int ix = ix0; ix <= ix1; ix++)
+      vCells.push_back(iy*n + ix);
+
+  if (x0 < -this->halfSize || x1 >= this->halfSize || y0 < -this->halfSize || y1 >= this->halfSize)
+    vCells.push_back(n*n);
+
+  return this->Collect(id, vCells);
+}
+
+
+
+std::vector<long> CorsikaBunchIndex::Annulus(int id, double x, double y, double rMin, double rMax)
+{
+  std::vector<int> vCells;
+
+  const int n = this->nCells;
+  for (int iy = 0; iy < n; iy++)
+  {
+    const double cy0 = iy*this->cellSize - this->halfSize;
+    const double cy1 = cy0 + this->cellSize;
+    const double dyMin = y < cy0 ? cy0 - y : (y > cy1 ? y - cy1 : 0.);
+    const double dyMax = std::max(std::fabs(y - cy0), std::fabs(y - cy1));
+
+    for (int ix = 0; ix < n; ix++)
+    {
+      const double cx0 = ix*this->cellSize - this->halfSize;
+      const double cx1 = cx0 + this->cellSize;
+      const double dxMin = x < cx0 ? cx0 - x : (x > cx1 ? x - cx1 : 0.);
+      const double dxMax = std::max(std::fabs(x - cx0), std::fabs(x - cx1));
+
+      // The cell overlaps the annulus if its nearest point is inside the
+      // outer circle and its farthest point outside the inner one
+      if (dxMin*dxMin + dyMin*dyMin < rMax*rMax && dxMax*dxMax + dyMax*dyMax >= rMin*rMin)
+        vCells.push_back(iy*n + ix);
+    }
+  }
+
+  if (x - rMax < -this->halfSize || x + rMax > this->halfSize || y - rMax < -this->halfSize || y + rMax > this->halfSize)
+    vCells.push_back(n*n);
+
+  return this->Collect(id, vCells);
+}
+
+
+
+//
+// Write to a temporary file and rename it over the target
+//
+bool CorsikaBunchIndex::Write(std::string s)
+{
+  std::string sTmp = s + ".tmp";
+
+  FILE * f = std::fopen(sTmp.c_str(), "wb");
+  if (!f)
+  {
+    std::cerr << "CorsikaBunchIndex::Write(): could not open " << sTmp << "." << std::endl;
+    return false;
+  }
+
+  bool ok = true;
+  long n = this->vShowers.size();
+  ok &= std::fwrite(sIndexMagic, 1, 4, f) == 4;
+  ok &= std::fwrite(&iIndexVersion, sizeof(int), 1, f) == 1;
+  ok &= std::fwrite(&this->cellSize, sizeof(double), 1, f) == 1;
+  ok &= std::fwrite(&this->nCells, sizeof(int), 1, f) == 1;
+  ok &= std::fwrite(&this->nFileSubBlocks, sizeof(long), 1, f) == 1;
+  ok &= std::fwrite(&n, sizeof(long), 1, f) == 1;
+
+  for (auto & sh : this->vShowers)
+  {
+    long nSubs = sh.vSubs.size();
+    ok &= std::fwrite(&sh.id, sizeof(int), 1, f) == 1;
+    ok &= std::fwrite(&sh.first, sizeof(long), 1, f) == 1;
+    ok &= std::fwrite(&sh.nsub, sizeof(long), 1, f) == 1;
+    ok &= std::fwrite(&nSubs, sizeof(long), 1, f) == 1;
+    ok &= std::fwrite(sh.vCellStart.data(), sizeof(unsigned int), sh.vCellStart.size(), f) == sh.vCellStart.size();
+    ok &= std::fwrite(sh.vSubs.data(), sizeof(unsigned int), nSubs, f) == nSubs;
+  }
+
+  ok &= std::fclose(f) == 0;
+
+  if (!ok || std::rename(sTmp.c_str(), s.c_str()) != 0)
+  {
+    std::cerr << "CorsikaBunchIndex::Write(): could not write " << s << "." << std::endl;
+    std::remove(sTmp.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+
+bool CorsikaBunchIndex::Read(std::string s)
+{
+  FILE * f = std::fopen(s.c_str(), "rb");
+  if (!f) return false;
+
+  char magic[4];
+  int version = 0;
+  long n = 0;
+
+  bool ok = std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, sIndexMagic, 4) == 0;
+  ok = ok && std::fread(&version, sizeof(int), 1, f) == 1 && version == iIndexVersion;
+  ok = ok && std::fread(&this->cellSize, sizeof(double), 1, f) == 1 && this->cellSize > 0.;
+  ok = ok && std::fread(&this->nCells, sizeof(int), 1, f) == 1 && this->nCells > 0;
+  ok = ok && std::fread(&this->nFileSubBlocks, sizeof(long), 1, f) == 1;
+  ok = ok && std::fread(&n, sizeof(long), 1, f) == 1 && n >= 0;
+
+  this->halfSize = 0.5*this->cellSize*this->nCells;
+  this->vShowers.clear();
+  this->mShowers.clear();
+
+  const long nStart = long(this->nCells)*this->nCells + 2;
+
+  for (long i = 0; ok && i < n; i++)
+  {
+    Shower sh;
+    long nSubs = 0;
+    ok = std::fread(&sh.id, sizeof(int), 1, f) == 1;
+    ok = ok && std::fread(&sh.first, sizeof(long), 1, f) == 1;
+    ok = ok && std::fread(&sh.nsub, sizeof(long), 1, f) == 1;
+    ok = ok && std::fread(&nSubs, sizeof(long), 1, f) == 1 && nSubs >= 0;
+    sh.vCellStart.resize(ok ? nStart : 0);
+    ok = ok && std::fread(sh.vCellStart.data(), sizeof(unsigned int), nStart, f) == nStart;
+    ok = ok && sh.vCellStart.back() == nSubs;
+    sh.vSubs.resize(ok ? nSubs : 0);
+    ok = ok && std::fread(sh.vSubs.data(), sizeof(unsigned int), nSubs, f) == nSubs;
+
+    if (ok)
+    {
+      this->mShowers[sh.id] = this->vShowers.size();
+      this->vShowers.push_back(sh);
+    }
+  }
+
+  std::fclose(f);
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaBunchIndex::Read(): " << s << " is not a valid index file." << std::endl;
+    this->vShowers.clear();
+    this->mShowers.clear();
+  }
+
+  this->vBuild.assign(long(this->nCells)*this->nCells + 1, std::vector<unsigned int>());
+
+  return ok;
+}
@@ -0,0 +1,195 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <thread>
+#include <functional>
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <CorsikaCache.h>
+
+static const char sCacheMagic[4] = {'C','C','H','E'};
+static const int iCacheVersion = 1;
+
+// Magic, version, key and size before the bytes of an entry
+static const long kHeaderBytes = 4 + sizeof(int) + sizeof(uint64_t) + sizeof(long);
+
+CorsikaCache::CorsikaCache(std::string s)
+: sDir(s)
+, kGood(false)
+, nHits(0)
+, nMisses(0)
+, nStored(0)
+{
+  if (!this->sDir.empty() && this->sDir.back() != '/') this->sDir += "/";
+
+  struct stat st;
+  if (stat(this->sDir.c_str(), &st) != 0) mkdir(this->sDir.c_str(), 0755);
+  this->kGood = stat(this->sDir.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && access(this->sDir.c_str(), W_OK) == 0;
+
+  // The absolute path, which is saved in the result indexes
+  char sPath[PATH_MAX];
+  if (this->kGood && realpath(this->sDir.c_str(), sPath)) this->sDir = std::string(sPath) + "/";
+
+  if (!this->kGood) std::cerr << "CorsikaCache::CorsikaCache(): could not use " << this->sDir << " as cache directory." << std::endl;
+}
+
+
+
+//
+// Entries are spread over 256 subdirectories by the first byte of the key
+//
+std::string CorsikaCache::FileName(uint64_t key)
+{
+  std::ostringstream s;
+  s << std::hex << std::setfill('0') << std::setw(16) << key;
+  return this->sDir + s.str().substr(0,2) + "/" + s.str();
+}
+
+
+
+bool CorsikaCache::Get(uint64_t key, std::vector<char> & v)
+{
+  FILE * f = this->kGood ? std::fopen(this->FileName(key).c_str(), "rb") : 0;
+  if (!f)
+  {
+    this->nMisses++;
+    return false;
+  }
+
+  char magic[4];
+  int version = 0;
+  uint64_t stored = 0;
+  long n = 0;
+
+  bool ok = std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, sCacheMagic, 4) == 0;
+  ok = ok && std::fread(&version, sizeof(int), 1, f) == 1 && version == iCacheVersion;
+  ok = ok && std::fread(&stored, sizeof(uint64_t), 1, f) == 1 && stored == key;
+  ok = ok && std::fread(&n, sizeof(long), 1, f) == 1 && n >= 0;
+  if (ok) v.resize(n);
+  ok = ok && long(std::fread(v.data(), 1, n, f)) == n;
+
+  std::fclose(f);
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaCache::Get(): " << this->FileName(key) << " is not a valid cache entry, it will be computed again." << std::endl;
+    v.clear();
+    this->nMisses++;
+    return false;
+  }
+
+  this->nHits++;
+  return true;
+}
+
+
+
+//
+// Write to a temporary file of this process and thread, and rename it
+//
+bool CorsikaCache::Put(uint64_t key, const std::vector<char> & v)
+{
+  if (!this->kGood) return false;
+
+  std::string s = this->FileName(key);
+  mkdir(s.substr(0, s.rfind('/')).c_str(), 0755);
+
+  std::ostringstream sTmp;
+  sTmp << s << ".tmp" << getpid() << "_" << std::hash<std::thread::id>()(std::this_thread::get_id());
+
+  FILE * f = std::fopen(sTmp.str().c_str(), "wb");
+  if (!f)
+  {
+    std::cerr << "CorsikaCache::Put(): could not open " << sTmp.str() << "." << std::endl;
+    return false;
+  }
+
+  bool ok = true;
+  long n = v.size();
+  ok &= std::fwrite(sCacheMagic, 1, 4, f) == 4;
+  ok &= std::fwrite(&iCacheVersion, sizeof(int), 1, f) == 1;
+  ok &= std::fwrite(&key, sizeof(uint64_t), 1, f) == 1;
+  ok &= std::fwrite(&n, sizeof(long), 1, f) == 1;
+  ok &= long(std::fwrite(v.data(), 1, n, f)) == n;
+  ok &= std::fclose(f) == 0;
+
+  if (!ok || std::rename(sTmp.str().c_str(), s.c_str()) != 0)
+  {
+    std::cerr << "CorsikaCache::Put(): could not write " << s << "." << std::endl;
+    std::remove(sTmp.str().c_str());
+    return false;
+  }
+
+  this->nStored++;
+  return true;
+}
+
+
+
+//
+// The whole file is mapped, and the bytes follow its header
+//
+bool CorsikaCache::Map(uint64_t key, const char * & p, long & n)
+{
+  p = 0;
+  n = 0;
+
+  int fd = this->kGood ? open(this->FileName(key).c_str(), O_RDONLY) : -1;
+  if (fd < 0)
+  {
+    this->nMisses++;
+    return false;
+  }
+
+  struct stat st;
+  void * pMap = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= kHeaderBytes) pMap = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  bool ok = pMap != MAP_FAILED;
+  if (ok)
+  {
+    const char * c = (const char *) pMap;
+    int version = 0;
+    uint64_t stored = 0;
+    std::memcpy(&version, c + 4, sizeof(int));
+    std::memcpy(&stored, c + 4 + sizeof(int), sizeof(uint64_t));
+    std::memcpy(&n, c + 4 + sizeof(int) + sizeof(uint64_t), sizeof(long));
+    ok = std::memcmp(c, sCacheMagic, 4) == 0 && version == iCacheVersion && stored == key && n >= 0 && kHeaderBytes + n == st.st_size;
+    if (!ok) munmap(pMap, st.st_size);
+  }
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaCache::Map(): " << this->FileName(key) << " is not a valid cache entry." << std::endl;
+    n = 0;
+    this->nMisses++;
+    return false;
+  }
+
+  p = (const char *) pMap + kHeaderBytes;
+  this->nHits++;
+  return true;
+}
+
+
+
+void CorsikaCache::Unmap(const char * p, long n)
+{
+  if (p) munmap((void *) (p - kHeaderBytes), kHeaderBytes + n);
+}
+
+
+
+void CorsikaCache::Print()
+{
+  std::cout << "Cache " << this->sDir << ": " << this->nHits << " results found, " << this->nMisses << " computed, " << this->nStored << " stored" << std::endl;
+}
@@ -0,0 +1,190 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#include <TH1.h>
+
+#include <CorsikaCheckpoint.h>
+
+static const char sCheckpointMagic[4] = {'C','K','P','T'};
+static const int iCheckpointVersion = 1;
+
+
+
+std::vector<double> CorsikaCheckpoint::Get(std::string s)
+{
+  if (!this->Has(s))
+  {
+    std::cerr << "CorsikaCheckpoint::Get(): no entry " << s << "." << std::endl;
+    return std::vector<double>(0);
+  }
+
+  return this->mData[s];
+}
+
+
+
+void CorsikaCheckpoint::SetHist(std::string s, const TH1 & h)
+{
+  double stats[13] = {0.};
+  h.GetStats(stats);
+
+  std::vector<double> v(stats, stats + 13);
+  v.push_back(h.GetEntries());
+
+  this->mData[s + ".stats"] = v;
+  this->mData[s] = std::vector<double>(h.GetNcells());
+  for (int i = 0; i < h.GetNcells(); i++) this->mData[s][i] = h.GetBinContent(i);
+
+  if (h.GetSumw2N() > 0)
+  {
+    const double * w2 = h.GetSumw2()->GetArray();
+    this->mData[s + ".sumw2"] = std::vector<double>(w2, w2 + h.GetSumw2N());
+  }
+}
+
+
+
+bool CorsikaCheckpoint::GetHist(std::string s, TH1 & h)
+{
+  if (!this->Has(s) || !this->Has(s + ".stats") || this->mData[s].size() != h.GetNcells())
+  {
+    std::cerr << "CorsikaCheckpoint::GetHist(): no compatible entry for histogram " << s << "." << std::endl;
+    return false;
+  }
+
+  h.Reset();
+
+  const auto & v = this->mData[s];
+  for (int i = 0; i < h.GetNcells(); i++) h.SetBinContent(i, v[i]);
+
+  if (this->Has(s + ".sumw2"))
+  {
+    h.Sumw2();
+    const auto & w2 = this->mData[s + ".sumw2"];
+    for (int i = 0; i < h.GetNcells(); i++) h.GetSumw2()->GetArray()[i] = w2[i];
+  }
+
+  auto stats = this->mData[s + ".stats"];
+  h.PutStats(stats.data());
+  h.SetEntries(stats[13]);
+
+  return true;
+}
+
+
+
+void CorsikaCheckpoint::SetBytes(std::string s, const std::vector<char> & v)
+{
+  std::vector<double> w((v.size() + sizeof(double) - 1)/sizeof(double) + 1, 0.);
+  w[0] = v.size();
+  if (!v.empty()) std::memcpy(&w[1], v.data(), v.size());
+  this->mData[s] = w;
+}
+
+
+
+bool CorsikaCheckpoint::GetBytes(std::string s, std::vector<char> & v)
+{
+  if (!this->Has(s) || this->mData[s].empty())
+  {
+    std::cerr << "CorsikaCheckpoint::GetBytes(): no entry " << s << "." << std::endl;
+    return false;
+  }
+
+  const auto & w = this->mData[s];
+  const size_t n = w[0];
+  if (n > (w.size() - 1)*sizeof(double)) return false;
+
+  v.resize(n);
+  if (n > 0) std::memcpy(v.data(), &w[1], n);
+  return true;
+}
+
+
+
+//
+// Write to a temporary file, flush it to disk and rename it over the target
+//
+bool CorsikaCheckpoint::Write(std::string s)
+{
+  std::string sTmp = s + ".tmp";
+
+  FILE * f = std::fopen(sTmp.c_str(), "wb");
+  if (!f)
+  {
+    std::cerr << "CorsikaCheckpoint::Write(): could not open " << sTmp << "." << std::endl;
+    return false;
+  }
+
+  bool ok = true;
+  long n = this->mData.size();
+  ok &= std::fwrite(sCheckpointMagic, 1, 4, f) == 4;
+  ok &= std::fwrite(&iCheckpointVersion, sizeof(int), 1, f) == 1;
+  ok &= std::fwrite(&n, sizeof(long), 1, f) == 1;
+
+  for (auto & entry : this->mData)
+  {
+    long nName = entry.first.size();
+    long nData = entry.second.size();
+    ok &= std::fwrite(&nName, sizeof(long), 1, f) == 1;
+    ok &= std::fwrite(entry.first.data(), 1, nName, f) == nName;
+    ok &= std::fwrite(&nData, sizeof(long), 1, f) == 1;
+    ok &= std::fwrite(entry.second.data(), sizeof(double), nData, f) == nData;
+  }
+
+  ok &= std::fflush(f) == 0;
+  ok &= fsync(fileno(f)) == 0;
+  ok &= std::fclose(f) == 0;
+
+  if (!ok || std::rename(sTmp.c_str(), s.c_str()) != 0)
+  {
+    std::cerr << "CorsikaCheckpoint::Write(): could not write " << s << "." << std::endl;
+    std::remove(sTmp.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+
+bool CorsikaCheckpoint::Read(std::string s)
+{
+  FILE * f = std::fopen(s.c_str(), "rb");
+  if (!f) return false;
+
+  this->mData.clear();
+
+  char magic[4];
+  int version = 0;
+  long n = 0;
+
+  bool ok = std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, sCheckpointMagic, 4) == 0;
+  ok = ok && std::fread(&version, sizeof(int), 1, f) == 1 && version == iCheckpointVersion;
+  ok = ok && std::fread(&n, sizeof(long), 1, f) == 1;
+
+  for (long i = 0; ok && i < n; i++)
+  {
+    long nName = 0;
+    long nData = 0;
+    ok = std::fread(&nName, sizeof(long), 1, f) == 1 && nName >= 0;
+    std::string sName(ok ? nName : 0, ' ');
+    ok = ok && std::fread(&sName[0], 1, nName, f) == nName;
+    ok = ok && std::fread(&nData, sizeof(long), 1, f) == 1 && nData >= 0;
+    std::vector<double> v(ok ? nData : 0);
+    ok = ok && std::fread(v.data(), sizeof(double), nData, f) == nData;
+    if (ok) this->mData[sName] = v;
+  }
+
+  std::fclose(f);
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaCheckpoint::Read(): " << s << " is not a valid checkpoint file." << std::endl;
+    this->mData.clear();
+  }
+
+  return ok;
+}
@@ -9,7 +9,7 @@
 //
 // The constructor
 //
-CorsikaFile::CorsikaFile(std::string s)
+CorsikaFile::CorsikaFile(std::string s, bool salvage)
 : stream(s, std::ifstream::in | std::ifstream::binary)
 , nBlockSize(0)          // to be determiend
 , nSubWords(0)           // to be determined
@@ -17,11 +17,14 @@ CorsikaFile::CorsikaFile(std::string s)
 , nWordSize(4)           // from manual
 , nParticlesPerBlock(39) // from manual
 , nWordsPerParticle(7)   // from manual (+1 below if thinning)
-, iCurSub(0)
 , kThin(false)
 , kSkip(false)
 , kGood(true)
 , kDone(false)
+, kSalvage(salvage)
+, kTruncated(false)
+, iLastEnd(-1)
+, iSkipped(-1)
 , sFileName(s)
 {
   //
@@ -56,7 +59,7 @@ CorsikaFile::CorsikaFile(std::string s)
     }
     else
     { // Still ditn't find the event header, guess thinning is enabled
-      this->stream.ignore(this->nWordSize*39);
+      this->stream.ignore(this->nWordSize*38);
       this->stream.read(buf,this->nWordSize);
       if (std::string(buf,this->nWordSize) == "EVTH")
       { // The sub block has 312 words (thinning enabled)
@@ -92,14 +95,15 @@ CorsikaFile::CorsikaFile(std::string s)
   // Get number of words per subblock
   this->nSubWords = this->nBlockSize/(this->nWordSize*this->nSubBlocks);
 
-  // Rewind file
-  this->stream.seekg(0);
+  // Get the reader specialized for this block layout
+  this->reader.reset(CorsikaBlockReader::Create(this->stream, this->kThin, this->kSkip));
 
 
 
   //
   // Read run header
   //
+  this->Reset();
   this->vHeader = this->NextSubBlock();
 
   if (this->vHeader.empty())
@@ -110,29 +114,22 @@ CorsikaFile::CorsikaFile(std::string s)
     return;
   }
 
-  this->stream.seekg(0, std::ios::end);
-  this->stream.seekg(size_t(this->stream.tellg()) - this->nBlockSize - 2*this->nWordSize*int(this->kSkip));
-
 
 
   //
   // Look for run end block
   //
 
-  // Reset read status
-  this->Reset();
-
-  // Go to the end of file
-  this->stream.seekg(0, std::ios::end);
-
   // Go to the beginning of the last block
-  this->stream.seekg(size_t(this->stream.tellg()) - this->nBlockSize - 2*this->nWordSize*int(this->kSkip));
+  long nSub = this->reader->NSubBlocks();
+  this->reader->Seek(nSub - (nSub%this->nSubBlocks == 0 ? this->nSubBlocks : nSub%this->nSubBlocks));
 
   // Seek for the run end subblock
   bool kEnd = false;
   for (int i = 0; i<this->nSubBlocks; i++)
   {
     auto subBlk = this->NextSubBlock();
+    if (subBlk.empty()) break;
     if (std::string((char*)subBlk.data(),4) == "RUNE")
     {
       this->vEnd = subBlk;
@@ -145,13 +142,38 @@ CorsikaFile::CorsikaFile(std::string s)
   this->Reset();
 
   // Check if run end block was found
-  if (!kEnd)
+  if (!kEnd && !this->kSalvage)
   {
     std::cerr << "I could not find the run end subblock in the file " << s << "." << std::endl;
     this->kGood = false;
     return;
   }
 
+
+
+  //
+  // Salvage mode: look backwards for the end of the last complete shower
+  //
+  if (!kEnd)
+  {
+    this->kTruncated = true;
+
+    for (long i = nSub - 1; i > 0 && this->iLastEnd < 0; i--)
+    {
+      this->reader->Seek(i);
+      const float * p = this->reader->Next();
+      if (p && std::string((char*)p,4) == "EVTE") this->iLastEnd = i;
+    }
+
+    this->Reset();
+
+    std::cerr << "I could not find the run end subblock in the file " << s << "." << std::endl;
+    if (this->iLastEnd < 0)
+      std::cerr << "Salvage mode: there is no complete shower in this file." << std::endl;
+    else
+      std::cerr << "Salvage mode: reading the showers that end before sub-block " << this->iLastEnd+1 << " of " << nSub << "." << std::endl;
+  }
+
   return;
 }
 
@@ -165,32 +187,30 @@ CorsikaFile::~CorsikaFile()
 }
 
 
-std::vector<float> CorsikaFile::NextSubBlock()
+int CorsikaFile::ReadBunches(long i, CorsikaBunches & b)
 {
-  if (this->iCurSub == 0 && this->kSkip)
+  this->reader->Seek(i);
+
+  const float * p = this->reader->Next();
+  if (!p)
   {
-    char buf[this->nWordSize];
-    this->stream.read(buf,this->nWordSize);
+    b.Resize(0);
+    return 0;
   }
 
-  std::vector<float> v(this->nSubWords);
-  this->stream.read((char*)v.data(),this->nSubWords*this->nWordSize);
+  CorsikaTimer timer(CorsikaProfiler::kDecode);
+  return this->reader->Decode(p, 0, b);
+}
 
-  if (!this->stream.good() || this->stream.eof()) return std::vector<float>(0);
 
-  iCurSub++;
 
-  if (this->iCurSub == this->nSubBlocks)
-  {
-    iCurSub = 0;
-    if (this->kSkip)
-    {
-      char buf[this->nWordSize];
-      this->stream.read(buf,this->nWordSize);
-    }
-  }
+std::vector<float> CorsikaFile::NextSubBlock()
+{
+  const float * p = this->reader->Next();
+
+  if (!p) return std::vector<float>(0);
 
-  return v;
+  return std::vector<float>(p, p + this->nSubWords);
 }
 
 
@@ -200,27 +220,7 @@ std::vector<float> CorsikaFile::NextSubBlock()
 //
 void CorsikaFile::RewindSubBlock()
 {
-  std::size_t pos = std::size_t(this->stream.tellg());
-
-  if (this->iCurSub == 0)
-  {
-    pos -= (this->nSubWords+int(this->kSkip))*this->nWordSize;
-    this->iCurSub = this->nSubBlocks - 1;
-  }
-  else if (this->iCurSub == 1)
-  {
-    pos -= (this->nSubWords+int(this->kSkip))*this->nWordSize;
-    this->iCurSub = 0;
-  }
-  else
-  {
-    pos -= this->nSubWords*this->nWordSize;
-    this->iCurSub--;
-  }
-
-  if (pos < 0) pos = 0;
-
-  this->stream.seekg(pos);
+  this->reader->Seek(this->reader->Tell() - 1);
 }
 
 
@@ -241,7 +241,12 @@ CorsikaShower CorsikaFile::NextShower()
     // current file.
     if (subBlk.empty())
     {
-      if (this->stream.eof())
+      this->kDone = true;
+
+      // In salvage mode the end of the readable data is the end of the run
+      if (this->kTruncated) return CorsikaShower(*this,false);
+
+      if (this->reader->Tell() >= this->reader->NSubBlocks())
       {
         std::cerr << "Reached end of file " << this->sFileName << " before run end subblock!." << std::endl;
         std::cerr << "Was this simulation complete?" << std::endl;
@@ -267,6 +272,17 @@ CorsikaShower CorsikaFile::NextShower()
 
       return CorsikaShower(*this,false);
     }
+
+    // Salvage mode: a shower header after the last shower end starts the incomplete trailing shower
+    if (sHeader == "EVTH" && this->kTruncated && this->reader->Tell() - 1 > this->iLastEnd)
+    {
+      this->kDone = true;
+      this->iSkipped = int(subBlk[1]);
+
+      std::cerr << "Salvage mode: skipping the incomplete shower " << this->iSkipped << " at the end of " << this->sFileName << "." << std::endl;
+
+      return CorsikaShower(*this,false);
+    }
   }
 
   this->RewindSubBlock();
@@ -276,11 +292,76 @@ CorsikaShower CorsikaFile::NextShower()
 
 
 
+//
+// ID of the first shower header at or after sub-block i, and before iEnd if
+// given, moved to its position, or -1 if there is none
+//
+int CorsikaFile::NextHeader(long & i, long iEnd)
+{
+  this->reader->Seek(i);
+
+  const float * p;
+  while ((iEnd < 0 || this->reader->Tell() < iEnd) && (p = this->reader->Next()))
+  {
+    const std::string sHeader((const char*)p,4);
+    if (sHeader == "RUNE") break;
+    if (sHeader != "EVTH") continue;
+
+    i = this->reader->Tell() - 1;
+    return int(p[1]);
+  }
+
+  return -1;
+}
+
+
+
+//
+// Each step of the bisection only scans its range [mid, hi) for a header:
+// without one there, the next header is that of hi, whose ID is >= id. The
+// header of the shower is the first one found with its ID.
+//
+bool CorsikaFile::SeekShower(int id)
+{
+  const long iStart = this->reader->Tell();
+
+  // The header set for the ID, if it is there
+  long i = -1;
+  auto it = this->mHeaders.find(id);
+  if (it != this->mHeaders.end())
+  {
+    long j = it->second;
+    if (this->NextHeader(j, j + 1) == id) i = j;
+  }
+
+  if (i < 0)
+  {
+    // First sub-block from which the next header has an ID >= id
+    long lo = 0, hi = this->reader->NSubBlocks();
+    while (lo < hi)
+    {
+      const long mid = lo + (hi - lo)/2;
+      long j = mid;
+      const int idNext = this->NextHeader(j, hi);
+      if (idNext >= 0 && idNext < id) lo = j + 1;
+      else hi = mid;
+      if (idNext == id) i = j;
+    }
+  }
+
+  const bool ok = i >= 0;
+  this->reader->Seek(ok ? i : iStart);
+  if (ok) this->kDone = false;
+
+  return ok;
+}
+
+
+
 //
 // Go to beginning of file and reset subbloc counter
 //
 void CorsikaFile::Reset()
 {
-  this->stream.seekg(0);
-  this->iCurSub = 0;
+  this->reader->Seek(0);
 }
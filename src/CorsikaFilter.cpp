@@ -0,0 +1,155 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#include <CorsikaFilter.h>
+
+CorsikaFilter::CorsikaFilter(double maxRadius)
+: maxRadius2(maxRadius*maxRadius)
+, minBunch(0.)
+, tMin(0.)
+, tMax(0.)
+, kTime(false)
+, vName({"weight","radius","time"})
+, vRejected(3,0.)
+, nInput(0.)
+, nAccepted(0.)
+{
+}
+
+
+
+void CorsikaFilter::SetTimeWindow(double t0, double t1)
+{
+  this->tMin = t0;
+  this->tMax = t1;
+  this->kTime = true;
+}
+
+
+
+int CorsikaFilter::AddCut(std::string s)
+{
+  this->vName.push_back(s);
+  this->vRejected.push_back(0.);
+  return this->vName.size() - 1;
+}
+
+
+
+//
+// Set the selection mask of the batch and return the number of selected bunches
+//
+int CorsikaFilter::Apply(CorsikaBunches & b)
+{
+  const int n = b.n;
+  const float * bunch = b.bunch.data();
+  const float * posx = b.posx.data();
+  const float * posy = b.posy.data();
+  const float * nsec = b.nsec.data();
+  unsigned char * mask = b.mask.data();
+
+  const float w0 = this->minBunch;
+  const float r2 = this->maxRadius2;
+  const float t0 = this->tMin;
+  const float t1 = this->tMax;
+
+  int nRej = 0;
+
+  // Bunch weight: empty slots at the end of a sub-block have zero weight
+  for (int i = 0; i < n; i++)
+  {
+    mask[i] = bunch[i] > w0;
+    nRej += 1 - mask[i];
+  }
+  this->vRejected[kWeightCut] += nRej;
+
+  // Radius at ground
+  nRej = 0;
+  for (int i = 0; i < n; i++)
+  {
+    unsigned char pass = posx[i]*posx[i] + posy[i]*posy[i] < r2;
+    nRej += mask[i] & (1 - pass);
+    mask[i] &= pass;
+  }
+  this->vRejected[kRadiusCut] += nRej;
+
+  // Arrival time window
+  if (this->kTime)
+  {
+    nRej = 0;
+    for (int i = 0; i < n; i++)
+    {
+      unsigned char pass = t0 <= nsec[i] && nsec[i] < t1;
+      nRej += mask[i] & (1 - pass);
+      mask[i] &= pass;
+    }
+    this->vRejected[kTimeCut] += nRej;
+  }
+
+  int nSel = 0;
+  for (int i = 0; i < n; i++) nSel += mask[i];
+
+  this->nInput += n;
+  this->nAccepted += nSel;
+
+  return nSel;
+}
+
+
+
+std::vector<double> CorsikaFilter::GetCounters()
+{
+  std::vector<double> v = {this->nInput, this->nAccepted};
+  v.insert(v.end(), this->vRejected.begin(), this->vRejected.end());
+  return v;
+}
+
+
+
+void CorsikaFilter::SetCounters(const std::vector<double> & v)
+{
+  if (v.size() != this->vRejected.size() + 2)
+  {
+    std::cerr << "CorsikaFilter::SetCounters(): expected " << this->vRejected.size() + 2 << " counters, got " << v.size() << "." << std::endl;
+    return;
+  }
+
+  this->nInput = v[0];
+  this->nAccepted = v[1];
+  for (int i = 0; i < this->vRejected.size(); i++) this->vRejected[i] = v[i+2];
+}
+
+
+
+std::string CorsikaFilter::Definition()
+{
+  std::ostringstream s;
+  s << std::setprecision(17) << "r2=" << this->maxRadius2 << " w>" << this->minBunch;
+  if (this->kTime) s << " t=[" << this->tMin << "," << this->tMax << ")";
+  for (auto & name : this->vName) s << " " << name;
+  return s.str();
+}
+
+
+
+void CorsikaFilter::Merge(const CorsikaFilter & other)
+{
+  this->nInput += other.nInput;
+  this->nAccepted += other.nAccepted;
+  for (int i = 0; i < this->vRejected.size() && i < other.vRejected.size(); i++) this->vRejected[i] += other.vRejected[i];
+}
+
+
+
+void CorsikaFilter::Print()
+{
+  std::cout << "Bunch selection:" << std::endl;
+  std::cout << std::setw(15) << "input" << std::setw(15) << this->nInput << std::endl;
+  for (int i = 0; i < this->vName.size(); i++)
+  {
+    if (i == kTimeCut && !this->kTime) continue;
+    std::cout << std::setw(15) << this->vName[i] << std::setw(15) << -this->vRejected[i] << std::endl;
+  }
+  std::cout << std::setw(15) << "accepted" << std::setw(15) << this->nAccepted << std::endl;
+}
@@ -0,0 +1,207 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#include <CorsikaFootprint.h>
+#include <CorsikaSerialize.h>
+
+static const char sFootprintMagic[4] = {'T','F','P','T'};
+static const int iFootprintVersion = 1;
+
+// Cells of the grid at most, larger than a mirror diameter for wide layouts
+static const double kMaxCells = 1 << 22;
+
+CorsikaFootprint::CorsikaFootprint(std::string s)
+: kGood(false)
+, xMin(0.), yMin(0.), fCell(1.)
+, nx(0), ny(0)
+{
+  std::ifstream stream(s);
+  if (!stream.is_open())
+  {
+    std::cerr << "CorsikaFootprint::CorsikaFootprint(): could not open the layout " << s << "." << std::endl;
+    return;
+  }
+
+  std::ostringstream sDef;
+  sDef << std::setprecision(17);
+
+  const double deg = std::acos(-1.)/180.;
+  std::string sLine;
+  int iLine = 0;
+  while (std::getline(stream, sLine))
+  {
+    iLine++;
+    const size_t first = sLine.find_first_not_of(" \t\r");
+    if (first == std::string::npos || sLine[first] == '#') continue;
+
+    std::istringstream sFields(sLine);
+    double x = 0., y = 0., r = 0., zenith = 0., azimuth = 0., fov = 0.;
+    bool ok = bool(sFields >> x >> y >> r) && r > 0.;
+    const bool kPointing = ok && bool(sFields >> zenith);
+    if (kPointing) ok = bool(sFields >> azimuth >> fov) && fov > 0.;
+
+    if (!ok)
+    {
+      std::cerr << "CorsikaFootprint::CorsikaFootprint(): invalid telescope at line " << iLine << " of " << s << "." << std::endl;
+      return;
+    }
+
+    Telescope tel;
+    tel.x = x*1.e2;
+    tel.y = y*1.e2;
+    tel.r2 = r*r*1.e4;
+    tel.kPointing = kPointing;
+    tel.u = std::sin(zenith*deg)*std::cos(azimuth*deg);
+    tel.v = std::sin(zenith*deg)*std::sin(azimuth*deg);
+    tel.w = std::cos(zenith*deg);
+    tel.cosFov = std::cos(fov*deg);
+    this->vTel.push_back(tel);
+
+    sDef << x << " " << y << " " << r;
+    if (kPointing) sDef << " " << zenith << " " << azimuth << " " << fov;
+    sDef << ";";
+  }
+
+  if (this->vTel.empty())
+  {
+    std::cerr << "CorsikaFootprint::CorsikaFootprint(): no telescopes in the layout " << s << "." << std::endl;
+    return;
+  }
+
+  this->sDefinition = sDef.str();
+  this->Bucket();
+
+  const size_t n = this->vTel.size();
+  this->vPhotons.resize(n);
+  this->vBunches.resize(n);
+  this->vMean.resize(n);
+  this->vM2.resize(n);
+  this->vFirst.resize(n);
+  this->vLast.resize(n);
+  this->Reset();
+
+  this->kGood = true;
+}
+
+
+
+//
+// Each telescope goes to the cells its mirror overlaps, at most 4 since the
+// cells are at least a mirror diameter wide
+//
+void CorsikaFootprint::Bucket()
+{
+  double x0 = std::numeric_limits<double>::max(), x1 = -x0;
+  double y0 = x0, y1 = -x0, rmax = 0.;
+  for (auto & tel : this->vTel)
+  {
+    const double r = std::sqrt(tel.r2);
+    x0 = std::min(x0, tel.x - r);
+    x1 = std::max(x1, tel.x + r);
+    y0 = std::min(y0, tel.y - r);
+    y1 = std::max(y1, tel.y + r);
+    rmax = std::max(rmax, r);
+  }
+
+  const double cell = std::max(2.*rmax, std::sqrt((x1 - x0)*(y1 - y0)/kMaxCells));
+  this->xMin = x0;
+  this->yMin = y0;
+  this->fCell = 1./cell;
+  this->nx = int((x1 - x0)/cell) + 1;
+  this->ny = int((y1 - y0)/cell) + 1;
+
+  auto cells = [&](const Telescope & tel, int & ix0, int & ix1, int & iy0, int & iy1)
+  {
+    const double r = std::sqrt(tel.r2);
+    ix0 = std::max(0, int((tel.x - r - this->xMin)*this->fCell));
+    ix1 = std::min(this->nx - 1, int((tel.x + r - this->xMin)*this->fCell));
+    iy0 = std::max(0, int((tel.y - r - this->yMin)*this->fCell));
+    iy1 = std::min(this->ny - 1, int((tel.y + r - this->yMin)*this->fCell));
+  };
+
+  // Count the telescopes per cell, then place them
+  this->vCellStart.assign(this->nx*this->ny + 1, 0);
+  for (auto & tel : this->vTel)
+  {
+    int ix0, ix1, iy0, iy1;
+    cells(tel, ix0, ix1, iy0, iy1);
+    for (int iy = iy0; iy <= iy1; iy++)
+      for (int ix = ix0; ix <= ix1; ix++) this->vCellStart[iy*this->nx + ix + 1]++;
+  }
+  for (size_t i = 1; i < this->vCellStart.size(); i++) this->vCellStart[i] += this->vCellStart[i-1];
+
+  this->vCellTel.resize(this->vCellStart.back());
+  std::vector<int> vNext(this->vCellStart.begin(), this->vCellStart.end() - 1);
+  for (int i = 0; i < int(this->vTel.size()); i++)
+  {
+    int ix0, ix1, iy0, iy1;
+    cells(this->vTel[i], ix0, ix1, iy0, iy1);
+    for (int iy = iy0; iy <= iy1; iy++)
+      for (int ix = ix0; ix <= ix1; ix++) this->vCellTel[vNext[iy*this->nx + ix]++] = i;
+  }
+}
+
+
+
+void CorsikaFootprint::Reset()
+{
+  std::fill(this->vPhotons.begin(), this->vPhotons.end(), 0.);
+  std::fill(this->vBunches.begin(), this->vBunches.end(), 0.);
+  std::fill(this->vMean.begin(), this->vMean.end(), 0.);
+  std::fill(this->vM2.begin(), this->vM2.end(), 0.);
+  std::fill(this->vFirst.begin(), this->vFirst.end(), std::numeric_limits<double>::max());
+  std::fill(this->vLast.begin(), this->vLast.end(), -std::numeric_limits<double>::max());
+}
+
+
+
+void CorsikaFootprint::Serialize(std::vector<char> & v)
+{
+  const unsigned long n = this->vTel.size();
+
+  v.clear();
+  CorsikaAppend(v, sFootprintMagic, 4);
+  CorsikaAppend(v, &iFootprintVersion);
+  CorsikaAppend(v, &n);
+  CorsikaAppend(v, this->vPhotons.data(), n);
+  CorsikaAppend(v, this->vBunches.data(), n);
+  CorsikaAppend(v, this->vMean.data(), n);
+  CorsikaAppend(v, this->vM2.data(), n);
+  CorsikaAppend(v, this->vFirst.data(), n);
+  CorsikaAppend(v, this->vLast.data(), n);
+}
+
+
+
+bool CorsikaFootprint::Deserialize(const std::vector<char> & v)
+{
+  size_t pos = 0;
+  char magic[4];
+  int version = 0;
+  unsigned long n = 0;
+
+  bool ok = CorsikaExtract(v, pos, magic, 4) && std::memcmp(magic, sFootprintMagic, 4) == 0;
+  ok = ok && CorsikaExtract(v, pos, &version) && version == iFootprintVersion;
+  ok = ok && CorsikaExtract(v, pos, &n) && n == this->vTel.size();
+  ok = ok && pos + 6*n*sizeof(double) <= v.size();
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaFootprint::Deserialize(): not valid sums for this layout." << std::endl;
+    return false;
+  }
+
+  CorsikaExtract(v, pos, this->vPhotons.data(), n);
+  CorsikaExtract(v, pos, this->vBunches.data(), n);
+  CorsikaExtract(v, pos, this->vMean.data(), n);
+  CorsikaExtract(v, pos, this->vM2.data(), n);
+  CorsikaExtract(v, pos, this->vFirst.data(), n);
+  CorsikaExtract(v, pos, this->vLast.data(), n);
+
+  return true;
+}
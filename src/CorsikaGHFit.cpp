@@ -0,0 +1,333 @@
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+#include <CorsikaGHFit.h>
+#include <CorsikaSerialize.h>
+
+// Number of fits in lockstep per work item of a thread
+static const int nFitChunk = 64;
+
+CorsikaGHFit::CorsikaGHFit(int npar, int maxiter)
+: nPar(npar == 4 ? 4 : 6)
+, maxIter(maxiter)
+{
+}
+
+
+
+int CorsikaGHFit::Add(const std::vector<double> & vDepth, const std::vector<double> & vProfile)
+{
+  const int iFit = this->vData.size();
+
+  this->vData.push_back(vProfile);
+  this->vData.back().resize(vDepth.size(), 0.);
+  this->vPar.push_back(std::vector<double>(kNPar, 0.));
+  this->vChi2.push_back(-1.);
+  this->vNdof.push_back(0);
+  this->vStatus.push_back(kNotFit);
+
+  // Profiles on the same depth grid are fit together
+  auto & vSameHash = this->mBatches[CorsikaHash(vDepth.data(), vDepth.size())];
+  for (int ib : vSameHash)
+  {
+    if (this->vBatches[ib].vDepth == vDepth)
+    {
+      Batch & b = this->vBatches[ib];
+      b.vFit.push_back(iFit);
+      if (int(b.vFit.size()) >= nFitChunk)
+      {
+        this->FitBatch(b, 0, b.vFit.size());
+        this->Release(b);
+      }
+      return iFit;
+    }
+  }
+
+  Batch b;
+  b.vDepth = vDepth;
+  b.vFit.push_back(iFit);
+  vSameHash.push_back(this->vBatches.size());
+  this->vBatches.push_back(b);
+
+  return iFit;
+}
+
+
+
+long CorsikaGHFit::Bytes()
+{
+  long n = this->vData.capacity()*sizeof(std::vector<double>) + this->vPar.capacity()*sizeof(std::vector<double>);
+  n += this->vChi2.capacity()*sizeof(double) + (this->vNdof.capacity() + this->vStatus.capacity())*sizeof(int);
+  for (auto & v : this->vData) n += v.capacity()*sizeof(double);
+  for (auto & v : this->vPar) n += v.capacity()*sizeof(double);
+  for (auto & b : this->vBatches) n += sizeof(Batch) + b.vDepth.capacity()*sizeof(double) + b.vFit.capacity()*sizeof(int);
+
+  return n;
+}
+
+
+
+//
+// The profiles of a batch that were fit, keeping the depths for the next ones
+//
+void CorsikaGHFit::Release(Batch & b)
+{
+  for (int iFit : b.vFit) std::vector<double>().swap(this->vData[iFit]);
+  b.vFit.clear();
+}
+
+
+
+double CorsikaGHFit::Eval(const double * p, double x)
+{
+  const double a = p[kXmax] - p[kX0];
+  const double l = p[kP4] + p[kP5]*x + p[kP6]*x*x;
+  if (x <= p[kX0] || a <= 0. || l <= 0.) return 0.;
+
+  return p[kNmax]*std::exp((a*std::log((x - p[kX0])/a) + p[kXmax] - x)/l);
+}
+
+
+
+void CorsikaGHFit::Fit(int nThreads)
+{
+  // Work items: chunks of fits of a batch
+  std::vector<std::vector<int>> vItems;
+  for (size_t ib = 0; ib < this->vBatches.size(); ib++)
+    for (int first = 0; first < this->vBatches[ib].vFit.size(); first += nFitChunk)
+      vItems.push_back({int(ib), first, std::min<int>(first + nFitChunk, this->vBatches[ib].vFit.size())});
+
+  std::atomic<int> iNext(0);
+  auto worker = [&]()
+  {
+    int i;
+    while ((i = iNext++) < vItems.size())
+      this->FitBatch(this->vBatches[vItems[i][0]], vItems[i][1], vItems[i][2]);
+  };
+
+  nThreads = std::max(1, std::min<int>(nThreads, vItems.size()));
+  if (nThreads == 1) worker();
+  else
+  {
+    std::vector<std::thread> vThreads;
+    for (int i = 0; i < nThreads; i++) vThreads.emplace_back(worker);
+    for (auto & t : vThreads) t.join();
+  }
+
+  for (auto & b : this->vBatches) this->Release(b);
+}
+
+
+
+//
+// Levenberg-Marquardt of the fits first..last-1 of a batch, in lockstep.
+// Arrays are indexed [i*K + k] for point i and fit k, parameters [j*K + k].
+//
+void CorsikaGHFit::FitBatch(const Batch & b, int first, int last)
+{
+  const int K = last - first;
+  const int n = b.vDepth.size();
+  const int np = this->nPar;
+  const double * X = b.vDepth.data();
+  const double inf = std::numeric_limits<double>::infinity();
+
+  std::vector<double> y(n*K), w(n*K);
+  std::vector<double> p(kNPar*K, 0.), pt(kNPar*K, 0.);
+  std::vector<double> lambda(K, 1.e-3), chi2(K, inf), chi2t(K, inf);
+  std::vector<double> A(np*np*K), g(np*K);
+  std::vector<unsigned char> active(K, 0);
+  std::vector<int> status(K, kNotFit);
+
+  //
+  // Data, weights and starting point: the maximum of the profile
+  //
+  for (int k = 0; k < K; k++)
+  {
+    const auto & v = this->vData[b.vFit[first + k]];
+
+    int imax = 0;
+    for (int i = 0; i < n; i++)
+    {
+      y[i*K + k] = v[i];
+      if (v[i] > v[imax]) imax = i;
+    }
+
+    const double ymax = v[imax];
+    if (!(ymax > 0.) || n <= np) continue;
+
+    for (int i = 0; i < n; i++) w[i*K + k] = 1./std::max(std::fabs(v[i]), 1.e-4*ymax);
+
+    p[kNmax*K + k] = ymax;
+    p[kXmax*K + k] = X[imax];
+    p[kX0*K + k] = std::min(0., X[0]) - 0.1*(X[imax] - X[0]) - 1.;
+    p[kP4*K + k] = 70.;
+
+    active[k] = 1;
+    status[k] = kMaxIter;
+  }
+
+  // Chi2 of the active fits for the given parameters; invalid parameters give infinity
+  auto chi2of = [&](const std::vector<double> & par, std::vector<double> & out)
+  {
+    for (int k = 0; k < K; k++)
+    {
+      const bool ok = par[kNmax*K + k] > 0. && par[kXmax*K + k] > par[kX0*K + k];
+      out[k] = active[k] && ok ? 0. : inf;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+      const double x = X[i];
+      for (int k = 0; k < K; k++)
+      {
+        const double x0 = par[kX0*K + k];
+        const double xm = par[kXmax*K + k];
+        const double a = xm - x0;
+        const double l = par[kP4*K + k] + par[kP5*K + k]*x + par[kP6*K + k]*x*x;
+        const double N = x > x0 ? par[kNmax*K + k]*std::exp((a*std::log((x - x0)/a) + xm - x)/l) : 0.;
+        const double r = y[i*K + k] - N;
+        out[k] += l > 0. ? w[i*K + k]*r*r : inf;
+      }
+    }
+  };
+
+  chi2of(p, chi2);
+
+  for (int iter = 0; iter < this->maxIter; iter++)
+  {
+    if (std::find(active.begin(), active.end(), 1) == active.end()) break;
+
+    //
+    // Normal equations: A = J^T W J and g = J^T W r
+    //
+    std::fill(A.begin(), A.end(), 0.);
+    std::fill(g.begin(), g.end(), 0.);
+
+    double J[kNPar];
+    for (int i = 0; i < n; i++)
+    {
+      const double x = X[i];
+      for (int k = 0; k < K; k++)
+      {
+        const double x0 = p[kX0*K + k];
+        const double xm = p[kXmax*K + k];
+        const double a = xm - x0;
+        const double l = p[kP4*K + k] + p[kP5*K + k]*x + p[kP6*K + k]*x*x;
+        if (!active[k] || x <= x0 || l <= 0.) continue;
+
+        const double lnt = std::log((x - x0)/a);
+        const double ge = (a*lnt + xm - x)/l;
+        const double N = p[kNmax*K + k]*std::exp(ge);
+        const double dl = -N*ge/l;
+
+        J[kNmax] = N/p[kNmax*K + k];
+        J[kX0] = N*(1. - lnt - a/(x - x0))/l;
+        J[kXmax] = N*lnt/l;
+        J[kP4] = dl;
+        J[kP5] = dl*x;
+        J[kP6] = dl*x*x;
+
+        const double wr = w[i*K + k]*(y[i*K + k] - N);
+        for (int j = 0; j < np; j++)
+        {
+          g[j*K + k] += J[j]*wr;
+          for (int m = 0; m <= j; m++) A[(j*np + m)*K + k] += w[i*K + k]*J[j]*J[m];
+        }
+      }
+    }
+
+    //
+    // Damped step of each fit, by Cholesky decomposition
+    //
+    pt = p;
+    for (int k = 0; k < K; k++)
+    {
+      if (!active[k]) continue;
+
+      double L[kNPar][kNPar] = {{0.}};
+      bool ok = true;
+      for (int j = 0; j < np && ok; j++)
+      {
+        for (int m = 0; m <= j; m++)
+        {
+          double s = A[(j*np + m)*K + k];
+          if (m == j) s *= 1. + lambda[k];
+          for (int q = 0; q < m; q++) s -= L[j][q]*L[m][q];
+
+          if (m == j)
+          {
+            ok = s > 0.;
+            L[j][j] = ok ? std::sqrt(s) : 0.;
+          }
+          else L[j][m] = s/L[m][m];
+        }
+      }
+
+      if (!ok)
+      {
+        pt[kNmax*K + k] = -1.;
+        continue;
+      }
+
+      double z[kNPar];
+      for (int j = 0; j < np; j++)
+      {
+        double s = g[j*K + k];
+        for (int q = 0; q < j; q++) s -= L[j][q]*z[q];
+        z[j] = s/L[j][j];
+      }
+      for (int j = np-1; j >= 0; j--)
+      {
+        double s = z[j];
+        for (int q = j+1; q < np; q++) s -= L[q][j]*z[q];
+        z[j] = s/L[j][j];
+        pt[j*K + k] += z[j];
+      }
+    }
+
+    chi2of(pt, chi2t);
+
+    //
+    // Accept or reject the steps
+    //
+    for (int k = 0; k < K; k++)
+    {
+      if (!active[k]) continue;
+
+      if (chi2t[k] < chi2[k])
+      {
+        const double rel = (chi2[k] - chi2t[k])/chi2[k];
+        for (int j = 0; j < np; j++) p[j*K + k] = pt[j*K + k];
+        chi2[k] = chi2t[k];
+        lambda[k] = std::max(1.e-12, 0.1*lambda[k]);
+        if (rel < 1.e-9) status[k] = kConverged;
+      }
+      else
+      {
+        lambda[k] *= 10.;
+        if (lambda[k] > 1.e10) status[k] = kStalled;
+      }
+
+      if (status[k] == kConverged || status[k] == kStalled) active[k] = 0;
+    }
+  }
+
+  //
+  // Results
+  //
+  for (int k = 0; k < K; k++)
+  {
+    const int iFit = b.vFit[first + k];
+    for (int j = 0; j < kNPar; j++) this->vPar[iFit][j] = p[j*K + k];
+
+    if (status[k] != kNotFit && !std::isfinite(chi2[k])) status[k] = kFailed;
+
+    this->vStatus[iFit] = status[k];
+    this->vChi2[iFit] = status[k] == kNotFit ? -1. : chi2[k];
+    this->vNdof[iFit] = status[k] == kNotFit ? 0 : n - np;
+  }
+}
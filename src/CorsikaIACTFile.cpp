@@ -0,0 +1,397 @@
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include <CorsikaIACTFile.h>
+#include <CorsikaProfiler.h>
+
+CorsikaIACTFile::CorsikaIACTFile(std::string s, const std::set<int> & telescopes)
+: stream(s, std::ios::in | std::ios::binary)
+, sFileName(s)
+, kGood(true)
+, kDone(false)
+, kShowerDone(true)
+, sTelescopes(telescopes)
+, iArrayEnd(-1)
+, iPhotonsEnd(-1)
+, iArray(0)
+, iTelescope(0)
+, nLeft(0)
+, kCompact(false)
+, fWeight(1.)
+{
+  //
+  // Check if file is open
+  //
+  if (!this->stream.is_open())
+  {
+    std::cerr << "CorsikaIACTFile::CorsikaIACTFile(): could not open the file " << s << "." << std::endl;
+    this->kGood = false;
+    return;
+  }
+
+
+
+  //
+  // Read the objects before the first shower: run header and telescopes
+  //
+  Object o;
+  while (true)
+  {
+    const long pos = this->stream.tellg();
+    if (!this->ReadObject(o)) break;
+
+    if (o.type == kRunHeader) this->ReadFloats(this->vHeader, o.length);
+    else if (o.type == kTelescopes)
+    {
+      int ntel = 0;
+      this->stream.read(reinterpret_cast<char*>(&ntel), 4);
+      if (ntel < 0 || 4 + 16L*ntel > o.length)
+      {
+        std::cerr << "CorsikaIACTFile::CorsikaIACTFile(): invalid telescope layout in " << s << "." << std::endl;
+        this->kGood = false;
+        return;
+      }
+
+      for (auto pv : {&this->vTelX, &this->vTelY, &this->vTelZ, &this->vTelR})
+      {
+        pv->resize(ntel);
+        this->stream.read(reinterpret_cast<char*>(pv->data()), 4L*ntel);
+      }
+      this->stream.seekg(o.length - 4 - 16L*ntel, std::ios::cur);
+    }
+    else if (o.type == kEventHeader)
+    {
+      this->stream.seekg(pos);
+      break;
+    }
+    else this->SkipObject(o);
+  }
+
+  if (this->vHeader.size() < 273)
+  {
+    std::cerr << "The file " << s << " is not a valid CORSIKA IACT file: no run header." << std::endl;
+    this->kGood = false;
+    return;
+  }
+
+  if (this->vTelX.empty())
+  {
+    std::cerr << "The file " << s << " is not a valid CORSIKA IACT file: no telescopes." << std::endl;
+    this->kGood = false;
+    return;
+  }
+
+  for (int tel : this->sTelescopes)
+    if (tel < 1 || tel > this->NTelescopes())
+      std::cerr << "CorsikaIACTFile::CorsikaIACTFile(): there is no telescope " << tel << " in " << s << "." << std::endl;
+
+  this->stream.clear();
+}
+
+
+
+bool CorsikaIACTFile::IsIACT(std::string s)
+{
+  std::ifstream f(s, std::ios::in | std::ios::binary);
+  uint32_t sync = 0;
+  return f.read(reinterpret_cast<char*>(&sync), 4) && sync == kSync;
+}
+
+
+
+bool CorsikaIACTFile::ReadObject(Object & o, bool top)
+{
+  CorsikaTimer timer(CorsikaProfiler::kSubBlockIO);
+
+  // Top level objects start with the sync marker
+  uint32_t sync = kSync;
+  if (top && !this->stream.read(reinterpret_cast<char*>(&sync), 4)) return false;
+  if (sync != kSync)
+  {
+    std::cerr << "CorsikaIACTFile::ReadObject(): no eventio sync marker at byte " << long(this->stream.tellg()) - 4 << " of " << this->sFileName << "." << std::endl;
+    return false;
+  }
+
+  // Type, version and flags, identifier and length, whose high bits are in
+  // an extension word when the extended flag is set
+  uint32_t w[3];
+  if (!this->stream.read(reinterpret_cast<char*>(w), 12)) return false;
+
+  o.type = w[0] & 0xffff;
+  o.version = (w[0] >> 20) & 0xfff;
+  o.id = int32_t(w[1]);
+  o.length = w[2] & 0x3fffffff;
+
+  if (w[0] & (1u << 17))
+  {
+    uint32_t ext = 0;
+    if (!this->stream.read(reinterpret_cast<char*>(&ext), 4)) return false;
+    o.length |= long(ext & 0xfff) << 30;
+  }
+
+  CorsikaProfiler::Count(CorsikaProfiler::kBytesRead, top ? 16 : 12);
+
+  return true;
+}
+
+
+
+bool CorsikaIACTFile::ReadFloats(std::vector<float> & v, long length)
+{
+  CorsikaTimer timer(CorsikaProfiler::kSubBlockIO);
+
+  // A count and the floats, e.g. the 273 words of a CORSIKA header
+  int n = 0;
+  this->stream.read(reinterpret_cast<char*>(&n), 4);
+  if (n < 0 || 4 + 4L*n > length)
+  {
+    std::cerr << "CorsikaIACTFile::ReadFloats(): invalid object in " << this->sFileName << "." << std::endl;
+    this->stream.seekg(length - 4, std::ios::cur);
+    return false;
+  }
+
+  v.resize(n);
+  this->stream.read(reinterpret_cast<char*>(v.data()), 4L*n);
+  this->stream.seekg(length - 4 - 4L*n, std::ios::cur);
+
+  CorsikaProfiler::Count(CorsikaProfiler::kBytesRead, 4 + 4L*n);
+
+  return bool(this->stream);
+}
+
+
+
+void CorsikaIACTFile::SkipObject(const Object & o)
+{
+  this->stream.seekg(o.length, std::ios::cur);
+}
+
+
+
+bool CorsikaIACTFile::NextShower()
+{
+  if (!this->kGood || this->kDone) return false;
+
+  // What is left of the current shower is skipped
+  if (this->iArrayEnd >= 0) this->stream.seekg(this->iArrayEnd);
+  this->iArrayEnd = -1;
+  this->iPhotonsEnd = -1;
+  this->nLeft = 0;
+
+  Object o;
+  while (this->ReadObject(o))
+  {
+    if (o.type == kEventHeader)
+    {
+      this->ReadFloats(this->vEventHeader, o.length);
+      if (this->vEventHeader.size() < 273)
+      {
+        std::cerr << "CorsikaIACTFile::NextShower(): invalid event header in " << this->sFileName << "." << std::endl;
+        break;
+      }
+
+      this->vEventEnd.clear();
+      this->vOffX.assign(1, 0.);
+      this->vOffY.assign(1, 0.);
+      this->vOffW.assign(1, 1.);
+      this->kShowerDone = false;
+      return true;
+    }
+    else if (o.type == kRunEnd)
+    {
+      this->ReadFloats(this->vEnd, o.length);
+      this->kDone = true;
+      return false;
+    }
+    else this->SkipObject(o);
+  }
+
+  if (this->vEnd.empty()) std::cerr << "CorsikaIACTFile::NextShower(): the file " << this->sFileName << " ends without run end." << std::endl;
+  this->kDone = true;
+  return false;
+}
+
+
+
+int CorsikaIACTFile::NextBunches(CorsikaBunches & b)
+{
+  //
+  // Find the next photon object of a requested telescope, going through
+  // the objects of the shower
+  //
+  Object o;
+  while (this->nLeft == 0)
+  {
+    if (!this->kGood || this->kShowerDone)
+    {
+      b.Resize(0);
+      return 0;
+    }
+
+    // Past the photons of the last telescope, whatever the object has after them
+    if (this->iPhotonsEnd >= 0 && long(this->stream.tellg()) != this->iPhotonsEnd) this->stream.seekg(this->iPhotonsEnd);
+    this->iPhotonsEnd = -1;
+
+    // Photons of the telescopes, within the current array object
+    if (this->iArrayEnd >= 0 && long(this->stream.tellg()) < this->iArrayEnd)
+    {
+      if (!this->ReadObject(o, false)) break;
+
+      if (o.type != kPhotons || !this->Wanted(o.id%1000))
+      {
+        this->SkipObject(o);
+        continue;
+      }
+
+      // Array, telescope, number of photons and of bunches
+      int16_t ids[2];
+      float photons;
+      int32_t nbunches;
+      this->stream.read(reinterpret_cast<char*>(ids), 4);
+      this->stream.read(reinterpret_cast<char*>(&photons), 4);
+      this->stream.read(reinterpret_cast<char*>(&nbunches), 4);
+
+      this->kCompact = o.version/1000 == 1;
+      const long nBytes = 12 + long(nbunches)*(this->kCompact ? 16 : 32);
+      if (nbunches < 0 || nBytes > o.length || ids[1] < 0 || ids[1] >= this->NTelescopes())
+      {
+        std::cerr << "CorsikaIACTFile::NextBunches(): invalid photons of telescope " << ids[1]+1 << " in shower " << this->ID() << "." << std::endl;
+        this->stream.seekg(o.length - 12, std::ios::cur);
+        continue;
+      }
+
+      this->iTelescope = ids[1];
+      this->iPhotonsEnd = long(this->stream.tellg()) - 12 + o.length;
+      this->nLeft = nbunches;
+      continue;
+    }
+    this->iArrayEnd = -1;
+
+    // Objects of the shower
+    const long pos = this->stream.tellg();
+    if (!this->ReadObject(o)) break;
+
+    if (o.type == kOffsets)
+    {
+      // Number of arrays, time offset, offsets in x and y, and weights since version 1
+      int narray = 0;
+      this->stream.read(reinterpret_cast<char*>(&narray), 4);
+      const long nBytes = 8 + (o.version >= 1 ? 12L : 8L)*narray;
+      if (narray < 1 || nBytes > o.length)
+      {
+        std::cerr << "CorsikaIACTFile::NextBunches(): invalid array offsets in shower " << this->ID() << "." << std::endl;
+        this->stream.seekg(o.length - 4, std::ios::cur);
+        continue;
+      }
+
+      this->stream.seekg(4, std::ios::cur);
+      this->vOffX.resize(narray);
+      this->vOffY.resize(narray);
+      this->vOffW.assign(narray, 1.);
+      this->stream.read(reinterpret_cast<char*>(this->vOffX.data()), 4L*narray);
+      this->stream.read(reinterpret_cast<char*>(this->vOffY.data()), 4L*narray);
+      if (o.version >= 1) this->stream.read(reinterpret_cast<char*>(this->vOffW.data()), 4L*narray);
+      this->stream.seekg(o.length - nBytes, std::ios::cur);
+    }
+    else if (o.type == kArray)
+    {
+      this->iArray = o.id;
+      this->iArrayEnd = long(this->stream.tellg()) + o.length;
+
+      double wsum = 0.;
+      for (auto w : this->vOffW) wsum += w;
+      const bool ok = this->iArray >= 0 && this->iArray < this->NArrays() && wsum > 0.;
+      this->fWeight = ok ? this->vOffW[this->iArray]/wsum : 0.;
+      if (!ok) std::cerr << "CorsikaIACTFile::NextBunches(): no offset for array " << this->iArray << " in shower " << this->ID() << "." << std::endl;
+    }
+    else if (o.type == kEventEnd)
+    {
+      this->ReadFloats(this->vEventEnd, o.length);
+      this->kShowerDone = true;
+    }
+    else if (o.type == kEventHeader || o.type == kRunEnd)
+    {
+      // A shower without event end: the object is read by NextShower()
+      std::cerr << "CorsikaIACTFile::NextBunches(): shower " << this->ID() << " has no event end." << std::endl;
+      this->stream.seekg(pos);
+      this->kShowerDone = true;
+    }
+    else this->SkipObject(o);
+  }
+
+  if (this->nLeft == 0)
+  {
+    std::cerr << "CorsikaIACTFile::NextBunches(): the file " << this->sFileName << " ends within shower " << this->ID() << "." << std::endl;
+    this->kShowerDone = true;
+    this->kDone = true;
+    b.Resize(0);
+    return 0;
+  }
+
+
+
+  //
+  // Read and decode a batch of bunches: x, y, cx, cy, time, zem, photons and
+  // wavelength, as floats, or as shorts in the compact format
+  //
+  const int n = std::min<long>(this->nLeft, kBatch);
+  const int nWord = this->kCompact ? 2 : 4;
+
+  this->vBuffer.resize(8*nWord*n);
+  {
+    CorsikaTimer timer(CorsikaProfiler::kSubBlockIO);
+    this->stream.read(this->vBuffer.data(), this->vBuffer.size());
+  }
+  CorsikaProfiler::Count(CorsikaProfiler::kBytesRead, this->vBuffer.size());
+
+  if (!this->stream)
+  {
+    std::cerr << "CorsikaIACTFile::NextBunches(): the file " << this->sFileName << " ends within shower " << this->ID() << "." << std::endl;
+    this->nLeft = 0;
+    this->kShowerDone = true;
+    this->kDone = true;
+    b.Resize(0);
+    return 0;
+  }
+  this->nLeft -= n;
+
+  CorsikaTimer timer(CorsikaProfiler::kDecode);
+
+  const float x0 = this->vTelX[this->iTelescope] + this->vOffX[this->iArray];
+  const float y0 = this->vTelY[this->iTelescope] + this->vOffY[this->iArray];
+
+  b.Resize(n);
+  float v[8];
+  for (int i = 0; i < n; i++)
+  {
+    if (this->kCompact)
+    {
+      int16_t u[8];
+      std::memcpy(u, this->vBuffer.data() + 16*i, 16);
+      v[0] = 0.1f*u[0];
+      v[1] = 0.1f*u[1];
+      v[2] = u[2]/30000.f;
+      v[3] = u[3]/30000.f;
+      v[4] = 0.1f*u[4];
+      v[5] = std::pow(10.f, 0.001f*u[5]);
+      v[6] = 0.01f*u[6];
+    }
+    else std::memcpy(v, this->vBuffer.data() + 32*i, 32);
+
+    b.posx[i]   = v[0] + x0;
+    b.posy[i]   = v[1] + y0;
+    b.cosu[i]   = v[2];
+    b.cosv[i]   = v[3];
+    b.nsec[i]   = v[4];
+    b.height[i] = v[5];
+    b.bunch[i]  = v[6]*this->fWeight;
+    b.weight[i] = 1.;
+  }
+
+  CorsikaProfiler::Count(CorsikaProfiler::kBunches, n);
+
+  return n;
+}
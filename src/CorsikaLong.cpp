@@ -5,15 +5,19 @@
 #include <algorithm>
 
 #include <CorsikaLong.h>
+#include <CorsikaGHFit.h>
+#include <CorsikaProfiler.h>
 
-CorsikaLong::CorsikaLong(std::string s)
+CorsikaLong::CorsikaLong(std::string s, long maxBytes)
 : stream(s)
 , nShow(0)
 , kGood(true)
 , kSlant(false)
-, vColPart({"depth","gammas","positrons","electrons","mu_p","mu_m","hadrons","charged","nuclei","cherenkov"})
-, vColDep({"depth","gamma","em_ioniz","em_cut","mu_ioniz","mu_cut","hadron_ioniz","hadron_cut","netrino","sum"})
+, nMaxBytes(maxBytes)
+, nBytes(0)
 {
+  CorsikaTimer timer(CorsikaProfiler::kLongParse);
+
   //
   // Check if file is open
   //
@@ -26,13 +30,6 @@ CorsikaLong::CorsikaLong(std::string s)
 
 
 
-  //
-  // An useful lambda
-  //
-  auto discard = [this](int n){std::string u; for(int i=0; i<n; i++) this->stream >> u;};
-
-
-
   //
   // Check if it is a longitudinal corsika file
   //
@@ -48,7 +45,7 @@ CorsikaLong::CorsikaLong(std::string s)
 
 
   // Check if profiles are given in vertical steps
-  discard(3);
+  this->Discard(3);
   this->stream >> buf;
   if (buf != "VERTICAL") this->kSlant = true;
   this->stream.seekg(0);
@@ -56,7 +53,7 @@ CorsikaLong::CorsikaLong(std::string s)
 
 
   //
-  // Parse file
+  // Parse file: the profiles of the first showers are kept, as many as fit
   //
   // while(std::getline(this->stream,buf))
   while (this->stream >> buf)
@@ -64,56 +61,203 @@ CorsikaLong::CorsikaLong(std::string s)
     // Check if we have a new shower
     if (buf != "LONGITUDINAL") continue;
 
-    int iEvent;
-    int iSteps;
+    std::streampos pos = this->stream.tellg();
+    int iEvent = this->ReadShower(this->nMaxBytes <= 0 || this->nBytes < this->nMaxBytes);
+    if (iEvent < 0) break;
 
-    // Get number of steps
-    discard(2);
-    this->stream >> iSteps;
+    // Save the event ID
+    this->mOffset[iEvent] = pos;
+    this->vID.push_back(iEvent);
+  }
 
-    // Get event number
-    discard(7);
-    this->stream >> iEvent;
+  // Get number of showers
+  this->nShow = this->vID.size();
 
-    // Discard column names
-    discard(10);
+}
 
-    // Alocate profiles
-    for (int itype = 0; itype < 2; itype++)
-      for (int idepth = 0; idepth < iSteps; idepth++)
-        for (int ipart = 0; ipart < 10; ipart++)
-          this->mProf[iEvent][itype][ipart] = std::vector<double>(iSteps);
 
-    // Get profiles
-    for (int itype = 0; itype < 2; itype++)
-    {
-      for (int idepth = 0; idepth < iSteps; idepth++)
-        for (int ipart = 0; ipart < 10; ipart++)
-          this->stream >> this->mProf[iEvent][itype][ipart][idepth];
 
-      // Discard the following couple of lines before the energy deposit profiles
-      if (itype == 0) discard(29);
-    }
+void CorsikaLong::Discard(int n)
+{
+  std::string u;
+  for (int i=0; i<n; i++) this->stream >> u;
+}
+
+
+
+//
+// Parse the shower that starts at the current position, just after its
+// LONGITUDINAL word. The fit is always stored, the profiles if asked for.
+//
+int CorsikaLong::ReadShower(bool keep)
+{
+  int iEvent = -1;
+  int iSteps = 0;
+
+  // Get number of steps
+  this->Discard(2);
+  this->stream >> iSteps;
+
+  // Get event number
+  this->Discard(7);
+  this->stream >> iEvent;
+
+  // Discard column names
+  this->Discard(10);
+
+  if (!this->stream || iSteps <= 0) return -1;
+
+  // Get profiles
+  std::map<int,std::map<int,std::vector<double>>> mShower;
+  for (int itype = 0; itype < 2; itype++)
+  {
+    for (int ipart = 0; ipart < 10; ipart++) mShower[itype][ipart] = std::vector<double>(iSteps);
+
+    for (int idepth = 0; idepth < iSteps; idepth++)
+      for (int ipart = 0; ipart < 10; ipart++)
+        this->stream >> mShower[itype][ipart][idepth];
+
+    // Discard the following couple of lines before the energy deposit profiles
+    if (itype == 0) this->Discard(29);
+  }
+
+  // Discard useless text before the GH fit
+  this->Discard(19);
+
+  // Get the Gaisser-Hillas fit of charged particle profile
+  if (this->mGH.count(iEvent) == 0) this->nBytes += 128;
+  this->mGH[iEvent] = std::vector<double>(8);
+  for (int ipar = 0; ipar < 8; ipar++)
+  {
+    if (ipar == 6) this->Discard(2);
+    else if (ipar == 7) this->Discard(5);
+    this->stream >> this->mGH[iEvent][ipar];
+  }
+
+  if (keep && this->mProf.count(iEvent) == 0)
+  {
+    this->mProf[iEvent] = std::move(mShower);
+    this->Keep(iEvent);
+  }
+
+  return iEvent;
+}
+
+
+
+//
+// Account for the profiles of a shower, and drop the oldest ones above the
+// maximum size, but the newest
+//
+void CorsikaLong::Keep(int iEvent)
+{
+  static const long nNodeBytes = 64;
+
+  auto bytes = [this](int id)
+  {
+    long n = 2*nNodeBytes;
+    for (auto & type : this->mProf[id])
+      for (auto & prof : type.second) n += nNodeBytes + prof.second.capacity()*sizeof(double);
+    return n;
+  };
+
+  this->nBytes += bytes(iEvent);
+  this->qKept.push_back(iEvent);
+
+  while (this->nMaxBytes > 0 && this->nBytes > this->nMaxBytes && this->qKept.size() > 1)
+  {
+    const int id = this->qKept.front();
+    this->qKept.pop_front();
+    this->nBytes -= bytes(id);
+    this->mProf.erase(id);
+  }
+}
+
+
+
+//
+// Make sure the profiles of a shower are in memory
+//
+bool CorsikaLong::Fetch(int n)
+{
+  if (this->mProf.count(n) > 0) return true;
+  if (this->mOffset.count(n) == 0) return false;
 
-    // Discard useless text before the GH fit
-    discard(19);
+  CorsikaTimer timer(CorsikaProfiler::kLongParse);
 
-    // Get the Gaisser-Hillas fit of charged particle profile
-    this->mGH[iEvent] = std::vector<double>(8);
-    for (int ipar = 0; ipar < 8; ipar++)
+  this->stream.clear();
+  this->stream.seekg(this->mOffset[n]);
+  return this->ReadShower(true) == n && this->mProf.count(n) > 0;
+}
+
+
+
+CorsikaLong::CorsikaLong()
+: nShow(0)
+, kGood(true)
+, kSlant(false)
+, nMaxBytes(0)
+, nBytes(0)
+{
+}
+
+
+
+void CorsikaLong::AddSubBlock(const float * p)
+{
+  CorsikaTimer timer(CorsikaProfiler::kLongParse);
+
+  static const int nHeader = 13;
+  static const int nRows = 26;
+
+  const int iEvent = int(p[1]);
+  const int iSteps = int(p[4])/100;
+  const int iBlock = int(p[5]);
+
+  if (iSteps <= 0 || iBlock <= 0 || (iBlock-1)*nRows >= iSteps)
+  {
+    std::cerr << "CorsikaLong::AddSubBlock(): invalid LONG sub-block for shower " << iEvent << "." << std::endl;
+    return;
+  }
+
+  // Allocate the profiles at the first sub-block of the shower
+  if (this->mSteps.count(iEvent) == 0)
+  {
+    for (int ipart = 0; ipart < 10; ipart++)
     {
-      if (ipar == 6) discard(2);
-      else if (ipar == 7) discard(5);
-      this->stream >> this->mGH[iEvent][ipar];
+      this->mProf[iEvent][0][ipart] = std::vector<double>(iSteps, 0.);
+      this->mProf[iEvent][1][ipart] = std::vector<double>(0);
     }
-
-    // Save the event ID
-    this->vID.push_back(iEvent);
+    this->mSteps[iEvent] = 0;
   }
 
-  // Get number of showers
-  this->nShow = this->vID.size();
+  auto & mShower = this->mProf[iEvent][0];
+  if (mShower[0].size() != iSteps) return;
+
+  const int iFirst = (iBlock-1)*nRows;
+  const int iLast = std::min(iSteps, iFirst + nRows);
+  for (int idepth = iFirst; idepth < iLast; idepth++)
+    for (int ipart = 0; ipart < 10; ipart++)
+      mShower[ipart][idepth] = p[nHeader + 10*(idepth - iFirst) + ipart];
+
+  this->mSteps[iEvent] += iLast - iFirst;
+  if (this->mSteps[iEvent] < iSteps || std::find(this->vID.begin(),this->vID.end(),iEvent) != this->vID.end()) return;
+
+  // All steps are in: fit the charged particles, as CORSIKA does for the
+  // .long file, and store the fit as there: 6 parameters, chi2/ndof and a
+  // deviation, left to 0
+  CorsikaGHFit ghfit(6);
+  ghfit.Add(mShower[0], mShower[7]);
+  ghfit.Fit();
 
+  this->mGH[iEvent] = ghfit.GetParameters(0);
+  this->mGH[iEvent].push_back(ghfit.GetNdof(0) > 0 ? ghfit.GetChi2(0)/ghfit.GetNdof(0) : 0.);
+  this->mGH[iEvent].push_back(0.);
+  this->nBytes += 128;
+  this->Keep(iEvent);
+
+  this->vID.push_back(iEvent);
+  this->nShow = this->vID.size();
 }
 
 
@@ -126,13 +270,19 @@ void CorsikaLong::Print(int n)
     return;
   }
 
-  std::cout << "Shower ID: " << n << std::endl << std::endl;
+  if (!this->Fetch(n))
+  {
+    std::cerr << "CorsikaLong::Print(): the profiles of the ID " << n << " are not in memory anymore." << std::endl;
+    return;
+  }
 
+  std::cout << "Shower ID: " << n << std::endl << std::endl;
 
-  int iSteps = this->mProf[n][0][0].size();
 
   for (int itype = 0; itype < 2; itype++)
   {
+    int iSteps = this->mProf[n][itype][0].size();
+
     if (itype == 0) std::cout << "Particle profiles" << std::endl;
     else std::cout << std::endl << "Energy deposit profiles" << std::endl;
 
@@ -176,50 +326,70 @@ double CorsikaLong::GetXmax(int n)
 
 
 
-std::vector<double> CorsikaLong::GetProfile(int n, int ipart)
+//
+// The profile is copied into the capacity of the buffer, so that a buffer
+// reused from shower to shower is not allocated again
+//
+bool CorsikaLong::FillProfile(int n, int itype, int ipart, std::vector<double> & v)
 {
+  v.clear();
+
   if (std::find(this->vID.begin(),this->vID.end(),n) == this->vID.end())
   {
-    std::cerr << "CorsikaLong::GetProfile(): no data available for shower with ID " << n << "." << std::endl;
-    return std::vector<double>(0);
+    std::cerr << "CorsikaLong::FillProfile(): no data available for shower with ID " << n << "." << std::endl;
+    return false;
   }
 
-  if (ipart < 0 || ipart >= 10)
+  if (itype < 0 || itype >= 2 || ipart < 0 || ipart >= 10)
   {
-    std::cerr << "CorsikaLong::GetProfile(): particle type should be between 0 and 9. Value given is " << ipart << "." << std::endl;
-    return std::vector<double>(0);
+    std::cerr << "CorsikaLong::FillProfile(): table should be 0 or 1 and particle type between 0 and 9. Values given are " << itype << " and " << ipart << "." << std::endl;
+    return false;
   }
 
-  return this->mProf[n][0][ipart];
+  if (!this->Fetch(n))
+  {
+    std::cerr << "CorsikaLong::FillProfile(): the profiles of shower " << n << " are not in memory anymore." << std::endl;
+    return false;
+  }
+
+  // The LONG sub-blocks of CER files have no energy deposit table
+  auto & mTables = this->mProf[n];
+  auto iTable = mTables.find(itype);
+  if (iTable == mTables.end()) return true;
+  auto iColumn = iTable->second.find(ipart);
+  if (iColumn != iTable->second.end()) v.assign(iColumn->second.begin(), iColumn->second.end());
+
+  return true;
 }
 
 
 
-std::vector<double> CorsikaLong::GetDepositProfile(int n, int ipart)
+std::vector<double> CorsikaLong::GetProfile(int n, int ipart)
 {
-  if (std::find(this->vID.begin(),this->vID.end(),n) == this->vID.end())
-  {
-    std::cerr << "CorsikaLong::GetDepositProfile(): no data available for shower with ID " << n << "." << std::endl;
-    return std::vector<double>(0);
-  }
+  std::vector<double> v;
+  this->FillProfile(n, 0, ipart, v);
+  return v;
+}
+
 
-  if (ipart < 0 || ipart >= 10)
-  {
-    std::cerr << "CorsikaLong::GetDepositProfile(): particle type should be between 0 and 9. Value given is " << ipart << "." << std::endl;
-    return std::vector<double>(0);
-  }
 
-  return this->mProf[n][1][ipart];
+std::vector<double> CorsikaLong::GetDepositProfile(int n, int ipart)
+{
+  std::vector<double> v;
+  this->FillProfile(n, 1, ipart, v);
+  return v;
 }
 
 
 
-std::vector<double> CorsikaLong::GetFit(int n)
+const std::vector<double> & CorsikaLong::GetFit(int n)
 {
+  static const std::vector<double> vNone;
+
   if (std::find(this->vID.begin(),this->vID.end(),n) == this->vID.end())
   {
     std::cerr << "CorsikaLong::GetFit(): no data available for shower with ID " << n << "." << std::endl;
-    return std::vector<double>(0);
+    return vNone;
   }
 
   return this->mGH[n];
@@ -227,11 +397,14 @@ std::vector<double> CorsikaLong::GetFit(int n)
 
 
 
-std::string CorsikaLong::GetColumnName(int i, int j)
+std::string CorsikaLong::ColumnName(int i, int j)
 {
+  static const char * vColPart[10] = {"depth","gammas","positrons","electrons","mu_p","mu_m","hadrons","charged","nuclei","cherenkov"};
+  static const char * vColDep[10] = {"depth","gamma","em_ioniz","em_cut","mu_ioniz","mu_cut","hadron_ioniz","hadron_cut","netrino","sum"};
+
   if (j < 0 || j >= 10) return std::string("");
 
-  if (i == 0) return this->vColPart[j];
-  else if (i == 1) return this->vColDep[j];
+  if (i == 0) return vColPart[j];
+  else if (i == 1) return vColDep[j];
   else return std::string("");
 }
@@ -0,0 +1,125 @@
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <algorithm>
+
+#include <sys/resource.h>
+
+#include <CorsikaMemory.h>
+
+long CorsikaMemory::nBudget = 0;
+
+static std::mutex mMemoryLock;
+static long vMemoryPeak[CorsikaMemory::kNSubsystems + 1] = {0};
+
+
+
+CorsikaMemory::CorsikaMemory()
+{
+  for (int i = 0; i < kNSubsystems; i++) this->vBytes[i] = 0;
+}
+
+
+
+//
+// The instance of the calling thread. Instances are never deleted, so the
+// peaks remain available after worker threads are gone.
+//
+CorsikaMemory & CorsikaMemory::Local()
+{
+  thread_local CorsikaMemory * p = 0;
+
+  if (!p)
+  {
+    p = new CorsikaMemory();
+    std::lock_guard<std::mutex> lock(mMemoryLock);
+    Instances().push_back(p);
+  }
+
+  return *p;
+}
+
+
+
+std::vector<CorsikaMemory*> & CorsikaMemory::Instances()
+{
+  static std::vector<CorsikaMemory*> v;
+  return v;
+}
+
+
+
+void CorsikaMemory::Set(int s, long bytes)
+{
+  CorsikaMemory & local = Local();
+  std::lock_guard<std::mutex> lock(mMemoryLock);
+
+  local.vBytes[s] = bytes;
+
+  // Peaks of the subsystem and of the total, the last entry
+  long sum = 0, total = 0;
+  for (auto p : Instances())
+  {
+    sum += p->vBytes[s];
+    for (int i = 0; i < kNSubsystems; i++) total += p->vBytes[i];
+  }
+  vMemoryPeak[s] = std::max(vMemoryPeak[s], sum);
+  vMemoryPeak[kNSubsystems] = std::max(vMemoryPeak[kNSubsystems], total);
+}
+
+
+
+long CorsikaMemory::Current(int s)
+{
+  std::lock_guard<std::mutex> lock(mMemoryLock);
+
+  long sum = 0;
+  for (auto p : Instances())
+    for (int i = 0; i < kNSubsystems; i++)
+      if (s < 0 || i == s) sum += p->vBytes[i];
+
+  return sum;
+}
+
+
+
+long CorsikaMemory::Peak(int s)
+{
+  std::lock_guard<std::mutex> lock(mMemoryLock);
+  return vMemoryPeak[s < 0 ? kNSubsystems : s];
+}
+
+
+
+long CorsikaMemory::Resident()
+{
+  // Maximum resident set size, in kB on Linux
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  return long(usage.ru_maxrss)*1024;
+}
+
+
+
+std::string CorsikaMemory::SubsystemName(int s)
+{
+  static const char * names[kNSubsystems] = {"input","long_profiles","accumulators","output_queue"};
+  return (s >= 0 && s < kNSubsystems) ? names[s] : "";
+}
+
+
+
+void CorsikaMemory::Print()
+{
+  std::cout << "Memory (peak, MB):" << std::endl;
+  std::cout << std::setprecision(4);
+  for (int i = 0; i < kNSubsystems; i++) std::cout << std::setw(15) << SubsystemName(i) << std::setw(12) << Peak(i)*1.e-6 << std::endl;
+  std::cout << std::setw(15) << "total" << std::setw(12) << Peak()*1.e-6 << std::endl;
+  std::cout << std::setw(15) << "resident" << std::setw(12) << Resident()*1.e-6 << std::endl;
+  if (nBudget > 0)
+  {
+    std::cout << std::setw(15) << "budget" << std::setw(12) << nBudget*1.e-6;
+    std::cout << (Peak() > nBudget ? "  (exceeded after compaction, see the messages above)" : "") << std::endl;
+  }
+  std::cout << std::setprecision(6);
+}
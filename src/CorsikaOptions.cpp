@@ -0,0 +1,116 @@
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <climits>
+#include <cerrno>
+
+#include <CorsikaOptions.h>
+
+CorsikaOptions::CorsikaOptions(int argc, char ** argv, std::map<std::string,int> mKnown)
+: kGood(true)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string s = argv[i];
+
+    // Positional argument
+    if (s.size() < 3 || s.compare(0,2,"--") != 0)
+    {
+      this->vArgs.push_back(s);
+      continue;
+    }
+
+    // Option: check if it is known and get its values
+    s = s.substr(2);
+
+    if (mKnown.count(s) == 0)
+    {
+      std::cerr << "Unknown option --" << s << "." << std::endl;
+      this->kGood = false;
+      continue;
+    }
+
+    if (i + mKnown[s] >= argc)
+    {
+      std::cerr << "Option --" << s << " expects " << mKnown[s] << " value(s)." << std::endl;
+      this->kGood = false;
+      return;
+    }
+
+    this->mOpt[s] = std::vector<std::string>(argv + i + 1, argv + i + 1 + mKnown[s]);
+    i += mKnown[s];
+  }
+}
+
+
+
+std::string CorsikaOptions::GetString(std::string s, std::string def, int i)
+{
+  if (!this->Has(s) || i < 0 || i >= this->mOpt[s].size()) return def;
+  return this->mOpt[s][i];
+}
+
+
+
+//
+// A value of an option (or an argument, for an empty name) as a number, an
+// integer if kInt: anything left after the number makes the options bad
+//
+bool CorsikaOptions::Parse(std::string s, std::string sValue, bool kInt, double & x)
+{
+  char * pEnd = 0;
+  errno = 0;
+  if (kInt)
+  {
+    const long n = std::strtol(sValue.c_str(), &pEnd, 10);
+    x = n;
+    if (n < INT_MIN || n > INT_MAX) errno = ERANGE;
+  }
+  else x = std::strtod(sValue.c_str(), &pEnd);
+
+  if (!sValue.empty() && *pEnd == '\0' && errno == 0) return true;
+
+  if (s.empty()) std::cerr << "Argument " << sValue << " is not " << (kInt ? "an integer" : "a number") << "." << std::endl;
+  else std::cerr << "Option --" << s << " expects " << (kInt ? "an integer" : "a number") << ", not " << sValue << "." << std::endl;
+  this->kGood = false;
+  return false;
+}
+
+
+
+void CorsikaOptions::CheckNumbers(std::string s, bool kInt, int first, int n)
+{
+  if (!this->Has(s)) return;
+
+  double x;
+  const int last = n < 0 ? this->mOpt[s].size() : std::min<int>(first + n, this->mOpt[s].size());
+  for (int i = first; i < last; i++) this->Parse(s, this->mOpt[s][i], kInt, x);
+}
+
+
+
+double CorsikaOptions::GetDouble(std::string s, double def, int i)
+{
+  double x;
+  if (!this->Has(s) || i < 0 || i >= this->mOpt[s].size()) return def;
+  return this->Parse(s, this->mOpt[s][i], false, x) ? x : def;
+}
+
+
+
+int CorsikaOptions::GetInt(std::string s, int def, int i)
+{
+  double x;
+  if (!this->Has(s) || i < 0 || i >= this->mOpt[s].size()) return def;
+  return this->Parse(s, this->mOpt[s][i], true, x) ? int(x) : def;
+}
+
+
+
+int CorsikaOptions::GetArgInt(int n, int def)
+{
+  double x;
+  if (n < 0 || n >= this->vArgs.size()) return def;
+  return this->Parse("", this->vArgs[n], true, x) ? int(x) : def;
+}
@@ -0,0 +1,219 @@
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#include <CorsikaProfileGrid.h>
+#include <CorsikaSerialize.h>
+
+static const char sGridMagic[4] = {'P','G','R','D'};
+static const int iGridVersion = 2;
+
+CorsikaProfileGrid::CorsikaProfileGrid(int nprof)
+: iType(kDepth)
+, nProfiles(nprof)
+{
+}
+
+
+
+void CorsikaProfileGrid::Allocate()
+{
+  const int n = this->vNodes.size();
+  this->vSum.assign(this->nProfiles*n, 0.);
+  this->vCount.assign(this->nProfiles*n, 0.);
+  this->vIndex.assign(n, 0);
+  this->vFrac.assign(n, 0.);
+  this->vIn.assign(n, 0.);
+}
+
+
+
+void CorsikaProfileGrid::SetGrid(int type, int n, double min, double max)
+{
+  this->iType = type == kAge ? kAge : kDepth;
+  this->vNodes.resize(std::max(n, 1));
+  for (int j = 0; j < this->vNodes.size(); j++) this->vNodes[j] = n > 1 ? min + j*(max - min)/(n - 1) : min;
+  this->Allocate();
+}
+
+
+
+void CorsikaProfileGrid::Add(const std::vector<std::vector<double>> & vProf, double xmax)
+{
+  if (vProf.size() < 2 || vProf[0].size() < 2) return;
+
+  const std::vector<double> & vDepth = vProf[0];
+  const int m = vDepth.size();
+
+  if (this->vNodes.empty())
+  {
+    this->vNodes = vDepth;
+    this->Allocate();
+  }
+
+  if (this->iType == kAge && !(xmax > 0.)) return;
+
+  //
+  // Position of the nodes among the depths of the shower. The nodes and the
+  // depths are increasing, so one sweep finds all intervals.
+  //
+  const int n = this->vNodes.size();
+  int i = 0;
+  for (int j = 0; j < n; j++)
+  {
+    const double s = this->vNodes[j];
+    const double x = this->iType == kAge ? (s < 3. ? 2.*xmax*s/(3. - s) : vDepth[m-1] + 1.) : s;
+
+    if (!(x >= vDepth[0] && x <= vDepth[m-1]))
+    {
+      this->vIndex[j] = 0;
+      this->vFrac[j] = 0.;
+      this->vIn[j] = 0.;
+      continue;
+    }
+
+    while (i < m-2 && vDepth[i+1] < x) i++;
+    const double dx = vDepth[i+1] - vDepth[i];
+    this->vIndex[j] = i;
+    this->vFrac[j] = dx > 0. ? (x - vDepth[i])/dx : 0.;
+    this->vIn[j] = 1.;
+  }
+
+  //
+  // Interpolate and add each profile
+  //
+  const int * idx = this->vIndex.data();
+  const double * f = this->vFrac.data();
+  const double * in = this->vIn.data();
+
+  // A profile shorter than the depths does not count for its column
+  for (int k = 0; k < this->nProfiles && k+1 < vProf.size(); k++)
+  {
+    if (vProf[k+1].size() < m) continue;
+
+    const double * y = vProf[k+1].data();
+    double * sum = this->vSum.data() + k*n;
+    double * count = this->vCount.data() + k*n;
+    for (int j = 0; j < n; j++)
+    {
+      sum[j] += in[j]*((1. - f[j])*y[idx[j]] + f[j]*y[idx[j]+1]);
+      count[j] += in[j];
+    }
+  }
+}
+
+
+
+void CorsikaProfileGrid::Merge(const CorsikaProfileGrid & other)
+{
+  if (other.vNodes.empty()) return;
+
+  if (this->vNodes.empty())
+  {
+    *this = other;
+    return;
+  }
+
+  if (other.iType != this->iType || other.nProfiles != this->nProfiles)
+  {
+    std::cerr << "CorsikaProfileGrid::Merge(): the grids are of different kinds." << std::endl;
+    return;
+  }
+
+  const int n = this->vNodes.size();
+
+  if (other.vNodes == this->vNodes)
+  {
+    for (size_t j = 0; j < this->vSum.size(); j++) this->vSum[j] += other.vSum[j];
+    for (size_t j = 0; j < this->vCount.size(); j++) this->vCount[j] += other.vCount[j];
+    return;
+  }
+
+  // Different nodes, e.g. grids taken from showers of different zenith
+  // angles: sums and counts are interpolated as the profiles are
+  const int m = other.vNodes.size();
+  for (int j = 0; j < n; j++)
+  {
+    const double x = this->vNodes[j];
+    if (m < 2 || !(x >= other.vNodes[0] && x <= other.vNodes[m-1])) continue;
+
+    const int i = std::min<int>(std::upper_bound(other.vNodes.begin(), other.vNodes.end(), x) - other.vNodes.begin() - 1, m-2);
+    const double dx = other.vNodes[i+1] - other.vNodes[i];
+    const double f = dx > 0. ? (x - other.vNodes[i])/dx : 0.;
+
+    for (int k = 0; k < this->nProfiles; k++)
+    {
+      this->vSum[k*n + j] += (1. - f)*other.vSum[k*m + i] + f*other.vSum[k*m + i+1];
+      this->vCount[k*n + j] += (1. - f)*other.vCount[k*m + i] + f*other.vCount[k*m + i+1];
+    }
+  }
+}
+
+
+
+bool CorsikaProfileGrid::Filled()
+{
+  for (auto c : this->vCount) if (c > 0.) return true;
+  return false;
+}
+
+
+
+std::vector<double> CorsikaProfileGrid::Average(int k)
+{
+  const int n = this->vNodes.size();
+  std::vector<double> v(n, 0.);
+  if (k < 0 || k >= this->nProfiles) return v;
+
+  for (int j = 0; j < n; j++) v[j] = this->vCount[k*n + j] > 0. ? this->vSum[k*n + j]/this->vCount[k*n + j] : 0.;
+  return v;
+}
+
+
+
+void CorsikaProfileGrid::Serialize(std::vector<char> & v)
+{
+  const unsigned long n = this->vNodes.size();
+
+  v.clear();
+  CorsikaAppend(v, sGridMagic, 4);
+  CorsikaAppend(v, &iGridVersion);
+  CorsikaAppend(v, &this->iType);
+  CorsikaAppend(v, &this->nProfiles);
+  CorsikaAppend(v, &n);
+  CorsikaAppend(v, this->vNodes.data(), n);
+  CorsikaAppend(v, this->vCount.data(), this->nProfiles*n);
+  CorsikaAppend(v, this->vSum.data(), this->nProfiles*n);
+}
+
+
+
+bool CorsikaProfileGrid::Deserialize(const std::vector<char> & v)
+{
+  size_t pos = 0;
+  char magic[4];
+  int version = 0, type = 0, nprof = 0;
+  unsigned long n = 0;
+
+  bool ok = CorsikaExtract(v, pos, magic, 4) && std::memcmp(magic, sGridMagic, 4) == 0;
+  ok = ok && CorsikaExtract(v, pos, &version) && version == iGridVersion;
+  ok = ok && CorsikaExtract(v, pos, &type) && CorsikaExtract(v, pos, &nprof) && CorsikaExtract(v, pos, &n);
+  ok = ok && nprof > 0 && pos + (1 + 2*nprof)*n*sizeof(double) <= v.size();
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaProfileGrid::Deserialize(): not a valid profile grid." << std::endl;
+    return false;
+  }
+
+  this->iType = type;
+  this->nProfiles = nprof;
+  this->vNodes.resize(n);
+  this->Allocate();
+
+  CorsikaExtract(v, pos, this->vNodes.data(), n);
+  CorsikaExtract(v, pos, this->vCount.data(), nprof*n);
+  CorsikaExtract(v, pos, this->vSum.data(), nprof*n);
+
+  return true;
+}
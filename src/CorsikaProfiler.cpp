@@ -0,0 +1,150 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <mutex>
+
+#include <CorsikaProfiler.h>
+
+bool CorsikaProfiler::kEnabled = false;
+int CorsikaProfiler::nThreads = 1;
+
+static std::mutex mProfilerLock;
+static std::chrono::steady_clock::time_point tProfilerStart;
+
+
+
+CorsikaProfiler::CorsikaProfiler()
+{
+  for (int i = 0; i < kNStages; i++) this->vTime[i] = this->vCalls[i] = 0.;
+  for (int i = 0; i < kNCounters; i++) this->vCount[i] = 0.;
+}
+
+
+
+//
+// The instance of the calling thread. Instances are never deleted, so the
+// totals remain available after worker threads are gone.
+//
+CorsikaProfiler & CorsikaProfiler::Local()
+{
+  thread_local CorsikaProfiler * p = 0;
+
+  if (!p)
+  {
+    p = new CorsikaProfiler();
+    std::lock_guard<std::mutex> lock(mProfilerLock);
+    Instances().push_back(p);
+  }
+
+  return *p;
+}
+
+
+
+std::vector<CorsikaProfiler*> & CorsikaProfiler::Instances()
+{
+  static std::vector<CorsikaProfiler*> v;
+  return v;
+}
+
+
+
+void CorsikaProfiler::Enable(bool k)
+{
+  if (k && !kEnabled) tProfilerStart = std::chrono::steady_clock::now();
+  kEnabled = k;
+}
+
+
+
+double CorsikaProfiler::Total(int i, bool kTime)
+{
+  std::lock_guard<std::mutex> lock(mProfilerLock);
+
+  double sum = 0.;
+  for (auto p : Instances()) sum += kTime ? p->vTime[i] : p->vCount[i];
+
+  return sum;
+}
+
+
+
+double CorsikaProfiler::WallTime()
+{
+  if (!kEnabled) return 0.;
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - tProfilerStart).count();
+}
+
+
+
+std::string CorsikaProfiler::StageName(int s)
+{
+  static const char * names[kNStages] = {"subblock_io","decode","filter","geometry","fill","root_io","long_parse"};
+  return (s >= 0 && s < kNStages) ? names[s] : "";
+}
+
+
+
+std::string CorsikaProfiler::CounterName(int c)
+{
+  static const char * names[kNCounters] = {"bytes_read","subblocks","bunches","accepted_bunches","showers","particles"};
+  return (c >= 0 && c < kNCounters) ? names[c] : "";
+}
+
+
+
+void CorsikaProfiler::Print()
+{
+  if (!kEnabled) return;
+
+  double wall = WallTime();
+  double io = GetTime(kSubBlockIO) + GetTime(kRootIO) + GetTime(kLongParse);
+  double compute = GetTime(kDecode) + GetTime(kFilter) + GetTime(kGeometry) + GetTime(kFill);
+
+  // Stage times are summed over the threads, the shares are of their total time
+  const double threadTime = nThreads*wall;
+
+  std::cout << "Profile (wall time " << std::setprecision(4) << wall << " s, " << nThreads << " thread(s)):" << std::endl;
+  for (int i = 0; i < kNStages; i++)
+  {
+    std::cout << std::setw(15) << StageName(i);
+    std::cout << std::setw(12) << GetTime(i) << " s";
+    std::cout << std::setw(10) << (threadTime > 0 ? 100.*GetTime(i)/threadTime : 0.) << " %";
+    std::cout << std::endl;
+  }
+  for (int i = 0; i < kNCounters; i++) std::cout << std::setw(15) << CounterName(i) << std::setw(12) << GetCount(i) << std::endl;
+  if (wall > 0)
+  {
+    std::cout << std::setw(15) << "MB/s" << std::setw(12) << GetCount(kBytesRead)/wall*1.e-6 << std::endl;
+    std::cout << std::setw(15) << "bunches/s" << std::setw(12) << GetCount(kBunches)/wall << std::endl;
+  }
+  std::cout << "This run was " << (io > compute ? "I/O" : "compute") << "-bound (I/O " << io << " s, compute " << compute << " s)." << std::endl;
+  std::cout << std::setprecision(6);
+}
+
+
+
+bool CorsikaProfiler::WriteJSON(std::string s)
+{
+  std::ofstream out(s);
+  if (!out.is_open())
+  {
+    std::cerr << "CorsikaProfiler::WriteJSON(): could not open " << s << "." << std::endl;
+    return false;
+  }
+
+  double wall = WallTime();
+
+  out << "{" << std::endl;
+  out << "  \"wall_time\": " << wall << "," << std::endl;
+  out << "  \"threads\": " << nThreads << "," << std::endl;
+  out << "  \"stages\": {" << std::endl;
+  for (int i = 0; i < kNStages; i++) out << "    \"" << StageName(i) << "\": " << GetTime(i) << (i < kNStages-1 ? "," : "") << std::endl;
+  out << "  }," << std::endl;
+  out << "  \"counters\": {" << std::endl;
+  for (int i = 0; i < kNCounters; i++) out << "    \"" << CounterName(i) << "\": " << std::setprecision(15) << GetCount(i) << (i < kNCounters-1 ? "," : "") << std::endl;
+  out << "  }" << std::endl;
+  out << "}" << std::endl;
+
+  return out.good();
+}
@@ -0,0 +1,728 @@
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <thread>
+#include <algorithm>
+#include <map>
+
+#include <TFile.h>
+
+#include <CorsikaReader.h>
+#include <CorsikaFile.h>
+#include <CorsikaIACTFile.h>
+#include <CorsikaShower.h>
+#include <CorsikaLong.h>
+#include <CorsikaAtmosphere.h>
+#include <CorsikaBunches.h>
+#include <CorsikaParticles.h>
+#include <CorsikaProfiler.h>
+#include <CorsikaAnalysis.h>
+#include <CorsikaCheckpoint.h>
+#include <CorsikaRun.h>
+#include <CorsikaBunchIndex.h>
+#include <CorsikaMemory.h>
+
+//
+// The showers of a CER file, from the start of the range of the shard, if
+// any, to the first shower after it. The headers of the showers and the
+// ends of their particle data are taken from the saved index, if any.
+//
+class CorsikaReader::SourceCER : public CorsikaReader::Source
+{
+private:
+
+  CorsikaReader & reader;
+  int ifile;
+  CorsikaFile & cfile;
+  CorsikaLong & clong;
+  CorsikaAtmosphere & catm;
+  CorsikaAnalysis & analysis;
+  CorsikaBunches & bunches;
+  CorsikaFile * pDat;
+  CorsikaBunchIndex * pIndex;
+  CorsikaBunchIndex * pSaved;
+
+  std::unique_ptr<CorsikaShower> pShower;
+
+public:
+
+  long iShardFirst;
+  long iShardLast;
+  long iShardStop;
+  std::vector<int> vFileIDs;
+
+  SourceCER(CorsikaReader & r, int i, CorsikaFile & f, CorsikaLong & l, CorsikaAtmosphere & a, CorsikaAnalysis & an, CorsikaBunches & b, CorsikaFile * d, CorsikaBunchIndex * x, CorsikaBunchIndex * s, long first, long last)
+  : reader(r), ifile(i), cfile(f), clong(l), catm(a), analysis(an), bunches(b), pDat(d), pIndex(x), pSaved(s), iShardFirst(first), iShardLast(last), iShardStop(-1)
+  {
+  }
+
+  bool Next(std::vector<float> & vHeader)
+  {
+    while (!this->cfile.Done())
+    {
+      //
+      // Get next shower and check
+      //
+      this->pShower.reset(new CorsikaShower(this->cfile.NextShower()));
+      auto & shower = *this->pShower;
+      if (!shower.Good()) continue;
+
+      // The shower of the next shard starts here; its particles are found by their ID
+      if (shower.SubBlock() - 1 >= this->iShardLast)
+      {
+        this->iShardStop = shower.SubBlock() - 1;
+        return false;
+      }
+      if (this->pDat && this->iShardFirst > 0 && this->vFileIDs.empty() && !this->pDat->SeekShower(shower.ID()))
+        std::cerr << "The DAT file has no particles for shower " << shower.ID() << "." << std::endl;
+
+      // The profiles of the shower are after its particle data
+      if (this->reader.kEmbedded && !shower.ReadLong(this->clong, this->pSaved ? this->pSaved->End(shower.ID()) : -1))
+        std::cerr << "Shower " << shower.ID() << " has no LONG sub-blocks." << std::endl;
+
+      vHeader = shower.GetHeader();
+      return true;
+    }
+    return false;
+  }
+
+  void Begin()
+  {
+    this->vFileIDs.push_back(this->pShower->ID());
+    if (this->pIndex) this->pIndex->BeginShower(this->pShower->ID(), this->pShower->SubBlock());
+  }
+
+  //
+  // Loop over batches of particles, straight to their end for a shower
+  // found whole in the cache, whose number of sub-blocks it keeps
+  //
+  void Fill(bool kBunches)
+  {
+    auto & shower = *this->pShower;
+    const int iRun = this->reader.run.RunNumber(this->ifile);
+    const long iFirstSub = shower.SubBlock();
+    if (!kBunches) shower.SkipTo(iFirstSub + this->analysis.NSubBlocks());
+    while(!shower.Done())
+    {
+      long iSub = shower.SubBlock();
+      if (!kBunches || !this->reader.sampler.Keep(iRun, shower.ID(), iSub - iFirstSub))
+      {
+        shower.SkipBunches();
+        this->analysis.Skip();
+        continue;
+      }
+      shower.NextBunches(this->bunches);
+      if (this->pIndex) this->pIndex->Add(iSub, this->bunches);
+      this->analysis.Fill(this->bunches, this->catm);
+    }
+    if (this->pIndex) this->pIndex->EndShower(shower.SubBlock());
+  }
+
+  bool Resumable(){return true;}
+
+  void Save(CorsikaCheckpoint & ckpt)
+  {
+    ckpt.Set("Input", {double(this->reader.run.RunNumber(this->ifile)), double(this->cfile.NSubBlocksTotal())});
+    ckpt.Set("SubBlock", {double(this->cfile.Tell())});
+  }
+
+  long Bytes(){return this->cfile.Bytes();}
+
+};
+
+
+
+//
+// The showers of an IACT eventio file: the bunches of the requested
+// telescopes, in batches as the sub-blocks of a CER file
+//
+class CorsikaReader::SourceIACT : public CorsikaReader::Source
+{
+private:
+
+  CorsikaIACTFile & iact;
+  CorsikaAtmosphere & catm;
+  CorsikaAnalysis & analysis;
+  CorsikaBunches & bunches;
+
+public:
+
+  SourceIACT(CorsikaIACTFile & f, CorsikaAtmosphere & a, CorsikaAnalysis & an, CorsikaBunches & b)
+  : iact(f), catm(a), analysis(an), bunches(b)
+  {
+  }
+
+  bool Next(std::vector<float> & vHeader)
+  {
+    if (!this->iact.NextShower()) return false;
+    vHeader = this->iact.GetEventHeader();
+    return true;
+  }
+
+  // The IACT times are already relative to the arrival of the front at the core
+  void Begin(){this->analysis.SetCoreTime(0.);}
+
+  // Batches of bunches of all requested telescopes and arrays
+  void Fill(bool kBunches)
+  {
+    while (kBunches && this->iact.NextBunches(this->bunches) > 0) this->analysis.Fill(this->bunches, this->catm);
+  }
+
+  long Bytes(){return this->iact.Bytes();}
+
+};
+
+
+
+CorsikaReader::CorsikaReader(CorsikaRun & r, TFile & f, std::vector<std::unique_ptr<CorsikaAnalysis>> & v)
+: run(r)
+, froot(f)
+, vAnalysis(v)
+, maxShowers(0)
+, nLongBytes(0)
+, kSalvage(false)
+, kCurved(false)
+, kParticles(false)
+, kEmbedded(false)
+, kSlant(false)
+, kIndex(false)
+, kKeepIndex(false)
+, pCkpt(NULL)
+, nCheckpoint(0)
+, kResume(false)
+, iShard(0)
+, nShards(0)
+, nRunBytes(0)
+, nStarted(0)
+, nShardRead(0)
+, nShardRange(0)
+, kFailed(false)
+, kOverBudget(false)
+{
+}
+
+
+
+void CorsikaReader::SetEmbeddedLong(bool kSlantDepth)
+{
+  this->kEmbedded = true;
+  this->kSlant = kSlantDepth;
+}
+
+
+
+void CorsikaReader::SetIndex(bool kKeep)
+{
+  this->kIndex = true;
+  this->kKeepIndex = kKeep;
+}
+
+
+
+void CorsikaReader::SetCheckpoint(CorsikaCheckpoint & ckpt, std::string sFile, int n, bool kLoaded)
+{
+  this->pCkpt = &ckpt;
+  this->sCkpFil = sFile;
+  this->nCheckpoint = n;
+  this->kResume = kLoaded;
+}
+
+
+
+//
+// The sizes of the files define the byte ranges of the shards
+//
+void CorsikaReader::SetShard(int i, int n)
+{
+  this->iShard = i;
+  this->nShards = n;
+
+  this->vFileBytes.assign(this->run.NFiles(), 0);
+  this->nRunBytes = 0;
+  for (int k = 0; k < this->run.NFiles(); k++)
+  {
+    std::ifstream f(this->run.CerName(k), std::ifstream::binary | std::ifstream::ate);
+    this->vFileBytes[k] = f ? long(f.tellg()) : 0;
+    this->nRunBytes += this->vFileBytes[k];
+  }
+}
+
+
+
+bool CorsikaReader::Multi()
+{
+  return this->run.NFiles() > 1;
+}
+
+
+
+//
+// The bounds are computed alike by all shards, so that each sub-block is in
+// one range
+//
+void CorsikaReader::ShardBounds(int ifile, long nSub, long & first, long & last)
+{
+  long b0 = 0;
+  for (int i = 0; i < ifile; i++) b0 += this->vFileBytes[i];
+
+  auto bound = [&](int k)
+  {
+    const long b = std::min(std::max(this->nRunBytes*k/this->nShards - b0, 0L), this->vFileBytes[ifile]);
+    return this->vFileBytes[ifile] > 0 ? long(double(b)/this->vFileBytes[ifile]*nSub) : 0L;
+  };
+
+  first = bound(this->iShard - 1);
+  last = bound(this->iShard);
+}
+
+
+
+//
+// Over the budget, the accumulators are compacted. The stores that grow
+// with the showers are bounded, so that what is left over is the current
+// shower and the input buffers: the run goes on.
+//
+void CorsikaReader::Account(CorsikaAnalysis & analysis, long input, CorsikaLong & clong)
+{
+  CorsikaMemory::Set(CorsikaMemory::kInput, input);
+  CorsikaMemory::Set(CorsikaMemory::kLong, clong.Bytes());
+  CorsikaMemory::Set(CorsikaMemory::kAccumulators, analysis.Bytes());
+  CorsikaMemory::Set(CorsikaMemory::kOutput, analysis.OutputBytes());
+  if (!CorsikaMemory::OverBudget()) return;
+
+  analysis.Compact();
+  CorsikaMemory::Set(CorsikaMemory::kAccumulators, analysis.Bytes());
+  if (!CorsikaMemory::OverBudget()) return;
+
+  std::lock_guard<std::mutex> lock(this->mtxOut);
+  if (!this->kOverBudget) std::cerr << "The memory budget is exceeded by the current shower and the input buffers after compaction (" << CorsikaMemory::Current()*1.e-6 << " MB), going on." << std::endl;
+  this->kOverBudget = true;
+}
+
+
+
+//
+// CORSIKA writes the showers in the same order to the CER and DAT files;
+// if a shower is missing in one of them, the DAT file is moved to the
+// shower with the same ID, or left where it is for the next CER shower.
+//
+void CorsikaReader::FillParticles(CorsikaFile * pDat, int id, CorsikaAnalysis & analysis, CorsikaParticles & particles)
+{
+  if (!pDat || pDat->Done()) return;
+
+  const long iPos = pDat->Tell();
+  auto dshower = pDat->NextShower();
+  if (dshower.Good() && dshower.ID() != id && pDat->SeekShower(id))
+  {
+    std::cerr << "The DAT file has shower " << dshower.ID() << " where shower " << id << " was expected, moved to shower " << id << "." << std::endl;
+    dshower = pDat->NextShower();
+  }
+
+  if (!dshower.Good() || dshower.ID() != id)
+  {
+    std::cerr << "The DAT file has no particles for shower " << id << "." << std::endl;
+    pDat->Seek(iPos);
+    return;
+  }
+
+  // The particles of a shower found in the cache are only skipped
+  const bool kFill = analysis.NeedsParticles();
+  while (!dshower.Done())
+  {
+    if (!kFill)
+    {
+      dshower.SkipBunches();
+      continue;
+    }
+    dshower.NextParticles(particles);
+    analysis.FillParticles(particles);
+  }
+}
+
+
+
+//
+// The input of photons (of the given kind), the profiles and the particles
+//
+bool CorsikaReader::CheckInputs(int ifile, bool kGood, std::string sKind, CorsikaLong & clong, CorsikaFile * pDat)
+{
+  const bool kMulti = this->Multi();
+
+  if (!kGood)
+  {
+    std::cerr << "Some error happened when trying to open the " << sKind << " with cherenkov photons!" << (kMulti ? " Will skip it." : " Will exit.") << std::endl;
+    std::cerr << "File is: " << this->run.CerName(ifile) << std::endl;
+  }
+  else if (!clong.Good())
+  {
+    std::cerr << "Some error happened when trying to open the file with longitudinal profiles!" << (kMulti ? " Will skip it." : " Will exit.") << std::endl;
+    std::cerr << "File is: " << this->run.LongName(ifile) << std::endl;
+  }
+  else if (pDat && !pDat->Good())
+  {
+    std::cerr << "Some error happened when trying to open the file with ground particles!" << (kMulti ? " Will skip it." : " Will exit.") << std::endl;
+    std::cerr << "File is: " << this->run.DatName(ifile) << std::endl;
+  }
+  else return true;
+
+  this->kFailed = true;
+  return false;
+}
+
+
+
+//
+// The banner of a file comes after the lines of its photons and profiles
+//
+TDirectory * CorsikaReader::BeginFile(int ifile, std::string sInputs, int nShow, int date, int version, CorsikaFile * pDat)
+{
+  // Showers of each file go to their own directory when reading several files
+  TDirectory * pDir = &this->froot;
+  if (this->Multi())
+  {
+    std::string sRunDir = "Run_" + CorsikaRun::RunString(this->run.RunNumber(ifile));
+    this->froot.mkdir(sRunDir.c_str());
+    pDir = this->froot.GetDirectory(sRunDir.c_str());
+  }
+
+  std::cout << sInputs;
+  if (pDat) std::cout << "+ Particle file " << this->run.DatName(ifile) << ": Ok" << std::endl;
+  std::cout << "+ Number of showers: " << nShow << std::endl;
+  std::cout << "+ Date of run start: " << date%100 << "/" << date%10000/100 << "/" << date/10000 << " (dd/mm/yy)" << std::endl;
+  std::cout << "+ CORSIKA version:   " << version << std::endl;
+  std::cout << std::endl;
+  std::cout << "Starting loop over showers...";
+  std::cout << std::setw(10) << "Energy";
+  std::cout << std::setw(10) << "Theta";
+  std::cout << std::setw(10) << "Phi";
+  std::cout << std::setw(10) << "Xmax";
+  std::cout << std::setw(10) << "ID";
+  std::cout << std::endl;
+
+  return pDir;
+}
+
+
+
+//
+// The loop over the showers of an input file, until its end or the maximum
+// number of showers of the run
+//
+void CorsikaReader::ReadShowers(int ifile, int nShow, TDirectory * pDir, Source & source, CorsikaAnalysis & analysis, CorsikaLong & clong, CorsikaAtmosphere & catm, CorsikaFile * pDat, CorsikaBunches & bunches, CorsikaParticles & particles)
+{
+  std::unique_lock<std::mutex> lock(this->mtxOut, std::defer_lock);
+
+  const int wShow = std::floor(std::log10(std::max(1,nShow)))+1;
+
+  int nFile = 0;
+  std::vector<float> vHeader;
+  while (source.Next(vHeader))
+  {
+    lock.lock();
+    bool kLimit = this->maxShowers > 0 && this->nStarted >= this->maxShowers;
+    if (!kLimit) this->nStarted++;
+    lock.unlock();
+
+    if (kLimit) break;
+
+    CorsikaProfiler::Count(CorsikaProfiler::kShowers);
+
+    // Put Xmax of the current shower in a variable, since it is used later
+    const int id = int(vHeader[1]);
+    float xmax = clong.GetXmax(id);
+
+    // Start the shower in the analysis, this adds it to the header tree,
+    // and build the slant depth table along its axis
+    analysis.BeginShower(vHeader, clong.GetFit(id));
+    catm.SetShower(vHeader[10], vHeader[47], this->kCurved);
+    source.Begin();
+    nFile++;
+
+
+
+    //
+    // Shower message, printed as a whole when the shower is done
+    //
+    std::ostringstream sMessage;
+    sMessage << "+ Reading shower ";
+    sMessage << std::setw(wShow) << nFile;
+    sMessage << "/";
+    sMessage << std::setw(wShow) << nShow;
+    sMessage << ":";
+    sMessage << std::setw(10) << vHeader[3] << " GeV";
+    sMessage << std::setw(10) << vHeader[10];
+    sMessage << std::setw(10) << vHeader[11];
+    sMessage << std::setw(10) << xmax;
+    sMessage << std::setw(10) << id;
+    if (this->Multi()) sMessage << "  (run " << CorsikaRun::RunString(this->run.RunNumber(ifile)) << ")";
+    sMessage << " ... ";
+
+
+
+    //
+    // Get profiles
+    //
+    analysis.AddProfiles(clong);
+
+    // Parts of the shower found in the cache are not filled again, and
+    // its bunches are skipped if they all were
+    source.Fill(analysis.UseCache(vHeader, catm));
+
+    // Ground particles of the same shower
+    this->FillParticles(pDat, id, analysis, particles);
+
+    lock.lock();
+
+    // A shower written after the checkpoint we resume from is written again
+    if (this->kResume) pDir->Delete(("Event_" + std::to_string(id) + ";*").c_str());
+
+    // Write histograms of this shower to output file
+    analysis.EndShower(*pDir);
+
+
+
+    //
+    // Final shower message
+    //
+    std::cout << sMessage.str() << "Done!" << std::endl;
+
+
+
+    //
+    // Checkpoint: flush the output file, then save the state and the position of the next shower
+    //
+    if (source.Resumable() && this->nCheckpoint > 0 && analysis.NShowers()%this->nCheckpoint == 0)
+    {
+      CorsikaTimer timer(CorsikaProfiler::kRootIO);
+      this->froot.Write();
+      this->froot.Flush();
+
+      auto & ckpt = *this->pCkpt;
+      ckpt.Clear();
+      analysis.Save(ckpt);
+      source.Save(ckpt);
+      if (pDat) ckpt.Set("ParticleSubBlock", {double(pDat->Tell())});
+      ckpt.Write(this->sCkpFil);
+    }
+
+    lock.unlock();
+
+    this->Account(analysis, source.Bytes() + bunches.Bytes() + (pDat ? pDat->Bytes() + particles.Bytes() : 0), clong);
+  }
+}
+
+
+
+void CorsikaReader::ReadIACT(int ifile, CorsikaAnalysis & analysis, CorsikaBunches & bunches, CorsikaParticles & particles)
+{
+  auto sInpFil = this->run.CerName(ifile);
+  auto sInpLng = this->run.LongName(ifile);
+
+  CorsikaIACTFile   iact(sInpFil, this->sTelescopes);
+  CorsikaLong       clong(sInpLng, this->nLongBytes);
+  CorsikaAtmosphere catm(iact.GetHeader());
+
+  std::unique_ptr<CorsikaFile> pDat;
+  if (this->kParticles) pDat.reset(new CorsikaFile(this->run.DatName(ifile)));
+
+  std::unique_lock<std::mutex> lock(this->mtxOut);
+
+  if (!this->CheckInputs(ifile, iact.Good(), "IACT file", clong, pDat.get())) return;
+
+  std::ostringstream sInputs;
+  sInputs << "+ IACT file " << sInpFil << ": Ok" << std::endl;
+  sInputs << "+ Telescopes: " << (this->sTelescopes.empty() ? iact.NTelescopes() : int(this->sTelescopes.size())) << " of " << iact.NTelescopes() << std::endl;
+  sInputs << "+ Longitudinal file " << sInpLng << ": " << (clong.Good() ? "Ok" : "Fail") << std::endl;
+  TDirectory * pDir = this->BeginFile(ifile, sInputs.str(), iact.NShow(), iact.StartDate(), iact.Version(), pDat.get());
+
+  lock.unlock();
+
+
+
+  //
+  // Loop over showers
+  //
+  SourceIACT source(iact, catm, analysis, bunches);
+  this->ReadShowers(ifile, iact.NShow(), pDir, source, analysis, clong, catm, pDat.get(), bunches, particles);
+
+  // A streamed file is only known to be complete at its run end
+  if (iact.Done() && iact.GetEnd().empty())
+  {
+    lock.lock();
+    std::cerr << "The IACT file " << sInpFil << " ends without run end: its last shower may be incomplete." << std::endl;
+    this->kFailed = true;
+    lock.unlock();
+  }
+}
+
+
+
+void CorsikaReader::ReadCER(int ifile, CorsikaAnalysis & analysis, CorsikaBunches & bunches, CorsikaParticles & particles)
+{
+  auto sInpFil = this->run.CerName(ifile);
+  auto sInpLng = this->run.LongName(ifile);
+  const bool kShard = this->nShards > 0;
+
+  // Corsika related stuff: the CERXXXXXX file, the .long file (or the
+  // profiles of the LONG sub-blocks, filled per shower) and the atmospheric profile object
+  CorsikaFile       cfile(sInpFil, this->kSalvage);
+  CorsikaLong       clong = this->kEmbedded ? CorsikaLong() : CorsikaLong(sInpLng, this->nLongBytes);
+  CorsikaAtmosphere catm(cfile);
+  if (this->kEmbedded) clong.SetSlant(this->kSlant);
+  if (this->kEmbedded) clong.SetMaxBytes(this->nLongBytes);
+
+  // The DATXXXXXX particle file of the same run, read in the same pass
+  std::unique_ptr<CorsikaFile> pDat;
+  if (this->kParticles) pDat.reset(new CorsikaFile(this->run.DatName(ifile), this->kSalvage));
+
+  std::unique_lock<std::mutex> lock(this->mtxOut);
+
+  if (!this->CheckInputs(ifile, cfile.Good(), "file", clong, pDat.get())) return;
+
+  // The checkpoint must be made for this input
+  if (this->kResume)
+  {
+    auto & ckpt = *this->pCkpt;
+    if (!ckpt.Has("Input") || ckpt.Get("Input") != std::vector<double>{double(this->run.RunNumber(ifile)), double(cfile.NSubBlocksTotal())})
+    {
+      std::cerr << "The checkpoint " << this->sCkpFil << " was not made for the input " << sInpFil << "! Will exit." << std::endl;
+      this->kFailed = true;
+      return;
+    }
+    cfile.Seek(long(ckpt.Get("SubBlock")[0]));
+    if (pDat && ckpt.Has("ParticleSubBlock")) pDat->Seek(long(ckpt.Get("ParticleSubBlock")[0]));
+  }
+
+  // The index saved by an earlier pass, if it is up to date: the headers of
+  // the showers and the ends of their particle data are taken from it
+  CorsikaBunchIndex saved;
+  const bool kSaved = (kShard || this->kEmbedded || this->kIndex) && saved.Read(CorsikaBunchIndex::FileName(sInpFil)) && saved.NFileSubBlocks() == cfile.NSubBlocksTotal();
+
+  // The range of the shard in this file, from which the next shower header is looked for
+  long iShardFirst = 0, iShardLast = cfile.NSubBlocksTotal();
+  if (kShard)
+  {
+    this->ShardBounds(ifile, cfile.NSubBlocksTotal(), iShardFirst, iShardLast);
+    if (iShardFirst >= iShardLast) return;
+    cfile.Seek(iShardFirst);
+
+    auto mHeaders = kSaved ? saved.Headers() : std::map<int,long>();
+    cfile.SetHeaders(mHeaders);
+    for (auto & h : mHeaders)
+      if (h.second >= iShardFirst) {cfile.Seek(h.second); break;}
+  }
+
+  std::ostringstream sInputs;
+  sInputs << "+ Cherenkov file " << sInpFil << ": " << (cfile.Good() ? "Ok" : "Fail") << std::endl;
+  if (this->kEmbedded) sInputs << "+ Longitudinal profiles: LONG sub-blocks (" << (clong.Slant() ? "slant" : "vertical") << ")" << std::endl;
+  else sInputs << "+ Longitudinal file " << sInpLng << ": " << (clong.Good() ? "Ok" : "Fail") << std::endl;
+  TDirectory * pDir = this->BeginFile(ifile, sInputs.str(), cfile.NShow(), cfile.StartDate(), cfile.Version(), pDat.get());
+
+  lock.unlock();
+
+
+
+  // Spatial index of the bunches at ground, built during the pass, or
+  // with the cache kept as saved by an earlier pass if it is up to date
+  std::unique_ptr<CorsikaBunchIndex> pIndex;
+  if (this->kIndex && !this->kKeepIndex)
+  {
+    pIndex.reset(new CorsikaBunchIndex());
+    pIndex->SetFileSubBlocks(cfile.NSubBlocksTotal());
+  }
+  else if (this->kIndex)
+  {
+    lock.lock();
+    if (kSaved) std::cout << "+ Spatial index " << CorsikaBunchIndex::FileName(sInpFil) << " is up to date, and kept" << std::endl;
+    else std::cerr << "The spatial index " << CorsikaBunchIndex::FileName(sInpFil) << " is out of date, and can not be saved again with the cache." << std::endl;
+    lock.unlock();
+  }
+
+
+
+  //
+  // Loop over showers
+  //
+  SourceCER source(*this, ifile, cfile, clong, catm, analysis, bunches, pDat.get(), pIndex.get(), kSaved ? &saved : NULL, iShardFirst, iShardLast);
+  this->ReadShowers(ifile, cfile.NShow(), pDir, source, analysis, clong, catm, pDat.get(), bunches, particles);
+
+  // Sub-blocks read by the shard, from the start of its range to the next shower after it
+  if (kShard)
+  {
+    lock.lock();
+    this->nShardRead += (source.iShardStop >= 0 ? source.iShardStop : cfile.Tell()) - iShardFirst;
+    this->nShardRange += iShardLast - iShardFirst;
+    lock.unlock();
+  }
+
+  // Save the index next to the input
+  if (pIndex && pIndex->NShowers() > 0)
+  {
+    auto sIdxFil = CorsikaBunchIndex::FileName(sInpFil);
+    bool ok = pIndex->Write(sIdxFil);
+    lock.lock();
+    if (ok) std::cout << "+ Spatial index of " << pIndex->NShowers() << " shower(s) was saved to " << sIdxFil << std::endl;
+    lock.unlock();
+  }
+
+  //
+  // Salvage report of this file
+  //
+  if (cfile.Truncated())
+  {
+    lock.lock();
+    std::cout << std::endl;
+    std::cout << "Salvage mode: recovered " << source.vFileIDs.size() << " complete shower(s) from " << sInpFil << ", a file without run end." << std::endl;
+    std::cout << "Recovered shower IDs:";
+    for (auto id : source.vFileIDs) std::cout << " " << id;
+    std::cout << std::endl;
+    if (cfile.SkippedShower() >= 0) std::cout << "Skipped incomplete shower ID: " << cfile.SkippedShower() << std::endl;
+    std::cout << std::endl;
+    lock.unlock();
+  }
+}
+
+
+
+void CorsikaReader::Read(int ithread)
+{
+  auto & analysis = *this->vAnalysis[ithread];
+
+  // The bunch and particle batches
+  CorsikaBunches bunches(39);
+  CorsikaParticles particles(39);
+
+  int ifile;
+  while ((ifile = this->run.Claim()) >= 0)
+  {
+    analysis.SetRun(this->run.RunNumber(ifile));
+
+    // IACT eventio files are recognized by their sync marker
+    if (CorsikaIACTFile::IsIACT(this->run.CerName(ifile))) this->ReadIACT(ifile, analysis, bunches, particles);
+    else this->ReadCER(ifile, analysis, bunches, particles);
+  }
+}
+
+
+
+//
+// The showers already in the analysis of the first reader (those before the
+// checkpoint we resume from) count for the maximum number of showers
+//
+void CorsikaReader::Run(int nThreads)
+{
+  this->nStarted = this->vAnalysis[0]->NShowers();
+
+  if (nThreads == 1)
+  {
+    this->Read(0);
+    return;
+  }
+
+  std::vector<std::thread> vThreads;
+  for (int i = 0; i < nThreads; i++) vThreads.emplace_back(&CorsikaReader::Read, this, i);
+  for (auto & t : vThreads) t.join();
+}
@@ -0,0 +1,191 @@
+#include <cstring>
+
+#include <TH2.h>
+
+#include <CorsikaResultArena.h>
+#include <CorsikaSerialize.h>
+
+long CorsikaResultArena::Book(int nx, double xmin, double xmax, int ny, double ymin, double ymax)
+{
+  Hist hist;
+  hist.nx = nx;
+  hist.ny = ny;
+  hist.xmin = xmin;
+  hist.xmax = xmax;
+  hist.ymin = ymin;
+  hist.ymax = ymax;
+  hist.offset = this->vBuffer.size();
+  hist.nCells = long(nx + 2)*(ny > 0 ? ny + 2 : 1);
+
+  // The ROOT histogram used to write it, with its sums of squared weights
+  if (ny > 0) hist.carrier.reset(new TH2D("","",nx,xmin,xmax,ny,ymin,ymax));
+  else hist.carrier.reset(new TH1D("","",nx,xmin,xmax));
+  hist.carrier->Sumw2();
+
+  this->vBuffer.resize(this->vBuffer.size() + 2*hist.nCells + kNStats, 0.);
+  this->vHist.push_back(std::move(hist));
+
+  return this->vHist.size() - 1;
+}
+
+
+
+int CorsikaResultArena::Book1D(int nx, double xmin, double xmax)
+{
+  return this->Book(nx, xmin, xmax, 0, 0., 0.);
+}
+
+
+
+int CorsikaResultArena::Book2D(int nx, double xmin, double xmax, int ny, double ymin, double ymax)
+{
+  return this->Book(nx, xmin, xmax, ny, ymin, ymax);
+}
+
+
+
+void CorsikaResultArena::Reset()
+{
+  if (!this->vBuffer.empty()) std::memset(this->vBuffer.data(), 0, this->vBuffer.size()*sizeof(double));
+}
+
+
+
+void CorsikaResultArena::AddTo(int h, TH1 & target, bool squared)
+{
+  const Hist & hist = this->vHist[h];
+  const double * c = this->Contents(h);
+  const double * e = this->Sumw2(h);
+  const double * s = c + 2*hist.nCells;
+
+  double * t = target.GetArray();
+  if (squared)
+  {
+    for (long i = 0; i < hist.nCells; i++) t[i] += c[i]*c[i];
+    return;
+  }
+
+  for (long i = 0; i < hist.nCells; i++) t[i] += c[i];
+
+  if (target.GetSumw2N() == 0) target.Sumw2();
+  double * t2 = target.GetSumw2()->GetArray();
+  for (long i = 0; i < hist.nCells; i++) t2[i] += e[i];
+
+  double stats[13] = {0.};
+  target.GetStats(stats);
+  for (int i = 0; i < kEntries; i++) stats[i] += s[i];
+  target.PutStats(stats);
+  target.SetEntries(target.GetEntries() + s[kEntries]);
+}
+
+
+
+void CorsikaResultArena::Write(int h, const char * name)
+{
+  Hist & hist = this->vHist[h];
+  const double * c = this->Contents(h);
+  double stats[13] = {0.};
+  std::memcpy(stats, c + 2*hist.nCells, kEntries*sizeof(double));
+
+  TH1 & carrier = *hist.carrier;
+  std::memcpy(carrier.GetArray(), c, hist.nCells*sizeof(double));
+  std::memcpy(carrier.GetSumw2()->GetArray(), c + hist.nCells, hist.nCells*sizeof(double));
+  carrier.PutStats(stats);
+  carrier.SetEntries(c[2*hist.nCells + kEntries]);
+  carrier.Write(name);
+}
+
+
+
+void CorsikaResultArena::Append(int h, std::vector<char> & v)
+{
+  const Hist & hist = this->vHist[h];
+  const double * c = this->Contents(h);
+  const double * e = this->Sumw2(h);
+
+  long n = 0;
+  for (long i = 0; i < hist.nCells; i++)
+    if (c[i] != 0. || e[i] != 0.) n++;
+
+  CorsikaAppend(v, &hist.nCells);
+  CorsikaAppend(v, &n);
+  for (long i = 0; i < hist.nCells; i++)
+  {
+    if (c[i] == 0. && e[i] == 0.) continue;
+    CorsikaAppend(v, &i);
+    CorsikaAppend(v, c + i);
+    CorsikaAppend(v, e + i);
+  }
+  CorsikaAppend(v, c + 2*hist.nCells, kNStats);
+}
+
+
+
+bool CorsikaResultArena::Extract(int h, const std::vector<char> & v, size_t & pos)
+{
+  const Hist & hist = this->vHist[h];
+  double * c = this->Contents(h);
+  double * e = this->Sumw2(h);
+
+  long nCells = 0, n = 0;
+  if (!CorsikaExtract(v, pos, &nCells) || nCells != hist.nCells || !CorsikaExtract(v, pos, &n)) return false;
+
+  // Left empty if the buffer ends before the histogram
+  std::memset(c, 0, (2*hist.nCells + kNStats)*sizeof(double));
+  bool ok = true;
+  for (long j = 0; ok && j < n; j++)
+  {
+    long i = 0;
+    ok = CorsikaExtract(v, pos, &i) && i >= 0 && i < hist.nCells;
+    ok = ok && CorsikaExtract(v, pos, c + i) && CorsikaExtract(v, pos, e + i);
+  }
+  ok = ok && CorsikaExtract(v, pos, c + 2*hist.nCells, kNStats);
+
+  if (!ok) std::memset(c, 0, (2*hist.nCells + kNStats)*sizeof(double));
+  return ok;
+}
+
+
+
+bool CorsikaResultArena::ExtractTo(const std::vector<char> & v, size_t & pos, TH1 * target)
+{
+  long nCells = 0, n = 0;
+  if (!CorsikaExtract(v, pos, &nCells) || !CorsikaExtract(v, pos, &n) || n < 0) return false;
+  if (target && nCells != target->GetNcells()) return false;
+
+  // Cells as index, content and sum of squared weights, then the statistics
+  const size_t nCell = sizeof(long) + 2*sizeof(double);
+  if (pos + n*nCell + kNStats*sizeof(double) > v.size()) return false;
+
+  if (!target)
+  {
+    pos += n*nCell + kNStats*sizeof(double);
+    return true;
+  }
+
+  double * t = target->GetArray();
+  if (target->GetSumw2N() == 0) target->Sumw2();
+  double * t2 = target->GetSumw2()->GetArray();
+  for (long j = 0; j < n; j++)
+  {
+    long i = 0;
+    double c = 0., e = 0.;
+    CorsikaExtract(v, pos, &i);
+    CorsikaExtract(v, pos, &c);
+    CorsikaExtract(v, pos, &e);
+    if (i < 0 || i >= nCells) continue;
+    t[i] += c;
+    t2[i] += e;
+  }
+
+  double s[kNStats];
+  CorsikaExtract(v, pos, s, kNStats);
+
+  double stats[13] = {0.};
+  target->GetStats(stats);
+  for (int i = 0; i < kEntries; i++) stats[i] += s[i];
+  target->PutStats(stats);
+  target->SetEntries(target->GetEntries() + s[kEntries]);
+
+  return true;
+}
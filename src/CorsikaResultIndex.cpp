@@ -0,0 +1,307 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <CorsikaResultIndex.h>
+#include <CorsikaSerialize.h>
+
+static const char sResultMagic[4] = {'C','R','E','S'};
+static const int iResultVersion = 1;
+
+CorsikaResultIndex::CorsikaResultIndex()
+: nParts(0)
+, nMaxBytes(0)
+, pSpill(NULL, std::fclose)
+, nSpilled(0)
+{
+}
+
+
+
+void CorsikaResultIndex::Add(int run, const std::vector<double> & vHeader, const std::vector<uint64_t> & vPartKeys)
+{
+  if (this->NShowers() == 0) this->nParts = vPartKeys.size();
+  if (this->nMaxBytes > 0 && !this->vRuns.empty() && this->Bytes() + this->RecordBytes() > this->nMaxBytes) this->Spill();
+
+  this->vRuns.push_back(run);
+  this->vHeaderRows.push_back(vHeader);
+  this->vHeaderRows.back().resize(kNColumns, 0.);
+  this->vKeys.push_back(vPartKeys);
+  this->vKeys.back().resize(this->nParts, 0);
+}
+
+
+
+//
+// The showers in memory are appended to the file. If no temporary file can
+// be opened, they stay in memory.
+//
+void CorsikaResultIndex::Spill()
+{
+  if (this->vRuns.empty()) return;
+
+  if (!this->pSpill) this->pSpill.reset(std::tmpfile());
+  if (!this->pSpill)
+  {
+    std::cerr << "CorsikaResultIndex::Spill(): could not open a temporary file, the showers are kept in memory." << std::endl;
+    this->nMaxBytes = 0;
+    return;
+  }
+
+  std::vector<char> v;
+  this->AppendRows(v);
+  std::fseek(this->pSpill.get(), 0, SEEK_END);
+  if (std::fwrite(v.data(), 1, v.size(), this->pSpill.get()) != v.size())
+  {
+    std::cerr << "CorsikaResultIndex::Spill(): could not write the temporary file, the showers are kept in memory." << std::endl;
+    this->nMaxBytes = 0;
+    return;
+  }
+
+  this->nSpilled += this->vRuns.size();
+  this->vRuns.clear();
+  this->vHeaderRows.clear();
+  this->vKeys.clear();
+}
+
+
+
+bool CorsikaResultIndex::ReadSpilled(std::function<void(const char *, long)> f)
+{
+  if (this->nSpilled == 0) return true;
+
+  const long nRecord = this->RecordBytes();
+  std::vector<char> v(256*nRecord);
+  FILE * file = this->pSpill.get();
+  if (std::fseek(file, 0, SEEK_SET) != 0) return false;
+
+  for (long i = 0; i < this->nSpilled; )
+  {
+    const long n = std::min(256L, this->nSpilled - i);
+    if (std::fread(v.data(), 1, n*nRecord, file) != size_t(n*nRecord))
+    {
+      std::cerr << "CorsikaResultIndex::ReadSpilled(): could not read the temporary file." << std::endl;
+      return false;
+    }
+    f(v.data(), n);
+    i += n;
+  }
+
+  return true;
+}
+
+
+
+void CorsikaResultIndex::Merge(CorsikaResultIndex & other)
+{
+  if (this->sCacheDir.empty()) this->sCacheDir = other.sCacheDir;
+
+  const int n = other.nParts;
+  int run = 0;
+  std::vector<double> vHeader(kNColumns);
+  std::vector<uint64_t> vPartKeys(n);
+  other.ReadSpilled([&](const char * p, long nRecords)
+  {
+    for (long i = 0; i < nRecords; i++)
+    {
+      std::memcpy(&run, p, sizeof(int));
+      std::memcpy(vHeader.data(), p + sizeof(int), kNColumns*sizeof(double));
+      std::memcpy(vPartKeys.data(), p + sizeof(int) + kNColumns*sizeof(double), n*sizeof(uint64_t));
+      this->Add(run, vHeader, vPartKeys);
+      p += other.RecordBytes();
+    }
+  });
+
+  for (size_t i = 0; i < other.vRuns.size(); i++) this->Add(other.vRuns[i], other.vHeaderRows[i], other.vKeys[i]);
+}
+
+
+
+void CorsikaResultIndex::AppendHead(std::vector<char> & v)
+{
+  const long nRun = this->sRun.size();
+  const long nDir = this->sCacheDir.size();
+  const long nShowers = this->NShowers();
+
+  CorsikaAppend(v, sResultMagic, 4);
+  CorsikaAppend(v, &iResultVersion);
+  CorsikaAppend(v, &nRun);
+  CorsikaAppend(v, this->sRun.data(), nRun);
+  CorsikaAppend(v, &nDir);
+  CorsikaAppend(v, this->sCacheDir.data(), nDir);
+  CorsikaAppend(v, &this->nParts);
+  CorsikaAppend(v, &nShowers);
+}
+
+
+
+void CorsikaResultIndex::AppendRows(std::vector<char> & v)
+{
+  for (size_t i = 0; i < this->vRuns.size(); i++)
+  {
+    CorsikaAppend(v, &this->vRuns[i]);
+    CorsikaAppend(v, this->vHeaderRows[i].data(), kNColumns);
+    CorsikaAppend(v, this->vKeys[i].data(), this->nParts);
+  }
+}
+
+
+
+void CorsikaResultIndex::Serialize(std::vector<char> & v)
+{
+  v.clear();
+  this->AppendHead(v);
+  this->ReadSpilled([this, &v](const char * p, long n){v.insert(v.end(), p, p + n*this->RecordBytes());});
+  this->AppendRows(v);
+}
+
+
+
+bool CorsikaResultIndex::Deserialize(const std::vector<char> & v)
+{
+  size_t pos = 0;
+  char magic[4];
+  int version = 0, n = 0;
+  long nRun = -1, nDir = -1, nShowers = -1;
+
+  bool ok = CorsikaExtract(v, pos, magic, 4) && std::memcmp(magic, sResultMagic, 4) == 0;
+  ok = ok && CorsikaExtract(v, pos, &version) && version == iResultVersion;
+  ok = ok && CorsikaExtract(v, pos, &nRun) && nRun >= 0 && pos + nRun <= v.size();
+  if (ok) this->sRun.assign(v.data() + pos, nRun);
+  pos += ok ? nRun : 0;
+  ok = ok && CorsikaExtract(v, pos, &nDir) && nDir >= 0 && pos + nDir <= v.size();
+  if (ok) this->sCacheDir.assign(v.data() + pos, nDir);
+  pos += ok ? nDir : 0;
+  ok = ok && CorsikaExtract(v, pos, &n) && n >= 0;
+  ok = ok && CorsikaExtract(v, pos, &nShowers) && nShowers >= 0;
+  ok = ok && pos + nShowers*(sizeof(int) + kNColumns*sizeof(double) + n*sizeof(uint64_t)) == v.size();
+
+  this->vRuns.clear();
+  this->vHeaderRows.clear();
+  this->vKeys.clear();
+  this->pSpill.reset();
+  this->nSpilled = 0;
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaResultIndex::Deserialize(): not a valid result index." << std::endl;
+    return false;
+  }
+
+  this->nParts = n;
+  this->vRuns.resize(nShowers);
+  this->vHeaderRows.assign(nShowers, std::vector<double>(kNColumns));
+  this->vKeys.assign(nShowers, std::vector<uint64_t>(n));
+  for (long i = 0; i < nShowers; i++)
+  {
+    CorsikaExtract(v, pos, &this->vRuns[i]);
+    CorsikaExtract(v, pos, this->vHeaderRows[i].data(), kNColumns);
+    CorsikaExtract(v, pos, this->vKeys[i].data(), n);
+  }
+
+  if (this->nMaxBytes > 0 && this->Bytes() > this->nMaxBytes) this->Spill();
+
+  return true;
+}
+
+
+
+//
+// Write to a temporary file and rename it over the target. The spilled
+// showers are copied by blocks, not read back into memory at once.
+//
+bool CorsikaResultIndex::Write(std::string s)
+{
+  std::string sTmp = s + ".tmp";
+  FILE * f = std::fopen(sTmp.c_str(), "wb");
+  if (!f)
+  {
+    std::cerr << "CorsikaResultIndex::Write(): could not open " << sTmp << "." << std::endl;
+    return false;
+  }
+
+  std::vector<char> v;
+  this->AppendHead(v);
+  bool ok = std::fwrite(v.data(), 1, v.size(), f) == v.size();
+  ok = ok && this->ReadSpilled([this, f, &ok](const char * p, long n){ok = ok && std::fwrite(p, 1, n*this->RecordBytes(), f) == size_t(n*this->RecordBytes());});
+  v.clear();
+  this->AppendRows(v);
+  ok = ok && std::fwrite(v.data(), 1, v.size(), f) == v.size();
+  ok &= std::fclose(f) == 0;
+
+  if (!ok || std::rename(sTmp.c_str(), s.c_str()) != 0)
+  {
+    std::cerr << "CorsikaResultIndex::Write(): could not write " << s << "." << std::endl;
+    std::remove(sTmp.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+
+bool CorsikaResultIndex::Read(std::string s)
+{
+  std::ifstream stream(s, std::ifstream::binary);
+  if (!stream.is_open())
+  {
+    std::cerr << "CorsikaResultIndex::Read(): could not open " << s << "." << std::endl;
+    return false;
+  }
+
+  const std::vector<char> v((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+  return this->Deserialize(v);
+}
+
+
+
+void CorsikaResultIndex::BeginLayout(std::vector<char> & v)
+{
+  const int version = kPartLayout;
+  const std::vector<long> vOffsets(kNHists, -1);
+  CorsikaAppend(v, &version);
+  CorsikaAppend(v, vOffsets.data(), kNHists);
+}
+
+
+
+void CorsikaResultIndex::SetOffset(std::vector<char> & v, int h)
+{
+  const long offset = v.size();
+  std::memcpy(v.data() + sizeof(int) + h*sizeof(long), &offset, sizeof(long));
+}
+
+
+
+//
+// Each histogram is its number of cells and of non-empty cells, the
+// non-empty cells as index, content and sum of squared weights, and 8
+// statistics, as appended by CorsikaResultArena
+//
+bool CorsikaResultIndex::Locate(const char * p, long n, std::vector<long> & vOffsets)
+{
+  vOffsets.assign(kNHists, -1);
+
+  int version = 0;
+  if (n < LayoutBytes()) return false;
+  std::memcpy(&version, p, sizeof(int));
+  if (version != kPartLayout) return false;
+  std::memcpy(vOffsets.data(), p + sizeof(int), kNHists*sizeof(long));
+
+  for (int h = 0; h < kNHists; h++)
+  {
+    long nCells = 0, nFilled = -1;
+    const long pos = vOffsets[h];
+    if (pos < LayoutBytes() || pos + 2*long(sizeof(long)) > n) return false;
+    std::memcpy(&nCells, p + pos, sizeof(long));
+    std::memcpy(&nFilled, p + pos + sizeof(long), sizeof(long));
+    if (nFilled < 0 || nFilled > nCells) return false;
+    if (pos + 2*long(sizeof(long)) + nFilled*long(sizeof(long) + 2*sizeof(double)) + 8*long(sizeof(double)) > n) return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,423 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <set>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#include <dirent.h>
+#include <strings.h>
+
+#include <CorsikaResultStore.h>
+
+static const char * sColumns[CorsikaResultIndex::kNColumns + 1] = {
+  "ID", "Energy", "Primary", "Theta", "Phi", "ObsLvl", "LEmod", "HEmod",
+  "Fit0", "Fit1", "Fit2", "Fit3", "Fit4", "Fit5", "FitChi2ndof", "FitDev", "Run"
+};
+
+// The histograms of the averages, with their number of age bins and their
+// bin width, as booked by CorsikaAnalysis
+struct StoreHist
+{
+  const char * name;
+  int first;
+  int nAges;
+  double width;
+  bool kDensity;
+};
+
+static const StoreHist vStoreHists[3] = {
+  {"EmissionAngle", CorsikaResultIndex::kEmissionAngle, 20, 0.01, false},
+  {"EmissionDist", CorsikaResultIndex::kEmissionDist, 20, 1., false},
+  {"PhotonDensity", CorsikaResultIndex::kPhotonDensity, 1, 1., true}
+};
+
+CorsikaResultStore::CorsikaResultStore(std::vector<std::string> vd, std::string sCache)
+: vDirs(vd)
+, sCacheDir(sCache)
+, nMappedBytes(0)
+{
+  for (auto & s : this->vDirs)
+    if (!s.empty() && s.back() != '/') s += "/";
+}
+
+
+
+CorsikaResultStore::~CorsikaResultStore()
+{
+  this->Clear();
+}
+
+
+
+void CorsikaResultStore::Clear()
+{
+  for (auto & s : this->vShowers)
+    if (s.kMapped) CorsikaCache::Unmap(s.p, s.n);
+
+  this->vShowers.clear();
+  this->vRuns.clear();
+  this->vHeader.clear();
+  this->vCopies.clear();
+  this->mCaches.clear();
+  this->nMappedBytes = 0;
+}
+
+
+
+int CorsikaResultStore::Column(std::string s)
+{
+  for (int i = 0; i <= CorsikaResultIndex::kNColumns; i++)
+    if (strcasecmp(s.c_str(), sColumns[i]) == 0) return i;
+  return -1;
+}
+
+
+
+//
+// Runs in the order of their file names, and showers in the order of each run
+//
+void CorsikaResultStore::Load()
+{
+  this->Clear();
+
+  const int nCol = CorsikaResultIndex::kNColumns;
+  const double deg = 180./std::acos(-1.);
+  std::vector<char> v;
+
+  for (auto & sDir : this->vDirs)
+  {
+    DIR * d = opendir(sDir.c_str());
+    if (!d)
+    {
+      std::cerr << "CorsikaResultStore::Load(): could not open the directory " << sDir << "." << std::endl;
+      continue;
+    }
+
+    std::vector<std::string> vFiles;
+    while (struct dirent * e = readdir(d))
+    {
+      std::string s = e->d_name;
+      if (s.compare(0, 10, "cherenkov_") == 0 && s.size() > 18 && s.compare(s.size() - 8, 8, ".results") == 0) vFiles.push_back(s);
+    }
+    closedir(d);
+    std::sort(vFiles.begin(), vFiles.end());
+
+    for (auto & sFile : vFiles)
+    {
+      CorsikaResultIndex index;
+      if (!index.Read(sDir + sFile)) continue;
+
+      std::string sCache = this->sCacheDir.empty() ? index.CacheDir() : this->sCacheDir;
+      auto & pCache = this->mCaches[sCache];
+      if (!pCache) pCache.reset(new CorsikaCache(sCache));
+
+      Run run;
+      run.sFile = sDir + sFile;
+      run.sName = index.Run();
+      run.nShowers = index.NShowers();
+      run.nFound = 0;
+
+      for (int i = 0; i < index.NShowers(); i++)
+      {
+        Shower s;
+        s.run = index.RunOf(i);
+        s.index = this->vRuns.size();
+        s.p = 0;
+        s.n = 0;
+        s.kMapped = false;
+
+        const uint64_t key = index.Key(i, CorsikaResultIndex::kPartCherenkov);
+        if (key != 0 && pCache->Good())
+        {
+          if (int(this->vShowers.size()) < kMaxMaps) s.kMapped = pCache->Map(key, s.p, s.n);
+          else if (pCache->Get(key, v))
+          {
+            this->vCopies.emplace_back(new std::vector<char>(v));
+            s.p = this->vCopies.back()->data();
+            s.n = v.size();
+          }
+        }
+
+        std::vector<long> vOffsets;
+        if (s.p && !CorsikaResultIndex::Locate(s.p, s.n, vOffsets))
+        {
+          std::cerr << "CorsikaResultStore::Load(): the results of shower " << index.HeaderRow(i)[0] << " of " << run.sFile << " can not be read." << std::endl;
+          if (s.kMapped) CorsikaCache::Unmap(s.p, s.n);
+          s.p = 0;
+          s.n = 0;
+          s.kMapped = false;
+        }
+        if (s.p) std::copy(vOffsets.begin(), vOffsets.end(), s.vOffsets);
+
+        if (s.kMapped) this->nMappedBytes += s.n;
+        if (s.p) run.nFound++;
+
+        auto & row = index.HeaderRow(i);
+        this->vHeader.insert(this->vHeader.end(), row.begin(), row.begin() + nCol);
+        this->vHeader[this->vHeader.size() - nCol + 3] *= deg;
+        this->vHeader[this->vHeader.size() - nCol + 4] *= deg;
+
+        this->vShowers.push_back(s);
+      }
+
+      this->vRuns.push_back(run);
+    }
+  }
+}
+
+
+
+std::string CorsikaResultStore::Query(std::string sQuery)
+{
+  std::istringstream sWords(sQuery);
+  std::vector<std::string> vWords;
+  std::string s;
+  while (sWords >> s) vWords.push_back(s);
+
+  if (vWords.empty()) return "";
+
+  if (vWords[0] == "runs") return this->Runs();
+  if (vWords[0] == "showers") return this->Showers(vWords);
+  if (vWords[0] == "average") return this->Average(vWords);
+  if (vWords[0] == "reload")
+  {
+    this->Load();
+    std::ostringstream sOut;
+    sOut << "# " << this->NRuns() << " runs, " << this->NShowers() << " showers" << std::endl;
+    return sOut.str();
+  }
+
+  return "error: unknown query " + vWords[0] + ", expected runs, showers, average or reload\n";
+}
+
+
+
+//
+// Showers passing all cuts of the words after the first, except age=
+//
+bool CorsikaResultStore::Select(const std::vector<std::string> & vWords, std::vector<int> & vSel, std::string & sError)
+{
+  enum {kLt, kLe, kGt, kGe, kEq, kNe, kRange};
+  const std::vector<std::string> vOps = {"<", "<=", ">", ">=", "=", "!="};
+
+  struct Cut
+  {
+    int column;
+    int op;
+    double a, b;
+  };
+
+  auto number = [](std::string s, double & x)
+  {
+    char * end = 0;
+    x = std::strtod(s.c_str(), &end);
+    return !s.empty() && *end == 0;
+  };
+
+  std::vector<Cut> vCuts;
+  for (size_t i = 1; i < vWords.size(); i++)
+  {
+    const std::string & w = vWords[i];
+    if (w.compare(0, 4, "age=") == 0 || (i == 1 && vWords[0] == "average")) continue;
+
+    // Column, operator and value
+    const size_t iOp = std::min(w.find_first_of("<>=!"), w.size());
+    const size_t iValue = std::min(w.find_first_not_of("<>=!", iOp), w.size());
+    const std::string sValue = w.substr(iValue);
+
+    Cut cut;
+    cut.column = Column(w.substr(0, iOp));
+    cut.op = std::find(vOps.begin(), vOps.end(), w.substr(iOp, iValue - iOp)) - vOps.begin();
+
+    bool ok = cut.column >= 0 && cut.op < int(vOps.size());
+    const size_t iRange = sValue.find("..");
+    if (ok && cut.op == kEq && iRange != std::string::npos)
+    {
+      cut.op = kRange;
+      ok = number(sValue.substr(0, iRange), cut.a) && number(sValue.substr(iRange + 2), cut.b);
+    }
+    else ok = ok && number(sValue, cut.a);
+
+    if (!ok)
+    {
+      sError = "error: invalid cut " + w + ", expected a column of the Header tuple or run, an operator and a value\n";
+      return false;
+    }
+    vCuts.push_back(cut);
+  }
+
+  const int nCol = CorsikaResultIndex::kNColumns;
+  vSel.clear();
+  for (int i = 0; i < int(this->vShowers.size()); i++)
+  {
+    bool kPass = true;
+    for (auto & cut : vCuts)
+    {
+      const double x = cut.column == nCol ? this->vShowers[i].run : this->vHeader[long(i)*nCol + cut.column];
+      switch (cut.op)
+      {
+        case kLt: kPass = x < cut.a; break;
+        case kLe: kPass = x <= cut.a; break;
+        case kGt: kPass = x > cut.a; break;
+        case kGe: kPass = x >= cut.a; break;
+        case kEq: kPass = x == cut.a; break;
+        case kNe: kPass = x != cut.a; break;
+        default: kPass = x >= cut.a && x <= cut.b;
+      }
+      if (!kPass) break;
+    }
+    if (kPass) vSel.push_back(i);
+  }
+
+  return true;
+}
+
+
+
+std::string CorsikaResultStore::Runs()
+{
+  std::ostringstream sOut;
+  sOut << "# Run Showers WithResults File" << std::endl;
+  for (auto & run : this->vRuns) sOut << run.sName << " " << run.nShowers << " " << run.nFound << " " << run.sFile << std::endl;
+  return sOut.str();
+}
+
+
+
+std::string CorsikaResultStore::Showers(const std::vector<std::string> & vWords)
+{
+  std::vector<int> vSel;
+  std::string sError;
+  if (!this->Select(vWords, vSel, sError)) return sError;
+
+  const int nCol = CorsikaResultIndex::kNColumns;
+  std::string sOut = "# Run";
+  for (int j = 0; j < nCol; j++) sOut += std::string(" ") + sColumns[j];
+  sOut += " (Theta and Phi in deg)\n";
+
+  char sValue[64];
+  for (int i : vSel)
+  {
+    sOut += std::to_string(this->vShowers[i].run);
+    for (int j = 0; j < nCol; j++) sOut.append(sValue, std::snprintf(sValue, sizeof(sValue), " %.10g", this->vHeader[long(i)*nCol + j]));
+    sOut += "\n";
+  }
+
+  return sOut;
+}
+
+
+
+//
+// The sums of the selected showers divided by their number, as the averages
+// of readCorsika: the content and its error per bin, or for the photon
+// density the mean and standard deviation of the densities of the showers
+//
+std::string CorsikaResultStore::Average(const std::vector<std::string> & vWords)
+{
+  const StoreHist * pHist = 0;
+  for (auto & h : vStoreHists)
+    if (vWords.size() > 1 && vWords[1] == h.name) pHist = &h;
+  if (!pHist) return "error: expected average EmissionAngle|EmissionDist age=a [cuts], or average PhotonDensity [cuts]\n";
+
+  // The age bin, -1 if not given and -2 if invalid
+  int iAge = -1;
+  for (size_t i = 2; i < vWords.size(); i++)
+  {
+    if (vWords[i].compare(0, 4, "age=") != 0) continue;
+    char * end = 0;
+    iAge = std::strtol(vWords[i].c_str() + 4, &end, 10);
+    if (vWords[i].size() == 4 || *end != 0 || iAge < 0) iAge = -2;
+  }
+  if ((pHist->nAges > 1 && (iAge < 0 || iAge >= pHist->nAges)) || (pHist->nAges == 1 && iAge != -1))
+    return pHist->nAges > 1 ? "error: expected an age bin age=a, with 0 <= a < 20\n" : "error: the photon density has no age bins\n";
+
+  std::vector<int> vSel;
+  std::string sError;
+  if (!this->Select(vWords, vSel, sError)) return sError;
+
+  const int h = pHist->first + std::max(iAge, 0);
+  const double pi = std::acos(-1.);
+
+  // The non-empty cells of the histogram of each shower, as index, content
+  // and sum of squared weights
+  long nCells = -1;
+  int nUsed = 0, nMissing = 0;
+  std::set<int> sRunsUsed;
+  for (int i : vSel)
+  {
+    const Shower & s = this->vShowers[i];
+    if (!s.p)
+    {
+      nMissing++;
+      continue;
+    }
+
+    const char * c = s.p + s.vOffsets[h];
+    long nc = 0, nFilled = 0;
+    std::memcpy(&nc, c, sizeof(long));
+    std::memcpy(&nFilled, c + sizeof(long), sizeof(long));
+    c += 2*sizeof(long);
+
+    if (nCells < 0)
+    {
+      nCells = nc;
+      this->vSum.assign(nCells, 0.);
+      this->vSum2.assign(nCells, 0.);
+    }
+    else if (nc != nCells) return "error: the selected showers have histograms of different binnings\n";
+
+    for (long j = 0; j < nFilled; j++, c += sizeof(long) + 2*sizeof(double))
+    {
+      long k = 0;
+      double w = 0., w2 = 0.;
+      std::memcpy(&k, c, sizeof(long));
+      std::memcpy(&w, c + sizeof(long), sizeof(double));
+      std::memcpy(&w2, c + sizeof(long) + sizeof(double), sizeof(double));
+      if (k < 0 || k >= nCells) continue;
+
+      if (pHist->kDensity)
+      {
+        if (k == 0 || k == nCells - 1) continue;
+        const double x0 = (k - 1)*pHist->width;
+        const double x1 = k*pHist->width;
+        w /= pi*(x1*x1 - x0*x0);
+        w2 = w*w;
+      }
+      this->vSum[k] += w;
+      this->vSum2[k] += w2;
+    }
+
+    nUsed++;
+    sRunsUsed.insert(s.run);
+  }
+
+  std::ostringstream sHead;
+  sHead << std::setprecision(10);
+  sHead << "# average " << pHist->name;
+  if (pHist->nAges > 1) sHead << " age=" << iAge;
+  sHead << " of " << nUsed << " showers in " << sRunsUsed.size() << " runs";
+  if (nMissing > 0) sHead << " (" << nMissing << " selected showers without results in the cache)";
+  sHead << std::endl;
+  if (nUsed > 0 && !pHist->kDensity) sHead << "# underflow " << this->vSum[0]/nUsed << " overflow " << this->vSum[nCells-1]/nUsed << std::endl;
+  sHead << (pHist->kDensity ? "# x mean sigma" : "# x content error") << std::endl;
+
+  // The bins are many, and formatted without streams
+  std::string sOut = sHead.str();
+  char sLine[128];
+  for (long k = 1; k + 1 < nCells && nUsed > 0; k++)
+  {
+    if (this->vSum[k] == 0. && this->vSum2[k] == 0.) continue;
+
+    const double mean = this->vSum[k]/nUsed;
+    const double err = pHist->kDensity ? std::sqrt(std::max(0., this->vSum2[k]/nUsed - mean*mean)) : std::sqrt(this->vSum2[k])/nUsed;
+    const int n = std::snprintf(sLine, sizeof(sLine), "%.10g %.10g %.10g\n", (k - 0.5)*pHist->width, mean, err);
+    sOut.append(sLine, n);
+  }
+
+  return sOut;
+}
@@ -0,0 +1,271 @@
+#include <iostream>
+#include <algorithm>
+
+#include <TNtupleD.h>
+
+#include <CorsikaRows.h>
+#include <CorsikaCheckpoint.h>
+
+// Rows read at once from a spilled chunk
+static const long nReadRows = 256;
+
+CorsikaRows::CorsikaRows(int n)
+: nColumns(std::max(n, 1))
+, nMaxRows(0)
+, pSpill(NULL, std::fclose)
+, nSpilled(0)
+{
+}
+
+
+
+//
+// Without a bound the vectors grow as usual; with one, never beyond it
+//
+void CorsikaRows::Add(int run, const std::vector<double> & vRow)
+{
+  if (this->nMaxRows > 0 && long(this->vRuns.size()) >= this->nMaxRows) this->Spill();
+
+  if (this->nMaxRows > 0 && this->vRuns.size() == this->vRuns.capacity())
+  {
+    const long n = std::min(std::max(2*long(this->vRuns.size()), 16L), this->nMaxRows);
+    this->vRuns.reserve(n);
+    this->vData.reserve(n*this->nColumns);
+  }
+
+  const size_t n = std::min<size_t>(vRow.size(), this->nColumns);
+  this->vData.insert(this->vData.end(), vRow.begin(), vRow.begin() + n);
+  this->vData.resize(this->vData.size() + this->nColumns - n, 0.);
+  this->vRuns.push_back(run);
+}
+
+
+
+void CorsikaRows::SetMaxBytes(long n)
+{
+  this->nMaxRows = n > 0 ? std::max(1L, n/long(this->nColumns*sizeof(double) + sizeof(int))) : 0;
+  if (this->nMaxRows > 0 && long(this->vRuns.size()) > this->nMaxRows) this->Spill();
+}
+
+
+
+std::vector<long> CorsikaRows::Order()
+{
+  std::vector<long> vOrder(this->vRuns.size());
+  for (size_t i = 0; i < vOrder.size(); i++) vOrder[i] = i;
+  std::stable_sort(vOrder.begin(), vOrder.end(), [this](long a, long b)
+  {
+    if (this->vRuns[a] != this->vRuns[b]) return this->vRuns[a] < this->vRuns[b];
+    return this->vData[a*this->nColumns] < this->vData[b*this->nColumns];
+  });
+
+  return vOrder;
+}
+
+
+
+//
+// The rows in memory, sorted, are appended to the file as a chunk. If no
+// temporary file can be opened, they stay in memory.
+//
+void CorsikaRows::Spill()
+{
+  if (this->vRuns.empty()) return;
+
+  if (!this->pSpill) this->pSpill.reset(std::tmpfile());
+  if (!this->pSpill)
+  {
+    std::cerr << "CorsikaRows::Spill(): could not open a temporary file, the rows are kept in memory." << std::endl;
+    this->nMaxRows = 0;
+    return;
+  }
+
+  FILE * f = this->pSpill.get();
+  std::fseek(f, 0, SEEK_END);
+
+  bool ok = true;
+  std::vector<double> vRow(this->nColumns + 1);
+  for (long i : this->Order())
+  {
+    vRow[0] = this->vRuns[i];
+    std::copy(this->vData.begin() + i*this->nColumns, this->vData.begin() + (i + 1)*this->nColumns, vRow.begin() + 1);
+    ok = ok && std::fwrite(vRow.data(), sizeof(double), vRow.size(), f) == vRow.size();
+  }
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaRows::Spill(): could not write the temporary file, the rows are kept in memory." << std::endl;
+    this->nMaxRows = 0;
+    return;
+  }
+
+  this->vChunks.push_back(this->vRuns.size());
+  this->nSpilled += this->vRuns.size();
+  this->vData.clear();
+  this->vRuns.clear();
+}
+
+
+
+void CorsikaRows::Merge(CorsikaRows & other)
+{
+  if (other.nColumns != this->nColumns) return;
+
+  std::vector<double> vRow;
+  other.ForEach([this, &vRow](int run, const double * p)
+  {
+    vRow.assign(p, p + this->nColumns);
+    this->Add(run, vRow);
+  });
+}
+
+
+
+void CorsikaRows::Clear()
+{
+  this->vData.clear();
+  this->vRuns.clear();
+  this->pSpill.reset();
+  this->vChunks.clear();
+  this->nSpilled = 0;
+}
+
+
+
+//
+// Merge of the sorted chunks and of the sorted rows in memory, taken last:
+// rows with the same run and ID come in the order they were added
+//
+void CorsikaRows::ForEach(std::function<void(int, const double *)> f)
+{
+  const long nRow = this->nColumns + 1;
+
+  // The rows of a chunk not read yet [next, end), and those read
+  struct Cursor
+  {
+    long next;
+    long end;
+    std::vector<double> vRows;
+    size_t pos;
+  };
+
+  std::vector<Cursor> vCursors;
+  long first = 0;
+  for (long n : this->vChunks)
+  {
+    vCursors.push_back({first, first + n, std::vector<double>(), 0});
+    first += n;
+  }
+
+  // The current row of a chunk, NULL at its end
+  auto current = [&](Cursor & c) -> const double *
+  {
+    if (c.pos < c.vRows.size()) return c.vRows.data() + c.pos;
+    if (c.next >= c.end) return NULL;
+
+    const long n = std::min(nReadRows, c.end - c.next);
+    c.vRows.resize(n*nRow);
+    c.pos = 0;
+    FILE * file = this->pSpill.get();
+    if (std::fseek(file, c.next*nRow*long(sizeof(double)), SEEK_SET) != 0 || std::fread(c.vRows.data(), sizeof(double), n*nRow, file) != size_t(n*nRow))
+    {
+      std::cerr << "CorsikaRows::ForEach(): could not read the temporary file, rows are missing." << std::endl;
+      c.vRows.clear();
+      c.next = c.end;
+      return NULL;
+    }
+    c.next += n;
+
+    return c.vRows.data();
+  };
+
+  const std::vector<long> vOrder = this->Order();
+  size_t iMem = 0;
+
+  while (true)
+  {
+    int best = -1;
+    double run = 0., id = 0.;
+    for (size_t c = 0; c < vCursors.size(); c++)
+    {
+      const double * p = current(vCursors[c]);
+      if (!p || (best >= 0 && (p[0] > run || (p[0] == run && p[1] >= id)))) continue;
+      best = c;
+      run = p[0];
+      id = p[1];
+    }
+
+    if (iMem < vOrder.size())
+    {
+      const long i = vOrder[iMem];
+      if (best < 0 || this->vRuns[i] < run || (this->vRuns[i] == run && this->vData[i*this->nColumns] < id))
+      {
+        f(this->vRuns[i], this->vData.data() + i*this->nColumns);
+        iMem++;
+        continue;
+      }
+    }
+
+    if (best < 0) break;
+
+    Cursor & c = vCursors[best];
+    const double * p = c.vRows.data() + c.pos;
+    f(int(p[0]), p + 1);
+    c.pos += nRow;
+  }
+}
+
+
+
+void CorsikaRows::Fill(TNtupleD & t)
+{
+  this->ForEach([&t](int, const double * p){t.Fill(p);});
+}
+
+
+
+void CorsikaRows::Save(CorsikaCheckpoint & ckpt, std::string s)
+{
+  std::vector<double> v, vR;
+  this->ForEach([this, &v, &vR](int run, const double * p)
+  {
+    v.insert(v.end(), p, p + this->nColumns);
+    vR.push_back(run);
+  });
+
+  ckpt.Set(s, v);
+  ckpt.Set(s + "Runs", vR);
+}
+
+
+
+bool CorsikaRows::Load(CorsikaCheckpoint & ckpt, std::string s, int run)
+{
+  this->Clear();
+  if (!ckpt.Has(s)) return false;
+
+  this->vData = ckpt.Get(s);
+  this->vData.resize(this->vData.size() - this->vData.size()%this->nColumns);
+  const long n = this->vData.size()/this->nColumns;
+
+  if (!ckpt.Has(s + "Runs"))
+  {
+    this->vRuns.assign(n, run);
+  }
+  else
+  {
+    auto vRuns = ckpt.Get(s + "Runs");
+    if (vRuns.size() != n)
+    {
+      this->Clear();
+      return false;
+    }
+    this->vRuns.assign(vRuns.begin(), vRuns.end());
+  }
+
+  if (this->nMaxRows > 0 && n > this->nMaxRows) this->Spill();
+  this->vData.shrink_to_fit();
+  this->vRuns.shrink_to_fit();
+
+  return true;
+}
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <CorsikaRun.h>
+
+CorsikaRun::CorsikaRun(std::string sInpDir, std::string sRuns)
+: iNext(0)
+, kGood(true)
+{
+  // Check if direcory name ends with '/'
+  if (sInpDir.empty() || sInpDir[sInpDir.size()-1] != '/') sInpDir += "/";
+
+  // Parse the comma separated list of run numbers and ranges
+  if (!ParseList(sRuns, this->vRunNumbers)) this->kGood = false;
+
+  if (this->vRunNumbers.empty()) this->kGood = false;
+
+  // Build strings with file names
+  for (auto run : this->vRunNumbers)
+  {
+    this->vCerFiles.push_back(sInpDir + "CER" + RunString(run));
+    this->vLongFiles.push_back(sInpDir + "DAT" + RunString(run) + ".long");
+    this->vDatFiles.push_back(sInpDir + "DAT" + RunString(run));
+  }
+}
+
+
+
+bool CorsikaRun::ParseList(std::string s, std::vector<int> & v)
+{
+  std::stringstream ss(s);
+  std::string sItem;
+  bool ok = true;
+
+  while (std::getline(ss, sItem, ','))
+  {
+    try
+    {
+      auto iDash = sItem.find('-', 1);
+      int first = std::stoi(sItem.substr(0, iDash));
+      int last = iDash == std::string::npos ? first : std::stoi(sItem.substr(iDash+1));
+
+      if (first < 0 || last < first) throw std::invalid_argument(sItem);
+
+      for (int i = first; i <= last; i++) v.push_back(i);
+    }
+    catch (std::exception & e)
+    {
+      std::cerr << "CorsikaRun: invalid number or range \"" << sItem << "\"." << std::endl;
+      ok = false;
+    }
+  }
+
+  // Each number once, in increasing order
+  std::sort(v.begin(), v.end());
+  v.erase(std::unique(v.begin(), v.end()), v.end());
+
+  return ok;
+}
+
+
+
+std::string CorsikaRun::Name()
+{
+  if (this->vRunNumbers.empty()) return "";
+  if (this->vRunNumbers.size() == 1) return RunString(this->vRunNumbers.front());
+  return RunString(this->vRunNumbers.front()) + "-" + RunString(this->vRunNumbers.back());
+}
+
+
+
+int CorsikaRun::Claim()
+{
+  std::lock_guard<std::mutex> lock(this->mtx);
+  if (this->iNext >= this->NFiles()) return -1;
+  return this->iNext++;
+}
+
+
+
+// Run number string with 6 digits
+std::string CorsikaRun::RunString(int run)
+{
+  std::string s = std::to_string(run);
+  while (s.size() < 6) s = "0" + s;
+  return s;
+}
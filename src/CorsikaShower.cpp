@@ -3,13 +3,16 @@
 
 #include <CorsikaFile.h>
 #include <CorsikaShower.h>
+#include <CorsikaLong.h>
+#include <CorsikaProfiler.h>
 
 CorsikaShower::CorsikaShower(CorsikaFile & cFile, bool good)
 : filePtr(&cFile)
 , iSubParticle(0)
+, iCurSub(-1)
 , kGood(good)
 , kDone(false)
-, vCurSub(0)
+, pCurSub(0)
 , vHeader(cFile.nSubWords,-1.)
 {
   //
@@ -46,13 +49,44 @@ CorsikaShower::CorsikaShower(CorsikaFile & cFile, bool good)
   //
   // Get first particle data block
   //
-  this->vCurSub = this->filePtr->NextSubBlock();
+  this->NextParticleBlock();
 
   return;
 }
 
 
 
+//
+// Read the next particle data sub-block and check if the particle data is over
+//
+void CorsikaShower::NextParticleBlock()
+{
+  this->iSubParticle = 0;
+
+  this->iCurSub = this->filePtr->Tell();
+  this->pCurSub = this->filePtr->ReadSubBlock();
+
+  if (!this->pCurSub)
+  {
+    std::cerr << "After loop over particles for shower number " << this->Number() << ", could not read the next data sub-block!" << std::endl;
+    this->kGood = false;
+    this->kDone = true;
+    return;
+  }
+
+  // Check if next subblock is not a particle block
+  auto sFirst = std::string((char*)this->pCurSub,4);
+  if (sFirst == "LONG" || sFirst == "EVTE")
+  {
+    // Tell we are done
+    this->kDone = true;
+
+    // Store the current subblock as the runEnd subblock
+    this->vEnd = std::vector<float>(this->pCurSub, this->pCurSub + this->filePtr->nSubWords);
+  }
+}
+
+
 
 std::vector<float> CorsikaShower::NextParticle()
 {
@@ -66,35 +100,132 @@ std::vector<float> CorsikaShower::NextParticle()
   // Check if we are done with the current particle subblock or simply return current particle
   if (this->iSubParticle == this->filePtr->nParticlesPerBlock)
   {
-    // This is the last particle, reset counter
-    this->iSubParticle = 0;
-
     // Store current particle
-    auto v = std::vector<float>(this->vCurSub.data() + init, this->vCurSub.data() + iend);
+    auto v = std::vector<float>(this->pCurSub + init, this->pCurSub + iend);
 
     // Read next subblock
-    this->vCurSub = this->filePtr->NextSubBlock();
+    this->NextParticleBlock();
+
+    return v;
+  }
+  else
+    return std::vector<float>(this->pCurSub + init, this->pCurSub + iend);
+}
+
+
+
+//
+// Decode all the remaining particles of the current sub-block into a batch
+// and move to the next sub-block. Returns the number of bunches in the batch.
+//
+int CorsikaShower::NextBunches(CorsikaBunches & b)
+{
+  if (this->kDone || !this->pCurSub)
+  {
+    b.Resize(0);
+    return 0;
+  }
+
+  int n = 0;
+  {
+    CorsikaTimer timer(CorsikaProfiler::kDecode);
+    n = this->filePtr->reader->Decode(this->pCurSub, this->iSubParticle, b);
+  }
+
+  CorsikaProfiler::Count(CorsikaProfiler::kBunches, n);
+
+  this->NextParticleBlock();
+
+  return n;
+}
+
+
+
+int CorsikaShower::NextParticles(CorsikaParticles & b)
+{
+  if (this->kDone || !this->pCurSub)
+  {
+    b.Resize(0);
+    return 0;
+  }
+
+  int n = 0;
+  {
+    CorsikaTimer timer(CorsikaProfiler::kDecode);
+    n = this->filePtr->reader->Decode(this->pCurSub, this->iSubParticle, b);
+  }
+
+  CorsikaProfiler::Count(CorsikaProfiler::kParticles, n);
+
+  this->NextParticleBlock();
+
+  return n;
+}
+
+
+
+void CorsikaShower::SkipBunches()
+{
+  if (this->kDone || !this->pCurSub) return;
+
+  this->NextParticleBlock();
+}
+
+
+
+bool CorsikaShower::SkipTo(long i)
+{
+  if (this->kDone || !this->pCurSub) return true;
 
-    if (this->vCurSub.empty())
+  auto reader = this->filePtr->reader.get();
+  if (i <= this->iCurSub || i >= reader->NSubBlocks()) return false;
+
+  const long iCur = this->iCurSub;
+  const int iParticle = this->iSubParticle;
+
+  reader->Seek(i);
+  this->NextParticleBlock();
+  if (this->kDone) return true;
+
+  reader->Seek(iCur);
+  this->NextParticleBlock();
+  this->iSubParticle = iParticle;
+
+  return false;
+}
+
+
+
+bool CorsikaShower::ReadLong(CorsikaLong & clong, long iLong)
+{
+  if (!this->pCurSub) return false;
+
+  auto reader = this->filePtr->reader.get();
+
+  bool kFound = false;
+
+  // From the given sub-block on, or only if the LONG sub-blocks start there
+  auto read = [&](long i, bool kStart)
+  {
+    reader->Seek(i);
+    while (const float * p = reader->Next())
     {
-      std::cerr << "After loop over particles for shower number " << this->Number() << ", could not read the next data sub-block!" << std::endl;
-      this->kGood = false;
-      return v;
+      auto sTag = std::string((char*)p,4);
+      if (sTag == "LONG")
+      {
+        clong.AddSubBlock(p);
+        kFound = true;
+      }
+      else if (kFound || kStart || sTag == "EVTE" || sTag == "EVTH" || sTag == "RUNE") break;
     }
+  };
 
-    // Check if next subblock is not a particle block
-    auto sFirst = std::string((char*)this->vCurSub.data(),4);
-    if (sFirst == "LONG" || sFirst == "EVTE")
-    {
-      // Tell we are done
-      this->kDone = true;
+  if (iLong > this->iCurSub && iLong < reader->NSubBlocks()) read(iLong, true);
+  if (!kFound) read(this->iCurSub, false);
 
-      // Store the current subblock as the runEnd subblock
-      this->vEnd = this->vCurSub;
-    }
+  // Back to the current sub-block, whose data may have been replaced
+  reader->Seek(this->iCurSub);
+  this->pCurSub = reader->Next();
 
-    return v;
-  }
-  else
-    return std::vector<float>(this->vCurSub.data() + init, this->vCurSub.data() + iend);
+  return kFound;
 }
@@ -0,0 +1,396 @@
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+#include <TDirectory.h>
+
+#include <CorsikaTileMap.h>
+#include <CorsikaSerialize.h>
+
+static const char sTileMapMagic[4] = {'T','M','A','P'};
+static const int iTileMapVersion = 2;
+
+// Number of entries of a new sparse tile before the first compaction
+static const unsigned int nTileCompact = 64;
+
+template<class T> CorsikaTileMapT<T>::CorsikaTileMapT(double bin, double half, int tile)
+: binSize(bin)
+, halfSize(half)
+, nBins(int(std::ceil(2.*half/bin)))
+, nTileBins(std::min(tile, 256))
+, nTiles((nBins + nTileBins - 1)/nTileBins)
+, vSlot(nTiles*nTiles, -1)
+, overflow(0.)
+, nMaxTiles(-1)
+, dropped(0.)
+{
+}
+
+
+
+template<class T> void CorsikaTileMapT<T>::SetMaxBytes(long n)
+{
+  this->nMaxTiles = n < 0 ? -1 : int(std::min<long>(n/(sizeof(Tile) + this->nTileBins*this->nTileBins*sizeof(T)), this->vSlot.size()));
+}
+
+
+
+template<class T> typename CorsikaTileMapT<T>::Tile & CorsikaTileMapT<T>::GetTile(int slot)
+{
+  if (this->vSlot[slot] >= 0) return this->vPool[this->vSlot[slot]];
+
+  const int i = this->vUsed.size();
+  if (i == this->vPool.size())
+  {
+    Tile t;
+    t.kDense = false;
+    t.nCompact = nTileCompact;
+    this->vPool.push_back(t);
+  }
+
+  this->vSlot[slot] = i;
+  this->vUsed.push_back(slot);
+
+  return this->vPool[i];
+}
+
+
+
+//
+// Sum the repeated bins of a sparse tile and keep it sorted. A tile using
+// more than a third of its bins is cheaper as a dense array.
+//
+template<class T> void CorsikaTileMapT<T>::Compact(Tile & t)
+{
+  if (t.kDense) return;
+
+  const int nTileSize = this->nTileBins*this->nTileBins;
+
+  std::vector<std::pair<unsigned short,T>> v(t.vBin.size());
+  for (size_t k = 0; k < v.size(); k++) v[k] = std::make_pair(t.vBin[k], t.vValue[k]);
+  std::sort(v.begin(), v.end(), [](const std::pair<unsigned short,T> & a, const std::pair<unsigned short,T> & b){return a.first < b.first;});
+
+  t.vBin.clear();
+  t.vValue.clear();
+  for (auto & p : v)
+  {
+    if (!t.vBin.empty() && t.vBin.back() == p.first) t.vValue.back() += p.second;
+    else
+    {
+      t.vBin.push_back(p.first);
+      t.vValue.push_back(p.second);
+    }
+  }
+
+  if (3*t.vBin.size() > nTileSize)
+  {
+    std::vector<T> vDense(nTileSize, 0);
+    for (size_t k = 0; k < t.vBin.size(); k++) vDense[t.vBin[k]] = t.vValue[k];
+    t.vValue.swap(vDense);
+    t.vBin.clear();
+    t.kDense = true;
+    return;
+  }
+
+  t.nCompact = std::max<unsigned int>(nTileCompact, 2*t.vBin.size());
+}
+
+
+
+//
+// A tile of this map or of another one, with contents of another type
+//
+template<class T> template<class S> void CorsikaTileMapT<T>::AddTile(int slot, const S & src, double scale)
+{
+  if (this->Full(slot))
+  {
+    for (auto w : src.vValue) this->dropped += scale*w;
+    return;
+  }
+
+  Tile & t = this->GetTile(slot);
+
+  // A dense source makes the target dense
+  if (src.kDense && !t.kDense)
+  {
+    t.nCompact = 0;
+    this->Compact(t);
+    if (!t.kDense)
+    {
+      std::vector<T> vDense(this->nTileBins*this->nTileBins, 0);
+      for (size_t k = 0; k < t.vBin.size(); k++) vDense[t.vBin[k]] += t.vValue[k];
+      t.vValue.swap(vDense);
+      t.vBin.clear();
+      t.kDense = true;
+    }
+  }
+
+  if (src.kDense)
+  {
+    for (size_t k = 0; k < src.vValue.size(); k++) t.vValue[k] += scale*src.vValue[k];
+  }
+  else if (t.kDense)
+  {
+    for (size_t k = 0; k < src.vBin.size(); k++) t.vValue[src.vBin[k]] += scale*src.vValue[k];
+  }
+  else
+  {
+    for (size_t k = 0; k < src.vBin.size(); k++)
+    {
+      t.vBin.push_back(src.vBin[k]);
+      t.vValue.push_back(scale*src.vValue[k]);
+    }
+    if (t.vBin.size() >= t.nCompact) this->Compact(t);
+  }
+}
+
+
+
+template<class T> void CorsikaTileMapT<T>::Reset()
+{
+  for (size_t i = 0; i < this->vUsed.size(); i++)
+  {
+    Tile & t = this->vPool[i];
+    t.kDense = false;
+    t.nCompact = nTileCompact;
+    t.vBin.clear();
+    t.vValue.clear();
+    this->vSlot[this->vUsed[i]] = -1;
+  }
+
+  this->vUsed.clear();
+  this->overflow = 0.;
+  this->dropped = 0.;
+}
+
+
+
+template<class T> template<class U> void CorsikaTileMapT<T>::Merge(CorsikaTileMapT<U> & other, double scale)
+{
+  if (other.nBins != this->nBins || other.nTileBins != this->nTileBins || other.binSize != this->binSize)
+  {
+    std::cerr << "CorsikaTileMap::Merge(): the maps have different binnings." << std::endl;
+    return;
+  }
+
+  for (size_t i = 0; i < other.vUsed.size(); i++)
+    this->AddTile(other.vUsed[i], other.vPool[i], scale);
+
+  this->overflow += scale*other.overflow;
+  this->dropped += scale*other.dropped;
+}
+
+
+
+template<class T> void CorsikaTileMapT<T>::Scale(double f)
+{
+  for (size_t i = 0; i < this->vUsed.size(); i++)
+    for (auto & w : this->vPool[i].vValue)
+      w *= f;
+
+  this->overflow *= f;
+  this->dropped *= f;
+}
+
+
+
+template<class T> double CorsikaTileMapT<T>::Integral()
+{
+  double sum = 0.;
+  for (size_t i = 0; i < this->vUsed.size(); i++)
+    for (auto w : this->vPool[i].vValue)
+      sum += w;
+
+  return sum;
+}
+
+
+
+template<class T> TH2D CorsikaTileMapT<T>::Coarse(double bin, double half, std::string name)
+{
+  const int n = int(std::ceil(2.*half/bin));
+  TH2D h(name.c_str(), name.c_str(), n, -half, half, n, -half, half);
+
+  for (size_t i = 0; i < this->vUsed.size(); i++)
+  {
+    const Tile & t = this->vPool[i];
+    const int tx = this->vUsed[i]%this->nTiles;
+    const int ty = this->vUsed[i]/this->nTiles;
+    const int nk = t.kDense ? t.vValue.size() : t.vBin.size();
+
+    for (int k = 0; k < nk; k++)
+    {
+      const T w = t.vValue[k];
+      if (w == 0) continue;
+
+      const int ib = t.kDense ? k : t.vBin[k];
+      const double x = -this->halfSize + (tx*this->nTileBins + ib%this->nTileBins + 0.5)*this->binSize;
+      const double y = -this->halfSize + (ty*this->nTileBins + ib/this->nTileBins + 0.5)*this->binSize;
+      h.Fill(x, y, w);
+    }
+  }
+
+  return h;
+}
+
+
+
+template<class T> void CorsikaTileMapT<T>::Serialize(std::vector<char> & v)
+{
+  v.clear();
+
+  const int nUsed = this->vUsed.size();
+  const int nValueBytes = sizeof(T);
+  CorsikaAppend(v, sTileMapMagic, 4);
+  CorsikaAppend(v, &iTileMapVersion);
+  CorsikaAppend(v, &nValueBytes);
+  CorsikaAppend(v, &this->binSize);
+  CorsikaAppend(v, &this->halfSize);
+  CorsikaAppend(v, &this->nTileBins);
+  CorsikaAppend(v, &this->overflow);
+  CorsikaAppend(v, &nUsed);
+
+  const int nTileSize = this->nTileBins*this->nTileBins;
+
+  for (int i = 0; i < nUsed; i++)
+  {
+    Tile & t = this->vPool[i];
+    this->Compact(t);
+
+    // Nonzero bins of the tile, written sparse unless the dense array is smaller
+    std::vector<unsigned short> vBin;
+    std::vector<T> vValue;
+    if (t.kDense)
+    {
+      for (int k = 0; k < nTileSize; k++)
+        if (t.vValue[k] != 0)
+        {
+          vBin.push_back(k);
+          vValue.push_back(t.vValue[k]);
+        }
+    }
+
+    const bool kDense = t.kDense && (sizeof(unsigned short) + sizeof(T))*vBin.size() >= sizeof(T)*nTileSize;
+    const unsigned char cDense = kDense;
+    CorsikaAppend(v, &this->vUsed[i]);
+    CorsikaAppend(v, &cDense);
+
+    if (kDense)
+    {
+      CorsikaAppend(v, t.vValue.data(), nTileSize);
+      continue;
+    }
+
+    const auto & vB = t.kDense ? vBin : t.vBin;
+    const auto & vW = t.kDense ? vValue : t.vValue;
+    const unsigned int n = vB.size();
+    CorsikaAppend(v, &n);
+    CorsikaAppend(v, vB.data(), n);
+    CorsikaAppend(v, vW.data(), n);
+  }
+}
+
+
+
+template<class T> bool CorsikaTileMapT<T>::Deserialize(const std::vector<char> & v)
+{
+  size_t pos = 0;
+  char magic[4];
+  int version = 0, nValueBytes = 0;
+  double bin = 0., half = 0.;
+  int tile = 0;
+  int nUsed = 0;
+  double over = 0.;
+
+  bool ok = CorsikaExtract(v, pos, magic, 4) && std::memcmp(magic, sTileMapMagic, 4) == 0;
+  ok = ok && CorsikaExtract(v, pos, &version) && version == iTileMapVersion;
+  ok = ok && CorsikaExtract(v, pos, &nValueBytes) && nValueBytes == sizeof(T);
+  ok = ok && CorsikaExtract(v, pos, &bin) && CorsikaExtract(v, pos, &half) && CorsikaExtract(v, pos, &tile) && bin > 0. && half > 0. && tile > 0;
+  ok = ok && CorsikaExtract(v, pos, &over) && CorsikaExtract(v, pos, &nUsed);
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaTileMap::Deserialize(): not a valid tile map." << std::endl;
+    return false;
+  }
+
+  // The bound is kept, the dropped weight is not saved
+  const int nMax = this->nMaxTiles;
+  *this = CorsikaTileMapT(bin, half, tile);
+  this->nMaxTiles = nMax;
+  this->overflow = over;
+
+  const int nTileSize = this->nTileBins*this->nTileBins;
+
+  for (int i = 0; ok && i < nUsed; i++)
+  {
+    int slot = 0;
+    unsigned char cDense = 0;
+    ok = CorsikaExtract(v, pos, &slot) && CorsikaExtract(v, pos, &cDense) && slot >= 0 && slot < this->vSlot.size();
+    if (!ok) break;
+
+    Tile t;
+    t.kDense = cDense;
+    t.nCompact = nTileCompact;
+
+    if (t.kDense)
+    {
+      t.vValue.resize(nTileSize);
+      ok = CorsikaExtract(v, pos, t.vValue.data(), nTileSize);
+    }
+    else
+    {
+      unsigned int n = 0;
+      ok = CorsikaExtract(v, pos, &n) && n <= nTileSize;
+      t.vBin.resize(ok ? n : 0);
+      t.vValue.resize(ok ? n : 0);
+      ok = ok && CorsikaExtract(v, pos, t.vBin.data(), n) && CorsikaExtract(v, pos, t.vValue.data(), n);
+      for (unsigned int k = 0; ok && k < n; k++) ok = t.vBin[k] < nTileSize;
+      t.nCompact = std::max<unsigned int>(nTileCompact, 2*n);
+    }
+
+    if (ok) this->AddTile(slot, t, 1.);
+  }
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaTileMap::Deserialize(): truncated or damaged tile map." << std::endl;
+    this->Reset();
+  }
+
+  return ok;
+}
+
+
+
+template<class T> int CorsikaTileMapT<T>::Write(TDirectory & dir, std::string name)
+{
+  std::vector<char> v;
+  this->Serialize(v);
+  dir.WriteObject(&v, name.c_str());
+  return 1;
+}
+
+
+
+template<class T> bool CorsikaTileMapT<T>::Read(TDirectory & dir, std::string name)
+{
+  std::vector<char> * p = 0;
+  dir.GetObject(name.c_str(), p);
+  if (!p) return false;
+
+  bool ok = this->Deserialize(*p);
+  delete p;
+
+  return ok;
+}
+
+
+
+template class CorsikaTileMapT<float>;
+template class CorsikaTileMapT<double>;
+template void CorsikaTileMapT<float>::Merge(CorsikaTileMapT<float> &, double);
+template void CorsikaTileMapT<double>::Merge(CorsikaTileMapT<float> &, double);
+template void CorsikaTileMapT<double>::Merge(CorsikaTileMapT<double> &, double);
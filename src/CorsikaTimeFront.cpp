@@ -0,0 +1,227 @@
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include <TDirectory.h>
+#include <TH2.h>
+#include <TProfile.h>
+
+#include <CorsikaTimeFront.h>
+#include <CorsikaSerialize.h>
+
+static const char sTimeFrontMagic[4] = {'T','F','R','T'};
+static const int iTimeFrontVersion = 1;
+
+CorsikaTimeFront::CorsikaTimeFront(int nr, double rmax, int nt, double t0, double t1, int na)
+: nRadius(nr)
+, radiusMax(rmax)
+, nTime(nt)
+, timeMin(t0)
+, timeMax(t1)
+, nAge(na)
+, fRadius(nr/rmax)
+, fTime(nt/(t1-t0))
+, vHist(nr*nt, 0.)
+, vWeight(na*nr, 0.)
+, vMean(na*nr, 0.)
+, vM2(na*nr, 0.)
+, overflow(0.)
+{
+}
+
+
+
+void CorsikaTimeFront::Reset()
+{
+  std::fill(this->vHist.begin(), this->vHist.end(), 0.);
+  std::fill(this->vWeight.begin(), this->vWeight.end(), 0.);
+  std::fill(this->vMean.begin(), this->vMean.end(), 0.);
+  std::fill(this->vM2.begin(), this->vM2.end(), 0.);
+  this->overflow = 0.;
+}
+
+
+
+void CorsikaTimeFront::Merge(const CorsikaTimeFront & other)
+{
+  if (other.nRadius != this->nRadius || other.nTime != this->nTime || other.nAge != this->nAge)
+  {
+    std::cerr << "CorsikaTimeFront::Merge(): the fronts have different binnings." << std::endl;
+    return;
+  }
+
+  for (size_t i = 0; i < this->vHist.size(); i++) this->vHist[i] += other.vHist[i];
+
+  for (size_t i = 0; i < this->vWeight.size(); i++)
+  {
+    const double wb = other.vWeight[i];
+    if (wb == 0.) continue;
+
+    const double wa = this->vWeight[i];
+    const double w = wa + wb;
+    const double d = other.vMean[i] - this->vMean[i];
+    this->vMean[i] += d*wb/w;
+    this->vM2[i] += other.vM2[i] + d*d*wa*wb/w;
+    this->vWeight[i] = w;
+  }
+
+  this->overflow += other.overflow;
+}
+
+
+
+void CorsikaTimeFront::Scale(double f)
+{
+  for (auto & w : this->vHist) w *= f;
+  for (auto & w : this->vWeight) w *= f;
+  for (auto & m : this->vM2) m *= f;
+
+  this->overflow *= f;
+}
+
+
+
+double CorsikaTimeFront::Weight(int ir, int ia)
+{
+  if (ia >= 0) return this->vWeight[ia*this->nRadius + ir];
+
+  double w = 0.;
+  for (ia = 0; ia < this->nAge; ia++) w += this->vWeight[ia*this->nRadius + ir];
+  return w;
+}
+
+
+
+double CorsikaTimeFront::Mean(int ir, int ia)
+{
+  if (ia >= 0) return this->vMean[ia*this->nRadius + ir];
+
+  double w = 0., sum = 0.;
+  for (ia = 0; ia < this->nAge; ia++)
+  {
+    const int i = ia*this->nRadius + ir;
+    w += this->vWeight[i];
+    sum += this->vWeight[i]*this->vMean[i];
+  }
+
+  return w > 0. ? sum/w : 0.;
+}
+
+
+
+double CorsikaTimeFront::Sigma(int ir, int ia)
+{
+  if (ia >= 0)
+  {
+    const int i = ia*this->nRadius + ir;
+    return this->vWeight[i] > 0. ? std::sqrt(this->vM2[i]/this->vWeight[i]) : 0.;
+  }
+
+  // Age bins merged as in Merge()
+  double w = 0., mean = 0., m2 = 0.;
+  for (ia = 0; ia < this->nAge; ia++)
+  {
+    const int i = ia*this->nRadius + ir;
+    const double wb = this->vWeight[i];
+    if (wb == 0.) continue;
+
+    const double d = this->vMean[i] - mean;
+    mean += d*wb/(w + wb);
+    m2 += this->vM2[i] + d*d*w*wb/(w + wb);
+    w += wb;
+  }
+
+  return w > 0. ? std::sqrt(m2/w) : 0.;
+}
+
+
+
+void CorsikaTimeFront::Serialize(std::vector<char> & v)
+{
+  const unsigned long nh = this->vHist.size();
+  const unsigned long nm = this->vWeight.size();
+
+  v.clear();
+  CorsikaAppend(v, sTimeFrontMagic, 4);
+  CorsikaAppend(v, &iTimeFrontVersion);
+  CorsikaAppend(v, &this->nRadius);
+  CorsikaAppend(v, &this->radiusMax);
+  CorsikaAppend(v, &this->nTime);
+  CorsikaAppend(v, &this->timeMin);
+  CorsikaAppend(v, &this->timeMax);
+  CorsikaAppend(v, &this->nAge);
+  CorsikaAppend(v, &this->overflow);
+  CorsikaAppend(v, &nh);
+  CorsikaAppend(v, this->vHist.data(), nh);
+  CorsikaAppend(v, &nm);
+  CorsikaAppend(v, this->vWeight.data(), nm);
+  CorsikaAppend(v, this->vMean.data(), nm);
+  CorsikaAppend(v, this->vM2.data(), nm);
+}
+
+
+
+bool CorsikaTimeFront::Deserialize(const std::vector<char> & v)
+{
+  size_t pos = 0;
+  char magic[4];
+  int version = 0, nr = 0, nt = 0, na = 0;
+  double rmax = 0., t0 = 0., t1 = 0., over = 0.;
+  unsigned long nh = 0, nm = 0;
+
+  bool ok = CorsikaExtract(v, pos, magic, 4) && std::memcmp(magic, sTimeFrontMagic, 4) == 0;
+  ok = ok && CorsikaExtract(v, pos, &version) && version == iTimeFrontVersion;
+  ok = ok && CorsikaExtract(v, pos, &nr) && CorsikaExtract(v, pos, &rmax);
+  ok = ok && CorsikaExtract(v, pos, &nt) && CorsikaExtract(v, pos, &t0) && CorsikaExtract(v, pos, &t1);
+  ok = ok && CorsikaExtract(v, pos, &na) && CorsikaExtract(v, pos, &over);
+  ok = ok && nr > 0 && nt > 0 && na > 0 && rmax > 0. && t1 > t0;
+
+  CorsikaTimeFront front(ok ? nr : 1, ok ? rmax : 1., ok ? nt : 1, ok ? t0 : 0., ok ? t1 : 1., ok ? na : 1);
+  ok = ok && CorsikaExtract(v, pos, &nh) && nh == front.vHist.size() && CorsikaExtract(v, pos, front.vHist.data(), nh);
+  ok = ok && CorsikaExtract(v, pos, &nm) && nm == front.vWeight.size();
+  ok = ok && CorsikaExtract(v, pos, front.vWeight.data(), nm) && CorsikaExtract(v, pos, front.vMean.data(), nm) && CorsikaExtract(v, pos, front.vM2.data(), nm);
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaTimeFront::Deserialize(): not a valid time front." << std::endl;
+    return false;
+  }
+
+  front.overflow = over;
+  *this = std::move(front);
+
+  return true;
+}
+
+
+
+//
+// The delay histogram vs. radius, and the mean delay per radius with its RMS
+// as the errors (option "s"), set from the moments of all ages: the weight
+// as bin entries, the sums of the weighted delay and squared delay as the
+// content and sum of squares of the profile
+//
+int CorsikaTimeFront::Write(TDirectory & dir, std::string name)
+{
+  TH2D hDelay(name.c_str(), "Arrival time vs. radius;r [m];t - t_{plane} [ns]", this->nRadius, 0., this->radiusMax, this->nTime, this->timeMin, this->timeMax);
+  TProfile pDelay((name + "Profile").c_str(), "Arrival time vs. radius;r [m];t - t_{plane} [ns]", this->nRadius, 0., this->radiusMax, "s");
+
+  for (int ir = 0; ir < this->nRadius; ir++)
+  {
+    for (int it = 0; it < this->nTime; it++) hDelay.SetBinContent(ir+1, it+1, this->Hist(ir, it));
+
+    const double w = this->Weight(ir);
+    const double mean = this->Mean(ir);
+    const double sigma = this->Sigma(ir);
+    pDelay.SetBinEntries(ir+1, w);
+    pDelay.SetBinContent(ir+1, w*mean);
+    (*pDelay.GetSumw2())[ir+1] = w*(sigma*sigma + mean*mean);
+  }
+
+  dir.cd();
+  hDelay.Write(name.c_str());
+  pDelay.Write((name + "Profile").c_str());
+
+  return 2;
+}
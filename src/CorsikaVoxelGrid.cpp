@@ -0,0 +1,220 @@
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#include <TDirectory.h>
+
+#include <CorsikaVoxelGrid.h>
+#include <CorsikaSerialize.h>
+
+static const char sVoxelMagic[4] = {'V','O','X','L'};
+static const int iVoxelVersion = 1;
+
+CorsikaVoxelGrid::CorsikaVoxelGrid(int nd, double d0, double d1, int nr, double rmax, int na, double rdense, size_t nsparse)
+: nDepth(nd)
+, depthMin(d0)
+, depthMax(d1)
+, nDist(nr)
+, distMax(rmax)
+, nAzim(na)
+, nDense(std::min(nr, std::max(0, int(rdense*nr/rmax))))
+, nMaxSparse(nsparse)
+, fDepth(nd/(d1-d0))
+, fDist(nr/rmax)
+, fAzim(na/(2.*M_PI))
+, vDense(nd*nDense*na, 0.)
+, overflow(0.)
+, dropped(0.)
+{
+}
+
+
+
+void CorsikaVoxelGrid::Reset()
+{
+  std::fill(this->vDense.begin(), this->vDense.end(), 0.);
+  this->mSparse.clear();
+  this->overflow = 0.;
+  this->dropped = 0.;
+}
+
+
+
+void CorsikaVoxelGrid::Merge(const CorsikaVoxelGrid & other, double scale)
+{
+  if (other.nDepth != this->nDepth || other.nDist != this->nDist || other.nAzim != this->nAzim || other.nDense != this->nDense)
+  {
+    std::cerr << "CorsikaVoxelGrid::Merge(): the grids have different binnings." << std::endl;
+    return;
+  }
+
+  for (size_t i = 0; i < this->vDense.size(); i++) this->vDense[i] += scale*other.vDense[i];
+  for (auto & v : other.mSparse) this->AddSparse(v.first, scale*v.second);
+
+  this->overflow += scale*other.overflow;
+  this->dropped += scale*other.dropped;
+}
+
+
+
+void CorsikaVoxelGrid::Scale(double f)
+{
+  for (auto & w : this->vDense) w *= f;
+  for (auto & v : this->mSparse) v.second *= f;
+
+  this->overflow *= f;
+  this->dropped *= f;
+}
+
+
+
+double CorsikaVoxelGrid::Integral()
+{
+  double sum = 0.;
+  for (auto w : this->vDense) sum += w;
+  for (auto & v : this->mSparse) sum += v.second;
+  return sum;
+}
+
+
+
+TH3D CorsikaVoxelGrid::Histogram(std::string name)
+{
+  TH3D h(name.c_str(), name.c_str(), this->nDepth, this->depthMin, this->depthMax, this->nDist, 0., this->distMax, this->nAzim, -M_PI, M_PI);
+
+  for (int id = 0; id < this->nDepth; id++)
+    for (int ir = 0; ir < this->nDense; ir++)
+      for (int ia = 0; ia < this->nAzim; ia++)
+      {
+        const double w = this->vDense[(id*this->nDense + ir)*this->nAzim + ia];
+        if (w != 0.) h.SetBinContent(id+1, ir+1, ia+1, w);
+      }
+
+  for (auto & v : this->mSparse)
+  {
+    const int ia = v.first%this->nAzim;
+    const int ir = (v.first/this->nAzim)%this->nDist;
+    const int id = v.first/(this->nAzim*this->nDist);
+    h.SetBinContent(id+1, ir+1, ia+1, v.second);
+  }
+
+  h.SetEntries(this->Integral());
+
+  return h;
+}
+
+
+
+void CorsikaVoxelGrid::Serialize(std::vector<char> & v)
+{
+  // Nonzero voxels, by global index
+  std::vector<unsigned int> vIndex;
+  std::vector<double> vValue;
+
+  for (int id = 0; id < this->nDepth; id++)
+    for (int ir = 0; ir < this->nDense; ir++)
+      for (int ia = 0; ia < this->nAzim; ia++)
+      {
+        const double w = this->vDense[(id*this->nDense + ir)*this->nAzim + ia];
+        if (w == 0.) continue;
+        vIndex.push_back((id*this->nDist + ir)*this->nAzim + ia);
+        vValue.push_back(w);
+      }
+
+  for (auto & s : this->mSparse)
+  {
+    vIndex.push_back(s.first);
+    vValue.push_back(s.second);
+  }
+
+  const double rDense = this->nDense/this->fDist;
+  const unsigned long nSparse = this->nMaxSparse;
+  const unsigned long n = vIndex.size();
+
+  v.clear();
+  CorsikaAppend(v, sVoxelMagic, 4);
+  CorsikaAppend(v, &iVoxelVersion);
+  CorsikaAppend(v, &this->nDepth);
+  CorsikaAppend(v, &this->depthMin);
+  CorsikaAppend(v, &this->depthMax);
+  CorsikaAppend(v, &this->nDist);
+  CorsikaAppend(v, &this->distMax);
+  CorsikaAppend(v, &this->nAzim);
+  CorsikaAppend(v, &rDense);
+  CorsikaAppend(v, &nSparse);
+  CorsikaAppend(v, &this->overflow);
+  CorsikaAppend(v, &this->dropped);
+  CorsikaAppend(v, &n);
+  CorsikaAppend(v, vIndex.data(), n);
+  CorsikaAppend(v, vValue.data(), n);
+}
+
+
+
+bool CorsikaVoxelGrid::Deserialize(const std::vector<char> & v)
+{
+  size_t pos = 0;
+  char magic[4];
+  int version = 0, nd = 0, nr = 0, na = 0;
+  double d0 = 0., d1 = 0., rmax = 0., rdense = 0., over = 0., drop = 0.;
+  unsigned long nsparse = 0, n = 0;
+
+  bool ok = CorsikaExtract(v, pos, magic, 4) && std::memcmp(magic, sVoxelMagic, 4) == 0;
+  ok = ok && CorsikaExtract(v, pos, &version) && version == iVoxelVersion;
+  ok = ok && CorsikaExtract(v, pos, &nd) && CorsikaExtract(v, pos, &d0) && CorsikaExtract(v, pos, &d1);
+  ok = ok && CorsikaExtract(v, pos, &nr) && CorsikaExtract(v, pos, &rmax) && CorsikaExtract(v, pos, &na);
+  ok = ok && CorsikaExtract(v, pos, &rdense) && CorsikaExtract(v, pos, &nsparse);
+  ok = ok && CorsikaExtract(v, pos, &over) && CorsikaExtract(v, pos, &drop) && CorsikaExtract(v, pos, &n);
+  ok = ok && nd > 0 && nr > 0 && na > 0 && d1 > d0 && rmax > 0.;
+
+  std::vector<unsigned int> vIndex(ok ? n : 0);
+  std::vector<double> vValue(ok ? n : 0);
+  ok = ok && CorsikaExtract(v, pos, vIndex.data(), n) && CorsikaExtract(v, pos, vValue.data(), n);
+
+  if (!ok)
+  {
+    std::cerr << "CorsikaVoxelGrid::Deserialize(): not a valid voxel grid." << std::endl;
+    return false;
+  }
+
+  *this = CorsikaVoxelGrid(nd, d0, d1, nr, rmax, na, rdense, nsparse);
+  this->overflow = over;
+  this->dropped = drop;
+
+  const unsigned int nVoxels = nd*nr*na;
+  for (unsigned long k = 0; k < n; k++)
+  {
+    const unsigned int i = vIndex[k];
+    if (i >= nVoxels) continue;
+
+    const int ir = (i/na)%nr;
+    if (ir < this->nDense) this->vDense[((i/(na*nr))*this->nDense + ir)*na + i%na] += vValue[k];
+    else this->AddSparse(i, vValue[k]);
+  }
+
+  return true;
+}
+
+
+
+int CorsikaVoxelGrid::Write(TDirectory & dir, std::string name)
+{
+  std::vector<char> v;
+  this->Serialize(v);
+  dir.WriteObject(&v, name.c_str());
+  return 1;
+}
+
+
+
+bool CorsikaVoxelGrid::Read(TDirectory & dir, std::string name)
+{
+  std::vector<char> * p = 0;
+  dir.GetObject(name.c_str(), p);
+  if (!p) return false;
+
+  bool ok = this->Deserialize(*p);
+  delete p;
+
+  return ok;
+}
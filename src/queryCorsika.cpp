@@ -0,0 +1,208 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <CorsikaOptions.h>
+#include <CorsikaResultStore.h>
+
+static volatile std::sig_atomic_t kStop = 0;
+
+static void stop(int){kStop = 1;}
+
+
+
+//
+// Address of the socket, false if the path is too long for it
+//
+static bool address(std::string s, sockaddr_un & addr)
+{
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (s.empty() || s.size() >= sizeof(addr.sun_path)) return false;
+  std::strncpy(addr.sun_path, s.c_str(), sizeof(addr.sun_path) - 1);
+  return true;
+}
+
+
+
+static bool sendAll(int fd, const std::string & s)
+{
+  for (size_t pos = 0; pos < s.size(); )
+  {
+    ssize_t n = send(fd, s.data() + pos, s.size() - pos, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    pos += n;
+  }
+  return true;
+}
+
+
+
+//
+// Client: send the query and print the answer, which ends with an empty line
+//
+static int ask(std::string sSocket, std::string sQuery)
+{
+  sockaddr_un addr;
+  int fd = address(sSocket, addr) ? socket(AF_UNIX, SOCK_STREAM, 0) : -1;
+  if (fd < 0 || connect(fd, (sockaddr *) &addr, sizeof(addr)) != 0)
+  {
+    std::cerr << "Could not connect to the server at " << sSocket << "! Will exit." << std::endl;
+    if (fd >= 0) close(fd);
+    return 1;
+  }
+
+  bool ok = sendAll(fd, sQuery + "\n");
+  shutdown(fd, SHUT_WR);
+
+  std::string sAnswer;
+  char buffer[65536];
+  ssize_t n;
+  while (ok && (n = recv(fd, buffer, sizeof(buffer), 0)) != 0)
+  {
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) ok = false;
+    else sAnswer.append(buffer, n);
+  }
+  close(fd);
+
+  std::cout << sAnswer;
+  return ok && sAnswer.compare(0, 6, "error:") != 0 ? 0 : 1;
+}
+
+
+
+int main(int argc, char ** argv)
+{
+  CorsikaOptions opts(argc, argv, {
+    {"cache",1},
+    {"query",1}
+  });
+
+  const bool kQuery = opts.Has("query");
+  if (!opts.Good() || (kQuery && opts.NArgs() != 1) || (!kQuery && opts.NArgs() < 2))
+  {
+    std::cerr << "Syntax error! Usage: ./queryCorsika socket outputDir/ [outputDir/ ...] [--cache dir]" << std::endl;
+    std::cerr << "                     ./queryCorsika socket --query \"query\"" << std::endl;
+    std::cerr << "Serves the runs processed by readCorsika with --cache in the output directories, found by their" << std::endl;
+    std::cerr << "result indexes (cherenkov_RUN.results), on a Unix socket. A query is a line, and its answer ends" << std::endl;
+    std::cerr << "with an empty line:" << std::endl;
+    std::cerr << "  runs                                         the runs, their showers and those with results" << std::endl;
+    std::cerr << "  showers [cuts]                               the Header rows of the showers" << std::endl;
+    std::cerr << "  average EmissionAngle|EmissionDist age=a [cuts]" << std::endl;
+    std::cerr << "  average PhotonDensity [cuts]                 average over the showers, as in the Average directory" << std::endl;
+    std::cerr << "  reload                                       read the result indexes again, e.g. after new runs" << std::endl;
+    std::cerr << "A cut is a column of the Header tuple or run, an operator among < <= > >= = != and a value, or a" << std::endl;
+    std::cerr << "range a..b, e.g. \"average EmissionAngle age=7 run=1..20 theta<30\" (theta and phi in deg)." << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --cache dir            the cache of the results, instead of the one each run was processed with" << std::endl;
+    std::cerr << "  --query \"query\"        send a query to the server and print its answer" << std::endl;
+    return 1;
+  }
+
+  const std::string sSocket = opts.GetArg(0);
+  if (kQuery) return ask(sSocket, opts.GetString("query"));
+
+  sockaddr_un addr;
+  if (!address(sSocket, addr))
+  {
+    std::cerr << "Invalid socket path: " << sSocket << "! Will exit." << std::endl;
+    return 1;
+  }
+
+  // A socket left by a server that is gone is replaced, a live one is not
+  struct stat st;
+  if (lstat(sSocket.c_str(), &st) == 0)
+  {
+    int fd = S_ISSOCK(st.st_mode) ? socket(AF_UNIX, SOCK_STREAM, 0) : -1;
+    const bool kLive = fd >= 0 && connect(fd, (sockaddr *) &addr, sizeof(addr)) == 0;
+    if (fd >= 0) close(fd);
+    if (!S_ISSOCK(st.st_mode) || kLive)
+    {
+      std::cerr << sSocket << " is the socket of a running server, or not a socket! Will exit." << std::endl;
+      return 1;
+    }
+    unlink(sSocket.c_str());
+  }
+
+  std::vector<std::string> vDirs;
+  for (int i = 1; i < opts.NArgs(); i++) vDirs.push_back(opts.GetArg(i));
+
+  CorsikaResultStore store(vDirs, opts.GetString("cache"));
+  store.Load();
+  std::cout << "Loaded " << store.NRuns() << " runs with " << store.NShowers() << " showers, " << store.MappedBytes() << " bytes of results mapped." << std::endl;
+
+  int fdServer = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fdServer < 0 || bind(fdServer, (sockaddr *) &addr, sizeof(addr)) != 0 || listen(fdServer, 16) != 0)
+  {
+    std::cerr << "Could not listen on " << sSocket << ": " << std::strerror(errno) << "! Will exit." << std::endl;
+    if (fdServer >= 0) close(fdServer);
+    return 1;
+  }
+
+  // Stop on SIGINT or SIGTERM, interrupting accept()
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = stop;
+  sigaction(SIGINT, &action, 0);
+  sigaction(SIGTERM, &action, 0);
+
+  std::cout << "Listening on " << sSocket << " ." << std::endl;
+
+  // One client at a time, each with a timeout so that a silent one does not
+  // hold the server; queries are answered in the order they come
+  while (!kStop)
+  {
+    int fd = accept(fdServer, 0, 0);
+    if (fd < 0) continue;
+
+    timeval timeout = {10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string sBuffer;
+    char buffer[4096];
+    bool ok = true;
+    while (ok && !kStop)
+    {
+      // Answer the complete lines received so far
+      size_t iEnd;
+      while (ok && (iEnd = sBuffer.find('\n')) != std::string::npos)
+      {
+        std::string sQuery = sBuffer.substr(0, iEnd);
+        sBuffer.erase(0, iEnd + 1);
+        if (!sQuery.empty() && sQuery.back() == '\r') sQuery.pop_back();
+
+        auto t0 = std::chrono::steady_clock::now();
+        std::string sAnswer = store.Query(sQuery);
+        auto t1 = std::chrono::steady_clock::now();
+
+        ok = sendAll(fd, sAnswer + "\n");
+        std::cout << "Query \"" << sQuery << "\" answered in " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms" << std::endl;
+      }
+
+      ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+      if (n > 0) sBuffer.append(buffer, n);
+      else if (n == 0 && !sBuffer.empty()) sBuffer += "\n";
+      else if (!(n < 0 && errno == EINTR)) ok = false;
+    }
+
+    close(fd);
+  }
+
+  close(fdServer);
+  unlink(sSocket.c_str());
+
+  std::cout << "Done, " << sSocket << " was removed." << std::endl;
+
+  return 0;
+}
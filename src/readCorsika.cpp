@@ -1,21 +1,32 @@
 #include <memory>
 #include <string>
+#include <sstream>
 #include <iostream>
 #include <iomanip>
-#include <cmath>
-#include <valarray>
+#include <thread>
+#include <algorithm>
+#include <set>
+#include <cstdio>
 
 #include <TFile.h>
+#include <TFileMerger.h>
 #include <TH1.h>
-#include <TH2.h>
-#include <TGraph.h>
-#include <TNtupleD.h>
+#include <TROOT.h>
 #include <TSystem.h>
 
-#include <CorsikaFile.h>
-#include <CorsikaShower.h>
-#include <CorsikaLong.h>
-#include <CorsikaAtmosphere.h>
+#include <CorsikaIACTFile.h>
+#include <CorsikaOptions.h>
+#include <CorsikaProfiler.h>
+#include <CorsikaAnalysis.h>
+#include <CorsikaCheckpoint.h>
+#include <CorsikaRun.h>
+#include <CorsikaBunchIndex.h>
+#include <CorsikaSampler.h>
+#include <CorsikaMemory.h>
+#include <CorsikaCache.h>
+#include <CorsikaResultIndex.h>
+#include <CorsikaFootprint.h>
+#include <CorsikaReader.h>
 
 int main(int argc, char ** argv)
 {
@@ -26,403 +37,482 @@ int main(int argc, char ** argv)
   // Input parameters
   //
 
+  // Parse command line: the known options and the number of values they take
+  CorsikaOptions opts(argc, argv, {
+    {"min-bunch",1},
+    {"time-window",2},
+    {"profile",0},
+    {"profile-json",1},
+    {"salvage",0},
+    {"checkpoint",1},
+    {"resume",0},
+    {"threads",1},
+    {"index",0},
+    {"ground-map",2},
+    {"voxels",0},
+    {"time-front",0},
+    {"tables",0},
+    {"refit",1},
+    {"profile-grid",4},
+    {"curved",0},
+    {"sample",1},
+    {"seed",1},
+    {"embedded-long",1},
+    {"telescopes",1},
+    {"particles",0},
+    {"shard",1},
+    {"merge",1},
+    {"memory-budget",1},
+    {"cache",1},
+    {"layout",1}
+  });
+
+  // Numeric values of the options and the maximum number of showers
+  for (auto s : {"threads","checkpoint","refit","seed","merge"}) opts.CheckNumbers(s, true);
+  for (auto s : {"min-bunch","time-window","ground-map","sample","memory-budget"}) opts.CheckNumbers(s);
+  opts.CheckNumbers("profile-grid", true, 1, 1);
+  opts.CheckNumbers("profile-grid", false, 2);
+  const int maxShowers = opts.NArgs() == 4 ? opts.GetArgInt(3) : 0;
+
   // Check number of parameters
-  if (argc != 4 && argc != 5)
+  if (!opts.Good() || (opts.NArgs() != 3 && opts.NArgs() != 4))
   {
-    std::cerr << "Syntax error! Usage: ./readCorsika inputDir/ outputDir/ runNumber [maxShowers:optional]" << std::endl;
+    std::cerr << "Syntax error! Usage: ./readCorsika inputDir/ outputDir/ runNumbers [maxShowers:optional] [options]" << std::endl;
+    std::cerr << "The run numbers are a single run or a list of runs and ranges (e.g. 1-8,12) read as one run." << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --min-bunch w          reject bunches with weight <= w (default 0)" << std::endl;
+    std::cerr << "  --time-window t0 t1    accept bunches with t0 <= nsec < t1 only" << std::endl;
+    std::cerr << "  --profile              print time spent per stage and throughput at the end" << std::endl;
+    std::cerr << "  --profile-json file    as --profile, and also write the report to file as JSON" << std::endl;
+    std::cerr << "  --salvage              read the complete showers of a file without run end (e.g. job killed)" << std::endl;
+    std::cerr << "  --checkpoint n         save the state of the run every n showers, next to the output file" << std::endl;
+    std::cerr << "  --resume               continue from the last checkpoint of a previous run" << std::endl;
+    std::cerr << "  --threads n            number of files read concurrently (default: one per core)" << std::endl;
+    std::cerr << "  --ground-map b h       also write sparse ground maps with bins of b m up to +-h m (e.g. 0.1 1000)" << std::endl;
+    std::cerr << "  --voxels               also write the emission density vs. slant depth, distance to axis and azimuth" << std::endl;
+    std::cerr << "  --time-front           also write the photon arrival times relative to the plane front vs. distance to axis and age" << std::endl;
+    std::cerr << "  --tables               also export the emission model tables (cherenkov_RUN.emt) for CorsikaEmissionModel.h" << std::endl;
+    std::cerr << "  --sample p             quick look: read a fraction p of the particle sub-blocks, weighted by 1/p" << std::endl;
+    std::cerr << "  --seed s               seed of the sampling (default 0); results do not depend on the number of threads" << std::endl;
+    std::cerr << "  --embedded-long v|s    profiles from the LONG sub-blocks of the CER file (vertical or slant depths), not the .long file;" << std::endl;
+    std::cerr << "                         they are found without reading ahead with an index saved by --index" << std::endl;
+    std::cerr << "  --curved               emission depths along the shower axis in a curved atmosphere (high zenith angles)" << std::endl;
+    std::cerr << "  --profile-grid k n a b average the profiles on n nodes from a to b in k = depth (slant, g/cm2) or age" << std::endl;
+    std::cerr << "  --refit n              also refit all profiles with Gaisser-Hillas functions of n = 4 or 6 parameters (GHFit tuple)" << std::endl;
+    std::cerr << "  --layout file          also count the photons on the mirrors of the telescopes of a layout file, a line" << std::endl;
+    std::cerr << "                         x y r [zenith azimuth fov] per telescope, in m and deg (Telescopes tuple)" << std::endl;
+    std::cerr << "  --particles            also read the DAT particle files in the same pass, for the ground particle densities" << std::endl;
+    std::cerr << "  --telescopes list      IACT eventio input (CER files starting with the eventio marker): read these telescopes only (e.g. 1-4,7)" << std::endl;
+    std::cerr << "  --index                save a spatial index of the bunches at ground next to each input (CERnnnnnn.idx)," << std::endl;
+    std::cerr << "                         kept as saved before with --cache" << std::endl;
+    std::cerr << "  --shard i/N            read the i-th of N parts of the run, of equal size in bytes, and save its partial sums" << std::endl;
+    std::cerr << "  --merge N              combine the partial outputs of the N shards of the run into the full output" << std::endl;
+    std::cerr << "  --memory-budget m      bound the memory of the readers to m MB: the run does not start if the sums over the showers" << std::endl;
+    std::cerr << "                         do not fit; the long-profile store, the ground maps and the voxels are bounded (the" << std::endl;
+    std::cerr << "                         photons beyond them are dropped and reported), the tuple rows are spilled to temporary" << std::endl;
+    std::cerr << "                         files, the written showers dropped from memory and the profiles of --refit fit early" << std::endl;
+    std::cerr << "  --cache dir            keep the results of each shower in dir, and take those found there instead of reading" << std::endl;
+    std::cerr << "                         the shower again: only new showers, or analyses whose definition changed, are filled" << std::endl;
+    std::cerr << "                         (the index of the results, cherenkov_RUN.results, is saved for queryCorsika)" << std::endl;
     return 1;
   }
 
   // Get parameters
-  std::string sInpDir = argv[1];
-  std::string sOutDir = argv[2];
-  int runNumber = std::stoi(argv[3]);
-  int maxShowers = 0;
-  if (argc == 5) maxShowers = std::stoi(argv[4]);
+  std::string sInpDir = opts.GetArg(0);
+  std::string sOutDir = opts.GetArg(1);
+
+  // Enable instrumentation before any file is touched
+  CorsikaProfiler::Enable(opts.Has("profile") || opts.Has("profile-json"));
 
   // Check if direcory names end with '/'
   if (sInpDir[sInpDir.size()-1] != '/') sInpDir += "/";
   if (sOutDir[sOutDir.size()-1] != '/') sOutDir += "/";
 
-  // Build a run number string with 6 digits
-  std::string sRunNumber = std::to_string(runNumber);
-  while (sRunNumber.size() < 6) sRunNumber = "0" + sRunNumber;
+  // The CER/DAT.long pairs of the run
+  CorsikaRun run(sInpDir, opts.GetArg(2));
+  if (!run.Good())
+  {
+    std::cerr << "Invalid run numbers: " << opts.GetArg(2) << "! Will exit." << std::endl;
+    return 1;
+  }
 
-  // Build strings with file names
-  auto sInpFil = sInpDir + "CER" + sRunNumber;
-  auto sInpLng = sInpDir + "DAT" + sRunNumber + ".long";
-  auto sOutFil = sOutDir + "cherenkov_" + sRunNumber + ".root";
+  const bool kMulti = run.NFiles() > 1;
+  std::string sRunNumber = run.Name();
 
-  // Creathe the output folder, if necessary
-  gSystem->mkdir(sOutDir.c_str());
+  // Build strings with file names
+  std::string sOutFil = sOutDir + "cherenkov_" + sRunNumber + ".root";
+  auto sCkpFil = sOutFil + ".ckpt";
 
+  // Number of reader threads: one file per thread at a time
+  int nThreads = opts.GetInt("threads", std::max(1u, std::thread::hardware_concurrency()));
+  const int nFitThreads = std::max(1, nThreads);
+  nThreads = std::max(1, std::min(nThreads, run.NFiles()));
 
+  // Checkpoints hold the position in a single file
+  int nCheckpoint = opts.GetInt("checkpoint",0);
+  if (kMulti && (nCheckpoint > 0 || opts.Has("resume")))
+  {
+    std::cerr << "Checkpoints are only supported for runs with a single file! Will exit." << std::endl;
+    return 1;
+  }
 
-  //
-  // Object declaration
-  //
+  // Profiles from the LONG sub-blocks of the CER files
+  const bool kEmbedded = opts.Has("embedded-long");
+  if (kEmbedded && opts.GetString("embedded-long") != "v" && opts.GetString("embedded-long") != "s")
+  {
+    std::cerr << "The depths of the LONG sub-blocks must be v (vertical) or s (slant)! Will exit." << std::endl;
+    return 1;
+  }
 
-  // Corsika related stuff: the CERXXXXXX file, the .long file and the atmospheric profile object
-  CorsikaFile       cfile(sInpFil);
-  CorsikaLong       clong(sInpLng);
-  CorsikaAtmosphere catm(cfile);
+  // Sampling of sub-blocks: the index must see all of them
+  CorsikaSampler sampler(opts.GetDouble("sample",1.), opts.GetInt("seed",0));
+  if (!(sampler.Probability() > 0. && sampler.Probability() <= 1.) || (sampler.Active() && opts.Has("index")))
+  {
+    std::cerr << "The sampling probability must be in (0,1], and the index needs all sub-blocks! Will exit." << std::endl;
+    return 1;
+  }
 
-  // Check input files
-  if (!cfile.Good())
+  // IACT eventio input: whole showers are read, with their .long file
+  bool kIACT = false;
+  for (int i = 0; i < run.NFiles(); i++) kIACT = kIACT || CorsikaIACTFile::IsIACT(run.CerName(i));
+  if (kIACT && (opts.Has("index") || opts.Has("salvage") || nCheckpoint > 0 || opts.Has("resume") || sampler.Active() || kEmbedded))
   {
-    std::cerr << "Some error happened when trying to open the file with cherenkov photons! Will exit." << std::endl;
-    std::cerr << "File is: " << sInpFil << std::endl;
+    std::cerr << "The index, salvage, checkpoints, sampling and LONG sub-blocks are not available for IACT eventio input! Will exit." << std::endl;
     return 1;
   }
-  else if (!clong.Good())
+
+  std::vector<int> vTelescopes;
+  if (opts.Has("telescopes") && !CorsikaRun::ParseList(opts.GetString("telescopes"), vTelescopes))
   {
-    std::cerr << "Some error happened when trying to open the file with longitudinal profiles! Will exit." << std::endl;
-    std::cerr << "File is: " << sInpLng << std::endl;
+    std::cerr << "Invalid telescopes: " << opts.GetString("telescopes") << "! Will exit." << std::endl;
     return 1;
   }
+  const std::set<int> sTelescopes(vTelescopes.begin(), vTelescopes.end());
 
-  // Output related stuff: the root file, the event tree and the average histograms
-  TFile froot(sOutFil.c_str(),"recreate");
-  froot.mkdir("Average");
+  // Layout of telescopes, read once and copied to each analysis
+  std::unique_ptr<CorsikaFootprint> pLayout;
+  if (opts.Has("layout"))
+  {
+    pLayout.reset(new CorsikaFootprint(opts.GetString("layout")));
+    if (!pLayout->Good())
+    {
+      std::cerr << "Invalid layout of telescopes: " << opts.GetString("layout") << "! Will exit." << std::endl;
+      return 1;
+    }
+  }
 
-  // Check output file
-  if (froot.IsZombie())
+  // Cache of the results of each shower, with the options of the readers
+  // that change the bunches of a shower
+  std::unique_ptr<CorsikaCache> pCache;
+  std::string sCacheContext;
+  if (opts.Has("cache"))
   {
-    std::cerr << "Could not open output root file! Will exit." << std::endl;
-    std::cerr << "File is: " << sOutFil << std::endl;
-    return 1;
+    pCache.reset(new CorsikaCache(opts.GetString("cache")));
+    if (!pCache->Good())
+    {
+      std::cerr << "The cache directory can not be used! Will exit." << std::endl;
+      return 1;
+    }
+
+    // The index needs all bunches: with the cache, it is kept from an earlier pass
+    for (int i = 0; opts.Has("index") && i < run.NFiles(); i++)
+    {
+      if (!gSystem->AccessPathName(CorsikaBunchIndex::FileName(run.CerName(i)).c_str())) continue;
+      std::cerr << "The index needs all bunches, and can only be used with the cache once saved (" << CorsikaBunchIndex::FileName(run.CerName(i)) << ")! Will exit." << std::endl;
+      return 1;
+    }
+
+    std::ostringstream sContext;
+    sContext << std::setprecision(17) << "sample=" << sampler.Probability();
+    if (sampler.Active()) sContext << " seed=" << opts.GetInt("seed",0);
+    sContext << " telescopes=";
+    for (int t : sTelescopes) sContext << t << ",";
+    sCacheContext = sContext.str();
   }
 
-  // Header tree (tuple)
-  TNtupleD theader("Header","Header","ID:Energy:Primary:Theta:Phi:ObsLvl:LEmod:HEmod:Fit0:Fit1:Fit2:Fit3:Fit4:Fit5:FitChi2ndof:FitDev");
-  theader.Write();
+  // DAT particle files, read along with the CER files
+  const bool kParticles = opts.Has("particles");
+
+  // Shards: the showers whose header is in the i-th of N byte ranges of the
+  // run, found by seeking to the start of the range, and their merging
+  const bool kShard = opts.Has("shard");
+  const bool kMerge = opts.Has("merge");
+  int iShard = 0, nShards = kMerge ? opts.GetInt("merge",0) : 0;
+  char cEnd;
+  if (kShard && std::sscanf(opts.GetString("shard").c_str(), "%d/%d%c", &iShard, &nShards, &cEnd) != 2) nShards = 0;
+  if ((kShard || kMerge) && (nShards < 1 || (kShard && (iShard < 1 || iShard > nShards)) || (kShard && kMerge)))
+  {
+    std::cerr << "Invalid shards: use --shard i/N with 1 <= i <= N, or --merge N! Will exit." << std::endl;
+    return 1;
+  }
+  if (kShard && (kIACT || opts.Has("index") || nCheckpoint > 0 || opts.Has("resume")))
+  {
+    std::cerr << "Shards are not available for IACT eventio input, with the index or with checkpoints! Will exit." << std::endl;
+    return 1;
+  }
 
-  // Histograms with cherenkov emission information
-  std::vector<TH1D> hThetaAverage(20,TH1D("","",1000*18,0.,10.*18.));
-  std::vector<TH1D> hDistAverage(20,TH1D("","",1000,0.,1000.));
+  if (kMerge) nThreads = 1;
+  CorsikaProfiler::SetThreads(nThreads);
 
-  // Histogram with average photons at ground
-  TH2D hGroundAverage("","",2*maxRadius,-maxRadius,maxRadius,2*maxRadius,-maxRadius,maxRadius);
+  if (kShard && !opts.Has("profile-grid"))
+    std::cerr << "Without --profile-grid, the average profiles of the shards are merged by interpolation on the depths of the first shower." << std::endl;
 
-  // Histogram of average density vs. r
-  TH1D hDensityAverage("","",maxRadius,0,maxRadius);
-  TH1D hDensitySigma("","",maxRadius,0,maxRadius);
+  auto shardName = [&](int i){return sOutDir + "cherenkov_" + sRunNumber + "_shard" + std::to_string(i) + "of" + std::to_string(nShards) + ".root";};
+  if (kShard) sOutFil = shardName(iShard);
+  auto sPartFil = sOutFil + ".part";
 
-  // The average profiles
-  std::vector<std::valarray<double>> vAvgProfPart(9,std::valarray<double>(0));
-  std::vector<std::valarray<double>> vAvgProfDep (9,std::valarray<double>(0));
-  std::vector<double> vDepthPart(0);
-  std::vector<double> vDepthDep(0);
+  // Ground maps: the table of tiles grows with the square of the bins per side
+  const double groundBin = opts.GetDouble("ground-map",0.1,0);
+  const double groundHalf = opts.GetDouble("ground-map",1000.,1);
+  if (opts.Has("ground-map") && !(groundBin > 0. && groundHalf > 0. && 2.*groundHalf/groundBin <= 1.e6))
+  {
+    std::cerr << "The ground map needs b > 0 and h > 0, with at most 1e6 bins per side! Will exit." << std::endl;
+    return 1;
+  }
 
-  // The shower counter
-  int nShowers = 0;
+  // Common grid of the average profiles: by default the depths of the first shower of the first run
+  auto sGridType = opts.GetString("profile-grid","depth");
+  int iGridType = sGridType == "age" ? CorsikaProfileGrid::kAge : CorsikaProfileGrid::kDepth;
+  if (opts.Has("profile-grid") && ((sGridType != "depth" && sGridType != "age") || opts.GetInt("profile-grid",0,1) < 2))
+  {
+    std::cerr << "The profile grid must be depth or age, with at least 2 nodes! Will exit." << std::endl;
+    return 1;
+  }
 
-  // The cherenkov bunch counter
-  double nBunches = 0.;
+  // Gaisser-Hillas refit of 4 or 6 parameters
+  if (opts.Has("refit") && opts.GetInt("refit",6) != 4 && opts.GetInt("refit",6) != 6)
+  {
+    std::cerr << "The refit takes n = 4 or 6 parameters! Will exit." << std::endl;
+    return 1;
+  }
 
+  // Memory budget: an eighth of it for the long-profile stores, split between
+  // the readers. The store is only a cache of the .long file, whose dropped
+  // profiles are read again when needed, so it gets the small fixed share.
+  CorsikaMemory::SetBudget(long(opts.GetDouble("memory-budget",0.)*1.e6));
+  const int nLongShare = 8;
+  const long nLongBytes = CorsikaMemory::Budget()/(nLongShare*nThreads);
+  if (opts.Has("memory-budget") && CorsikaMemory::Budget() <= 0)
+  {
+    std::cerr << "The memory budget must be positive! Will exit." << std::endl;
+    return 1;
+  }
 
+  // Creathe the output folder, if necessary
+  gSystem->mkdir(sOutDir.c_str());
 
-  //
-  // Initial message
-  //
-  std::cout << std::endl;
-  std::cout << "\e[1mreadCorsika\e[0m: starting analysis of run " << sRunNumber << "." << std::endl;
-  std::cout << std::endl;
-  std::cout << "+ Cherenkov file " << sInpFil << ": " << (cfile.Good() ? "Ok" : "Fail") << std::endl;
-  std::cout << "+ Longitudinal file " << sInpLng << ": " << (clong.Good() ? "Ok" : "Fail") << std::endl;
-  std::cout << "+ Number of showers: " << cfile.NShow() << std::endl;
-  std::cout << "+ Date of run start: " << cfile.StartDate()%100 << "/" << cfile.StartDate()%10000/100 << "/" << cfile.StartDate()/10000 << " (dd/mm/yy)" << std::endl;
-  std::cout << "+ CORSIKA version:   " << cfile.Version() << std::endl;
-  std::cout << std::endl;
-  std::cout << "Starting loop over showers...";
-  std::cout << std::setw(10) << "Energy";
-  std::cout << std::setw(10) << "Theta";
-  std::cout << std::setw(10) << "Phi";
-  std::cout << std::setw(10) << "Xmax";
-  std::cout << std::setw(10) << "ID";
-  std::cout << std::endl;
+  // Histograms are owned by the analysis, never by the output file, and the
+  // readers only touch the output file under the output lock
+  TH1::AddDirectory(kFALSE);
+  if (nThreads > 1) ROOT::EnableThreadSafety();
 
 
 
   //
-  // Loop over showers
+  // Object declaration
   //
-  while(!cfile.Done())
+
+  // One analysis per reader thread, merged at the end. The ordered bunch
+  // selection applies the cheap cuts first, then the emission age
+  auto newAnalysis = [&]()
   {
-    //
-    // Get next shower and check
-    //
-    auto shower = cfile.NextShower();
-    if (!shower.Good()) continue;
-
-    // increment shower counter
-    nShowers++;
-
-
-    //
-    // Get overview of the shower and add to the header tree
-    //
-
-    // Put Xmax of the current shower in a variable, since it is used later
-    float xmax = clong.GetXmax(shower.ID());
-
-    // Build the vector that will go to the header tree
-    std::vector<double> vHeader;
-    vHeader.push_back(shower.ID());
-    vHeader.push_back(shower.Energy());
-    vHeader.push_back(shower.Primary());
-    vHeader.push_back(shower.Theta());
-    vHeader.push_back(shower.Phi());
-    vHeader.push_back(shower.ObsLvl());
-    vHeader.push_back(shower.LEmod());
-    vHeader.push_back(shower.HEmod());
-
-    auto vFit = clong.GetFit(shower.ID());
-    vHeader.insert(vHeader.end(),vFit.begin(),vFit.end());
-
-    theader.Fill(vHeader.data());
-
-
-
-    //
-    // Initial shower message
-    //
-    std::cout << "+ Reading shower ";
-    std::cout << std::setw(std::floor(std::log10(cfile.NShow()))+1) << nShowers;
-    std::cout << "/";
-    std::cout << std::setw(std::floor(std::log10(cfile.NShow()))+1) << cfile.NShow();
-    std::cout << ":";
-    std::cout << std::setw(10) << shower.Energy() << " GeV";
-    std::cout << std::setw(10) << shower.Theta();
-    std::cout << std::setw(10) << shower.Phi();
-    std::cout << std::setw(10) << xmax;
-    std::cout << std::setw(10) << shower.ID();
-    std::cout << " ... ";
-    std::cout << std::flush;
-
-
-
-    //
-    // Get profiles and write to output file
-    //
-
-    // depths for particle profiles
-    auto vDepth = clong.GetProfile(shower.ID(),0);
-    if (!clong.Slant())
-      for (auto & x : vDepth)
-        x = x/std::cos(shower.Theta());
-
-    // save depths for average particle profiles
-    if (vDepthPart.empty()) vDepthPart = vDepth;
-
-    // create directories on the output file for particle profiles of this event
-    froot.mkdir(("Event_" + std::to_string(shower.ID()) + "/ParticleProfiles").c_str());
-    froot.cd(("Event_" + std::to_string(shower.ID()) + "/ParticleProfiles").c_str());
-
-    // loop to build and save profiles
-    for (int i=1; i<10; i++)
+    auto pAnalysis = new CorsikaAnalysis(maxRadius);
+    pAnalysis->Filter().SetMinBunch(opts.GetDouble("min-bunch",0.));
+    if (opts.Has("time-window")) pAnalysis->Filter().SetTimeWindow(opts.GetDouble("time-window",0.,0),opts.GetDouble("time-window",0.,1));
+    if (opts.Has("ground-map")) pAnalysis->EnableGroundMap(groundBin,groundHalf);
+    if (opts.Has("voxels")) pAnalysis->EnableVoxels();
+    if (opts.Has("time-front")) pAnalysis->EnableTimeFront();
+    if (opts.Has("profile-grid")) pAnalysis->SetProfileGrid(iGridType,opts.GetInt("profile-grid",0,1),opts.GetDouble("profile-grid",0.,2),opts.GetDouble("profile-grid",0.,3));
+    if (sampler.Active()) pAnalysis->SetSampling(sampler.Probability());
+    if (opts.Has("refit")) pAnalysis->EnableRefit(opts.GetInt("refit",6), nFitThreads);
+    if (kParticles) pAnalysis->EnableParticles();
+    if (pLayout) pAnalysis->EnableTelescopes(*pLayout);
+    if (CorsikaMemory::Budget() > 0) pAnalysis->SetReleaseShowers(true);
+    if (pCache) pAnalysis->SetCache(pCache.get(), sCacheContext);
+    return pAnalysis;
+  };
+
+  std::vector<std::unique_ptr<CorsikaAnalysis>> vAnalysis;
+  for (int i = 0; i < nThreads; i++) vAnalysis.emplace_back(newAnalysis());
+
+  // The sums over the showers, of fixed size, must fit in the budget with
+  // the long-profile stores. Of what is left, half bounds the stores that
+  // grow with the showers (the rows of the tuples, the ground map and voxel
+  // sums), split between the readers, and half is for the input buffers,
+  // the current shower, whose maps are bounded alike, and the output queue.
+  long nStoreBytes = 0;
+  if (CorsikaMemory::Budget() > 0)
+  {
+    const long nFixed = nThreads*vAnalysis[0]->Bytes(true);
+    const long nFree = CorsikaMemory::Budget() - nThreads*nLongBytes - nFixed;
+    if (nFree <= 0)
     {
-      auto vProfile = clong.GetProfile(shower.ID(),i);
-      TGraph gProfile(vDepth.size(),vDepth.data(),vProfile.data());
-      gProfile.Write(clong.GetColumnName(0,i).c_str());
-
-      // add profiles to average
-      if (vAvgProfPart[i-1].size() == 0)
-        vAvgProfPart[i-1]  = std::valarray<double>(vProfile.data(),vProfile.size());
-      else
-        vAvgProfPart[i-1] += std::valarray<double>(vProfile.data(),vProfile.size());
+      std::cerr << "The memory budget does not hold the sums over the showers of " << nThreads << " reader(s), " << nFixed*1.e-6 << " MB, and their long-profile stores! Will exit." << std::endl;
+      return 1;
     }
+    nStoreBytes = nFree/(2*nThreads);
+    for (auto & p : vAnalysis) p->SetMaxBytes(nStoreBytes);
+  }
 
-    // depths for energy deposit profiles
-    vDepth = clong.GetDepositProfile(shower.ID(),0);
-    if (!clong.Slant())
-      for (auto & x : vDepth)
-        x = x/std::cos(shower.Theta());
-
-    // save depths for average energy deposit profiles
-    if (vDepthDep.empty()) vDepthDep = vDepth;
-
-    // create directories on the output file for energy deposit profiles of this event
-    froot.mkdir(("Event_" + std::to_string(shower.ID()) + "/DepositProfiles").c_str());
-    froot.cd(("Event_" + std::to_string(shower.ID()) + "/DepositProfiles").c_str());
+  // Resume from the last checkpoint
+  CorsikaCheckpoint ckpt;
+  bool kResume = false;
 
-    // loop to build and save profiles
-    for (int i=1; i<10; i++)
+  if (opts.Has("resume"))
+  {
+    if (!ckpt.Read(sCkpFil))
     {
-      auto vProfile = clong.GetDepositProfile(shower.ID(),i);
-      TGraph gProfile(vDepth.size(),vDepth.data(),vProfile.data());
-      gProfile.Write(clong.GetColumnName(1,i).c_str());
-
-      // add profiles to average
-      if (vAvgProfDep[i-1].size() == 0)
-        vAvgProfDep[i-1]  = std::valarray<double>(vProfile.data(),vProfile.size());
-      else
-        vAvgProfDep[i-1] += std::valarray<double>(vProfile.data(),vProfile.size());
+      std::cerr << "No checkpoint found at " << sCkpFil << ", starting from the first shower." << std::endl;
     }
+    else if (!vAnalysis[0]->Load(ckpt))
+    {
+      std::cerr << "Could not restore the checkpoint " << sCkpFil << "! Will exit." << std::endl;
+      return 1;
+    }
+    else
+    {
+      kResume = true;
+    }
+  }
 
-    //
-    // Distributions of particles arriving at ground
-    //
-
-    // Create histograms for this shower
-    std::vector<TH1D> hThetaShower(20,TH1D("","",1000,0.,10.));
-    std::vector<TH1D> hDistShower(20,TH1D("","",1000,0.,1000.));
-    TH2D hPhotonsAtGround("","",2*maxRadius/2,-maxRadius,maxRadius,2*maxRadius/2,-maxRadius,maxRadius);
-    TH1D hPhotonDensity("","",maxRadius,0.,maxRadius);
+  // Merge: the partial sums of the shards, added in order as those of the
+  // reader threads, and their showers, copied to the output file
+  if (kMerge)
+  {
+    TFileMerger merger(kFALSE);
+    merger.OutputFile(sOutFil.c_str(), "recreate");
 
-    // Loop over particles
-    while(!shower.Done())
+    for (int i = 1; i <= nShards; i++)
     {
-      // Convention:
-      // cosu = sin(theta)*cos(phi)
-      // cosv = sin(theta)*sin(phi)
-      // distance in cm
-      // time in nsec
-
-      // Get the current particle
-      auto vPart = shower.NextParticle();
-
-      // Give friendly names to particle fields
-      const float & bunch  = vPart[0];
-      const float & posx   = vPart[1];
-      const float & posy   = vPart[2];
-      const float & cosu   = vPart[3];
-      const float & cosv   = vPart[4];
-      const float & nsec   = vPart[5];
-      const float & height = vPart[6];
-
-      // Project the emission height into the shower axis
-      float cosTheta = std::sqrt(1. - cosu*cosu - cosv*cosv);
-      float xem = posx - height*cosu/cosTheta;
-      float yem = posy - height*cosv/cosTheta;
-      float heightProj = std::cos(shower.Theta())*std::cos(shower.Theta())*(height - std::tan(shower.Theta()) * (xem*std::cos(shower.Phi()) + yem*std::sin(shower.Phi())));
-
-      // Compute radial distance to core, emission depth, emission age and emission angle
-      float posr = std::sqrt(posx*posx + posy*posy);
-      float depth = catm.Depth(heightProj);
-      float age = 3./(1.+2.*xmax/depth);
-      float theta = std::acos(cosTheta)*180./std::acos(-1.);
-
-      // Compute distance of emission point to shower, on the shower plane
-      float delta = std::sin(shower.Theta())*(std::cos(shower.Phi())*xem + std::sin(shower.Phi())*yem) - std::cos(shower.Theta())*height;
-      float dist = std::sqrt(xem*xem + yem*yem + height*height - delta*delta);
-
-      // Fill histograms if shower is inside range
-      if (age < 2. && posr*1.e-2 < maxRadius)
+      auto sShardFil = shardName(i);
+      CorsikaCheckpoint part;
+      std::unique_ptr<CorsikaAnalysis> pPart(newAnalysis());
+      pPart->SetMaxBytes(nStoreBytes);
+      if (!part.Read(sShardFil + ".part") || !pPart->Load(part))
       {
-        // Histograms with number of cherenkov photons vs. emission angle
-        hThetaAverage[(int)std::floor(age*10.)].Fill(theta,bunch);
-        hThetaShower[(int)std::floor(age*10.)].Fill(theta,bunch);
-
-        // Histograms with number of cherenkov photons vs. perpendicular distance to axis
-        hDistAverage[(int)std::floor(age*10.)].Fill(dist*1.e-2,bunch);
-        hDistShower[(int)std::floor(age*10.)].Fill(dist*1.e-2,bunch);
-
-        // 2D histogram with photons at ground
-        hPhotonsAtGround.Fill(posx*1.e-2,posy*1.e-2,bunch);
-        hGroundAverage.Fill(posx*1.e-2,posy*1.e-2,bunch);
-
-        // Histogram of photon density vs. r
-        hPhotonDensity.Fill(posr*1.e-2,bunch);
+        std::cerr << "Could not read the partial sums of shard " << i << "/" << nShards << " at " << sShardFil << ".part (same options as the shards?)! Will exit." << std::endl;
+        return 1;
       }
+      vAnalysis[0]->Merge(*pPart);
+      merger.AddFile(sShardFil.c_str());
     }
 
-    // Write histograms of this shower to output file
-    froot.mkdir(("Event_" + std::to_string(shower.ID()) + "/EmissionAngle").c_str());
-    froot.cd(("Event_" + std::to_string(shower.ID()) + "/EmissionAngle").c_str());
-    for (int i=0; i<20; i++) hThetaShower[i].Write(std::to_string(i).c_str());
+    CorsikaTimer timer(CorsikaProfiler::kRootIO);
+    if (!merger.Merge())
+    {
+      std::cerr << "Could not merge the showers of the shards into " << sOutFil << "! Will exit." << std::endl;
+      return 1;
+    }
+  }
 
-    froot.mkdir(("Event_" + std::to_string(shower.ID()) + "/EmissionDist").c_str());
-    froot.cd(("Event_" + std::to_string(shower.ID()) + "/EmissionDist").c_str());
-    for (int i=0; i<20; i++) hDistShower[i].Write(std::to_string(i).c_str());
+  // Output related stuff: the root file. When resuming, the showers written before the checkpoint are kept,
+  // and when merging, the showers of the shards. The averages of a shard are in its partial sums.
+  CorsikaTimer openTimer(CorsikaProfiler::kRootIO);
+  TFile froot(sOutFil.c_str(), kResume || kMerge ? "update" : "recreate");
+  if (!kResume && !kShard) froot.mkdir("Average");
+  openTimer.Stop();
 
-    froot.cd(("Event_" + std::to_string(shower.ID())).c_str());
-    hPhotonsAtGround.Write("PhotonsAtGround");
+  // Check output file
+  if (froot.IsZombie())
+  {
+    std::cerr << "Could not open output root file! Will exit." << std::endl;
+    std::cerr << "File is: " << sOutFil << std::endl;
+    return 1;
+  }
 
-    for (int i=1; i<=hPhotonDensity.GetNbinsX(); i++)
-    {
-      double xleft = hPhotonDensity.GetBinLowEdge(i);
-      double xright = hPhotonDensity.GetBinLowEdge(i+1);
-      hPhotonDensity.SetBinContent(i,hPhotonDensity.GetBinContent(i)/(std::acos(-1.)*(xright*xright-xleft*xleft)));
-      hPhotonDensity.SetBinError(i,0);
-    }
 
-    froot.cd(("Event_" + std::to_string(shower.ID())).c_str());
-    hPhotonDensity.Write("PhotonDensity");
 
-    auto hPhotonDensitySquare = hPhotonDensity;
-    hPhotonDensitySquare.Multiply(&hPhotonDensitySquare);
+  //
+  // The readers: process whole files, one at a time, until none is left
+  //
+  CorsikaReader reader(run, froot, vAnalysis);
+  reader.SetMaxShowers(maxShowers);
+  reader.SetLongBytes(nLongBytes);
+  reader.SetSalvage(opts.Has("salvage"));
+  reader.SetCurved(opts.Has("curved"));
+  reader.SetParticles(kParticles);
+  reader.SetSampler(sampler);
+  reader.SetTelescopes(sTelescopes);
+  if (kEmbedded) reader.SetEmbeddedLong(opts.GetString("embedded-long") == "s");
+  if (opts.Has("index")) reader.SetIndex(bool(pCache));
+  reader.SetCheckpoint(ckpt, sCkpFil, nCheckpoint, kResume);
+  if (kShard) reader.SetShard(iShard, nShards);
 
-    hDensityAverage.Add(&hPhotonDensity);
-    hDensitySigma.Add(&hPhotonDensitySquare);
 
 
+  //
+  // Initial message
+  //
+  std::cout << std::endl;
+  std::cout << "\e[1mreadCorsika\e[0m: starting analysis of run " << sRunNumber << "." << std::endl;
+  std::cout << std::endl;
+  if (kMulti) std::cout << "+ Files: " << run.NFiles() << ", read by " << nThreads << " thread(s)" << std::endl;
+  if (kResume) std::cout << "+ Resuming after shower " << vAnalysis[0]->NShowers() << " from checkpoint " << sCkpFil << std::endl;
+  if (kShard) std::cout << "+ Shard " << iShard << "/" << nShards << " of " << reader.RunBytes() << " bytes" << std::endl;
+  if (kMerge) std::cout << "+ Merged " << nShards << " shard(s), " << vAnalysis[0]->NShowers() << " shower(s)" << std::endl;
 
-    //
-    // Final shower message
-    //
-    std::cout << "Done!" << std::endl;
 
 
+  // Nothing is read when merging shards
+  if (!kMerge) reader.Run(nThreads);
 
-    if (maxShowers > 0 && nShowers >= maxShowers) break;
-  }
+  // A single input that could not be read is an error
+  if (reader.Failed() && !kMulti) return 1;
 
-  //
-  // Finish computation of average particle profiles and write them to the output file
-  //
-  froot.mkdir("Average/ParticleProfiles");
-  froot.cd("Average/ParticleProfiles");
-  for (int i=0; i<9; i++)
+  // Combine the analyses of all readers
+  auto & analysis = *vAnalysis[0];
+  for (int i = 1; i < nThreads; i++) analysis.Merge(*vAnalysis[i]);
+
+  // A shard saves its sums for the merge, even without showers. Its showers
+  // are those starting in its range, so that showers larger than the ranges
+  // make the shards uneven.
+  if (kShard)
   {
-    vAvgProfPart[i] /= double(nShowers);
-    TGraph gProfile(vDepthPart.size(),vDepthPart.data(),&vAvgProfPart[i][0]);
-    gProfile.Write(clong.GetColumnName(0,i+1).c_str());
+    const long nShardRead = reader.NShardRead(), nShardRange = reader.NShardRange();
+    if (nShardRead > 2*nShardRange || 2*nShardRead < nShardRange)
+      std::cerr << "The shard read " << nShardRead << " sub-blocks for a range of " << nShardRange << ": the showers are large for " << nShards << " shards, which are uneven; fewer shards would balance them better." << std::endl;
+
+    ckpt.Clear();
+    analysis.Save(ckpt);
+    if (!ckpt.Write(sPartFil))
+    {
+      std::cerr << "Could not save the partial sums of the shard to " << sPartFil << "! Will exit." << std::endl;
+      froot.Close();
+      return 1;
+    }
   }
 
-  froot.mkdir("Average/DepositProfiles");
-  froot.cd("Average/DepositProfiles");
-  for (int i=0; i<9; i++)
+  // Nothing to average
+  else if (analysis.NShowers() == 0)
   {
-    vAvgProfDep[i] /= double(nShowers);
-    TGraph gProfile(vDepthDep.size(),vDepthDep.data(),&vAvgProfDep[i][0]);
-    gProfile.Write(clong.GetColumnName(1,i+1).c_str());
+    std::cerr << "No shower could be read from run " << sRunNumber << "! Will exit." << std::endl;
+    froot.Close();
+    return 1;
   }
 
   //
-  // Finish computations of histograms with averages and write to output file
+  // Finish computation of averages and write them to the output file
   //
-  for(int i=0; i<20; i++)
+  else
   {
-    hThetaAverage[i].Scale(1./double(nShowers));
-    hDistAverage[i].Scale(1./double(nShowers));
+    froot.cd();
+    analysis.Write(froot);
   }
-  froot.mkdir("Average/EmissionAngle");
-  froot.cd("Average/EmissionAngle");
-  for(int i=0; i<20; i++) hThetaAverage[i].Write(std::to_string(i).c_str());
-  froot.mkdir("Average/EmissionDist");
-  froot.cd("Average/EmissionDist");
-  for(int i=0; i<20; i++) hDistAverage[i].Write(std::to_string(i).c_str());
-
-  froot.cd("Average");
 
-  hGroundAverage.Scale(1./double(nShowers));
-  hGroundAverage.Write("PhotonsAtGround");
+  auto sTabFil = sOutDir + "cherenkov_" + sRunNumber + ".emt";
+  bool kTables = !kShard && opts.Has("tables") && analysis.WriteTables(sTabFil);
 
-  hDensityAverage.Scale(1./double(nShowers));
-  hDensityAverage.Write("PhotonDensity");
-
-  hDensitySigma.Scale(1./double(nShowers));
-  auto hDensityAverageSquared = hDensityAverage;
-  hDensityAverageSquared.Multiply(&hDensityAverageSquared);
-  hDensitySigma.Add(&hDensityAverageSquared,-1.);
-  for (int i=1; i<=hDensitySigma.GetNbinsX(); i++) hDensitySigma.SetBinContent(i,std::sqrt(hDensitySigma.GetBinContent(i)));
-  hDensitySigma.Write("PhotonDensitySigma");
-
-  froot.cd();
-  theader.Write(theader.GetName(),TFile::kOverwrite);
+  // Where the results of the showers read with the cache are, for queryCorsika
+  auto sResFil = CorsikaResultIndex::FileName(sOutDir, sRunNumber);
+  analysis.Results().SetRun(sRunNumber);
+  bool kResults = !kShard && analysis.Results().NShowers() > 0 && analysis.Results().Write(sResFil);
 
+  CorsikaTimer closeTimer(CorsikaProfiler::kRootIO);
   froot.Close();
+  closeTimer.Stop();
+
+  // The run is complete, the checkpoint is not needed anymore
+  if (nCheckpoint > 0 || kResume) gSystem->Unlink(sCkpFil.c_str());
 
 
 
@@ -430,9 +520,36 @@ int main(int argc, char ** argv)
   // Final message
   //
   std::cout << std::endl;
+  analysis.Filter().Print();
+  std::cout << std::endl;
+
+  if (CorsikaProfiler::Enabled())
+  {
+    CorsikaProfiler::Print();
+    std::cout << std::endl;
+  }
+
+  CorsikaMemory::Print();
+  std::cout << std::endl;
+
+  if (pCache)
+  {
+    pCache->Print();
+    std::cout << std::endl;
+  }
+
+  if (opts.Has("profile-json") && CorsikaProfiler::WriteJSON(opts.GetString("profile-json")))
+  {
+    std::cout << "Profile report was saved to " << opts.GetString("profile-json") << " ." << std::endl;
+    std::cout << std::endl;
+  }
   std::cout << "Done with run " << sRunNumber << "!" << std::endl;
+  if (reader.Failed()) std::cout << "Some files of the run could not be read, see the messages above." << std::endl;
   std::cout << "Root data was saved to " << sOutFil << " ." << std::endl;
+  if (kShard) std::cout << "Partial sums of shard " << iShard << "/" << nShards << " were saved to " << sPartFil << " (combine the shards with --merge " << nShards << ")." << std::endl;
+  if (kTables) std::cout << "Emission model tables were saved to " << sTabFil << " ." << std::endl;
+  if (kResults) std::cout << "Index of the cached results was saved to " << sResFil << " (serve it with queryCorsika)." << std::endl;
   std::cout << std::endl;
 
-  return 0;
+  return reader.Failed() ? 1 : 0;
 }